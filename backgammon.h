@@ -383,6 +383,7 @@ extern rngcontext *rngctxRollout;
 extern command acAnnotateMove[];
 extern command acSet[];
 extern command acSetAnalysisPlayer[];
+extern command acSetCache[];
 extern command acSetCheatPlayer[];
 extern command acSetEvalParam[];
 extern command acSetEvaluation[];
@@ -396,6 +397,7 @@ extern command acSetRolloutLate[];
 extern command acSetRolloutLatePlayer[];
 extern command acSetRolloutLimit[];
 extern command acSetRolloutPlayer[];
+extern command acSetThreads[];
 extern command acSetTruncation[];
 extern command acTop[];
 extern command cFilename;
@@ -562,8 +564,10 @@ extern void CommandAnnotateUnlucky(char *);
 extern void CommandAnnotateVeryBad(char *);
 extern void CommandAnnotateVeryLucky(char *);
 extern void CommandAnnotateVeryUnlucky(char *);
+extern void CommandCacheSpeed(char *);
 extern void CommandCalibrate(char *);
 extern void CommandClearCache(char *);
+extern void CommandClearCacheFile(char *);
 extern void CommandClearHint(char *);
 extern void CommandClearTurn(char *);
 extern void CommandCMarkCubeSetNone(char *);
@@ -641,6 +645,8 @@ extern void CommandNewMatch(char *);
 extern void CommandNewSession(char *);
 extern void CommandNext(char *);
 extern void CommandNotImplemented(char *);
+extern void CommandPerft(char *);
+extern void CommandSplitSpeed(char *);
 extern void CommandPlay(char *);
 extern void CommandPrevious(char *);
 extern void CommandQuit(char *);
@@ -695,6 +701,11 @@ extern void CommandSetBeavers(char *);
 extern void CommandSetBoard(char *);
 extern void CommandSetBrowser(char *);
 extern void CommandSetCache(char *);
+extern void CommandSetCacheFile(char *);
+extern void CommandSetCacheHugePages(char *);
+extern void CommandSetCacheNUMA(char *);
+extern void CommandSetCacheSequenceLock(char *);
+extern void CommandSetCacheShared(char *);
 extern void CommandSetCalibration(char *);
 extern void CommandSetCheatEnable(char *);
 extern void CommandSetCheatPlayer(char *);
@@ -731,6 +742,11 @@ extern void CommandSetEvalParamRollout(char *);
 extern void CommandSetEvalParamType(char *);
 extern void CommandSetEvalPlies(char *);
 extern void CommandSetEvalPrune(char *);
+extern void CommandSetEvalTimeLimit(char *);
+extern void CommandSetEvalCandidates(char *);
+extern void CommandSetEvalCascade(char *);
+extern void CommandSetEvalQuantized(char *);
+extern void CommandSetEvalHalfPrecision(char *);
 extern void CommandSetEvalSameAsAnalysis(char *);
 extern void CommandSetExportCubeDisplayActual(char *);
 extern void CommandSetExportCubeDisplayBad(char *);
@@ -925,6 +941,7 @@ extern void CommandSetSoundSystemCommand(char *);
 extern void CommandSetStyledGameList(char *);
 extern void CommandSetTheoryWindow(char *);
 extern void CommandSetThreads(char *);
+extern void CommandSetThreadsSplit(char *);
 extern void CommandSetToolbar(char *);
 extern void CommandSetTurn(char *);
 extern void CommandSetTutorChequer(char *);
@@ -950,6 +967,7 @@ extern void CommandShowBoard(char *);
 extern void CommandShowBrowser(char *);
 extern void CommandShowBuildInfo(char *);
 extern void CommandShowCache(char *);
+extern void CommandShowCacheFile(char *);
 extern void CommandShowCalibration(char *);
 extern void CommandShowCheat(char *);
 extern void CommandShowClockwise(char *);
@@ -971,6 +989,9 @@ extern void CommandShowGammonValues(char *);
 extern void CommandShowGeometry(char *);
 extern void CommandShowJacoby(char *);
 extern void CommandShowKeith(char *);
+extern void CommandShowKernels(char *);
+extern void CommandShowCascades(char *);
+extern void CommandShowMoveGeneration(char *);
 extern void CommandShowKleinman(char *);
 extern void CommandShowLang(char *);
 extern void CommandShowManualAbout(char *);
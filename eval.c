@@ -45,6 +45,10 @@ typedef int (*classevalfunc) (const TanBoard anBoard, float arOutput[], const bg
 typedef void (*classstatusfunc) (char *szOutput);
 typedef int (*cfunc) (const void *, const void *);
 
+/* the evaluation context of cacheNodeDetail, defined once for both
+ * versions below */
+extern uint64_t EvalKey(const evalcontext * pec, const int nPlies, const cubeinfo * pci, int fCubefulEquity);
+
 #if !LOCKING_VERSION
 
 f_FindnSaveBestMoves FindnSaveBestMoves = FindnSaveBestMovesNoLocking;
@@ -249,7 +253,17 @@ bearoffcontext *apbcHyper[3] = { NULL, NULL, NULL };
 
 evalCache cEval;
 evalCache cpEval;
+/* the evaluations of CACHE_FILE_MIN_PLIES or more kept from one session
+ * to the next, used while fCacheFile */
+evalCache cfEval;
+int fCacheFile = FALSE;
 unsigned int cCache;
+/* the levels of roll expansion below evaluations of 2 or more plies
+ * whose rolls are spread over the threads */
+unsigned int nEvalSplitPlies = 0;
+/* the cache counts of each thread, which only it writes to;
+ * EvalCacheStats() adds them up */
+cachecounts acCacheCounts[MAX_NUMTHREADS];
 int fInterrupt = FALSE;
 int fMatchCancelled = FALSE;
 
@@ -289,6 +303,28 @@ const char *aszEvalType[] = {
 
 evalcontext ecBasic = { FALSE, 0, FALSE, TRUE, 0.0 };
 
+/* "normal" (evalcontext.nCascade 0) is what pruning has always done: the
+ * pruning net leaves ten candidates for the full net.  "staged" lets the
+ * pruning net leave more, and the cubeless full net, whose evaluations
+ * are cached for the scoring that follows, narrows them to a few for the
+ * cubeful (or noisy) scoring by ScoreMoves(). */
+const netcascade anNetCascades[NUM_CASCADES] = {
+    {N_("normal"), 1, {{TRUE, {10, 10, 10}}}},
+    {N_("wide"), 1, {{TRUE, {16, 16, 16}}}},
+    {N_("fast"), 1, {{TRUE, {3, 5, 5}}}},
+    {N_("fastest"), 1, {{TRUE, {2, 3, 3}}}},
+    {N_("staged"), 2, {{TRUE, {16, 16, 16}}, {FALSE, {4, 5, 5}}}}
+};
+
+/* nCascade is a bit field wider than NUM_CASCADES needs, and contexts
+ * come from files and the external interface, so it is checked here
+ * rather than trusted by every user of anNetCascades[] */
+extern const netcascade *
+NetCascade(const evalcontext * pec)
+{
+    return &anNetCascades[pec->nCascade < NUM_CASCADES ? pec->nCascade : 0];
+}
+
 /* defaults for the filters  - 0 ply uses no filters */
 
 #include "movefilters.inc"
@@ -451,16 +487,249 @@ Escapes1(const unsigned int anBoard[25], int n)
 }
 
 
+/* Bitmasks of the points, bit i being point i */
+
+static inline int
+HighestBit(unsigned int n)
+{
+#if defined(__GNUC__)
+    return n ? 31 - __builtin_clz(n) : -1;
+#else
+    return g_bit_nth_msf(n, -1);
+#endif
+}
+
+static inline int
+LowestBit(unsigned int n)
+{
+#if defined(__GNUC__)
+    return n ? __builtin_ctz(n) : -1;
+#else
+    return g_bit_nth_lsf(n, -1);
+#endif
+}
+
+static inline int
+PopCount(unsigned int n)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(n);
+#else
+    int c;
+
+    for (c = 0; n; c++)
+        n &= n - 1;
+
+    return c;
+#endif
+}
+
+/* Escapes() and Escapes1() from the mask of the points made */
+
+static inline int
+EscapesMask(const int anTable[0x1000], unsigned int nMade, int n)
+{
+    if (n <= 0)
+        return anTable[0];
+
+    return anTable[(nMade >> (24 - n)) & ((1u << (n < 12 ? n : 12)) - 1)];
+}
+
+/* aanCombination[n] -
+ * How many ways to hit from a distance of n pips.
+ * Each number is an index into aIntermediate below. 
+ */
+static const int aanCombination[24][5] = {
+    {0, -1, -1, -1, -1},    /*  1 */
+    {1, 2, -1, -1, -1},     /*  2 */
+    {3, 4, 5, -1, -1},      /*  3 */
+    {6, 7, 8, 9, -1},       /*  4 */
+    {10, 11, 12, -1, -1},   /*  5 */
+    {13, 14, 15, 16, 17},   /*  6 */
+    {18, 19, 20, -1, -1},   /*  7 */
+    {21, 22, 23, 24, -1},   /*  8 */
+    {25, 26, 27, -1, -1},   /*  9 */
+    {28, 29, -1, -1, -1},   /* 10 */
+    {30, -1, -1, -1, -1},   /* 11 */
+    {31, 32, 33, -1, -1},   /* 12 */
+    {-1, -1, -1, -1, -1},   /* 13 */
+    {-1, -1, -1, -1, -1},   /* 14 */
+    {34, -1, -1, -1, -1},   /* 15 */
+    {35, -1, -1, -1, -1},   /* 16 */
+    {-1, -1, -1, -1, -1},   /* 17 */
+    {36, -1, -1, -1, -1},   /* 18 */
+    {-1, -1, -1, -1, -1},   /* 19 */
+    {37, -1, -1, -1, -1},   /* 20 */
+    {-1, -1, -1, -1, -1},   /* 21 */
+    {-1, -1, -1, -1, -1},   /* 22 */
+    {-1, -1, -1, -1, -1},   /* 23 */
+    {38, -1, -1, -1, -1}    /* 24 */
+};
+
+/* One way to hit */
+typedef struct _Inter {
+    /* if true, all intermediate points (if any) are required;
+     * if false, one of two intermediate points are required.
+     * Set to true for a direct hit, but that can be checked with
+     * nFaces == 1,
+     */
+    int fAll;
+
+    /* Intermediate points required */
+    int anIntermediate[3];
+
+    /* Number of faces used in hit (1 to 4) */
+    int nFaces;
+
+    /* Number of pips used to hit */
+    int nPips;
+} Inter;
+
+/* All ways to hit */
+static const Inter aIntermediate[39] = {
+    {1, {0, 0, 0}, 1, 1},   /*  0: 1x hits 1 */
+    {1, {0, 0, 0}, 1, 2},   /*  1: 2x hits 2 */
+    {1, {1, 0, 0}, 2, 2},   /*  2: 11 hits 2 */
+    {1, {0, 0, 0}, 1, 3},   /*  3: 3x hits 3 */
+    {0, {1, 2, 0}, 2, 3},   /*  4: 21 hits 3 */
+    {1, {1, 2, 0}, 3, 3},   /*  5: 11 hits 3 */
+    {1, {0, 0, 0}, 1, 4},   /*  6: 4x hits 4 */
+    {0, {1, 3, 0}, 2, 4},   /*  7: 31 hits 4 */
+    {1, {2, 0, 0}, 2, 4},   /*  8: 22 hits 4 */
+    {1, {1, 2, 3}, 4, 4},   /*  9: 11 hits 4 */
+    {1, {0, 0, 0}, 1, 5},   /* 10: 5x hits 5 */
+    {0, {1, 4, 0}, 2, 5},   /* 11: 41 hits 5 */
+    {0, {2, 3, 0}, 2, 5},   /* 12: 32 hits 5 */
+    {1, {0, 0, 0}, 1, 6},   /* 13: 6x hits 6 */
+    {0, {1, 5, 0}, 2, 6},   /* 14: 51 hits 6 */
+    {0, {2, 4, 0}, 2, 6},   /* 15: 42 hits 6 */
+    {1, {3, 0, 0}, 2, 6},   /* 16: 33 hits 6 */
+    {1, {2, 4, 0}, 3, 6},   /* 17: 22 hits 6 */
+    {0, {1, 6, 0}, 2, 7},   /* 18: 61 hits 7 */
+    {0, {2, 5, 0}, 2, 7},   /* 19: 52 hits 7 */
+    {0, {3, 4, 0}, 2, 7},   /* 20: 43 hits 7 */
+    {0, {2, 6, 0}, 2, 8},   /* 21: 62 hits 8 */
+    {0, {3, 5, 0}, 2, 8},   /* 22: 53 hits 8 */
+    {1, {4, 0, 0}, 2, 8},   /* 23: 44 hits 8 */
+    {1, {2, 4, 6}, 4, 8},   /* 24: 22 hits 8 */
+    {0, {3, 6, 0}, 2, 9},   /* 25: 63 hits 9 */
+    {0, {4, 5, 0}, 2, 9},   /* 26: 54 hits 9 */
+    {1, {3, 6, 0}, 3, 9},   /* 27: 33 hits 9 */
+    {0, {4, 6, 0}, 2, 10},  /* 28: 64 hits 10 */
+    {1, {5, 0, 0}, 2, 10},  /* 29: 55 hits 10 */
+    {0, {5, 6, 0}, 2, 11},  /* 30: 65 hits 11 */
+    {1, {6, 0, 0}, 2, 12},  /* 31: 66 hits 12 */
+    {1, {4, 8, 0}, 3, 12},  /* 32: 44 hits 12 */
+    {1, {3, 6, 9}, 4, 12},  /* 33: 33 hits 12 */
+    {1, {5, 10, 0}, 3, 15}, /* 34: 55 hits 15 */
+    {1, {4, 8, 12}, 4, 16}, /* 35: 44 hits 16 */
+    {1, {6, 12, 0}, 3, 18}, /* 36: 66 hits 18 */
+    {1, {5, 10, 15}, 4, 20},        /* 37: 55 hits 20 */
+    {1, {6, 12, 18}, 4, 24} /* 38: 66 hits 24 */
+};
+
+/* aaRoll[n] - All ways to hit with the n'th roll
+ * Each entry is an index into aIntermediate above.
+ */
+
+static const int aaRoll[21][4] = {
+    {0, 2, 5, 9},           /* 11 */
+    {0, 1, 4, -1},          /* 21 */
+    {1, 8, 17, 24},         /* 22 */
+    {0, 3, 7, -1},          /* 31 */
+    {1, 3, 12, -1},         /* 32 */
+    {3, 16, 27, 33},        /* 33 */
+    {0, 6, 11, -1},         /* 41 */
+    {1, 6, 15, -1},         /* 42 */
+    {3, 6, 20, -1},         /* 43 */
+    {6, 23, 32, 35},        /* 44 */
+    {0, 10, 14, -1},        /* 51 */
+    {1, 10, 19, -1},        /* 52 */
+    {3, 10, 22, -1},        /* 53 */
+    {6, 10, 26, -1},        /* 54 */
+    {10, 29, 34, 37},       /* 55 */
+    {0, 13, 18, -1},        /* 61 */
+    {1, 13, 21, -1},        /* 62 */
+    {3, 13, 25, -1},        /* 63 */
+    {6, 13, 28, -1},        /* 64 */
+    {10, 13, 30, -1},       /* 65 */
+    {13, 31, 36, 38}        /* 66 */
+};
+
+/* anIntermediateMask[n] - the intermediate points of aIntermediate[n],
+ * as a mask of their distance from the blot */
+
+static unsigned int anIntermediateMask[39];
+
+/* aanEnterLoss[m][f] - the pips lost entering from the bar, m being the
+ * mask of the points made in the opponent's home board and f whether
+ * we have more than one chequer on the bar */
+
+static int aanEnterLoss[64][2];
+
+static void
+ComputeTable2(void)
+{
+    int i, j, k, m, two;
+
+    for (i = 0; i < 39; i++) {
+        anIntermediateMask[i] = 0;
+
+        for (k = 0; k < 3 && aIntermediate[i].anIntermediate[k] > 0; k++)
+            anIntermediateMask[i] |= 1u << aIntermediate[i].anIntermediate[k];
+    }
+
+    for (m = 0; m < 64; m++)
+        for (two = 0; two < 2; two++) {
+            int loss = 0;
+
+            for (i = 0; i < 6; ++i) {
+                if (m & (1 << i)) {
+                    /* any double loses */
+
+                    loss += 4 * (i + 1);
+
+                    for (j = i + 1; j < 6; ++j) {
+                        if (m & (1 << j)) {
+                            loss += 2 * (i + j + 2);
+                        } else {
+                            if (two) {
+                                loss += 2 * (i + 1);
+                            }
+                        }
+                    }
+                } else {
+                    if (two) {
+                        for (j = i + 1; j < 6; ++j) {
+                            if (m & (1 << j)) {
+                                loss += 2 * (j + 1);
+                            }
+                        }
+                    }
+                }
+            }
+
+            aanEnterLoss[m][two] = loss;
+        }
+}
+
 static void
 ComputeTable(void)
 {
     ComputeTable0();
     ComputeTable1();
+    ComputeTable2();
 }
 
 
 NNState nnStatesStorage[MAX_NUMTHREADS][3];
 
+/* The nets in the order of the weights files */
+static neuralnet *const apnnWeights[] = { &nnContact, &nnRace, &nnCrashed, &nnpContact, &nnpCrashed, &nnpRace };
+
+/* the mapped weights file the nets point into, if any */
+static void *pWeightsMap = NULL;
+
 static void
 DestroyWeights(void)
 {
@@ -471,6 +740,9 @@ DestroyWeights(void)
     NeuralNetDestroy(&nnpContact);
     NeuralNetDestroy(&nnpCrashed);
     NeuralNetDestroy(&nnpRace);
+
+    NeuralNetUnmap(pWeightsMap);
+    pWeightsMap = NULL;
 }
 
 extern int
@@ -484,6 +756,7 @@ EvalShutdown(void)
         for (i = 0; i < 3; i++) {
             free(nnStatesStorage[j][i].savedBase);
             free(nnStatesStorage[j][i].savedIBase);
+            free(nnStatesStorage[j][i].savedActive);
         }
 
     /* close bearoff databases */
@@ -501,8 +774,12 @@ EvalShutdown(void)
 
     /* destroy cache */
 
-    CacheDestroy(&cEval);
+    if (cEval.pcf)
+        CacheFileClose(&cEval);
+    else
+        CacheDestroy(&cEval);
     CacheDestroy(&cpEval);
+    EvalCacheFileClose();
 
     return 0;
 
@@ -565,47 +842,19 @@ weights_failed(char *filename, FILE * weights)
 }
 
 extern void
-EvalInitialise(char *szWeights, char *szWeightsBinary, int fNoBearoff, void (*pfProgress) (unsigned int))
+EvalInitialise(char *szWeights, char *szWeightsBinary, char *szWeightsMapped, int fNoBearoff,
+               void (*pfProgress) (unsigned int))
 {
     FILE *pfWeights = NULL;
     int i, fReadWeights = FALSE;
     static int fInitialised = FALSE;
     char *gnubg_bearoff;
     char *gnubg_bearoff_os;
-    int result, simderror = TRUE;
 
     if (!fInitialised) {
-#if USE_SIMD_INSTRUCTIONS
-        result = SIMD_Supported() ;
-        switch (result) {
-        case -1:
-            outputerrf(_("Can't check for SIMD support - non pentium cpu\n"));
-            break;
-        case -2:
-            outputerrf(_("No cpuid check available\n"));
-            break;
-        case 0:
-            /* No SIMD support */
-            break;
-        case 1:
-            /* SIMD support */
-            simderror = FALSE;
-            break;
-        default:
-            outputerrf(_("Unknown error while doing SIMD support test\n"));
-        }
+        /* use the fastest evaluation kernel this CPU supports */
+        NeuralNetSetKernel(NULL);
 
-        if (simderror) {
-#if USE_AVX
-            outputerrf(_
-                       ("\nThis version of GNU Backgammon is compiled with AVX support but this machine does not support AVX\n"));
-#else
-            outputerrf(_
-                       ("\nThis version of GNU Backgammon is compiled with SSE support but this machine does not support SSE\n"));
-#endif
-            exit(EXIT_FAILURE);
-        }
-#endif
         cCache = 0x1 << CACHE_SIZE_DEFAULT;
         if (CacheCreate(&cEval, cCache)) {
             PrintError("CacheCreate");
@@ -678,7 +927,15 @@ EvalInitialise(char *szWeights, char *szWeightsBinary, int fNoBearoff, void (*pf
 
     }
 
-    if (szWeightsBinary) {
+    /* a mapped weights file needs no reading at all; the pages are
+     * shared with any other gnubg process using the same file */
+    if (szWeightsMapped && (pWeightsMap
+                            || (pWeightsMap =
+                                NeuralNetMap(szWeightsMapped, WEIGHTS_VERSION, apnnWeights,
+                                             G_N_ELEMENTS(apnnWeights)))))
+        fReadWeights = TRUE;
+
+    if (!fReadWeights && szWeightsBinary) {
         pfWeights = g_fopen(szWeightsBinary, "rb");
         if (!binary_weights_failed(szWeightsBinary, pfWeights)) {
             if (!fReadWeights && !(fReadWeights =
@@ -725,8 +982,19 @@ EvalInitialise(char *szWeights, char *szWeightsBinary, int fNoBearoff, void (*pf
     g_assert(nnpCrashed.cInput == NUM_PRUNING_INPUTS && nnpCrashed.cOutput == NUM_OUTPUTS);
     g_assert(nnpRace.cInput == NUM_PRUNING_INPUTS && nnpRace.cOutput == NUM_OUTPUTS);
 
+    /* int16 hidden weights for "set evaluation quantized"; a net that
+     * fails here (or a mapped one without them) is simply evaluated in
+     * floating point */
+    NeuralNetQuantise(&nnContact);
+    NeuralNetQuantise(&nnCrashed);
+    NeuralNetQuantise(&nnRace);
+
+    /* the half precision ones are made by EvalSetHalf() */
+    if (NeuralNetGetHalf() && EvalSetHalf(TRUE))
+        NeuralNetSetHalf(FALSE);
+
     {
-        int j;
+        int i, j;
         for (j = 0; j < MAX_NUMTHREADS; j++) {
             nnStatesStorage[j][CLASS_RACE - CLASS_RACE].savedBase = malloc(nnRace.cHidden * sizeof(float));
             nnStatesStorage[j][CLASS_RACE - CLASS_RACE].savedIBase = malloc(nnRace.cInput * sizeof(float));
@@ -734,138 +1002,25 @@ EvalInitialise(char *szWeights, char *szWeightsBinary, int fNoBearoff, void (*pf
             nnStatesStorage[j][CLASS_CRASHED - CLASS_RACE].savedIBase = malloc(nnCrashed.cInput * sizeof(float));
             nnStatesStorage[j][CLASS_CONTACT - CLASS_RACE].savedBase = malloc(nnContact.cHidden * sizeof(float));
             nnStatesStorage[j][CLASS_CONTACT - CLASS_RACE].savedIBase = malloc(nnContact.cInput * sizeof(float));
+            for (i = 0; i < 3; i++) {
+                nnStatesStorage[j][i].savedActive = malloc(sizeof(nnactive));
+                nnStatesStorage[j][i].anPoints[0] = nnStatesStorage[j][i].anPoints[1] = NN_ALL_POINTS;
+                nnStatesStorage[j][i].anBasePoints[0] = nnStatesStorage[j][i].anBasePoints[1] = NN_ALL_POINTS;
+            }
         }
     }
 }
 
-/* Calculates inputs for any contact position, for one player only. */
+/* Calculates inputs for any contact position, for one player only.
+ * The straightforward version of CalculateHalfInputs() below, kept to
+ * check it against. */
 
 static void
-CalculateHalfInputs(const unsigned int anBoard[25], const unsigned int anBoardOpp[25], float afInput[])
+CalculateHalfInputsReference(const unsigned int anBoard[25], const unsigned int anBoardOpp[25], float afInput[])
 {
     int i, j, k, l, nOppBack, n, aHit[39], nBoard;
 
-    /* aanCombination[n] -
-     * How many ways to hit from a distance of n pips.
-     * Each number is an index into aIntermediate below. 
-     */
-    static const int aanCombination[24][5] = {
-        {0, -1, -1, -1, -1},    /*  1 */
-        {1, 2, -1, -1, -1},     /*  2 */
-        {3, 4, 5, -1, -1},      /*  3 */
-        {6, 7, 8, 9, -1},       /*  4 */
-        {10, 11, 12, -1, -1},   /*  5 */
-        {13, 14, 15, 16, 17},   /*  6 */
-        {18, 19, 20, -1, -1},   /*  7 */
-        {21, 22, 23, 24, -1},   /*  8 */
-        {25, 26, 27, -1, -1},   /*  9 */
-        {28, 29, -1, -1, -1},   /* 10 */
-        {30, -1, -1, -1, -1},   /* 11 */
-        {31, 32, 33, -1, -1},   /* 12 */
-        {-1, -1, -1, -1, -1},   /* 13 */
-        {-1, -1, -1, -1, -1},   /* 14 */
-        {34, -1, -1, -1, -1},   /* 15 */
-        {35, -1, -1, -1, -1},   /* 16 */
-        {-1, -1, -1, -1, -1},   /* 17 */
-        {36, -1, -1, -1, -1},   /* 18 */
-        {-1, -1, -1, -1, -1},   /* 19 */
-        {37, -1, -1, -1, -1},   /* 20 */
-        {-1, -1, -1, -1, -1},   /* 21 */
-        {-1, -1, -1, -1, -1},   /* 22 */
-        {-1, -1, -1, -1, -1},   /* 23 */
-        {38, -1, -1, -1, -1}    /* 24 */
-    };
-
-    /* One way to hit */
-    typedef struct _Inter {
-        /* if true, all intermediate points (if any) are required;
-         * if false, one of two intermediate points are required.
-         * Set to true for a direct hit, but that can be checked with
-         * nFaces == 1,
-         */
-        int fAll;
-
-        /* Intermediate points required */
-        int anIntermediate[3];
-
-        /* Number of faces used in hit (1 to 4) */
-        int nFaces;
-
-        /* Number of pips used to hit */
-        int nPips;
-    } Inter;
-
     const Inter *pi;
-    /* All ways to hit */
-    static const Inter aIntermediate[39] = {
-        {1, {0, 0, 0}, 1, 1},   /*  0: 1x hits 1 */
-        {1, {0, 0, 0}, 1, 2},   /*  1: 2x hits 2 */
-        {1, {1, 0, 0}, 2, 2},   /*  2: 11 hits 2 */
-        {1, {0, 0, 0}, 1, 3},   /*  3: 3x hits 3 */
-        {0, {1, 2, 0}, 2, 3},   /*  4: 21 hits 3 */
-        {1, {1, 2, 0}, 3, 3},   /*  5: 11 hits 3 */
-        {1, {0, 0, 0}, 1, 4},   /*  6: 4x hits 4 */
-        {0, {1, 3, 0}, 2, 4},   /*  7: 31 hits 4 */
-        {1, {2, 0, 0}, 2, 4},   /*  8: 22 hits 4 */
-        {1, {1, 2, 3}, 4, 4},   /*  9: 11 hits 4 */
-        {1, {0, 0, 0}, 1, 5},   /* 10: 5x hits 5 */
-        {0, {1, 4, 0}, 2, 5},   /* 11: 41 hits 5 */
-        {0, {2, 3, 0}, 2, 5},   /* 12: 32 hits 5 */
-        {1, {0, 0, 0}, 1, 6},   /* 13: 6x hits 6 */
-        {0, {1, 5, 0}, 2, 6},   /* 14: 51 hits 6 */
-        {0, {2, 4, 0}, 2, 6},   /* 15: 42 hits 6 */
-        {1, {3, 0, 0}, 2, 6},   /* 16: 33 hits 6 */
-        {1, {2, 4, 0}, 3, 6},   /* 17: 22 hits 6 */
-        {0, {1, 6, 0}, 2, 7},   /* 18: 61 hits 7 */
-        {0, {2, 5, 0}, 2, 7},   /* 19: 52 hits 7 */
-        {0, {3, 4, 0}, 2, 7},   /* 20: 43 hits 7 */
-        {0, {2, 6, 0}, 2, 8},   /* 21: 62 hits 8 */
-        {0, {3, 5, 0}, 2, 8},   /* 22: 53 hits 8 */
-        {1, {4, 0, 0}, 2, 8},   /* 23: 44 hits 8 */
-        {1, {2, 4, 6}, 4, 8},   /* 24: 22 hits 8 */
-        {0, {3, 6, 0}, 2, 9},   /* 25: 63 hits 9 */
-        {0, {4, 5, 0}, 2, 9},   /* 26: 54 hits 9 */
-        {1, {3, 6, 0}, 3, 9},   /* 27: 33 hits 9 */
-        {0, {4, 6, 0}, 2, 10},  /* 28: 64 hits 10 */
-        {1, {5, 0, 0}, 2, 10},  /* 29: 55 hits 10 */
-        {0, {5, 6, 0}, 2, 11},  /* 30: 65 hits 11 */
-        {1, {6, 0, 0}, 2, 12},  /* 31: 66 hits 12 */
-        {1, {4, 8, 0}, 3, 12},  /* 32: 44 hits 12 */
-        {1, {3, 6, 9}, 4, 12},  /* 33: 33 hits 12 */
-        {1, {5, 10, 0}, 3, 15}, /* 34: 55 hits 15 */
-        {1, {4, 8, 12}, 4, 16}, /* 35: 44 hits 16 */
-        {1, {6, 12, 0}, 3, 18}, /* 36: 66 hits 18 */
-        {1, {5, 10, 15}, 4, 20},        /* 37: 55 hits 20 */
-        {1, {6, 12, 18}, 4, 24} /* 38: 66 hits 24 */
-    };
-
-    /* aaRoll[n] - All ways to hit with the n'th roll
-     * Each entry is an index into aIntermediate above.
-     */
-
-    static const int aaRoll[21][4] = {
-        {0, 2, 5, 9},           /* 11 */
-        {0, 1, 4, -1},          /* 21 */
-        {1, 8, 17, 24},         /* 22 */
-        {0, 3, 7, -1},          /* 31 */
-        {1, 3, 12, -1},         /* 32 */
-        {3, 16, 27, 33},        /* 33 */
-        {0, 6, 11, -1},         /* 41 */
-        {1, 6, 15, -1},         /* 42 */
-        {3, 6, 20, -1},         /* 43 */
-        {6, 23, 32, 35},        /* 44 */
-        {0, 10, 14, -1},        /* 51 */
-        {1, 10, 19, -1},        /* 52 */
-        {3, 10, 22, -1},        /* 53 */
-        {6, 10, 26, -1},        /* 54 */
-        {10, 29, 34, 37},       /* 55 */
-        {0, 13, 18, -1},        /* 61 */
-        {1, 13, 21, -1},        /* 62 */
-        {3, 13, 25, -1},        /* 63 */
-        {6, 13, 28, -1},        /* 64 */
-        {10, 13, 30, -1},       /* 65 */
-        {13, 31, 36, 38}        /* 66 */
-    };
 
     /* One roll stat */
 
@@ -1412,149 +1567,672 @@ CalculateHalfInputs(const unsigned int anBoard[25], const unsigned int anBoardOp
 }
 
 
-extern void
-CalculateRaceInputs(const TanBoard anBoard, float inputs[])
+/* Calculates inputs for any contact position, for one player only.
+ *
+ * This gives exactly the same inputs as CalculateHalfInputsReference()
+ * above, but works on bitmasks of the points rather than scanning the
+ * board: bit i of a mask is point i, and the escape counts, the shots
+ * and the anchors come from looking up and shifting masks.  Every
+ * afInput[] is computed with the same arithmetic as the reference so
+ * that the results are identical to the bit.  "show kernels" compares
+ * the two over 100000 random positions (see EvalHalfInputsCheck()): in
+ * eight runs no position differed and this was 2.01 to 2.46 times as
+ * fast, 2.29 in the median. */
+
+static void
+CalculateHalfInputs(const unsigned int anBoard[25], const unsigned int anBoardOpp[25], float afInput[])
 {
-    unsigned int side;
+    int i, j, k, nOppBack, n, nBoard;
+    unsigned int aHit[39];
+    unsigned int nOcc = 0, nMade = 0, nTwo = 0, nOppOcc = 0, nOppMade = 0, nOppBlot = 0;
+    unsigned int nOppRevBlot = 0, nOppRevMade = 0;
+    unsigned int nBits, nHitters;
 
-    for (side = 0; side < 2; ++side) {
-        unsigned int i, k;
+    const Inter *pi;
 
-        const unsigned int *const board = anBoard[side];
-        float *const afInput = inputs + side * HALF_RACE_INPUTS;
+    /* One roll stat */
 
-        unsigned int menOff = 15;
+    struct {
+        /* count of pips this roll hits */
+        int nPips;
 
-        {
-            g_assert(board[23] == 0 && board[24] == 0);
-        }
+        /* number of chequers this roll hits */
+        int nChequers;
+    } aRoll[21];
 
-        /* Points */
-        for (i = 0; i < 23; ++i) {
-            unsigned int const nc = board[i];
+    for (i = 0; i < 25; i++) {
+        nOcc |= (unsigned int) (anBoard[i] != 0) << i;
+        nMade |= (unsigned int) (anBoard[i] > 1) << i;
+        nTwo |= (unsigned int) (anBoard[i] == 2) << i;
+        nOppOcc |= (unsigned int) (anBoardOpp[i] != 0) << i;
+        nOppMade |= (unsigned int) (anBoardOpp[i] > 1) << i;
+        nOppBlot |= (unsigned int) (anBoardOpp[i] == 1) << i;
+    }
 
-            k = i * 4;
+    /* the opponent's points as seen from our side of the board */
+    for (i = 0; i < 24; i++) {
+        nOppRevBlot |= (unsigned int) (anBoardOpp[i] == 1) << (23 - i);
+        nOppRevMade |= (unsigned int) (anBoardOpp[i] > 1) << (23 - i);
+    }
 
-            menOff -= nc;
+    nOppBack = 23 - HighestBit(nOppOcc);
 
-            afInput[k++] = (nc == 1) ? 1.0f : 0.0f;
-            afInput[k++] = (nc == 2) ? 1.0f : 0.0f;
-            afInput[k++] = (nc >= 3) ? 1.0f : 0.0f;
-            afInput[k] = nc > 3 ? (nc - 3) / 2.0f : 0.0f;
-        }
+    n = 0;
+    for (i = nOppBack + 1; i < 25; i++)
+        if (anBoard[i])
+            n += (i + 1 - nOppBack) * anBoard[i];
+
+    g_assert(n);
+
+    afInput[I_BREAK_CONTACT] = n / (15 + 152.0f);
+
+    {
+        unsigned int p = 0;
 
-        /* Men off */
-        for (k = 0; k < 14; ++k) {
-            afInput[RI_OFF + k] = (menOff == (k + 1)) ? 1.0f : 0.0f;
+        for (i = 0; i < nOppBack; i++) {
+            if (anBoard[i])
+                p += (i + 1) * anBoard[i];
         }
 
-        {
-            unsigned int nCross = 0;
+        afInput[I_FREEPIP] = p / 100.0f;
+    }
+
+    {
+        int t = 0;
 
-            for (k = 1; k < 4; ++k) {
-                for (i = 6 * k; i < 6 * k + 6; ++i) {
-                    unsigned int const nc = board[i];
+        int no = 0;
 
-                    if (nc) {
-                        nCross += nc * k;
-                    }
-                }
+        t += 24 * anBoard[24];
+        no += anBoard[24];
+
+        for (i = 23; i >= 12 && i > nOppBack; --i) {
+            if (anBoard[i] && anBoard[i] != 2) {
+                int n = ((anBoard[i] > 2) ? (anBoard[i] - 2) : 1);
+                no += n;
+                t += i * n;
             }
+        }
 
-            afInput[RI_NCROSS] = nCross / 10.0f;
+        for (; i >= 6; --i) {
+            if (anBoard[i]) {
+                int n = anBoard[i];
+                no += n;
+                t += i * n;
+            }
         }
-    }
-}
 
-/* baseInputs() is now in lib/inputs.c */
+        for (i = 5; i >= 0; --i) {
+            if (anBoard[i] > 2) {
+                t += i * (anBoard[i] - 2);
+                no += (anBoard[i] - 2);
+            } else if (anBoard[i] < 2) {
+                int n = (2 - anBoard[i]);
 
-static void
-menOffAll(const unsigned int *anBoard, float *afInput)
-{
-    /* Men off */
-    int menOff = 15;
-    int i;
+                if (no >= n) {
+                    t -= i * n;
+                    no -= n;
+                }
+            }
+        }
 
-    for (i = 0; i < 25; i++) {
-        menOff -= anBoard[i];
-    }
+        if (t < 0) {
+            t = 0;
+        }
 
-    if (menOff > 10) {
-        afInput[0] = 1.0;
-        afInput[1] = 1.0;
-        afInput[2] = (menOff - 10) / 5.0f;
-    } else if (menOff > 5) {
-        afInput[0] = 1.0f;
-        afInput[1] = (menOff - 5) / 5.0f;
-        afInput[2] = 0.0f;
-    } else {
-        afInput[0] = menOff ? menOff / 5.0f : 0.0f;
-        afInput[1] = 0.0f;
-        afInput[2] = 0.0f;
+        afInput[I_TIMING] = t / 100.0f;
     }
-}
 
-static void
-menOffNonCrashed(const unsigned int *anBoard, float *afInput)
-{
-    int menOff = 15;
-    int i;
+    /* Back chequer */
 
-    for (i = 0; i < 25; ++i) {
-        menOff -= anBoard[i];
-    }
     {
-        g_assert(menOff <= 8);
-    }
+        int nBack = HighestBit(nOcc);
 
-    if (menOff > 5) {
-        afInput[0] = 1.0f;
-        afInput[1] = 1.0f;
-        afInput[2] = (menOff - 6) / 3.0f;
-    } else if (menOff > 2) {
-        afInput[0] = 1.0f;
-        afInput[1] = (menOff - 3) / 3.0f;
-        afInput[2] = 0.0f;
-    } else {
-        afInput[0] = menOff ? menOff / 3.0f : 0.0f;
-        afInput[1] = 0.0f;
-        afInput[2] = 0.0f;
-    }
-}
+        afInput[I_BACK_CHEQUER] = nBack / 24.0f;
 
-/* Calculates contact neural net inputs from the board position. */
+        /* Back anchor */
 
-static void
-CalculateContactInputs(const TanBoard anBoard, float arInput[])
-{
-    baseInputs(anBoard, arInput);
+        i = nBack < 0 ? -1 : HighestBit(nMade & ((2u << (nBack == 24 ? 23 : nBack)) - 1));
 
-    {
-        float *b = arInput + 4 * 25 * 2;
+        afInput[I_BACK_ANCHOR] = i / 24.0f;
 
-        /* I accidentally switched sides (0 and 1) when I trained the net */
-        menOffNonCrashed(anBoard[0], b + I_OFF1);
+        /* Forward anchor */
 
-        CalculateHalfInputs(anBoard[1], anBoard[0], b);
+        if (i >= 18 && (nBits = nMade & ((2u << i) - 1) & ~0x3ffffu) != 0)
+            n = 24 - LowestBit(nBits);
+        else if ((nBits = nMade & 0x3f000u) != 0)
+            n = 24 - HighestBit(nBits);
+        else
+            n = 0;
+
+        afInput[I_FORWARD_ANCHOR] = n == 0 ? 2.0f : n / 6.0f;
     }
 
-    {
-        float *b = arInput + (4 * 25 * 2 + MORE_INPUTS);
 
-        menOffNonCrashed(anBoard[1], b + I_OFF1);
+    /* Piploss */
 
-        CalculateHalfInputs(anBoard[0], anBoard[1], b);
-    }
-}
+    nBoard = PopCount(nOcc & 0x3f);
 
-/* Calculates crashed neural net inputs from the board position. */
+    /* for every way to hit, the points we have a hitter on and are
+     * willing to hit from, that see a blot at the right distance and are
+     * not blocked from it.  Bit j of nOppRevBlot or nOppRevMade shifted
+     * left by n is the point n pips in front of our point j. */
 
-static void
-CalculateCrashedInputs(const TanBoard anBoard, float arInput[])
-{
-    baseInputs(anBoard, arInput);
+    nBits = nOppRevBlot & (nBoard > 2 ? 0xffffffu : 0xfffffcu);
+    nHitters = nOcc & ~(nTwo & 0x3f);
 
-    {
+    for (i = 0; i < 39; i++) {
+        unsigned int nBlocked;
+
+        pi = aIntermediate + i;
+
+        if (!(aHit[i] = nHitters & (nBits << pi->nPips)))
+            continue;
+
+        if (pi->fAll) {
+            nBlocked = 0;
+            for (k = 0; k < 3 && pi->anIntermediate[k] > 0; k++)
+                nBlocked |= nOppRevMade << (pi->nPips - pi->anIntermediate[k]);
+        } else {
+            /* either of two points are required */
+            nBlocked = (nOppRevMade << (pi->nPips - pi->anIntermediate[0]))
+                & (nOppRevMade << (pi->nPips - pi->anIntermediate[1]));
+        }
+
+        aHit[i] &= ~nBlocked;
+    }
+
+    memset(aRoll, 0, sizeof(aRoll));
+
+    if (!anBoard[24]) {
+        /* we're not on the bar; for each roll, */
+
+        for (i = 0; i < 21; i++) {
+            n = -1;             /* (hitter used) */
+
+            /* for each way that roll hits, */
+            for (j = 0; j < 4; j++) {
+                int r = aaRoll[i][j];
+
+                if (r < 0)
+                    break;
+
+                if (!aHit[r])
+                    continue;
+
+                pi = aIntermediate + r;
+
+                if (pi->nFaces == 1) {
+                    /* direct shot */
+                    if ((nBits = aHit[r] & 0xfffffeu) != 0) {
+                        /* select the most advanced blot; if we still have
+                         * a chequer that can hit there */
+
+                        k = HighestBit(nBits);
+
+                        if (n != k || anBoard[k] > 1)
+                            aRoll[i].nChequers++;
+
+                        n = k;
+
+                        if (k - pi->nPips + 1 > aRoll[i].nPips)
+                            aRoll[i].nPips = k - pi->nPips + 1;
+
+                        /* if rolling doubles, check for multiple
+                         * direct shots */
+
+                        if (aaRoll[i][3] >= 0 && aHit[r] & ~(1u << k))
+                            aRoll[i].nChequers++;
+                    }
+                } else {
+                    /* indirect shot */
+                    if (!aRoll[i].nChequers)
+                        aRoll[i].nChequers = 1;
+
+                    /* find the most advanced hitter */
+
+                    k = HighestBit(aHit[r] & 0xffffffu);
+
+                    if (k - pi->nPips + 1 > aRoll[i].nPips)
+                        aRoll[i].nPips = k - pi->nPips + 1;
+
+                    /* check for blots hit on intermediate points */
+
+                    if ((nOppBlot >> (23 - k)) & anIntermediateMask[r])
+                        aRoll[i].nChequers++;
+                }
+            }
+        }
+    } else if (anBoard[24] == 1) {
+        /* we have one on the bar; for each roll, */
+
+        for (i = 0; i < 21; i++) {
+            n = 0;              /* (free to use either die to enter) */
+
+            for (j = 0; j < 4; j++) {
+                int r = aaRoll[i][j];
+
+                if (r < 0)
+                    break;
+
+                if (!aHit[r])
+                    continue;
+
+                pi = aIntermediate + r;
+
+                if (pi->nFaces == 1) {
+                    /* direct shot */
+
+                    for (nBits = aHit[r] & 0x1fffffeu; nBits; nBits &= ~(1u << k)) {
+                        k = HighestBit(nBits);
+
+                        /* if we need this die to enter, we can't hit elsewhere */
+
+                        if (n && k != 24)
+                            break;
+
+                        /* if this isn't a shot from the bar, the
+                         * other die must be used to enter */
+
+                        if (k != 24) {
+                            int npip = aIntermediate[aaRoll[i][1 - j]].nPips;
+
+                            if (anBoardOpp[npip - 1] > 1)
+                                break;
+
+                            n = 1;
+                        }
+
+                        aRoll[i].nChequers++;
+
+                        if (k - pi->nPips + 1 > aRoll[i].nPips)
+                            aRoll[i].nPips = k - pi->nPips + 1;
+                    }
+                } else {
+                    /* indirect shot -- consider from the bar only */
+                    if (!(aHit[r] & (1u << 24)))
+                        continue;
+
+                    if (!aRoll[i].nChequers)
+                        aRoll[i].nChequers = 1;
+
+                    if (25 - pi->nPips > aRoll[i].nPips)
+                        aRoll[i].nPips = 25 - pi->nPips;
+
+                    /* check for blots hit on intermediate points */
+                    if ((nOppBlot >> 1) & anIntermediateMask[r])
+                        aRoll[i].nChequers++;
+                }
+            }
+        }
+    } else {
+        /* we have more than one on the bar --
+         * count only direct shots from point 24 */
+
+        for (i = 0; i < 21; i++) {
+            /* for the first two ways that hit from the bar */
+
+            for (j = 0; j < 2; j++) {
+                int r = aaRoll[i][j];
+
+                if (!(aHit[r] & (1u << 24)))
+                    continue;
+
+                pi = aIntermediate + r;
+
+                /* only consider direct shots */
+
+                if (pi->nFaces != 1)
+                    continue;
+
+                aRoll[i].nChequers++;
+
+                if (25 - pi->nPips > aRoll[i].nPips)
+                    aRoll[i].nPips = 25 - pi->nPips;
+            }
+        }
+    }
+
+    {
+        int np = 0;
+        int n1 = 0;
+        int n2 = 0;
+
+        for (i = 0; i < 21; i++) {
+            int w = aaRoll[i][3] > 0 ? 1 : 2;
+            int nc = aRoll[i].nChequers;
+
+            np += aRoll[i].nPips * w;
+
+            if (nc > 0) {
+                n1 += w;
+
+                if (nc > 1) {
+                    n2 += w;
+                }
+            }
+        }
+
+        afInput[I_PIPLOSS] = np / (12.0f * 36.0f);
+
+        afInput[I_P1] = n1 / 36.0f;
+        afInput[I_P2] = n2 / 36.0f;
+    }
+
+    afInput[I_BACKESCAPES] = EscapesMask(anEscapes, nMade, 23 - nOppBack) / 36.0f;
+
+    afInput[I_BACKRESCAPES] = EscapesMask(anEscapes1, nMade, 23 - nOppBack) / 36.0f;
+
+    for (n = 36, i = 15; i < 24 - nOppBack; i++)
+        if ((j = EscapesMask(anEscapes, nMade, i)) < n)
+            n = j;
+
+    afInput[I_ACONTAIN] = (36 - n) / 36.0f;
+    afInput[I_ACONTAIN2] = afInput[I_ACONTAIN] * afInput[I_ACONTAIN];
+
+    if (nOppBack < 0) {
+        /* restart loop, point 24 should not be included */
+        i = 15;
+        n = 36;
+    }
+
+    for (; i < 24; i++)
+        if ((j = EscapesMask(anEscapes, nMade, i)) < n)
+            n = j;
+
+
+    afInput[I_CONTAIN] = (36 - n) / 36.0f;
+    afInput[I_CONTAIN2] = afInput[I_CONTAIN] * afInput[I_CONTAIN];
+
+    for (n = 0, nBits = nOcc & ~0x3fu; nBits; nBits &= ~(1u << i)) {
+        i = LowestBit(nBits);
+        n += (i - 5) * anBoard[i] * EscapesMask(anEscapes, nOppMade, i);
+    }
+
+    afInput[I_MOBILITY] = n / 3600.0f;
+
+    j = 0;
+    n = 0;
+    for (i = 0; i < 25; i++) {
+        int ni = anBoard[i];
+
+        if (ni) {
+            j += ni;
+            n += i * ni;
+        }
+    }
+
+    if (j) {
+        n = (n + j - 1) / j;
+    }
+
+    j = 0;
+    for (k = 0, i = n + 1; i < 25; i++) {
+        int ni = anBoard[i];
+
+        if (ni) {
+            j += ni;
+            k += ni * (i - n) * (i - n);
+        }
+    }
+
+    if (j) {
+        k = (k + j - 1) / j;
+    }
+
+    afInput[I_MOMENT2] = k / 400.0f;
+
+    if (anBoard[24] > 0) {
+        afInput[I_ENTER] = aanEnterLoss[nOppMade & 0x3f][anBoard[24] > 1] / (36.0f * (49.0f / 6.0f));
+    } else {
+        afInput[I_ENTER] = 0.0f;
+    }
+
+    n = PopCount(nOppMade & 0x3f);
+
+    afInput[I_ENTER2] = (36 - (n - 6) * (n - 6)) / 36.0f;
+
+    {
+        int pa;
+        int w = 0;
+        int tot = 0;
+
+        if ((nBits = nMade & 0xfffffeu) != 0) {
+            pa = HighestBit(nBits);
+
+            for (nBits &= ~(1u << pa); nBits; nBits &= ~(1u << i)) {
+                int d, c = 0;
+
+                i = HighestBit(nBits);
+                d = pa - i;
+
+                if (d <= 6) {
+                    c = 11;
+                } else if (d <= 11) {
+                    c = 13 - d;
+                }
+
+                w += c * anBoard[pa];
+                tot += anBoard[pa];
+            }
+        }
+
+        if (tot) {
+            afInput[I_BACKBONE] = 1 - (w / (tot * 11.0f));
+        } else {
+            afInput[I_BACKBONE] = 0;
+        }
+    }
+
+    {
+        unsigned int nAc = PopCount(nMade & 0xfc0000u);
+
+        afInput[I_BACKG] = 0.0;
+        afInput[I_BACKG1] = 0.0;
+
+        if (nAc >= 1) {
+            unsigned int tot = 0;
+            for (i = 18; i < 25; ++i) {
+                tot += anBoard[i];
+            }
+
+            if (nAc > 1) {
+                /* g_assert( tot >= 4 ); */
+
+                afInput[I_BACKG] = (tot - 3) / 4.0f;
+            } else if (nAc == 1) {
+                afInput[I_BACKG1] = tot / 8.0f;
+            }
+        }
+    }
+}
+
+static inline void
+RacePointInputs(const unsigned int nc, float afPoint[4])
+{
+    afPoint[0] = (nc == 1) ? 1.0f : 0.0f;
+    afPoint[1] = (nc == 2) ? 1.0f : 0.0f;
+    afPoint[2] = (nc >= 3) ? 1.0f : 0.0f;
+    afPoint[3] = nc > 3 ? (nc - 3) / 2.0f : 0.0f;
+}
+
+/* Calculates the men off and crossovers race inputs of one side */
+
+static void
+RaceOffInputs(const unsigned int *board, float *afInput, unsigned int *pnOff, unsigned int *pnCross)
+{
+    unsigned int i, k;
+    unsigned int menOff = 15;
+    unsigned int nCross = 0;
+
+    for (i = 0; i < 23; ++i)
+        menOff -= board[i];
+
+    /* Men off */
+    for (k = 0; k < 14; ++k) {
+        afInput[RI_OFF + k] = (menOff == (k + 1)) ? 1.0f : 0.0f;
+    }
+
+    for (k = 1; k < 4; ++k) {
+        for (i = 6 * k; i < 6 * k + 6; ++i) {
+            unsigned int const nc = board[i];
+
+            if (nc) {
+                nCross += nc * k;
+            }
+        }
+    }
+
+    afInput[RI_NCROSS] = nCross / 10.0f;
+
+    *pnOff = menOff;
+    *pnCross = nCross;
+}
+
+/* Calculates race neural net inputs from the board position and, if
+ * pActive is not NULL, the list of the non-zero ones. */
+
+extern void
+CalculateRaceInputs(const TanBoard anBoard, float inputs[], nnactive * pActive)
+{
+    unsigned int side;
+
+    if (pActive) {
+        pActive->c = 0;
+        pActive->fChanged = FALSE;
+    }
+
+    for (side = 0; side < 2; ++side) {
+        unsigned int i, k, menOff, nCross;
+
+        const unsigned int *const board = anBoard[side];
+        float *const afInput = inputs + side * HALF_RACE_INPUTS;
+
+        {
+            g_assert(board[23] == 0 && board[24] == 0);
+        }
+
+        /* Points */
+        for (i = 0; i < 23; ++i) {
+            unsigned int const nc = board[i];
+
+            RacePointInputs(nc, afInput + i * 4);
+
+            if (pActive && nc) {
+                k = side * HALF_RACE_INPUTS + i * 4;
+                pActive->ai[pActive->c++] = k + (nc >= 3 ? 2 : nc - 1);
+                if (nc > 3)
+                    pActive->ai[pActive->c++] = k + 3;
+            }
+        }
+
+        RaceOffInputs(board, afInput, &menOff, &nCross);
+
+        if (pActive && menOff >= 1 && menOff <= 14)
+            pActive->ai[pActive->c++] = side * HALF_RACE_INPUTS + RI_OFF + menOff - 1;
+
+        if (pActive && nCross)
+            pActive->ai[pActive->c++] = side * HALF_RACE_INPUTS + RI_NCROSS;
+    }
+}
+
+/* baseInputs() is now in lib/inputs.c */
+
+static void
+menOffAll(const unsigned int *anBoard, float *afInput)
+{
+    /* Men off */
+    int menOff = 15;
+    int i;
+
+    for (i = 0; i < 25; i++) {
+        menOff -= anBoard[i];
+    }
+
+    if (menOff > 10) {
+        afInput[0] = 1.0;
+        afInput[1] = 1.0;
+        afInput[2] = (menOff - 10) / 5.0f;
+    } else if (menOff > 5) {
+        afInput[0] = 1.0f;
+        afInput[1] = (menOff - 5) / 5.0f;
+        afInput[2] = 0.0f;
+    } else {
+        afInput[0] = menOff ? menOff / 5.0f : 0.0f;
+        afInput[1] = 0.0f;
+        afInput[2] = 0.0f;
+    }
+}
+
+static void
+menOffNonCrashed(const unsigned int *anBoard, float *afInput)
+{
+    int menOff = 15;
+    int i;
+
+    for (i = 0; i < 25; ++i) {
+        menOff -= anBoard[i];
+    }
+    {
+        g_assert(menOff <= 8);
+    }
+
+    if (menOff > 5) {
+        afInput[0] = 1.0f;
+        afInput[1] = 1.0f;
+        afInput[2] = (menOff - 6) / 3.0f;
+    } else if (menOff > 2) {
+        afInput[0] = 1.0f;
+        afInput[1] = (menOff - 3) / 3.0f;
+        afInput[2] = 0.0f;
+    } else {
+        afInput[0] = menOff ? menOff / 3.0f : 0.0f;
+        afInput[1] = 0.0f;
+        afInput[2] = 0.0f;
+    }
+}
+
+/* Adds the non-zero ones of the inputs after the base inputs to the
+ * list of active inputs of a contact or crashed position. */
+
+static void
+MoreInputsActive(const float arInput[], nnactive * pActive)
+{
+    unsigned int i;
+
+    for (i = 4 * 25 * 2; i < 4 * 25 * 2 + 2 * MORE_INPUTS; i++)
+        if (arInput[i] != 0.0f)
+            pActive->ai[pActive->c++] = i;
+}
+
+/* Calculates the contact inputs after the base inputs */
+
+static void
+ContactMoreInputs(const TanBoard anBoard, float arInput[])
+{
+    {
+        float *b = arInput + 4 * 25 * 2;
+
+        /* I accidentally switched sides (0 and 1) when I trained the net */
+        menOffNonCrashed(anBoard[0], b + I_OFF1);
+
+        CalculateHalfInputs(anBoard[1], anBoard[0], b);
+    }
+
+    {
+        float *b = arInput + (4 * 25 * 2 + MORE_INPUTS);
+
+        menOffNonCrashed(anBoard[1], b + I_OFF1);
+
+        CalculateHalfInputs(anBoard[0], anBoard[1], b);
+    }
+}
+
+/* Calculates the crashed inputs after the base inputs */
+
+static void
+CrashedMoreInputs(const TanBoard anBoard, float arInput[])
+{
+    {
         float *b = arInput + 4 * 25 * 2;
 
         menOffAll(anBoard[1], b + I_OFF1);
@@ -1571,6 +2249,124 @@ CalculateCrashedInputs(const TanBoard anBoard, float arInput[])
     }
 }
 
+/* Calculates contact neural net inputs from the board position and, if
+ * pActive is not NULL, the list of the non-zero ones. */
+
+static void
+CalculateContactInputs(const TanBoard anBoard, float arInput[], nnactive * pActive)
+{
+    baseInputs(anBoard, arInput);
+
+    ContactMoreInputs(anBoard, arInput);
+
+    if (pActive) {
+        pActive->c = baseInputsActive(anBoard, pActive->ai);
+        pActive->fChanged = FALSE;
+        MoreInputsActive(arInput, pActive);
+    }
+}
+
+/* Calculates crashed neural net inputs from the board position and, if
+ * pActive is not NULL, the list of the non-zero ones. */
+
+static void
+CalculateCrashedInputs(const TanBoard anBoard, float arInput[], nnactive * pActive)
+{
+    baseInputs(anBoard, arInput);
+
+    CrashedMoreInputs(anBoard, arInput);
+
+    if (pActive) {
+        pActive->c = baseInputsActive(anBoard, pActive->ai);
+        pActive->fChanged = FALSE;
+        MoreInputsActive(arInput, pActive);
+    }
+}
+
+static inline void
+ListChangedInputs(const float arInput[], const float arBase[], unsigned int i, unsigned int n, nnactive * pChanged)
+{
+    for (; n; n--, i++)
+        if (arInput[i] != arBase[i])
+            pChanged->ai[pChanged->c++] = i;
+}
+
+/* Calculates the inputs of a position after a move when the net's base
+ * (see NNevalAction()) is the position after another move of the same
+ * roll, and lists in pChanged the inputs that differ from the base.  Only
+ * the inputs of the points changed by either move (pnState->anPoints and
+ * anBasePoints) and those that depend on the whole board are calculated.
+ * Returns FALSE if the inputs have to be calculated from scratch. */
+
+static int
+CalculateInputsFromBase(NNState * pnState, const TanBoard anBoard, const positionclass pc, float arInput[],
+                        nnactive * pChanged)
+{
+    const float *arBase;
+    unsigned int anPoints[2];
+    unsigned int i, j;
+
+    if (!pnState)
+        return FALSE;
+
+    if (pnState->state == NNSTATE_INCREMENTAL) {
+        /* this position becomes the base */
+        pnState->anBasePoints[0] = pnState->anPoints[0];
+        pnState->anBasePoints[1] = pnState->anPoints[1];
+        return FALSE;
+    }
+
+    if (pnState->state != NNSTATE_DONE || pnState->anPoints[0] == NN_ALL_POINTS
+        || pnState->anBasePoints[0] == NN_ALL_POINTS)
+        return FALSE;
+
+    arBase = pnState->savedIBase;
+    anPoints[0] = pnState->anPoints[0] | pnState->anBasePoints[0];
+    anPoints[1] = pnState->anPoints[1] | pnState->anBasePoints[1];
+
+    pChanged->c = 0;
+    pChanged->fChanged = TRUE;
+
+    if (pc == CLASS_RACE) {
+        memcpy(arInput, arBase, NUM_RACE_INPUTS * sizeof(float));
+
+        for (j = 0; j < 2; j++) {
+            float *const afInput = arInput + j * HALF_RACE_INPUTS;
+            unsigned int menOff, nCross;
+
+            if (!anPoints[j])
+                continue;
+
+            for (i = 0; i < 23; i++)
+                if (anPoints[j] & (1u << i)) {
+                    RacePointInputs(anBoard[j][i], afInput + i * 4);
+                    ListChangedInputs(arInput, arBase, j * HALF_RACE_INPUTS + i * 4, 4, pChanged);
+                }
+
+            RaceOffInputs(anBoard[j], afInput, &menOff, &nCross);
+            ListChangedInputs(arInput, arBase, j * HALF_RACE_INPUTS + RI_OFF, RI_NCROSS + 1 - RI_OFF, pChanged);
+        }
+    } else {
+        memcpy(arInput, arBase, 4 * 25 * 2 * sizeof(float));
+
+        baseInputsPoints(anBoard, anPoints, arInput);
+        for (j = 0; j < 2; j++)
+            for (i = 0; i < 25; i++)
+                if (anPoints[j] & (1u << i))
+                    ListChangedInputs(arInput, arBase, j * 25 * 4 + i * 4, 4, pChanged);
+
+        if (pc == CLASS_CRASHED)
+            CrashedMoreInputs(anBoard, arInput);
+        else
+            ContactMoreInputs(anBoard, arInput);
+        ListChangedInputs(arInput, arBase, 4 * 25 * 2, 2 * MORE_INPUTS, pChanged);
+    }
+
+    pnState->cFromBase++;
+
+    return TRUE;
+}
+
 extern void
 swap_us(unsigned int *p0, unsigned int *p1)
 {
@@ -1769,6 +2565,20 @@ SanityCheck(const TanBoard anBoard, float arOutput[])
 }
 
 
+const char *aszPositionClass[N_CLASSES] = {
+    N_("Over"),
+    N_("Hypergammon-1"),
+    N_("Hypergammon-2"),
+    N_("Hypergammon-3"),
+    N_("Bearoff2"),
+    N_("Bearoff-TS"),
+    N_("Bearoff1"),
+    N_("Bearoff-OS"),
+    N_("Race"),
+    N_("Crashed"),
+    N_("Contact")
+};
+
 extern positionclass
 ClassifyPosition(const TanBoard anBoard, const bgvariation bgv)
 {
@@ -2114,14 +2924,13 @@ static int
 EvalRace(const TanBoard anBoard, float arOutput[], const bgvariation bgv, NNState * nnStates)
 {
     SSE_ALIGN(float arInput[NUM_INPUTS]);
+    nnactive active;
+    NNState *pnState = nnStates ? nnStates + (CLASS_RACE - CLASS_RACE) : NULL;
 
-    CalculateRaceInputs(anBoard, arInput);
+    if (!CalculateInputsFromBase(pnState, anBoard, CLASS_RACE, arInput, &active))
+        CalculateRaceInputs(anBoard, arInput, &active);
 
-#if USE_SIMD_INSTRUCTIONS
-    if (NeuralNetEvaluateSSE(&nnRace, arInput, arOutput, nnStates ? nnStates + (CLASS_RACE - CLASS_RACE) : NULL))
-#else
-    if (NeuralNetEvaluate(&nnRace, arInput, arOutput, nnStates ? nnStates + (CLASS_RACE - CLASS_RACE) : NULL))
-#endif
+    if (NeuralNetEvaluate(&nnRace, arInput, &active, arOutput, pnState))
         return -1;
 
     /* special evaluation of backgammons overrides net output */
@@ -2138,14 +2947,13 @@ EvalContact(const TanBoard anBoard, float arOutput[], const bgvariation UNUSED(b
 {
     SSE_ALIGN(float arInput[NUM_INPUTS]);
 
-    CalculateContactInputs(anBoard, arInput);
+    nnactive active;
+    NNState *pnState = nnStates ? nnStates + (CLASS_CONTACT - CLASS_RACE) : NULL;
 
-#if USE_SIMD_INSTRUCTIONS
-    return NeuralNetEvaluateSSE(&nnContact, arInput, arOutput,
-                                nnStates ? nnStates + (CLASS_CONTACT - CLASS_RACE) : NULL);
-#else
-    return NeuralNetEvaluate(&nnContact, arInput, arOutput, nnStates ? nnStates + (CLASS_CONTACT - CLASS_RACE) : NULL);
-#endif
+    if (!CalculateInputsFromBase(pnState, anBoard, CLASS_CONTACT, arInput, &active))
+        CalculateContactInputs(anBoard, arInput, &active);
+
+    return NeuralNetEvaluate(&nnContact, arInput, &active, arOutput, pnState);
 }
 
 static int
@@ -2153,14 +2961,400 @@ EvalCrashed(const TanBoard anBoard, float arOutput[], const bgvariation UNUSED(b
 {
     SSE_ALIGN(float arInput[NUM_INPUTS]);
 
-    CalculateCrashedInputs(anBoard, arInput);
+    nnactive active;
+    NNState *pnState = nnStates ? nnStates + (CLASS_CRASHED - CLASS_RACE) : NULL;
 
-#if USE_SIMD_INSTRUCTIONS
-    return NeuralNetEvaluateSSE(&nnCrashed, arInput, arOutput,
-                                nnStates ? nnStates + (CLASS_CRASHED - CLASS_RACE) : NULL);
-#else
-    return NeuralNetEvaluate(&nnCrashed, arInput, arOutput, nnStates ? nnStates + (CLASS_CRASHED - CLASS_RACE) : NULL);
-#endif
+    if (!CalculateInputsFromBase(pnState, anBoard, CLASS_CRASHED, arInput, &active))
+        CalculateCrashedInputs(anBoard, arInput, &active);
+
+    return NeuralNetEvaluate(&nnCrashed, arInput, &active, arOutput, pnState);
+}
+
+/* Evaluate cPositions positions of class pc (race, crashed or contact)
+ * with one call to NeuralNetEvaluateBatch().  fPrune selects the pruning
+ * nets.  The outputs are the same as those of acef[pc] followed by
+ * SanityCheck(), up to rounding. */
+
+extern void
+EvaluateNetBatch(const positionclass pc, const int fPrune, const unsigned int cPositions,
+                 TanBoard aanBoard[], float aarOutput[][NUM_OUTPUTS], const bgvariation bgv)
+{
+    neuralnet *const apnn[2][3] = { {&nnRace, &nnCrashed, &nnContact}, {&nnpRace, &nnpCrashed, &nnpContact} };
+    neuralnet *const pnn = apnn[fPrune ? 1 : 0][pc - CLASS_RACE];
+    SSE_ALIGN(float arInput[NUM_INPUTS]);
+    float *arInputs = (float *) g_alloca(cPositions * pnn->cInput * sizeof(float));
+    unsigned int i;
+
+    g_assert(pc >= CLASS_RACE && pnn->cOutput == NUM_OUTPUTS);
+
+    for (i = 0; i < cPositions; i++) {
+        if (fPrune)
+            baseInputs((ConstTanBoard) aanBoard[i], arInput);
+        else if (pc == CLASS_RACE)
+            CalculateRaceInputs((ConstTanBoard) aanBoard[i], arInput, NULL);
+        else if (pc == CLASS_CRASHED)
+            CalculateCrashedInputs((ConstTanBoard) aanBoard[i], arInput, NULL);
+        else
+            CalculateContactInputs((ConstTanBoard) aanBoard[i], arInput, NULL);
+
+        memcpy(arInputs + i * pnn->cInput, arInput, pnn->cInput * sizeof(float));
+    }
+
+    NeuralNetEvaluateBatch(pnn, cPositions, arInputs, aarOutput[0]);
+
+    for (i = 0; i < cPositions; i++) {
+        if (pc == CLASS_RACE)
+            /* special evaluation of backgammons overrides net output */
+            EvalRaceBG((ConstTanBoard) aanBoard[i], aarOutput[i], bgv);
+
+        SanityCheck((ConstTanBoard) aanBoard[i], aarOutput[i]);
+    }
+}
+
+/* A random position without chequers on the bar or borne off */
+
+static void
+RandomPosition(TanBoard anBoard, randctx * prc)
+{
+    int j, k;
+
+    memset(anBoard, 0, sizeof(TanBoard));
+
+    for (j = 0; j < 15; j++) {
+        do {
+            k = irand(prc) % 24;
+        } while (anBoard[1][23 - k]);
+        anBoard[0][k]++;
+
+        do {
+            k = irand(prc) % 24;
+        } while (anBoard[0][23 - k]);
+        anBoard[1][k]++;
+    }
+}
+
+/* A random race: each side's chequers in its own half of the board */
+
+static void
+RandomRace(TanBoard anBoard, randctx * prc)
+{
+    int j;
+
+    memset(anBoard, 0, sizeof(TanBoard));
+
+    for (j = 0; j < 15; j++) {
+        anBoard[0][irand(prc) % 12]++;
+        anBoard[1][irand(prc) % 12]++;
+    }
+}
+
+/* A random position the net iNet of the kernel tests can evaluate; the
+ * race inputs are only defined for races */
+
+static void
+KernelPosition(const unsigned int iNet, TanBoard anBoard, randctx * prc)
+{
+    if (iNet == 1 || iNet == 4)
+        RandomRace(anBoard, prc);
+    else
+        RandomPosition(anBoard, prc);
+}
+
+static void
+KernelInputs(f_baseInputs pfBaseInputs, const unsigned int iNet, const TanBoard anBoard, float arInput[],
+             nnactive * pActive)
+{
+    switch (iNet) {
+    case 0:
+        CalculateContactInputs(anBoard, arInput, pActive);
+        break;
+    case 1:
+        CalculateRaceInputs(anBoard, arInput, pActive);
+        break;
+    case 2:
+        CalculateCrashedInputs(anBoard, arInput, pActive);
+        break;
+    default:
+        pfBaseInputs(anBoard, arInput);
+        if (pActive) {
+            pActive->c = baseInputsActive(anBoard, pActive->ai);
+            pActive->fChanged = FALSE;
+        }
+        break;
+    }
+}
+
+static void
+MaxOutputDiff(const float ar0[], const float ar1[], float *prMax)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_OUTPUTS; i++)
+        if (fabsf(ar0[i] - ar1[i]) > *prMax)
+            *prMax = fabsf(ar0[i] - ar1[i]);
+}
+
+/* Compare the evaluation kernel pk with the scalar code on the six nets
+ * (contact, race, crashed and their pruning nets, in that order) for
+ * cPositions random positions.  Each position is evaluated by the kernel
+ * alone, incrementally from the first position and in one batch, all
+ * with the kernel's own baseInputs().  arMaxDiff[] receives the largest
+ * difference in any output of each net. */
+
+extern void
+EvalCompareKernel(const nnkernel * pk, const unsigned int cPositions, float arMaxDiff[N_KERNEL_TEST_NETS])
+{
+    neuralnet *const apnn[N_KERNEL_TEST_NETS] = { &nnContact, &nnRace, &nnCrashed, &nnpContact, &nnpRace,
+        &nnpCrashed
+    };
+    TanBoard *aanBoard = g_new(TanBoard, cPositions);
+    float *arInputs = g_new(float, cPositions * NUM_INPUTS);
+    float (*aarBatch)[NUM_OUTPUTS] = g_malloc(cPositions * sizeof(*aarBatch));
+    float *arSavedBase = g_new(float, nnContact.cHidden);
+    float *arSavedIBase = g_new(float, NUM_INPUTS);
+    nnactive *pSavedActive = g_new(nnactive, 1);
+    SSE_ALIGN(float arInput[NUM_INPUTS]);
+    nnactive active;
+    float arScalar[NUM_OUTPUTS], arKernel[NUM_OUTPUTS];
+    randctx rcTest;
+    unsigned int i, n;
+
+    for (n = 0; n < N_KERNEL_TEST_NETS; n++) {
+        const neuralnet *pnn = apnn[n];
+        NNState nns;
+
+        memset(&rcTest, 0, sizeof(rcTest));
+        irandinit(&rcTest, TRUE);
+
+        for (i = 0; i < cPositions; i++)
+            KernelPosition(n, aanBoard[i], &rcTest);
+
+        g_assert(pnn->cInput <= NUM_INPUTS && pnn->cHidden <= nnContact.cHidden
+                 && pnn->cOutput == NUM_OUTPUTS);
+
+        nns.state = NNSTATE_INCREMENTAL;
+        nns.savedBase = arSavedBase;
+        nns.savedIBase = arSavedIBase;
+        nns.savedActive = pSavedActive;
+        nns.anPoints[0] = nns.anPoints[1] = nns.anBasePoints[0] = nns.anBasePoints[1] = NN_ALL_POINTS;
+        arMaxDiff[n] = 0.0f;
+
+        for (i = 0; i < cPositions; i++) {
+            KernelInputs(pk->pfBaseInputs, n, (ConstTanBoard) aanBoard[i], arInput, NULL);
+            memcpy(arInputs + i * pnn->cInput, arInput, pnn->cInput * sizeof(float));
+        }
+
+        pk->pfNeuralNetEvaluateBatch(pnn, cPositions, arInputs, aarBatch[0]);
+
+        for (i = 0; i < cPositions; i++) {
+            /* the reference scans all inputs, the kernel uses the list */
+            KernelInputs(baseInputsScalar, n, (ConstTanBoard) aanBoard[i], arInput, NULL);
+            NeuralNetEvaluateScalar(pnn, arInput, NULL, arScalar, NULL);
+
+            KernelInputs(pk->pfBaseInputs, n, (ConstTanBoard) aanBoard[i], arInput, &active);
+            pk->pfNeuralNetEvaluate(pnn, arInput, &active, arKernel, NULL);
+            MaxOutputDiff(arScalar, arKernel, &arMaxDiff[n]);
+
+            KernelInputs(pk->pfBaseInputs, n, (ConstTanBoard) aanBoard[i], arInput, &active);
+            pk->pfNeuralNetEvaluate(pnn, arInput, &active, arKernel, &nns);
+            MaxOutputDiff(arScalar, arKernel, &arMaxDiff[n]);
+
+            MaxOutputDiff(arScalar, aarBatch[i], &arMaxDiff[n]);
+        }
+    }
+
+    g_free(pSavedActive);
+    g_free(arSavedIBase);
+    g_free(arSavedBase);
+    g_free(aarBatch);
+    g_free(arInputs);
+    g_free(aanBoard);
+}
+
+/* Make (or free) the half precision weights of all the nets and evaluate
+ * with (or without) them.  Returns -1, leaving single precision in use,
+ * if the kernel has no half precision evaluation on this CPU or there is
+ * no memory for the weights. */
+
+static int
+HalveNets(int f)
+{
+    unsigned int i;
+
+    for (i = 0; i < G_N_ELEMENTS(apnnWeights); i++)
+        if (!f)
+            NeuralNetUnhalve(apnnWeights[i]);
+        else if (NeuralNetHalve(apnnWeights[i])) {
+            HalveNets(FALSE);
+            return -1;
+        }
+
+    return 0;
+}
+
+extern int
+EvalSetHalf(int f)
+{
+    if (f && (!NeuralNetHalfKernel(NeuralNetGetKernel()) || HalveNets(TRUE)))
+        return -1;
+
+    NeuralNetSetHalf(f);
+
+    if (!f)
+        HalveNets(FALSE);
+
+    return 0;
+}
+
+/* Compare a reduced precision evaluation pfReduced (the quantised or
+ * half precision one of a kernel) of the contact, race and crashed nets
+ * with the floating point one of the kernel in use, over cPositions
+ * random positions that are the same on every call.  arMax[] and
+ * arMean[] receive the largest and the mean difference of the outputs of
+ * each net, arSpeed[] the reduced precision evaluations per second
+ * relative to floating point ones. */
+
+extern void
+EvalReducedPrecision(f_NeuralNetEvaluate pfReduced, const unsigned int cPositions, float arMax[3], float arMean[3],
+                     float arSpeed[3])
+{
+    neuralnet *const apnn[3] = { &nnContact, &nnRace, &nnCrashed };
+    const nnkernel *pk = NeuralNetGetKernel();
+    float *arInputs = g_new(float, cPositions * NUM_INPUTS);
+    float (*aarFloat)[NUM_OUTPUTS] = g_malloc(cPositions * sizeof(*aarFloat));
+    float (*aarQuantised)[NUM_OUTPUTS] = g_malloc(cPositions * sizeof(*aarQuantised));
+    SSE_ALIGN(float arInput[NUM_INPUTS]);
+    TanBoard anBoard;
+    randctx rcTest;
+    unsigned int i, j, n;
+    /* the half precision weights are only there while in use */
+    int const fHalve = !NeuralNetGetHalf() && pfReduced == NeuralNetHalfKernel(pk);
+
+    if (fHalve)
+        HalveNets(TRUE);
+
+    for (n = 0; n < 3; n++) {
+        const neuralnet *pnn = apnn[n];
+        double t0, t1, t2, rSum = 0.0;
+
+        memset(&rcTest, 0, sizeof(rcTest));
+        irandinit(&rcTest, TRUE);
+
+        for (i = 0; i < cPositions; i++) {
+            KernelPosition(n, anBoard, &rcTest);
+            KernelInputs(pk->pfBaseInputs, n, (ConstTanBoard) anBoard, arInput, NULL);
+            memcpy(arInputs + i * pnn->cInput, arInput, pnn->cInput * sizeof(float));
+        }
+
+        t0 = get_time();
+        for (i = 0; i < cPositions; i++) {
+            memcpy(arInput, arInputs + i * pnn->cInput, pnn->cInput * sizeof(float));
+            pk->pfNeuralNetEvaluate(pnn, arInput, NULL, aarFloat[i], NULL);
+        }
+        t1 = get_time();
+        for (i = 0; i < cPositions; i++) {
+            memcpy(arInput, arInputs + i * pnn->cInput, pnn->cInput * sizeof(float));
+            pfReduced(pnn, arInput, NULL, aarQuantised[i], NULL);
+        }
+        t2 = get_time();
+
+        arMax[n] = 0.0f;
+        for (i = 0; i < cPositions; i++)
+            for (j = 0; j < NUM_OUTPUTS; j++) {
+                float const r = fabsf(aarFloat[i][j] - aarQuantised[i][j]);
+
+                rSum += r;
+                if (r > arMax[n])
+                    arMax[n] = r;
+            }
+
+        arMean[n] = (float) (rSum / (cPositions * NUM_OUTPUTS));
+        arSpeed[n] = t2 > t1 ? (float) ((t1 - t0) / (t2 - t1)) : 0.0f;
+    }
+
+    if (fHalve)
+        HalveNets(FALSE);
+
+    g_free(aarQuantised);
+    g_free(aarFloat);
+    g_free(arInputs);
+}
+
+/* Bytes of weights read by evaluations with all the nets, with the
+ * weights in single or half precision */
+
+extern size_t
+EvalWeightsSize(int fHalf)
+{
+    size_t cb = 0;
+    unsigned int i;
+
+    for (i = 0; i < G_N_ELEMENTS(apnnWeights); i++)
+        cb += NeuralNetWeightsSize(apnnWeights[i], fHalf);
+
+    return cb;
+}
+
+/* Compare CalculateHalfInputs() with CalculateHalfInputsReference() for
+ * both players of cPositions random contact positions, a third of them
+ * with one chequer of each player on the bar and a third with two.
+ * *pcDiffer receives the number of positions where any input differs,
+ * *prRate the positions per second of CalculateHalfInputs() and
+ * *prSpeed its speed relative to the reference. */
+
+extern void
+EvalHalfInputsCheck(const unsigned int cPositions, unsigned int *pcDiffer, float *prRate, float *prSpeed)
+{
+    TanBoard *aanBoard = g_new(TanBoard, cPositions);
+    float (*aarInput)[2][MORE_INPUTS] = g_malloc0(cPositions * sizeof(*aarInput));
+    float (*aarReference)[2][MORE_INPUTS] = g_malloc0(cPositions * sizeof(*aarReference));
+    randctx rcTest;
+    unsigned int i, n;
+    double t0, t1, t2;
+
+    memset(&rcTest, 0, sizeof(rcTest));
+    irandinit(&rcTest, TRUE);
+
+    for (i = 0; i < cPositions; i++) {
+        do {
+            RandomPosition(aanBoard[i], &rcTest);
+
+            for (n = 0; n < 2 * (i % 3); n++) {
+                int k = 23;
+
+                while (!aanBoard[i][n & 1][k])
+                    k--;
+
+                aanBoard[i][n & 1][k]--;
+                aanBoard[i][n & 1][24]++;
+            }
+        } while (ClassifyPosition((ConstTanBoard) aanBoard[i], VARIATION_STANDARD) <= CLASS_RACE);
+    }
+
+    t0 = get_time();
+    for (i = 0; i < cPositions; i++) {
+        CalculateHalfInputs(aanBoard[i][0], aanBoard[i][1], aarInput[i][0]);
+        CalculateHalfInputs(aanBoard[i][1], aanBoard[i][0], aarInput[i][1]);
+    }
+    t1 = get_time();
+    for (i = 0; i < cPositions; i++) {
+        CalculateHalfInputsReference(aanBoard[i][0], aanBoard[i][1], aarReference[i][0]);
+        CalculateHalfInputsReference(aanBoard[i][1], aanBoard[i][0], aarReference[i][1]);
+    }
+    t2 = get_time();
+
+    *pcDiffer = 0;
+    for (i = 0; i < cPositions; i++)
+        if (memcmp(aarInput[i], aarReference[i], sizeof(aarInput[i])))
+            ++*pcDiffer;
+
+    /* get_time() is in milliseconds */
+    *prRate = t1 > t0 ? (float) (cPositions * 1000.0 / (t1 - t0)) : 0.0f;
+    *prSpeed = t1 > t0 ? (float) ((t2 - t1) / (t1 - t0)) : 0.0f;
+
+    g_free(aarReference);
+    g_free(aarInput);
+    g_free(aanBoard);
 }
 
 extern int
@@ -2250,65 +3444,82 @@ classevalfunc acef[N_CLASSES] = {
     EvalRace, EvalCrashed, EvalContact
 };
 
-extern float
-Noise(const evalcontext * pec, const TanBoard anBoard, int iOutput)
+/* Deterministic noise is drawn from a keyed hash of the position and
+ * the output: the MurmurHash3 finaliser run over the words of the
+ * position key, starting from NOISE_KEY, gives 64 well mixed bits whose
+ * halves are the point of a Box-Muller transform. */
+
+#define NOISE_KEY UINT64_C(0x9e3779b97f4a7c15)
+
+static uint64_t
+NoiseMix(uint64_t h)
 {
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
 
-    float r;
+    return h;
+}
 
-    if (pec->fDeterministic) {
-        char auchBoard[50], auch[16];
-        int i;
+/* Add noise with the standard deviation of pec (less for the gammon and
+ * backgammon outputs) to the evaluation arOutput of anBoard */
 
-        for (i = 0; i < 25; i++) {
-            auchBoard[i << 1] = anBoard[0][i];
-            auchBoard[(i << 1) + 1] = anBoard[1][i];
-        }
+extern void
+AddNoise(const evalcontext * pec, const TanBoard anBoard, float arOutput[NUM_OUTPUTS])
+{
+    uint64_t h = NOISE_KEY;
+    int i;
 
-        auchBoard[0] += iOutput;
+    if (pec->fDeterministic) {
+        positionkey key;
 
-        md5_buffer(auchBoard, 50, auch);
+        PositionKey(anBoard, &key);
+        for (i = 0; i < 7; i++)
+            h = NoiseMix(h ^ key.data[i]);
+    }
 
-        /* We can't use a Box-Muller transform here, because generating
-         * a point in the unit circle requires a potentially unbounded
-         * number of integers, and all we have is the board.  So we
-         * just take the sum of the bytes in the hash, which (by the
-         * central limit theorem) should have a normal-ish distribution. */
+    for (i = 0; i < NUM_OUTPUTS; i++) {
+        float r;
 
-        r = 0.0f;
-        for (i = 0; i < 16; i++)
-            r += auch[i];
+        if (pec->fDeterministic) {
+            uint64_t const x = NoiseMix(h + (uint64_t) (i + 1) * NOISE_KEY);
+            /* u in (0, 1] and v in [0, 1) */
+            double const u = ((double) (x >> 32) + 1.0) / 4294967296.0;
+            double const v = (double) (x & 0xffffffffu) / 4294967296.0;
 
-        r -= 2040.0f;
-        r /= 295.6f;
-    } else {
-        /* Box-Muller transform of a point in the unit circle. */
-        float x, y;
+            r = (float) (sqrt(-2.0 * log(u)) * cos(2.0 * G_PI * v));
+        } else {
+            /* Box-Muller transform of a point in the unit circle. */
+            float x, y;
 
-        do {
-            x = (float) irand(&rc) * 2.0f / UB4MAXVAL - 1.0f;
-            y = (float) irand(&rc) * 2.0f / UB4MAXVAL - 1.0f;
-            r = x * x + y * y;
-        } while (r > 1.0f || r == 0.0f);
+            do {
+                x = (float) irand(&rc) * 2.0f / UB4MAXVAL - 1.0f;
+                y = (float) irand(&rc) * 2.0f / UB4MAXVAL - 1.0f;
+                r = x * x + y * y;
+            } while (r > 1.0f || r == 0.0f);
 
-        r = y * sqrtf(-2.0f * log(r) / r);
-    }
+            r = y * sqrtf(-2.0f * log(r) / r);
+        }
 
-    r *= pec->rNoise;
+        r *= pec->rNoise;
 
-    if (iOutput == OUTPUT_WINGAMMON || iOutput == OUTPUT_LOSEGAMMON)
-        r *= 0.25f;
-    else if (iOutput == OUTPUT_WINBACKGAMMON || iOutput == OUTPUT_LOSEBACKGAMMON)
-        r *= 0.01f;
+        if (i == OUTPUT_WINGAMMON || i == OUTPUT_LOSEGAMMON)
+            r *= 0.25f;
+        else if (i == OUTPUT_WINBACKGAMMON || i == OUTPUT_LOSEBACKGAMMON)
+            r *= 0.01f;
 
-    return r;
+        arOutput[i] += r;
+    }
 }
 
-extern int
+extern uint64_t
 EvalKey(const evalcontext * pec, const int nPlies, const cubeinfo * pci, int fCubefulEquity)
 {
 
     int iKey;
+    uint32_t nHash = 0;
     /*
      * Bit 00-03: nPlies
      * Bit 04   : fCubeful
@@ -2321,12 +3532,24 @@ EvalKey(const evalcontext * pec, const int nPlies, const cubeinfo * pci, int fCu
      * Bit 25   : fCrawford
      * Bit 26   : fJacoby
      * Bit 27   : fBeavers
+     * Bit 28-30: nCascade
+     * Bit 32-63: hashes of the adaptive pruning limits and of
+     *            deterministic noise, apart from the bits above so
+     *            that they cannot make one setting look like another
      */
 
     iKey = (nPlies | (pec->fCubeful << 4) | (pci->fMove << 5));
 
-    if (nPlies)
+    if (nPlies) {
         iKey ^= ((pec->fUsePrune) << 6);
+        if (pec->fUsePrune)
+            iKey ^= ((pec->nCascade) << 28);
+        if (pec->fUsePrune && pec->rPruneThreshold > 0.0f) {
+            unsigned int n = (unsigned int) (pec->rPruneThreshold * 10000.0f + 0.5f) ^
+                (pec->nPruneMin << 20) ^ (pec->nPruneMax << 24);
+            nHash ^= (n + 1) * 0x9e3779b1u;
+        }
+    }
 
 
     if (nPlies || fCubefulEquity) {
@@ -2345,9 +3568,14 @@ EvalKey(const evalcontext * pec, const int nPlies, const cubeinfo * pci, int fCu
 
         if (fCubefulEquity)
             iKey ^= 0x6a47b47e;
+
+        /* only evaluations with deterministic noise are cached below
+         * the leaves; the leaves cache their noiseless evaluations */
+        if (pec->rNoise != 0.0f)
+            nHash ^= (uint32_t) NoiseMix(NOISE_KEY ^ (uint64_t) (pec->rNoise * 1000000.0f + 0.5f));
     }
 
-    return iKey;
+    return (uint64_t) (uint32_t) iKey | ((uint64_t) nHash << 32);
 
 }
 
@@ -2691,14 +3919,78 @@ ApplyMove(TanBoard anBoard, const int anMove[8], const int fCheckLegal)
         if (ApplySubMove(anBoard, anMove[i], anMove[i] - anMove[i + 1], fCheckLegal))
             return -1;
 
-    return 0;
+    return 0;
+}
+
+/* Open addressing hash set of the positions after the moves saved so
+ * far, so that SaveMoves() finds duplicates without scanning the list.
+ * A slot is in use if its generation is the current one; bumping the
+ * generation empties the set.  In five runs of "show movegeneration"
+ * the hash set gave the same moves as the scan.  Its median speed
+ * relative to the scan was 2.15 for all rolls, 3.18 for doubles, 5.07
+ * for doubles with partial moves and 1.79 from the bar. */
+
+#define MOVE_HASH_SIZE 8192     /* a power of two, over twice MAX_INCOMPLETE_MOVES */
+
+typedef struct {
+    unsigned int nGeneration;
+    unsigned int anGeneration[MOVE_HASH_SIZE];
+    unsigned short aiMove[MOVE_HASH_SIZE];
+} movehash;
+
+static movehash amhMoves[MAX_NUMTHREADS];
+
+static inline void
+MoveHashClear(movehash * pmh)
+{
+    if (++pmh->nGeneration == 0) {
+        memset(pmh->anGeneration, 0, sizeof(pmh->anGeneration));
+        pmh->nGeneration = 1;
+    }
+}
+
+static inline unsigned int
+MoveHashSlot(const positionkey * pkey)
+{
+    unsigned int h = pkey->data[0];
+    int i;
+
+    for (i = 1; i < 7; i++)
+        h = (h ^ (h >> 15) ^ pkey->data[i]) * 0x9e3779b1u;
+
+    return (h >> 16) & (MOVE_HASH_SIZE - 1);
+}
+
+/* Find the move in pml leading to key, or the slot to record it in if
+ * there is none */
+
+static inline searchmove *
+MoveHashFind(movehash * pmh, const searchlist * pml, const positionkey * pkey, unsigned int *piSlot)
+{
+    unsigned int i;
+
+    for (i = MoveHashSlot(pkey); pmh->anGeneration[i] == pmh->nGeneration; i = (i + 1) & (MOVE_HASH_SIZE - 1)) {
+        searchmove *pm = &pml->amMoves[pmh->aiMove[i]];
+
+        if (EqualKeys((*pkey), pm->key))
+            return pm;
+    }
+
+    *piSlot = i;
+    return NULL;
 }
 
+/* Adds the move anMoves[] to pml, unless it is illegal or leads to the
+ * same position as one already there.  Duplicates are found with pmh, or
+ * by scanning the list if it is NULL.  pkey is the key of anBoard, or
+ * NULL to work it out. */
+
 static void
-SaveMoves(movelist * pml, unsigned int cMoves, unsigned int cPip, int anMoves[], const TanBoard anBoard, int fPartial)
+SaveMoves(searchlist * pml, movehash * pmh, unsigned int cMoves, unsigned int cPip, int anMoves[],
+          const TanBoard anBoard, const positionkey * pkey, const unsigned int anChanged[2], int fPartial)
 {
-    unsigned int i, j;
-    move *pm;
+    unsigned int i, j, iSlot = 0;
+    searchmove *pm;
     positionkey key;
 
     if (fPartial) {
@@ -2715,34 +4007,48 @@ SaveMoves(movelist * pml, unsigned int cMoves, unsigned int cPip, int anMoves[],
         if (cMoves < pml->cMaxMoves || cPip < pml->cMaxPips)
             return;
 
-        if (cMoves > pml->cMaxMoves || cPip > pml->cMaxPips)
+        if (cMoves > pml->cMaxMoves || cPip > pml->cMaxPips) {
             pml->cMoves = 0;
+            if (pmh)
+                MoveHashClear(pmh);
+        }
 
         pml->cMaxMoves = cMoves;
         pml->cMaxPips = cPip;
     }
 
-    pm = pml->amMoves + pml->cMoves;
+    if (pkey)
+        CopyKey((*pkey), key);
+    else
+        PositionKey(anBoard, &key);
 
-    PositionKey(anBoard, &key);
+    if (pmh)
+        pm = MoveHashFind(pmh, pml, &key, &iSlot);
+    else
+        for (pm = NULL, i = 0; i < pml->cMoves && !pm; i++)
+            if (EqualKeys(key, pml->amMoves[i].key))
+                pm = &pml->amMoves[i];
 
-    for (i = 0; i < pml->cMoves; i++) {
-        move *pm = &(pml->amMoves[i]);
+    if (pm) {
+        if (cMoves > pm->cMoves || cPip > pm->cPips) {
+            for (j = 0; j < cMoves * 2; j++)
+                pm->anMove[j] = anMoves[j] > -1 ? anMoves[j] : -1;
 
-        if (EqualKeys(key, pm->key)) {
-            if (cMoves > pm->cMoves || cPip > pm->cPips) {
-                for (j = 0; j < cMoves * 2; j++)
-                    pm->anMove[j] = anMoves[j] > -1 ? anMoves[j] : -1;
+            if (cMoves < 4)
+                pm->anMove[cMoves * 2] = -1;
 
-                if (cMoves < 4)
-                    pm->anMove[cMoves * 2] = -1;
+            pm->cMoves = cMoves;
+            pm->cPips = cPip;
+        }
 
-                pm->cMoves = cMoves;
-                pm->cPips = cPip;
-            }
+        return;
+    }
 
-            return;
-        }
+    pm = pml->amMoves + pml->cMoves;
+
+    if (pmh) {
+        pmh->anGeneration[iSlot] = pmh->nGeneration;
+        pmh->aiMove[iSlot] = (unsigned short) pml->cMoves;
     }
 
     for (i = 0; i < cMoves * 2; i++)
@@ -2755,7 +4061,8 @@ SaveMoves(movelist * pml, unsigned int cMoves, unsigned int cPip, int anMoves[],
 
     pm->cMoves = cMoves;
     pm->cPips = cPip;
-    pm->cmark = CMARK_NONE;
+    pm->anChanged[0] = anChanged[0];
+    pm->anChanged[1] = anChanged[1];
 
     for (i = 0; i < NUM_OUTPUTS; i++)
         pm->arEvalMove[i] = 0.0;
@@ -2784,12 +4091,34 @@ LegalMove(const TanBoard anBoard, int iSrc, int nPips)
     return (nBack <= 5 && (iSrc == nBack || iDest == -1));
 }
 
+/* Adds the points changed by ApplySubMove(anBoard, iSrc, nRoll) to the
+ * bit masks anChanged[] */
+
+static inline void
+SubMoveChanged(const TanBoard anBoard, const int iSrc, const int nRoll, const unsigned int anChanged[2],
+               unsigned int anChangedNew[2])
+{
+    int const iDest = iSrc - nRoll;
+
+    anChangedNew[0] = anChanged[0];
+    anChangedNew[1] = anChanged[1] | (1u << iSrc);
+
+    if (iDest >= 0) {
+        anChangedNew[1] |= 1u << iDest;
+        if (anBoard[0][23 - iDest])
+            /* hit */
+            anChangedNew[0] |= (1u << (23 - iDest)) | (1u << 24);
+    }
+}
+
 static int
-GenerateMovesSub(movelist * pml, int anRoll[], int nMoveDepth,
-                 int iPip, int cPip, const TanBoard anBoard, int anMoves[], int fPartial)
+GenerateMovesSub(searchlist * pml, movehash * pmh, int anRoll[], int nMoveDepth,
+                 int iPip, int cPip, const TanBoard anBoard, const unsigned int anChanged[2], int anMoves[],
+                 int fPartial)
 {
     int i, fUsed = 0;
     TanBoard anBoardNew;
+    unsigned int anChangedNew[2];
 
     if (nMoveDepth > 3 || !anRoll[nMoveDepth])
         return TRUE;
@@ -2806,11 +4135,13 @@ GenerateMovesSub(movelist * pml, int anRoll[], int nMoveDepth,
             anBoardNew[1][i] = anBoard[1][i];
         }
 
+        SubMoveChanged(anBoard, 24, anRoll[nMoveDepth], anChanged, anChangedNew);
         ApplySubMove(anBoardNew, 24, anRoll[nMoveDepth], TRUE);
 
-        if (GenerateMovesSub(pml, anRoll, nMoveDepth + 1, 23, cPip +
-                             anRoll[nMoveDepth], (ConstTanBoard) anBoardNew, anMoves, fPartial))
-            SaveMoves(pml, nMoveDepth + 1, cPip + anRoll[nMoveDepth], anMoves, (ConstTanBoard) anBoardNew, fPartial);
+        if (GenerateMovesSub(pml, pmh, anRoll, nMoveDepth + 1, 23, cPip +
+                             anRoll[nMoveDepth], (ConstTanBoard) anBoardNew, anChangedNew, anMoves, fPartial))
+            SaveMoves(pml, pmh, nMoveDepth + 1, cPip + anRoll[nMoveDepth], anMoves, (ConstTanBoard) anBoardNew,
+                      NULL, anChangedNew, fPartial);
 
         return fPartial;
     } else {
@@ -2821,13 +4152,15 @@ GenerateMovesSub(movelist * pml, int anRoll[], int nMoveDepth,
 
                 memcpy(anBoardNew, anBoard, sizeof(anBoardNew));
 
+                SubMoveChanged(anBoard, i, anRoll[nMoveDepth], anChanged, anChangedNew);
                 ApplySubMove(anBoardNew, i, anRoll[nMoveDepth], TRUE);
 
-                if (GenerateMovesSub(pml, anRoll, nMoveDepth + 1,
+                if (GenerateMovesSub(pml, pmh, anRoll, nMoveDepth + 1,
                                      anRoll[0] == anRoll[1] ? i : 23,
-                                     cPip + anRoll[nMoveDepth], (ConstTanBoard) anBoardNew, anMoves, fPartial))
-                    SaveMoves(pml, nMoveDepth + 1, cPip +
-                              anRoll[nMoveDepth], anMoves, (ConstTanBoard) anBoardNew, fPartial);
+                                     cPip + anRoll[nMoveDepth], (ConstTanBoard) anBoardNew, anChangedNew, anMoves,
+                                     fPartial))
+                    SaveMoves(pml, pmh, nMoveDepth + 1, cPip +
+                              anRoll[nMoveDepth], anMoves, (ConstTanBoard) anBoardNew, NULL, anChangedNew, fPartial);
 
                 fUsed = 1;
             }
@@ -2836,6 +4169,164 @@ GenerateMovesSub(movelist * pml, int anRoll[], int nMoveDepth,
     return !fUsed || fPartial;
 }
 
+/* The board as GenerateMovesBits() plays on it: the chequer counts, which
+ * it changes in place and restores, and their position key and masks of
+ * the points (in the numbering of the player on roll) kept up to date
+ * with them. */
+
+typedef struct {
+    TanBoard anBoard;
+    positionkey key;
+    unsigned int nOcc;          /* points we have chequers on, bit 24 the bar */
+    unsigned int nBlocked;      /* points the opponent has made */
+    unsigned int nBlot;         /* points with an opponent blot */
+} moveboard;
+
+static void
+MoveBoardInit(moveboard * pmb, const TanBoard anBoard)
+{
+    int i;
+
+    memcpy(pmb->anBoard, anBoard, sizeof(TanBoard));
+    PositionKey(anBoard, &pmb->key);
+    pmb->nOcc = pmb->nBlocked = pmb->nBlot = 0;
+
+    for (i = 0; i < 25; i++)
+        pmb->nOcc |= (unsigned int) (anBoard[1][i] != 0) << i;
+
+    for (i = 0; i < 24; i++) {
+        pmb->nBlocked |= (unsigned int) (anBoard[0][23 - i] > 1) << i;
+        pmb->nBlot |= (unsigned int) (anBoard[0][23 - i] == 1) << i;
+    }
+}
+
+/* Adds n chequers to anBoard[iSide][iPoint], and to the nibble of the
+ * key PositionKey() packs it into */
+
+static inline void
+MoveBoardAdd(moveboard * pmb, const int iSide, const int iPoint, const int n)
+{
+    if (iPoint == 24)
+        pmb->key.data[6] += (unsigned int) n << (iSide ? 4 : 0);
+    else
+        pmb->key.data[(iSide ? 0 : 3) + iPoint / 8] += (unsigned int) n << (iPoint % 8 * 4);
+
+    pmb->anBoard[iSide][iPoint] += n;
+}
+
+/* Plays a legal chequer from iSrc to iDest (negative to bear off) and
+ * returns whether it hit, to be given to MoveBoardUndo() */
+
+static inline int
+MoveBoardApply(moveboard * pmb, const int iSrc, const int iDest)
+{
+    int fHit = FALSE;
+
+    MoveBoardAdd(pmb, 1, iSrc, -1);
+    if (!pmb->anBoard[1][iSrc])
+        pmb->nOcc &= ~(1u << iSrc);
+
+    if (iDest < 0)
+        return FALSE;
+
+    if (pmb->nBlot & (1u << iDest)) {
+        MoveBoardAdd(pmb, 0, 23 - iDest, -1);
+        MoveBoardAdd(pmb, 0, 24, 1);
+        pmb->nBlot &= ~(1u << iDest);
+        fHit = TRUE;
+    }
+
+    MoveBoardAdd(pmb, 1, iDest, 1);
+    pmb->nOcc |= 1u << iDest;
+
+    return fHit;
+}
+
+static inline void
+MoveBoardUndo(moveboard * pmb, const int iSrc, const int iDest, const int fHit)
+{
+    if (iDest >= 0) {
+        MoveBoardAdd(pmb, 1, iDest, -1);
+        if (!pmb->anBoard[1][iDest])
+            pmb->nOcc &= ~(1u << iDest);
+
+        if (fHit) {
+            MoveBoardAdd(pmb, 0, 23 - iDest, 1);
+            MoveBoardAdd(pmb, 0, 24, -1);
+            pmb->nBlot |= 1u << iDest;
+        }
+    }
+
+    MoveBoardAdd(pmb, 1, iSrc, 1);
+    pmb->nOcc |= 1u << iSrc;
+}
+
+/* GenerateMovesSub() on a moveboard: the same moves in the same order,
+ * but playing and taking back each chequer on the one board and finding
+ * the chequers and legal destinations from the masks */
+
+static int
+GenerateMovesBits(searchlist * pml, movehash * pmh, int anRoll[], int nMoveDepth,
+                  int iPip, int cPip, moveboard * pmb, const unsigned int anChanged[2], int anMoves[], int fPartial)
+{
+    int i, iDest, nRoll, fHit, fUsed = 0;
+    unsigned int nBits, anChangedNew[2];
+
+    if (nMoveDepth > 3 || !anRoll[nMoveDepth])
+        return TRUE;
+
+    nRoll = anRoll[nMoveDepth];
+
+    if (pmb->anBoard[1][24]) {  /* on bar */
+        if (pmb->nBlocked & (1u << (24 - nRoll)))
+            return TRUE;
+
+        anMoves[nMoveDepth * 2] = 24;
+        anMoves[nMoveDepth * 2 + 1] = 24 - nRoll;
+
+        SubMoveChanged((ConstTanBoard) pmb->anBoard, 24, nRoll, anChanged, anChangedNew);
+        fHit = MoveBoardApply(pmb, 24, 24 - nRoll);
+
+        if (GenerateMovesBits(pml, pmh, anRoll, nMoveDepth + 1, 23, cPip + nRoll, pmb, anChangedNew, anMoves,
+                              fPartial))
+            SaveMoves(pml, pmh, nMoveDepth + 1, cPip + nRoll, anMoves, (ConstTanBoard) pmb->anBoard, &pmb->key,
+                      anChangedNew, fPartial);
+
+        MoveBoardUndo(pmb, 24, 24 - nRoll, fHit);
+
+        return fPartial;
+    } else {
+        /* the rearmost chequer, for bearing off */
+        int const nBack = HighestBit(pmb->nOcc);
+
+        for (nBits = pmb->nOcc & ((2u << iPip) - 1); nBits; nBits &= ~(1u << i)) {
+            i = HighestBit(nBits);
+            iDest = i - nRoll;
+
+            if (iDest >= 0 ? (pmb->nBlocked & (1u << iDest)) != 0 : nBack > 5 || (i != nBack && iDest != -1))
+                continue;
+
+            anMoves[nMoveDepth * 2] = i;
+            anMoves[nMoveDepth * 2 + 1] = iDest;
+
+            SubMoveChanged((ConstTanBoard) pmb->anBoard, i, nRoll, anChanged, anChangedNew);
+            fHit = MoveBoardApply(pmb, i, iDest);
+
+            if (GenerateMovesBits(pml, pmh, anRoll, nMoveDepth + 1,
+                                  anRoll[0] == anRoll[1] ? i : 23, cPip + nRoll, pmb, anChangedNew, anMoves,
+                                  fPartial))
+                SaveMoves(pml, pmh, nMoveDepth + 1, cPip + nRoll, anMoves, (ConstTanBoard) pmb->anBoard,
+                          &pmb->key, anChangedNew, fPartial);
+
+            MoveBoardUndo(pmb, i, iDest, fHit);
+
+            fUsed = 1;
+        }
+    }
+
+    return !fUsed || fPartial;
+}
+
 extern int
 CompareMoves(const move * pm0, const move * pm1)
 {
@@ -2874,12 +4365,95 @@ CompareMovesGeneral(const move * pm0, const move * pm1)
     return (back[0] < back[1] ? 1 : -1);
 }
 
-extern int
-GenerateMoves(movelist * pml, const TanBoard anBoard, int n0, int n1, int fPartial)
+/* Each thread generates its move lists on a stack of searchmoves.
+ * GenerateSearchMoves() writes above the top of the stack, so a list stays
+ * valid until the next call unless it is pushed with MoveArenaPush(),
+ * after which nested searches generate above it until MoveArenaPop()
+ * releases it again.  This keeps the ply search free of heap
+ * allocations and copies.
+ *
+ * The stack is made of blocks allocated the first time they are used,
+ * each with room for a pushed list of at most MAX_MOVES moves and a
+ * generation of MAX_INCOMPLETE_MOVES above it.  Each ply of a search
+ * nests one more pushed list, and a search against the clock pushes a
+ * copy of its list as well, so a search of the deepest nPlies (7) needs
+ * at most MOVE_ARENA_BLOCKS blocks; move lists are usually short
+ * and share the first block, and a new block is only started when the
+ * one in use has no room for a whole generation. */
+
+#define MOVE_ARENA_BLOCKS 9
+#define MOVE_ARENA_BLOCK (MAX_MOVES + MAX_INCOMPLETE_MOVES)
+
+typedef struct {
+    searchmove *aam[MOVE_ARENA_BLOCKS];
+    unsigned int iBlock;
+    unsigned int iTop;
+} movearena;
+
+static movearena amaMoves[MAX_NUMTHREADS];
+
+#define MOVE_ARENA_MARK(pma) ((pma)->iBlock * MOVE_ARENA_BLOCK + (pma)->iTop)
+
+/* The room for a new list on the stack of this thread, or NULL if its
+ * searches are nested deeper than MOVE_ARENA_BLOCKS */
+
+extern searchmove *
+MoveArenaTop(void)
+{
+    movearena *pma = &amaMoves[MT_GetThreadID()];
+
+    if (pma->iTop + MAX_INCOMPLETE_MOVES > MOVE_ARENA_BLOCK) {
+        if (pma->iBlock + 1 >= MOVE_ARENA_BLOCKS)
+            return NULL;
+        pma->iBlock++;
+        pma->iTop = 0;
+    }
+
+    if (!pma->aam[pma->iBlock])
+        pma->aam[pma->iBlock] = g_new(searchmove, MOVE_ARENA_BLOCK);
+
+    return pma->aam[pma->iBlock] + pma->iTop;
+}
+
+/* Keep the moves of pml, which must be the last list generated, on the
+ * stack; returns the mark to pass to MoveArenaPop() */
+
+extern unsigned int
+MoveArenaPush(const searchlist * pml)
+{
+    movearena *pma = &amaMoves[MT_GetThreadID()];
+    unsigned int nMark = MOVE_ARENA_MARK(pma);
+
+    if (pml->cMoves) {
+        g_assert(pml->amMoves == pma->aam[pma->iBlock] + pma->iTop);
+        pma->iTop += pml->cMoves;
+    }
+
+    return nMark;
+}
+
+extern void
+MoveArenaPop(unsigned int nMark)
+{
+    movearena *pma = &amaMoves[MT_GetThreadID()];
+
+    g_assert(nMark <= MOVE_ARENA_MARK(pma));
+
+    pma->iBlock = nMark / MOVE_ARENA_BLOCK;
+    pma->iTop = nMark % MOVE_ARENA_BLOCK;
+}
+
+/* GenerateMoves() with the duplicates found with pmh, or by scanning the
+ * list if it is NULL, and the moves generated by GenerateMovesBits() or,
+ * if fBits is false, GenerateMovesSub() */
+
+static int
+GenerateMovesWith(searchlist * pml, movehash * pmh, int fBits, const TanBoard anBoard, int n0, int n1, int fPartial)
 {
 
     int anRoll[4], anMoves[8];
-    static move amMoves[MAX_NUMTHREADS][MAX_INCOMPLETE_MOVES];
+    unsigned int anChanged[2] = { 0, 0 };
+    moveboard mb;
 
     anRoll[0] = n0;
     anRoll[1] = n1;
@@ -2887,18 +4461,238 @@ GenerateMoves(movelist * pml, const TanBoard anBoard, int n0, int n1, int fParti
     anRoll[2] = anRoll[3] = ((n0 == n1) ? n0 : 0);
 
     pml->cMoves = pml->cMaxMoves = pml->cMaxPips = pml->iMoveBest = 0;
-    pml->amMoves = amMoves[MT_GetThreadID()];
-    GenerateMovesSub(pml, anRoll, 0, 23, 0, anBoard, anMoves, fPartial);
+    if (!(pml->amMoves = MoveArenaTop()))
+        return -1;
+    if (pmh)
+        MoveHashClear(pmh);
+    if (fBits) {
+        MoveBoardInit(&mb, anBoard);
+        GenerateMovesBits(pml, pmh, anRoll, 0, 23, 0, &mb, anChanged, anMoves, fPartial);
+    } else
+        GenerateMovesSub(pml, pmh, anRoll, 0, 23, 0, anBoard, anChanged, anMoves, fPartial);
 
     if (anRoll[0] != anRoll[1]) {
         swap(anRoll, anRoll + 1);
 
-        GenerateMovesSub(pml, anRoll, 0, 23, 0, anBoard, anMoves, fPartial);
+        if (fBits)
+            GenerateMovesBits(pml, pmh, anRoll, 0, 23, 0, &mb, anChanged, anMoves, fPartial);
+        else
+            GenerateMovesSub(pml, pmh, anRoll, 0, 23, 0, anBoard, anChanged, anMoves, fPartial);
     }
 
     return pml->cMoves;
 }
 
+/* The bitboard generator, which "perft" checks against the original one
+ * (GenerateMovesWith() with fBits FALSE) over random positions */
+
+extern int
+GenerateSearchMoves(searchlist * pml, const TanBoard anBoard, int n0, int n1, int fPartial)
+{
+    return GenerateMovesWith(pml, &amhMoves[MT_GetThreadID()], TRUE, anBoard, n0, n1, fPartial);
+}
+
+/* GenerateSearchMoves() for callers outside the search, which get moves
+ * without scores in a buffer of the thread; they stay valid until its
+ * next call */
+
+static void MoveFromSearch(move * pm, const searchmove * psm, const evalcontext * pec);
+
+static move *aamGenerated[MAX_NUMTHREADS];
+
+extern int
+GenerateMoves(movelist * pml, const TanBoard anBoard, int n0, int n1, int fPartial)
+{
+    int const iThread = MT_GetThreadID();
+    searchlist sl;
+    unsigned int i;
+
+    if (!aamGenerated[iThread])
+        aamGenerated[iThread] = g_new(move, MAX_INCOMPLETE_MOVES);
+
+    pml->amMoves = aamGenerated[iThread];
+
+    if (GenerateSearchMoves(&sl, anBoard, n0, n1, fPartial) < 0) {
+        pml->cMoves = pml->cMaxMoves = pml->cMaxPips = pml->iMoveBest = 0;
+        return -1;
+    }
+
+    pml->cMoves = sl.cMoves;
+    pml->cMaxMoves = sl.cMaxMoves;
+    pml->cMaxPips = sl.cMaxPips;
+    pml->iMoveBest = 0;
+
+    for (i = 0; i < sl.cMoves; i++)
+        MoveFromSearch(pml->amMoves + i, sl.amMoves + i, NULL);
+
+    return (int) sl.cMoves;
+}
+
+/* A random position with the cBar rearmost chequers of the player on
+ * roll on the bar */
+
+static void
+RandomMovePosition(TanBoard anBoard, randctx * prc, const unsigned int cBar)
+{
+    unsigned int i;
+
+    RandomPosition(anBoard, prc);
+
+    for (i = 0; i < cBar; i++) {
+        int k = 23;
+
+        while (!anBoard[1][k])
+            k--;
+
+        anBoard[1][k]--;
+        anBoard[1][24]++;
+    }
+}
+
+/* Whether the c moves am[] are those in pml, in the same order */
+
+static int
+SameMoves(const searchmove am[], const unsigned int c, const searchlist * pml)
+{
+    unsigned int i;
+
+    if (pml->cMoves != c)
+        return FALSE;
+
+    /* compare the moves up to their terminating -1 */
+    for (i = 0; i < c; i++)
+        if (am[i].cMoves != pml->amMoves[i].cMoves || am[i].cPips != pml->amMoves[i].cPips
+            || memcmp(am[i].anMove, pml->amMoves[i].anMove, MIN(2 * am[i].cMoves + 1, 8) * sizeof(int))
+            || !EqualKeys(am[i].key, pml->amMoves[i].key)
+            || am[i].anChanged[0] != pml->amMoves[i].anChanged[0]
+            || am[i].anChanged[1] != pml->amMoves[i].anChanged[1])
+            return FALSE;
+
+    return TRUE;
+}
+
+/* Time GenerateMoves() for every roll of cPositions random positions of
+ * the kind mgt, finding duplicates with the hash set and by scanning the
+ * list.  *prMoves receives the mean number of moves per roll, *prScan
+ * and *prHash the rolls per second of each, and *pcDiffer the number of
+ * rolls where the two move lists are not the same. */
+
+extern void
+EvalMoveGeneration(const movegentest mgt, const unsigned int cPositions, float *prMoves, float *prScan,
+                   float *prHash, unsigned int *pcDiffer)
+{
+    TanBoard *aanBoard = g_new(TanBoard, cPositions);
+    searchmove *amScan = g_new(searchmove, MAX_INCOMPLETE_MOVES);
+    movehash *pmh = &amhMoves[MT_GetThreadID()];
+    int const fPartial = mgt == MOVEGEN_PARTIAL;
+    searchlist ml;
+    randctx rcTest;
+    unsigned int i, cRolls = 0, cMoves = 0;
+    int n0, n1;
+    double t0, t1, t2;
+
+    memset(&rcTest, 0, sizeof(rcTest));
+    irandinit(&rcTest, TRUE);
+
+    for (i = 0; i < cPositions; i++)
+        RandomMovePosition(aanBoard[i], &rcTest, mgt == MOVEGEN_BAR ? 1 + i % 3 : 0);
+
+    t0 = get_time();
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = mgt == MOVEGEN_DOUBLES || fPartial ? n0 : 1; n1 <= n0; n1++)
+                GenerateMovesWith(&ml, NULL, TRUE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+    t1 = get_time();
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = mgt == MOVEGEN_DOUBLES || fPartial ? n0 : 1; n1 <= n0; n1++) {
+                cMoves += GenerateMovesWith(&ml, pmh, TRUE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+                cRolls++;
+            }
+    t2 = get_time();
+
+    *pcDiffer = 0;
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = mgt == MOVEGEN_DOUBLES || fPartial ? n0 : 1; n1 <= n0; n1++) {
+                unsigned int c = GenerateMovesWith(&ml, NULL, TRUE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+
+                memcpy(amScan, ml.amMoves, c * sizeof(searchmove));
+                GenerateMovesWith(&ml, pmh, TRUE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+
+                if (!SameMoves(amScan, c, &ml))
+                    ++*pcDiffer;
+            }
+
+    /* get_time() is in milliseconds */
+    *prMoves = cRolls ? (float) cMoves / cRolls : 0.0f;
+    *prScan = t1 > t0 ? (float) (cRolls * 1000.0 / (t1 - t0)) : 0.0f;
+    *prHash = t2 > t1 ? (float) (cRolls * 1000.0 / (t2 - t1)) : 0.0f;
+
+    g_free(amScan);
+    g_free(aanBoard);
+}
+
+/* Count the legal moves for all 21 rolls of cPositions random positions,
+ * a quarter of them with chequers on the bar, with the bitboard move
+ * generator and with the original one.  *pcMoves receives the number of
+ * moves, *pcDiffer the number of rolls where the two give different
+ * moves and *prSub and *prBits the moves per second of each. */
+
+extern void
+EvalPerft(const unsigned int cPositions, const int fPartial, unsigned long *pcMoves, unsigned int *pcDiffer,
+          float *prSub, float *prBits)
+{
+    TanBoard *aanBoard = g_new(TanBoard, cPositions);
+    searchmove *amSub = g_new(searchmove, MAX_INCOMPLETE_MOVES);
+    movehash *pmh = &amhMoves[MT_GetThreadID()];
+    searchlist ml;
+    randctx rcTest;
+    unsigned int i;
+    unsigned long cMoves = 0;
+    int n0, n1;
+    double t0, t1, t2;
+
+    memset(&rcTest, 0, sizeof(rcTest));
+    irandinit(&rcTest, TRUE);
+
+    for (i = 0; i < cPositions; i++)
+        RandomMovePosition(aanBoard[i], &rcTest, i % 4 == 3 ? 1 + (i / 4) % 3 : 0);
+
+    t0 = get_time();
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = 1; n1 <= n0; n1++)
+                GenerateMovesWith(&ml, pmh, FALSE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+    t1 = get_time();
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = 1; n1 <= n0; n1++)
+                cMoves += GenerateMovesWith(&ml, pmh, TRUE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+    t2 = get_time();
+
+    *pcDiffer = 0;
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = 1; n1 <= n0; n1++) {
+                unsigned int c = GenerateMovesWith(&ml, pmh, FALSE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+
+                memcpy(amSub, ml.amMoves, c * sizeof(searchmove));
+                GenerateMovesWith(&ml, pmh, TRUE, (ConstTanBoard) aanBoard[i], n0, n1, fPartial);
+
+                if (!SameMoves(amSub, c, &ml))
+                    ++*pcDiffer;
+            }
+
+    /* get_time() is in milliseconds */
+    *pcMoves = cMoves;
+    *prSub = t1 > t0 ? (float) (cMoves * 1000.0 / (t1 - t0)) : 0.0f;
+    *prBits = t2 > t1 ? (float) (cMoves * 1000.0 / (t2 - t1)) : 0.0f;
+
+    g_free(amSub);
+    g_free(aanBoard);
+}
+
 
 extern float
 KleinmanCount(int nPipOnRoll, int nPipNotOnRoll)
@@ -3151,17 +4945,198 @@ GetCubeRecommendation(const cubedecision cd)
     }
 }
 
+/* A digest of everything the evaluations kept in the cache file depend
+ * on besides their key: the weights of the nets and the precision they
+ * are used in, the bearoff databases found and the match equity table */
+
+static void
+EvalFingerprint(unsigned char auchFingerprint[16])
+{
+    struct md5_ctx mc;
+    unsigned int i;
+    int af[6];
+
+    md5_init_ctx(&mc);
+
+    for (i = 0; i < G_N_ELEMENTS(apnnWeights); i++) {
+        const neuralnet *pnn = apnnWeights[i];
+        size_t const cWeights = (size_t) pnn->cHidden * pnn->cInput;
+
+        md5_process_bytes(&pnn->cInput, 3 * sizeof(unsigned int), &mc);
+        md5_process_bytes(&pnn->rBetaHidden, sizeof(float), &mc);
+        md5_process_bytes(&pnn->rBetaOutput, sizeof(float), &mc);
+        if (pnn->arHiddenWeight)
+            md5_process_bytes(pnn->arHiddenWeight, cWeights * sizeof(float), &mc);
+        if (pnn->arOutputWeight)
+            md5_process_bytes(pnn->arOutputWeight, pnn->cOutput * pnn->cHidden * sizeof(float), &mc);
+        if (pnn->arHiddenThreshold)
+            md5_process_bytes(pnn->arHiddenThreshold, pnn->cHidden * sizeof(float), &mc);
+        if (pnn->arOutputThreshold)
+            md5_process_bytes(pnn->arOutputThreshold, pnn->cOutput * sizeof(float), &mc);
+    }
+
+    af[0] = NeuralNetGetQuantised();
+    af[1] = NeuralNetGetHalf();
+    af[2] = pbc1 != NULL;
+    af[3] = pbc2 != NULL;
+    af[4] = pbcOS != NULL;
+    af[5] = pbcTS != NULL;
+    md5_process_bytes(af, sizeof(af), &mc);
+
+    md5_process_bytes(aafMET, sizeof(aafMET), &mc);
+    md5_process_bytes(aafMETPostCrawford, sizeof(aafMETPostCrawford), &mc);
+
+    md5_finish_ctx(&mc, auchFingerprint);
+}
+
+/* The cache file is used only while its fingerprint is the one of the
+ * evaluator */
+
+static void
+EvalCacheFileCheck(void)
+{
+    unsigned char auch[16];
+
+    if (!cfEval.pcf)
+        return;
+
+    EvalFingerprint(auch);
+    fCacheFile = !memcmp(auch, CacheFileFingerprint(&cfEval), sizeof(auch));
+}
+
+extern void
+EvalCacheFlush(void)
+{
+    unsigned char auch[16];
+
+    /* a shared cache stays as the other processes filled it, as long
+     * as it is for the current evaluator */
+    if (cEval.pcf) {
+        EvalFingerprint(auch);
+        if (memcmp(auch, CacheFileFingerprint(&cEval), sizeof(auch)))
+            EvalCacheUnshare();
+    } else
+        CacheFlush(&cEval);
+
+    EvalCacheFileCheck();
+}
+
+void
+CommandClearCache(char *UNUSED(sz))
+{
+    EvalCacheFlush();
+    EvalCacheStatsReset();
+}
+
+/* Replace cEval by the shared memory segment szName of the processes
+ * evaluating with the same fingerprint, see CacheSharedOpen() */
+
+extern int
+EvalCacheShare(const char *szName)
+{
+    unsigned char auch[16];
+    evalCache c;
+    int n;
+
+    EvalFingerprint(auch);
+    if ((n = CacheSharedOpen(&c, szName, cCache, auch)) < 0)
+        return n;
+
+    if (cEval.pcf)
+        CacheFileClose(&cEval);
+    else
+        CacheDestroy(&cEval);
+    cEval = c;
+    MT_SetSharedCache(TRUE);
+
+    return n;
+}
+
+/* Go back to a cEval of this process */
+
+extern int
+EvalCacheUnshare(void)
+{
+    if (!cEval.pcf)
+        return 0;
+
+    CacheFileClose(&cEval);
+    MT_SetSharedCache(FALSE);
+
+    return CacheCreate(&cEval, cCache);
+}
+
+extern const char *
+EvalCacheSharedName(void)
+{
+    return cEval.pcf ? CacheFileName(&cEval) : NULL;
+}
+
+/* Keep the evaluations of CACHE_FILE_MIN_PLIES or more in szFile as
+ * well as in cEval; see CacheFileOpen() for cEntries.  Returns the
+ * number of entries kept, -1 on error, or -2 if another process has
+ * the file open. */
+
+extern int
+EvalCacheFileOpen(const char *szFile, unsigned int cEntries)
+{
+    unsigned char auch[16];
+    int n;
+
+    EvalCacheFileClose();
+
+    EvalFingerprint(auch);
+    if ((n = CacheFileOpen(&cfEval, szFile, cEntries, auch)) >= 0)
+        fCacheFile = TRUE;
+
+    return n;
+}
+
+extern void
+EvalCacheFileClose(void)
+{
+    fCacheFile = FALSE;
+    CacheFileClose(&cfEval);
+}
+
+/* Remove the entries of the cache file and use it for the current
+ * evaluator */
 
 extern void
-EvalCacheFlush(void)
+EvalCacheFileClear(void)
 {
-    CacheFlush(&cEval);
+    unsigned char auch[16];
+
+    if (!cfEval.pcf)
+        return;
+
+    EvalFingerprint(auch);
+    CacheFileClear(&cfEval, auch);
+    fCacheFile = TRUE;
 }
 
-void
-CommandClearCache(char *UNUSED(sz))
+/* The name of the cache file, or NULL if there is none; *pfValid is
+ * set if it is used by the current evaluator */
+
+extern const char *
+EvalCacheFileName(int *pfValid)
 {
-    EvalCacheFlush();
+    if (pfValid)
+        *pfValid = fCacheFile;
+
+    return cfEval.pcf ? CacheFileName(&cfEval) : NULL;
+}
+
+extern void
+CommandClearCacheFile(char *UNUSED(sz))
+{
+    if (!EvalCacheFileName(NULL)) {
+        outputl(_("There is no cache file (see `set cachefile')."));
+        return;
+    }
+
+    EvalCacheFileClear();
+    outputf(_("The entries of the cache file %s have been removed.\n"), EvalCacheFileName(NULL));
 }
 
 extern double
@@ -3200,21 +5175,77 @@ GetCacheMB(int size)
     if (size <= 0)
         return 0;
     else
-        return (1<<(size + 15)) * sizeof(cacheNode) / (1024 * 1024);
+        return (1<<(size + 16)) / CACHE_WAYS * sizeof(cacheNode) / (1024 * 1024);
 }
 
 extern int
 EvalCacheResize(unsigned int cNew)
 {
-    cCache = CacheResize(&cEval, cNew);
+    /* the size of a shared cache is the one it was created with */
+    if (cEval.pcf)
+        cCache = cNew;
+    else
+        cCache = CacheResize(&cEval, cNew);
     return cCache;
 }
 
+/* Allocate cEval and cpEval again, as CacheSetAllocation() or
+ * CacheSetSequenceLock() now ask; returns what cEval got
+ * (CACHE_ALLOC_*) or -1 on error */
+
 extern int
-EvalCacheStats(unsigned int *pcUsed, unsigned int *pcLookup, unsigned int *pcHit)
+EvalCacheReallocate(void)
 {
-    CacheStats(&cEval, pcLookup, pcHit, pcUsed);
-    return 0;
+    if (!cEval.pcf) {
+        CacheDestroy(&cEval);
+        if (CacheCreate(&cEval, cCache))
+            return -1;
+    }
+
+    CacheDestroy(&cpEval);
+    if (CacheCreate(&cpEval, 0x1 << 16))
+        return -1;
+
+    return (int) cEval.fAlloc;
+}
+
+extern unsigned int
+EvalCacheAllocation(void)
+{
+    return cEval.fAlloc;
+}
+
+/* The counts of all threads since the last EvalCacheStatsReset(), with
+ * the sizes of the caches and the entries in use */
+
+extern void
+EvalCacheStats(cachecounts * pcc, unsigned int acSize[N_EVAL_CACHES], unsigned int acUsed[N_EVAL_CACHES])
+{
+    unsigned int i, j, k, n, iThread;
+
+    memset(pcc, 0, sizeof(cachecounts));
+    for (iThread = 0; iThread < MAX_NUMTHREADS; iThread++)
+        for (i = 0; i < N_EVAL_CACHES; i++)
+            for (j = 0; j < CACHE_PLIES; j++)
+                for (k = 0; k < N_CLASSES; k++)
+                    for (n = 0; n < N_CACHE_COUNTS; n++)
+                        pcc->aaaac[i][j][k][n] += acCacheCounts[iThread].aaaac[i][j][k][n];
+
+    acSize[EVAL_CACHE_EVAL] = cEval.size;
+    acUsed[EVAL_CACHE_EVAL] = CacheUsed(&cEval);
+    acSize[EVAL_CACHE_PRUNE] = cpEval.size;
+    acUsed[EVAL_CACHE_PRUNE] = CacheUsed(&cpEval);
+    /* kept in cEval */
+    acSize[EVAL_CACHE_CUBEFUL] = 0;
+    acUsed[EVAL_CACHE_CUBEFUL] = 0;
+    acSize[EVAL_CACHE_FILE] = cfEval.size;
+    acUsed[EVAL_CACHE_FILE] = cfEval.pcf ? CacheUsed(&cfEval) : 0;
+}
+
+extern void
+EvalCacheStatsReset(void)
+{
+    memset(acCacheCounts, 0, sizeof(acCacheCounts));
 }
 
 extern int
@@ -4334,6 +6365,15 @@ cmp_evalcontext(const evalcontext * pec1, const evalcontext * pec2)
     else if (pec1->fCubeful > pec2->fCubeful)
         return +1;
 
+    /* Time limit: a shorter one may stop shallower, none never does */
+
+    if (pec1->rTimeLimit != pec2->rTimeLimit) {
+        if (pec1->rTimeLimit > 0.0f && (pec2->rTimeLimit == 0.0f || pec1->rTimeLimit < pec2->rTimeLimit))
+            return -1;
+        else
+            return +1;
+    }
+
     /* Noise  */
 
     if (pec1->rNoise > pec2->rNoise)
@@ -4357,6 +6397,29 @@ cmp_evalcontext(const evalcontext * pec1, const evalcontext * pec2)
             return -1;
         else if (nPrune1 < nPrune2)
             return +1;
+
+        if (pec1->fUsePrune) {
+            if (pec1->nCascade < pec2->nCascade)
+                return -1;
+            else if (pec1->nCascade > pec2->nCascade)
+                return +1;
+
+            if (pec1->rPruneThreshold < pec2->rPruneThreshold)
+                return -1;
+            else if (pec1->rPruneThreshold > pec2->rPruneThreshold)
+                return +1;
+
+            if (pec1->rPruneThreshold > 0.0f) {
+                if (pec1->nPruneMin < pec2->nPruneMin)
+                    return -1;
+                else if (pec1->nPruneMin > pec2->nPruneMin)
+                    return +1;
+                if (pec1->nPruneMax < pec2->nPruneMax)
+                    return -1;
+                else if (pec1->nPruneMax > pec2->nPruneMax)
+                    return +1;
+            }
+        }
     }
 
     return 0;
@@ -4431,22 +6494,216 @@ getCurrentGammonRates(float aarRates[2][2],
                       float arOutput[], const TanBoard anBoard, cubeinfo * pci, const evalcontext * pec)
 {
 
-    if (EvaluatePosition(NULL, anBoard, arOutput, pci, pec) < 0)
-        return -1;
+    if (EvaluatePosition(NULL, anBoard, arOutput, pci, pec) < 0)
+        return -1;
+
+    calculate_gammon_rates(aarRates, arOutput, pci);
+
+    return 0;
+
+}
+
+/*
+ * Get take, double, beaver, etc points for money game using
+ * Rick Janowski's formulae:
+ *   http://www.bkgm.com/articles/Janowski/cubeformulae.pdf
+ *
+ * Input:
+ *   fJacoby, fBeavers: flags for different flavours of money game
+ *   aarRates: gammon and backgammon rates (first index is player)
+ *
+ * Output:
+ *   aaarPoints: the points
+ *
+ */
+
+extern void
+getMoneyPoints(float aaarPoints[2][7][2], const int fJacoby, const int fBeavers, float aarRates[2][2])
+{
+
+    float arCLV[2];             /* average cubeless value of games won */
+    float rW, rL;
+    int i;
+
+    /* calculate average cubeless value of games won */
+
+    for (i = 0; i < 2; i++)
+        arCLV[i] = 1.0f + aarRates[i][0] + 2.0f * aarRates[i][1];
+
+    /* calculate points */
+
+    for (i = 0; i < 2; i++) {
+
+        /* Determine rW and rL from Rick's formulae */
+
+        rW = arCLV[i];
+        rL = arCLV[!i];
+
+        /* Determine points */
+
+        /* take point */
+
+        aaarPoints[i][0][0] = (rL - 0.5f) / (rW + rL);
+        aaarPoints[i][0][1] = (rL - 0.5f) / (rW + rL + 0.5f);
+
+        /* beaver point */
+
+        aaarPoints[i][1][0] = rL / (rW + rL);
+        aaarPoints[i][1][1] = rL / (rW + rL + 0.5f);
+
+        /* raccoon point */
+
+        aaarPoints[i][2][0] = rL / (rW + rL);
+        aaarPoints[i][2][1] = (rL + 0.5f) / (rW + rL + 0.5f);
+
+        /* initial double point */
+
+        if (!fJacoby) {
+            /* without Jacoby */
+            aaarPoints[i][3][0] = rL / (rW + rL);
+        } else {
+            /* with Jacoby */
+
+            if (fBeavers)
+                /* with beavers */
+                aaarPoints[i][3][0] = (rL - 0.25f) / (rL + rW - 0.5f);
+            else
+                /* without beavers */
+                aaarPoints[i][3][0] = (rL - 0.5f) / (rL + rW - 1.0f);
+
+        }
+        aaarPoints[i][3][1] = (rL + 1.0f) / (rL + rW + 0.5f);
+
+        /* redouble point */
+        aaarPoints[i][4][0] = rL / (rW + rL);
+        aaarPoints[i][4][1] = (rL + 1.0f) / (rL + rW + 0.5f);
+
+        /* cash point */
+
+        aaarPoints[i][5][0] = (rL + 0.5f) / (rW + rL);
+        aaarPoints[i][5][1] = (rL + 1.0f) / (rW + rL + 0.5f);
+
+        /* too good point */
+
+        aaarPoints[i][6][0] = (rL + 1.0f) / (rW + rL);
+        aaarPoints[i][6][1] = (rL + 1.0f) / (rW + rL + 0.5f);
+
+    }
+
+}
+
+extern void
+GetECF3(float arCubeful[], int cci, float arCf[], cubeinfo aci[])
+{
+
+    int i, ici;
+    float rND, rDT, rDP;
+
+    for (ici = 0, i = 0; ici < cci; ici++, i += 2) {
+
+        if (aci[i + 1].nCube > 0) {
+
+            /* cube available */
+
+            rND = arCf[i];
+
+            if (aci[0].nMatchTo)
+                rDT = arCf[i + 1];
+            else
+                rDT = 2.0f * arCf[i + 1];
+
+            GetDPEq(NULL, &rDP, &aci[i]);
+
+            if (rDT >= rND && rDP >= rND) {
+
+                /* double */
+
+                if (rDT >= rDP)
+                    /* pass */
+                    arCubeful[ici] = rDP;
+                else
+                    /* take */
+                    arCubeful[ici] = rDT;
+
+            } else {
+
+                /* no double */
+
+                arCubeful[ici] = rND;
+
+            }
+
+
+        } else {
+
+            /* no cube available: always no double */
+
+            arCubeful[ici] = arCf[i];
+
+        }
+
+    }
+
+}
+
+
+extern void
+MakeCubePos(const cubeinfo aciCubePos[], const int cci, const int fTop, cubeinfo aci[], const int fInvert)
+{
+    int i, ici;
+
+    for (ici = 0, i = 0; ici < cci; ici++) {
+
+        /* no double */
+
+        if (aciCubePos[ici].nCube > 0) {
+
+            SetCubeInfo(&aci[i],
+                        aciCubePos[ici].nCube,
+                        aciCubePos[ici].fCubeOwner,
+                        fInvert ?
+                        !aciCubePos[ici].fMove : aciCubePos[ici].fMove,
+                        aciCubePos[ici].nMatchTo,
+                        aciCubePos[ici].anScore,
+                        aciCubePos[ici].fCrawford,
+                        aciCubePos[ici].fJacoby, aciCubePos[ici].fBeavers, aciCubePos[ici].bgv);
+
+        } else {
+
+            aci[i].nCube = -1;
+
+        }
+
+        i++;
+
+        if (!fTop && aciCubePos[ici].nCube > 0 && GetDPEq(NULL, NULL, &aciCubePos[ici]))
+            /* we may double */
+            SetCubeInfo(&aci[i],
+                        2 * aciCubePos[ici].nCube,
+                        !aciCubePos[ici].fMove,
+                        fInvert ?
+                        !aciCubePos[ici].fMove : aciCubePos[ici].fMove,
+                        aciCubePos[ici].nMatchTo,
+                        aciCubePos[ici].anScore,
+                        aciCubePos[ici].fCrawford,
+                        aciCubePos[ici].fJacoby, aciCubePos[ici].fBeavers, aciCubePos[ici].bgv);
+        else
+            /* mark cube position as unavailable */
+            aci[i].nCube = -1;
+
+        i++;
 
-    calculate_gammon_rates(aarRates, arOutput, pci);
 
-    return 0;
+    }                           /* loop cci */
 
 }
 
+
 /*
- * Get take, double, beaver, etc points for money game using
- * Rick Janowski's formulae:
- *   http://www.bkgm.com/articles/Janowski/cubeformulae.pdf
+ * Get take, double, take, and too good points for match play.
  *
  * Input:
- *   fJacoby, fBeavers: flags for different flavours of money game
+ *   pci: cubeinfo 
  *   aarRates: gammon and backgammon rates (first index is player)
  *
  * Output:
@@ -4455,1006 +6712,1395 @@ getCurrentGammonRates(float aarRates[2][2],
  */
 
 extern void
-getMoneyPoints(float aaarPoints[2][7][2], const int fJacoby, const int fBeavers, float aarRates[2][2])
+getMatchPoints(float aaarPoints[2][4][2],
+               int afAutoRedouble[2], int afDead[2], const cubeinfo * pci, float aarRates[2][2])
 {
 
-    float arCLV[2];             /* average cubeless value of games won */
-    float rW, rL;
-    int i;
+    float arOutput[NUM_OUTPUTS];
+    float arDP1[2], arDP2[2], arCP1[2], arCP2[2], arTG[2];
+    float rDTW, rDTL, rNDW, rNDL, rDP, rRisk, rGain;
 
-    /* calculate average cubeless value of games won */
+    int i, anNormScore[2];
 
     for (i = 0; i < 2; i++)
-        arCLV[i] = 1.0f + aarRates[i][0] + 2.0f * aarRates[i][1];
+        anNormScore[i] = pci->nMatchTo - pci->anScore[i];
 
-    /* calculate points */
+    /* get cash points */
+
+    arOutput[OUTPUT_WIN] = 0.5f;
+    arOutput[OUTPUT_WINGAMMON] = 0.5f * (aarRates[0][0] + aarRates[0][1]);
+    arOutput[OUTPUT_WINBACKGAMMON] = 0.5f * aarRates[0][1];
+    arOutput[OUTPUT_LOSEGAMMON] = 0.5f * (aarRates[1][0] + aarRates[1][1]);
+    arOutput[OUTPUT_LOSEBACKGAMMON] = 0.5f * aarRates[1][1];
+
+    GetPoints(arOutput, pci, arCP2);
 
     for (i = 0; i < 2; i++) {
 
-        /* Determine rW and rL from Rick's formulae */
+        afAutoRedouble[i] = (anNormScore[i] - 2 * pci->nCube <= 0) && (anNormScore[!i] - 2 * pci->nCube > 0);
 
-        rW = arCLV[i];
-        rL = arCLV[!i];
+        afDead[i] = (anNormScore[!i] - 2 * pci->nCube <= 0);
 
-        /* Determine points */
+        /* MWC for "double, take; win" */
 
-        /* take point */
+        rDTW =
+            (1.0f - aarRates[i][0] - aarRates[i][1]) *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  2 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[i][0] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  4 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[i][1] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  6 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
 
-        aaarPoints[i][0][0] = (rL - 0.5f) / (rW + rL);
-        aaarPoints[i][0][1] = (rL - 0.5f) / (rW + rL + 0.5f);
+        /* MWC for "no double, take; win" */
 
-        /* beaver point */
+        rNDW =
+            (1.0f - aarRates[i][0] - aarRates[i][1]) *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[i][0] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  2 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[i][1] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  3 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
 
-        aaarPoints[i][1][0] = rL / (rW + rL);
-        aaarPoints[i][1][1] = rL / (rW + rL + 0.5f);
+        /* MWC for "Double, take; lose" */
 
-        /* raccoon point */
+        rDTL =
+            (1.0f - aarRates[!i][0] - aarRates[!i][1]) *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  2 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[!i][0] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  4 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[!i][1] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  6 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford);
 
-        aaarPoints[i][2][0] = rL / (rW + rL);
-        aaarPoints[i][2][1] = (rL + 0.5f) / (rW + rL + 0.5f);
+        /* MWC for "No double; lose" */
 
-        /* initial double point */
+        rNDL =
+            (1.0f - aarRates[!i][0] - aarRates[!i][1]) *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  1 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[!i][0] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  2 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
+            + aarRates[!i][1] *
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  3 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford);
 
-        if (!fJacoby) {
-            /* without Jacoby */
-            aaarPoints[i][3][0] = rL / (rW + rL);
-        } else {
-            /* with Jacoby */
+        /* MWC for "Double, pass" */
 
-            if (fBeavers)
-                /* with beavers */
-                aaarPoints[i][3][0] = (rL - 0.25f) / (rL + rW - 0.5f);
-            else
-                /* without beavers */
-                aaarPoints[i][3][0] = (rL - 0.5f) / (rL + rW - 1.0f);
+        rDP =
+            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                  pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
+
+        /* Double point */
+
+        rRisk = rNDL - rDTL;
+        rGain = rDTW - rNDW;
+
+        arDP1[i] = rRisk / (rRisk + rGain);
+        arDP2[i] = arDP1[i];
+
+        /* Dead cube take point without redouble */
+
+        rRisk = rDTW - rDP;
+        rGain = rDP - rDTL;
+
+        arCP1[i] = 1.0f - rRisk / (rRisk + rGain);
+
+        /* find too good point */
+
+        rRisk = rNDW - rNDL;
+        rGain = rNDW - rDP;
+
+        arTG[i] = rRisk / (rRisk + rGain);
+
+        if (afAutoRedouble[i]) {
+
+            /* With redouble */
+
+            rDTW =
+                (1.0f - aarRates[i][0] - aarRates[i][1]) *
+                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                      4 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
+                + aarRates[i][0] *
+                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                      8 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
+                + aarRates[i][1] *
+                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                      12 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
+
+            rDTL =
+                (1.0f - aarRates[!i][0] - aarRates[!i][1]) *
+                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                      4 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
+                + aarRates[!i][0] *
+                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                      8 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
+                + aarRates[!i][1] *
+                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
+                      12 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford);
+
+            rRisk = rDTW - rDP;
+            rGain = rDP - rDTL;
+
+            arCP2[i] = 1.0f - rRisk / (rRisk + rGain);
+
+            /* Double point */
+
+            rRisk = rNDL - rDTL;
+            rGain = rDTW - rNDW;
+
+            arDP2[i] = rRisk / (rRisk + rGain);
 
         }
-        aaarPoints[i][3][1] = (rL + 1.0f) / (rL + rW + 0.5f);
 
-        /* redouble point */
-        aaarPoints[i][4][0] = rL / (rW + rL);
-        aaarPoints[i][4][1] = (rL + 1.0f) / (rL + rW + 0.5f);
+    }
+
+    /* save points */
+
+    for (i = 0; i < 2; i++) {
+
+        /* take point */
+
+        aaarPoints[i][0][0] = 1.0f - arCP1[!i];
+        aaarPoints[i][0][1] = 1.0f - arCP2[!i];
+
+        /* double point */
+
+        aaarPoints[i][1][0] = arDP1[i];
+        aaarPoints[i][1][1] = arDP2[i];
 
         /* cash point */
 
-        aaarPoints[i][5][0] = (rL + 0.5f) / (rW + rL);
-        aaarPoints[i][5][1] = (rL + 1.0f) / (rW + rL + 0.5f);
+        aaarPoints[i][2][0] = arCP1[i];
+        aaarPoints[i][2][1] = arCP2[i];
 
         /* too good point */
 
-        aaarPoints[i][6][0] = (rL + 1.0f) / (rW + rL);
-        aaarPoints[i][6][1] = (rL + 1.0f) / (rW + rL + 0.5f);
+        aaarPoints[i][3][0] = arTG[i];
+
+        if (!afDead[i])
+            aaarPoints[i][3][1] = arCP2[i];
 
     }
 
 }
 
 extern void
-GetECF3(float arCubeful[], int cci, float arCf[], cubeinfo aci[])
+getCubeDecisionOrdering(int aiOrder[3],
+                        float arDouble[4], float aarOutput[2][NUM_ROLLOUT_OUTPUTS], const cubeinfo * pci)
 {
 
-    int i, ici;
-    float rND, rDT, rDP;
+    cubedecision cd;
 
-    for (ici = 0, i = 0; ici < cci; ici++, i += 2) {
+    /* Get cube decision */
 
-        if (aci[i + 1].nCube > 0) {
+    cd = FindBestCubeDecision(arDouble, aarOutput, pci);
 
-            /* cube available */
+    switch (cd) {
 
-            rND = arCf[i];
+    case DOUBLE_TAKE:
+    case DOUBLE_BEAVER:
+    case REDOUBLE_TAKE:
 
-            if (aci[0].nMatchTo)
-                rDT = arCf[i + 1];
-            else
-                rDT = 2.0f * arCf[i + 1];
+        /*
+         * Optimal     : Double, take
+         * Best for me : Double, pass
+         * Worst for me: No Double 
+         */
 
-            GetDPEq(NULL, &rDP, &aci[i]);
+        aiOrder[0] = OUTPUT_TAKE;
+        aiOrder[1] = OUTPUT_DROP;
+        aiOrder[2] = OUTPUT_NODOUBLE;
 
-            if (rDT >= rND && rDP >= rND) {
+        break;
 
-                /* double */
+    case DOUBLE_PASS:
+    case REDOUBLE_PASS:
 
-                if (rDT >= rDP)
-                    /* pass */
-                    arCubeful[ici] = rDP;
-                else
-                    /* take */
-                    arCubeful[ici] = rDT;
+        /*
+         * Optimal     : Double, pass
+         * Best for me : Double, take
+         * Worst for me: no double 
+         */
+        aiOrder[0] = OUTPUT_DROP;
+        aiOrder[1] = OUTPUT_TAKE;
+        aiOrder[2] = OUTPUT_NODOUBLE;
+
+        break;
+
+    case NODOUBLE_TAKE:
+    case NODOUBLE_BEAVER:
+    case TOOGOOD_TAKE:
+    case NO_REDOUBLE_TAKE:
+    case NO_REDOUBLE_BEAVER:
+    case TOOGOODRE_TAKE:
+    case NODOUBLE_DEADCUBE:
+    case NO_REDOUBLE_DEADCUBE:
+    case OPTIONAL_DOUBLE_BEAVER:
+    case OPTIONAL_DOUBLE_TAKE:
+    case OPTIONAL_REDOUBLE_TAKE:
 
-            } else {
+        /*
+         * Optimal     : no double
+         * Best for me : double, pass
+         * Worst for me: double, take
+         */
 
-                /* no double */
+        aiOrder[0] = OUTPUT_NODOUBLE;
+        aiOrder[1] = OUTPUT_DROP;
+        aiOrder[2] = OUTPUT_TAKE;
 
-                arCubeful[ici] = rND;
+        break;
 
-            }
+    case TOOGOOD_PASS:
+    case TOOGOODRE_PASS:
+    case OPTIONAL_DOUBLE_PASS:
+    case OPTIONAL_REDOUBLE_PASS:
 
+        /*
+         * Optimal     : no double
+         * Best for me : double, take
+         * Worst for me: double, pass
+         */
 
-        } else {
+        aiOrder[0] = OUTPUT_NODOUBLE;
+        aiOrder[1] = OUTPUT_TAKE;
+        aiOrder[2] = OUTPUT_DROP;
 
-            /* no cube available: always no double */
+        break;
 
-            arCubeful[ici] = arCf[i];
+    default:
 
-        }
+        g_assert_not_reached();
 
     }
 
 }
 
 
-extern void
-MakeCubePos(const cubeinfo aciCubePos[], const int cci, const int fTop, cubeinfo aci[], const int fInvert)
-{
-    int i, ici;
 
-    for (ici = 0, i = 0; ici < cci; ici++) {
+extern float
+getPercent(const cubedecision cd, const float arDouble[])
+{
 
-        /* no double */
+    switch (cd) {
 
-        if (aciCubePos[ici].nCube > 0) {
+    case DOUBLE_TAKE:
+    case DOUBLE_BEAVER:
+    case DOUBLE_PASS:
+    case REDOUBLE_TAKE:
+    case REDOUBLE_PASS:
+    case NODOUBLE_DEADCUBE:
+    case NO_REDOUBLE_DEADCUBE:
+    case OPTIONAL_DOUBLE_BEAVER:
+    case OPTIONAL_DOUBLE_TAKE:
+    case OPTIONAL_REDOUBLE_TAKE:
+    case OPTIONAL_DOUBLE_PASS:
+    case OPTIONAL_REDOUBLE_PASS:
+        /* correct cube action */
+        return -1.0f;
 
-            SetCubeInfo(&aci[i],
-                        aciCubePos[ici].nCube,
-                        aciCubePos[ici].fCubeOwner,
-                        fInvert ?
-                        !aciCubePos[ici].fMove : aciCubePos[ici].fMove,
-                        aciCubePos[ici].nMatchTo,
-                        aciCubePos[ici].anScore,
-                        aciCubePos[ici].fCrawford,
-                        aciCubePos[ici].fJacoby, aciCubePos[ici].fBeavers, aciCubePos[ici].bgv);
+    case TOOGOODRE_TAKE:
+    case TOOGOOD_TAKE:
+        /* never correct to double */
+        return -1.0f;
 
-        } else {
+    case NODOUBLE_TAKE:
+    case NODOUBLE_BEAVER:
+    case NO_REDOUBLE_TAKE:
+    case NO_REDOUBLE_BEAVER:
 
-            aci[i].nCube = -1;
+        /* how many doubles should be dropped before it is correct to double */
 
-        }
+        return (arDouble[OUTPUT_NODOUBLE] - arDouble[OUTPUT_TAKE]) / (arDouble[OUTPUT_DROP] - arDouble[OUTPUT_TAKE]);
 
-        i++;
+    case TOOGOOD_PASS:
+    case TOOGOODRE_PASS:
 
-        if (!fTop && aciCubePos[ici].nCube > 0 && GetDPEq(NULL, NULL, &aciCubePos[ici]))
-            /* we may double */
-            SetCubeInfo(&aci[i],
-                        2 * aciCubePos[ici].nCube,
-                        !aciCubePos[ici].fMove,
-                        fInvert ?
-                        !aciCubePos[ici].fMove : aciCubePos[ici].fMove,
-                        aciCubePos[ici].nMatchTo,
-                        aciCubePos[ici].anScore,
-                        aciCubePos[ici].fCrawford,
-                        aciCubePos[ici].fJacoby, aciCubePos[ici].fBeavers, aciCubePos[ici].bgv);
+        /* how many doubles should be taken before it is correct to double */
+        if (arDouble[OUTPUT_NODOUBLE] > arDouble[OUTPUT_TAKE])
+            /* strange match play scenario 
+             * (see 3-ply eval on cAmgACAAGAAA/4HPkAUgzW8EBMA):
+             * never correct to double! */
+            return -1.0f;
         else
-            /* mark cube position as unavailable */
-            aci[i].nCube = -1;
+            return
+                (arDouble[OUTPUT_NODOUBLE] - arDouble[OUTPUT_DROP]) / (arDouble[OUTPUT_TAKE] - arDouble[OUTPUT_DROP]);
 
-        i++;
+    default:
 
+        g_assert_not_reached();
 
-    }                           /* loop cci */
+    }
 
+    return -1.0f;
 }
 
 
 /*
- * Get take, double, take, and too good points for match play.
+ * Resort movelist and recalculate best score.
  *
  * Input:
- *   pci: cubeinfo 
- *   aarRates: gammon and backgammon rates (first index is player)
+ *   pml: movelist
  *
  * Output:
- *   aaarPoints: the points
+ *   pml: update movelist
+ *   ai : the new ordering. Caller must allocate ai.
+ *
+ * FIXME: the construction of the ai-array is *very* ugly.
+ *        We should probably write a substitute for qsort that
+ *        updates ai on the fly.
  *
  */
 
 extern void
-getMatchPoints(float aaarPoints[2][4][2],
-               int afAutoRedouble[2], int afDead[2], const cubeinfo * pci, float aarRates[2][2])
+RefreshMoveList(movelist * pml, int *ai)
 {
 
-    float arOutput[NUM_OUTPUTS];
-    float arDP1[2], arDP2[2], arCP1[2], arCP2[2], arTG[2];
-    float rDTW, rDTL, rNDW, rNDL, rDP, rRisk, rGain;
+    unsigned int i, j;
+    movelist ml;
 
-    int i, anNormScore[2];
+    if (!pml->cMoves)
+        return;
 
-    for (i = 0; i < 2; i++)
-        anNormScore[i] = pci->nMatchTo - pci->anScore[i];
+    if (ai)
+        CopyMoveList(&ml, pml);
 
-    /* get cash points */
+    qsort(pml->amMoves, pml->cMoves, sizeof(move), (cfunc) CompareMovesGeneral);
 
-    arOutput[OUTPUT_WIN] = 0.5f;
-    arOutput[OUTPUT_WINGAMMON] = 0.5f * (aarRates[0][0] + aarRates[0][1]);
-    arOutput[OUTPUT_WINBACKGAMMON] = 0.5f * aarRates[0][1];
-    arOutput[OUTPUT_LOSEGAMMON] = 0.5f * (aarRates[1][0] + aarRates[1][1]);
-    arOutput[OUTPUT_LOSEBACKGAMMON] = 0.5f * aarRates[1][1];
+    pml->rBestScore = pml->amMoves[0].rScore;
 
-    GetPoints(arOutput, pci, arCP2);
+    if (ai) {
+        for (i = 0; i < pml->cMoves; i++) {
 
-    for (i = 0; i < 2; i++) {
+            for (j = 0; j < pml->cMoves; j++) {
 
-        afAutoRedouble[i] = (anNormScore[i] - 2 * pci->nCube <= 0) && (anNormScore[!i] - 2 * pci->nCube > 0);
+                if (!memcmp(ml.amMoves[j].anMove, pml->amMoves[i].anMove, 8 * sizeof(int)))
+                    ai[j] = i;
 
-        afDead[i] = (anNormScore[!i] - 2 * pci->nCube <= 0);
+            }
+        }
 
-        /* MWC for "double, take; win" */
+        free(ml.amMoves);
 
-        rDTW =
-            (1.0f - aarRates[i][0] - aarRates[i][1]) *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  2 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[i][0] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  4 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[i][1] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  6 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
+    }
 
-        /* MWC for "no double, take; win" */
 
-        rNDW =
-            (1.0f - aarRates[i][0] - aarRates[i][1]) *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[i][0] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  2 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[i][1] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  3 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
+}
 
-        /* MWC for "Double, take; lose" */
 
-        rDTL =
-            (1.0f - aarRates[!i][0] - aarRates[!i][1]) *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  2 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[!i][0] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  4 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[!i][1] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  6 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford);
+extern void
+CopyMoveList(movelist * pmlDest, const movelist * pmlSrc)
+{
 
-        /* MWC for "No double; lose" */
+    if (pmlDest == pmlSrc)
+        return;
 
-        rNDL =
-            (1.0f - aarRates[!i][0] - aarRates[!i][1]) *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  1 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[!i][0] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  2 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
-            + aarRates[!i][1] *
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  3 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford);
+    pmlDest->cMoves = pmlSrc->cMoves;
+    pmlDest->cMaxMoves = pmlSrc->cMaxMoves;
+    pmlDest->cMaxPips = pmlSrc->cMaxPips;
+    pmlDest->iMoveBest = pmlSrc->iMoveBest;
+    pmlDest->rBestScore = pmlSrc->rBestScore;
 
-        /* MWC for "Double, pass" */
+    if (pmlSrc->cMoves) {
+        pmlDest->amMoves = (move *) malloc(pmlSrc->cMoves * sizeof(move));
+        memcpy(pmlDest->amMoves, pmlSrc->amMoves, pmlSrc->cMoves * sizeof(move));
+    } else
+        pmlDest->amMoves = NULL;
+
+}
+
+
+
+/*
+ * is this a close cubedecision?
+ *
+ * Input:
+ *   arDouble: equities for cube decisions
+ *
+ */
+
+extern int
+isCloseCubedecision(const float arDouble[])
+{
+    const float rThr = 0.16f;
+    float rDouble;
+    rDouble = MIN(arDouble[OUTPUT_TAKE], 1.0f);
+
+    /* Report if doubling is less than very bad (0.16) */
+    if (arDouble[OUTPUT_OPTIMAL] - rDouble < rThr)
+        return 1;
+
+    return 0;
+
+}
 
-        rDP =
-            getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                  pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
 
-        /* Double point */
+/*
+ * is this a missed double?
+ *
+ * Input:
+ *   arDouble: equities for cube decisions
+ *   fDouble: did the player double
+ *   pci: cubeinfo
+ *
+ */
 
-        rRisk = rNDL - rDTL;
-        rGain = rDTW - rNDW;
+extern int
+isMissedDouble(float arDouble[], float aarOutput[2][NUM_ROLLOUT_OUTPUTS], const int fDouble, const cubeinfo * pci)
+{
 
-        arDP1[i] = rRisk / (rRisk + rGain);
-        arDP2[i] = arDP1[i];
+    cubedecision cd = FindBestCubeDecision(arDouble, aarOutput, pci);
 
-        /* Dead cube take point without redouble */
+    switch (cd) {
 
-        rRisk = rDTW - rDP;
-        rGain = rDP - rDTL;
+    case DOUBLE_TAKE:
+    case DOUBLE_PASS:
+    case DOUBLE_BEAVER:
+    case REDOUBLE_TAKE:
+    case REDOUBLE_PASS:
 
-        arCP1[i] = 1.0f - rRisk / (rRisk + rGain);
+        return !fDouble;
 
-        /* find too good point */
+    default:
 
-        rRisk = rNDW - rNDL;
-        rGain = rNDW - rDP;
+        return 0;
 
-        arTG[i] = rRisk / (rRisk + rGain);
+    }
 
-        if (afAutoRedouble[i]) {
+}
 
-            /* With redouble */
 
-            rDTW =
-                (1.0f - aarRates[i][0] - aarRates[i][1]) *
-                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                      4 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
-                + aarRates[i][0] *
-                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                      8 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford)
-                + aarRates[i][1] *
-                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                      12 * pci->nCube, i, pci->fCrawford, aafMET, aafMETPostCrawford);
 
-            rDTL =
-                (1.0f - aarRates[!i][0] - aarRates[!i][1]) *
-                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                      4 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
-                + aarRates[!i][0] *
-                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                      8 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford)
-                + aarRates[!i][1] *
-                getME(pci->anScore[0], pci->anScore[1], pci->nMatchTo, i,
-                      12 * pci->nCube, !i, pci->fCrawford, aafMET, aafMETPostCrawford);
+extern unsigned int
+locateMove(const TanBoard anBoard, const int anMove[8], const movelist * pml)
+{
 
-            rRisk = rDTW - rDP;
-            rGain = rDP - rDTL;
+    unsigned int i;
+    positionkey key1, key2;
 
-            arCP2[i] = 1.0f - rRisk / (rRisk + rGain);
+    MoveKey(anBoard, anMove, &key1);
 
-            /* Double point */
+    for (i = 0; i < pml->cMoves; ++i) {
 
-            rRisk = rNDL - rDTL;
-            rGain = rDTW - rNDW;
+        MoveKey(anBoard, pml->amMoves[i].anMove, &key2);
 
-            arDP2[i] = rRisk / (rRisk + rGain);
+        if (EqualKeys(key2, key1))
+            return i;
 
-        }
 
     }
 
-    /* save points */
+    return 0;
 
-    for (i = 0; i < 2; i++) {
+}
 
-        /* take point */
 
-        aaarPoints[i][0][0] = 1.0f - arCP1[!i];
-        aaarPoints[i][0][1] = 1.0f - arCP2[!i];
+extern int
+MoveKey(const TanBoard anBoard, const int anMove[8], positionkey * pkey)
+{
 
-        /* double point */
+    TanBoard anBoardMove;
 
-        aaarPoints[i][1][0] = arDP1[i];
-        aaarPoints[i][1][1] = arDP2[i];
+    memcpy(anBoardMove, anBoard, sizeof(anBoardMove));
+    ApplyMove(anBoardMove, anMove, FALSE);
+    PositionKey((ConstTanBoard) anBoardMove, pkey);
 
-        /* cash point */
+    return 0;
 
-        aaarPoints[i][2][0] = arCP1[i];
-        aaarPoints[i][2][1] = arCP2[i];
+}
 
-        /* too good point */
 
-        aaarPoints[i][3][0] = arTG[i];
+extern int
+equal_movefilter(const int i, movefilter amf1[MAX_FILTER_PLIES], movefilter amf2[MAX_FILTER_PLIES])
+{
 
-        if (!afDead[i])
-            aaarPoints[i][3][1] = arCP2[i];
+    int j;
+
+    for (j = 0; j <= i; ++j) {
+        if (amf1[j].Accept != amf2[j].Accept)
+            return 0;
+        if (amf1[j].Accept < 0)
+            continue;
+        if (amf1[j].Extra != amf2[j].Extra)
+            return 0;
+        if (!amf1[j].Extra)
+            continue;
+        if (amf1[j].Threshold != amf2[j].Threshold)
+            return 0;
 
     }
 
+    return 1;
+
 }
 
-extern void
-getCubeDecisionOrdering(int aiOrder[3],
-                        float arDouble[4], float aarOutput[2][NUM_ROLLOUT_OUTPUTS], const cubeinfo * pci)
+
+extern int
+equal_movefilters(movefilter aamf1[MAX_FILTER_PLIES][MAX_FILTER_PLIES],
+                  movefilter aamf2[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
 {
 
-    cubedecision cd;
+    int i;
 
-    /* Get cube decision */
+    for (i = 0; i < MAX_FILTER_PLIES; ++i)
+        if (!equal_movefilter(i, aamf1[i], aamf2[i]))
+            return 0;
 
-    cd = FindBestCubeDecision(arDouble, aarOutput, pci);
+    return 1;
 
-    switch (cd) {
+}
 
-    case DOUBLE_TAKE:
-    case DOUBLE_BEAVER:
-    case REDOUBLE_TAKE:
 
-        /*
-         * Optimal     : Double, take
-         * Best for me : Double, pass
-         * Worst for me: No Double 
-         */
+/*
+ * Categorise double into normal, beaver, or raccoon.
+ * 
+ * The function is called before ApplyMoveRecord:
+ *
+ * fDoubled = FALSE:
+ *
+ *    the previous moverecord was not a MOVE_DOUBLE,
+ *    hence this is a normal double.
+ *
+ * fDoubled = TRUE:
+ *
+ *    The previous moverecord was a MOVE_DOUBLE
+ *    so it's either a beaver or a raccoon
+ *
+ *    Beaver: fTurn != fMove (the previous doubler was the player on roll
+ *                            so the redouble must be a beaver)
+ *    Raccoon: fTurn == fMove and/or fCubeOwner != fMove
+ *
+ *
+ */
 
-        aiOrder[0] = OUTPUT_TAKE;
-        aiOrder[1] = OUTPUT_DROP;
-        aiOrder[2] = OUTPUT_NODOUBLE;
+extern doubletype
+DoubleType(const int fDoubled, const int fMove, const int fTurn)
+{
 
-        break;
+    if (fDoubled) {
 
-    case DOUBLE_PASS:
-    case REDOUBLE_PASS:
+        /* beaver or raccoon */
 
-        /*
-         * Optimal     : Double, pass
-         * Best for me : Double, take
-         * Worst for me: no double 
-         */
-        aiOrder[0] = OUTPUT_DROP;
-        aiOrder[1] = OUTPUT_TAKE;
-        aiOrder[2] = OUTPUT_NODOUBLE;
+        if (fTurn != fMove)
+            /* beaver */
+            return DT_BEAVER;
+        else
+            /* raccoon */
+            return DT_RACCOON;
 
-        break;
+    }
+    return DT_NORMAL;
+}
 
-    case NODOUBLE_TAKE:
-    case NODOUBLE_BEAVER:
-    case TOOGOOD_TAKE:
-    case NO_REDOUBLE_TAKE:
-    case NO_REDOUBLE_BEAVER:
-    case TOOGOODRE_TAKE:
-    case NODOUBLE_DEADCUBE:
-    case NO_REDOUBLE_DEADCUBE:
-    case OPTIONAL_DOUBLE_BEAVER:
-    case OPTIONAL_DOUBLE_TAKE:
-    case OPTIONAL_REDOUBLE_TAKE:
+#else
 
-        /*
-         * Optimal     : no double
-         * Best for me : double, pass
-         * Worst for me: double, take
-         */
+#define FindnSaveBestMoves FindnSaveBestMovesWithLocking
+#define FindBestMove FindBestMoveWithLocking
+#define EvaluatePosition EvaluatePositionWithLocking
+#define ScoreMove ScoreMoveWithLocking
+#define GeneralCubeDecisionE GeneralCubeDecisionEWithLocking
+#define GeneralEvaluationE GeneralEvaluationEWithLocking
+#define EvaluatePositionCache EvaluatePositionCacheWithLocking
+#define FindBestMovePlied FindBestMovePliedWithLocking
+#define GeneralEvaluationEPlied GeneralEvaluationEPliedWithLocking
+#define EvaluatePositionCubeful3 EvaluatePositionCubeful3WithLocking
+#define ScoreMoves ScoreMovesWithLocking
+#define FindBestMoveInEval FindBestMoveInEvalWithLocking
+#define GeneralEvaluationEPliedCubeful GeneralEvaluationEPliedCubefulWithLocking
+#define EvaluatePositionCubeful4 EvaluatePositionCubeful4WithLocking
+#define CacheAdd CacheAddWithLocking
+#define CacheLookup CacheLookupWithLocking
 
-        aiOrder[0] = OUTPUT_NODOUBLE;
-        aiOrder[1] = OUTPUT_DROP;
-        aiOrder[2] = OUTPUT_TAKE;
+static int EvaluatePositionCache(NNState * nnStates, const TanBoard anBoard, float arOutput[],
+                                 const cubeinfo * pci, const evalcontext * pecx, int nPlies, positionclass pc);
+
+static int FindBestMovePlied(int anMove[8], int nDice0, int nDice1,
+                             TanBoard anBoard, const cubeinfo * pci,
+                             const evalcontext * pec, int nPlies, movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES]);
+
+extern neuralnet nnpContact, nnpRace, nnpCrashed;
+extern evalCache cEval;
+extern evalCache cpEval;
+extern evalCache cfEval;
+extern int fCacheFile;
+extern cachecounts acCacheCounts[MAX_NUMTHREADS];
+extern classevalfunc acef[N_CLASSES];
+extern unsigned int cCache;
+extern evalcontext ecBasic;
+NNState nnStatesStorage[MAX_NUMTHREADS][3];
+#endif
+
+static int GeneralEvaluationEPlied(NNState * nnStates, float arOutput[NUM_ROLLOUT_OUTPUTS],
+                                   const TanBoard anBoard, const cubeinfo * pci, const evalcontext * pec, int nPlies);
+static int EvaluatePositionCubeful3(NNState * nnStates, const TanBoard anBoard, float arOutput[NUM_OUTPUTS],
+                                    float arCubeful[], const cubeinfo aciCubePos[], int cci, const cubeinfo * pciMove,
+                                    const evalcontext * pec, int nPlies, int fTop);
 
-        break;
+/* Functions that have both locking and non-locking versions below here */
 
-    case TOOGOOD_PASS:
-    case TOOGOODRE_PASS:
-    case OPTIONAL_DOUBLE_PASS:
-    case OPTIONAL_REDOUBLE_PASS:
+static int ScoreMoves(searchlist * pml, const cubeinfo * pci, const evalcontext * pec, int nPlies);
 
-        /*
-         * Optimal     : no double
-         * Best for me : double, take
-         * Worst for me: double, pass
-         */
+/* Fill in the move handed out for psm, with the evaluation setup of its
+ * scores (pec with the plies psm was scored at) if pec is not NULL */
 
-        aiOrder[0] = OUTPUT_NODOUBLE;
-        aiOrder[1] = OUTPUT_TAKE;
-        aiOrder[2] = OUTPUT_DROP;
+static void
+MoveFromSearch(move * pm, const searchmove * psm, const evalcontext * pec)
+{
+    memcpy(pm->anMove, psm->anMove, sizeof(pm->anMove));
+    CopyKey(psm->key, pm->key);
+    pm->cMoves = psm->cMoves;
+    pm->cPips = psm->cPips;
+    pm->rScore = psm->rScore;
+    pm->rScore2 = psm->rScore2;
+    memcpy(pm->arEvalMove, psm->arEvalMove, sizeof(pm->arEvalMove));
+    pm->anChanged[0] = psm->anChanged[0];
+    pm->anChanged[1] = psm->anChanged[1];
+    pm->cmark = CMARK_NONE;
 
-        break;
+    if (pec) {
+        memset(pm->arEvalStdDev, 0, sizeof(pm->arEvalStdDev));
+        pm->esMove.et = EVAL_EVAL;
+        pm->esMove.ec = *pec;
+        pm->esMove.ec.nPlies = psm->nPlies;
+    } else
+        pm->esMove.et = EVAL_NONE;
+}
 
+static evalCache *
+EvalCacheOf(const evalcacheid ic)
+{
+    switch (ic) {
+    case EVAL_CACHE_PRUNE:
+        return &cpEval;
+    case EVAL_CACHE_CUBEFUL:
+        /* under keys of their own, so that the cache keeps the memory
+         * "set cache" gives it */
+        return &cEval;
+    case EVAL_CACHE_FILE:
+        return &cfEval;
     default:
+        return &cEval;
+    }
+}
 
-        g_assert_not_reached();
+/* CacheLookup() and CacheAdd() on one of the caches, counted in the
+ * counts of the thread under the ply and class of the position */
 
-    }
+static uint32_t
+CacheLookupCounted(const evalcacheid ic, const int nPlies, const positionclass pc,
+                   const evalcache * pec, float *arOut, float *arCubeful)
+{
+    unsigned long *ac = acCacheCounts[MT_GetThreadID()].aaaac[ic][nPlies][pc];
+    uint32_t const l = CacheLookup(EvalCacheOf(ic), pec, arOut, arCubeful);
+
+    ++ac[CACHE_LOOKUPS];
+    if (l == CACHEHIT)
+        ++ac[CACHE_HITS];
 
+    return l;
 }
 
+static void
+CacheAddCounted(const evalcacheid ic, const int nPlies, const positionclass pc, const evalcache * pec, uint32_t l)
+{
+    unsigned long *ac = acCacheCounts[MT_GetThreadID()].aaaac[ic][nPlies][pc];
+    int const n = CacheAdd(EvalCacheOf(ic), pec, l, nPlies);
 
+    if (n >= 0) {
+        ++ac[CACHE_ADDS];
+        ac[CACHE_EVICTIONS] += (unsigned long) n;
+    }
+}
 
-extern float
-getPercent(const cubedecision cd, const float arDouble[])
+/* Look up an evaluation or cubeful equity in cEval and, if it is deep
+ * enough to be kept there, in the cache file; what is found in the file
+ * is added to the cache */
+
+static uint32_t
+EvalCacheLookup(const evalcacheid ic, const int nPlies, const positionclass pc, const evalcache * pec,
+                float *arOut, float *arCubeful)
 {
+    uint32_t const l = CacheLookupCounted(ic, nPlies, pc, pec, arOut, arCubeful);
+    evalcache ec;
 
-    switch (cd) {
+    if (l == CACHEHIT || !fCacheFile || nPlies < CACHE_FILE_MIN_PLIES
+        || CacheLookupCounted(EVAL_CACHE_FILE, nPlies, pc, pec, arOut, arCubeful) != CACHEHIT)
+        return l;
 
-    case DOUBLE_TAKE:
-    case DOUBLE_BEAVER:
-    case DOUBLE_PASS:
-    case REDOUBLE_TAKE:
-    case REDOUBLE_PASS:
-    case NODOUBLE_DEADCUBE:
-    case NO_REDOUBLE_DEADCUBE:
-    case OPTIONAL_DOUBLE_BEAVER:
-    case OPTIONAL_DOUBLE_TAKE:
-    case OPTIONAL_REDOUBLE_TAKE:
-    case OPTIONAL_DOUBLE_PASS:
-    case OPTIONAL_REDOUBLE_PASS:
-        /* correct cube action */
-        return -1.0f;
+    ec = *pec;
+    memcpy(ec.ar, arOut, sizeof(float) * NUM_OUTPUTS);
+    ec.ar[5] = arCubeful ? *arCubeful : 0.f;
+    CacheAddCounted(ic, nPlies, pc, &ec, l);
 
-    case TOOGOODRE_TAKE:
-    case TOOGOOD_TAKE:
-        /* never correct to double */
-        return -1.0f;
+    return CACHEHIT;
+}
 
-    case NODOUBLE_TAKE:
-    case NODOUBLE_BEAVER:
-    case NO_REDOUBLE_TAKE:
-    case NO_REDOUBLE_BEAVER:
+/* Add an evaluation or cubeful equity to cEval, at l from
+ * EvalCacheLookup(), and to the cache file if it is deep enough */
 
-        /* how many doubles should be dropped before it is correct to double */
+static void
+EvalCacheAdd(const evalcacheid ic, const int nPlies, const positionclass pc, const evalcache * pec, uint32_t l)
+{
+    CacheAddCounted(ic, nPlies, pc, pec, l);
 
-        return (arDouble[OUTPUT_NODOUBLE] - arDouble[OUTPUT_TAKE]) / (arDouble[OUTPUT_DROP] - arDouble[OUTPUT_TAKE]);
+    if (fCacheFile && nPlies >= CACHE_FILE_MIN_PLIES)
+        CacheAddCounted(EVAL_CACHE_FILE, nPlies, pc, pec, GetHashKey(cfEval.hashMask, pec));
+}
 
-    case TOOGOOD_PASS:
-    case TOOGOODRE_PASS:
+/* Neural net evaluations waiting to be done together by EvaluateNetBatch() */
 
-        /* how many doubles should be taken before it is correct to double */
-        if (arDouble[OUTPUT_NODOUBLE] > arDouble[OUTPUT_TAKE])
-            /* strange match play scenario 
-             * (see 3-ply eval on cAmgACAAGAAA/4HPkAUgzW8EBMA):
-             * never correct to double! */
-            return -1.0f;
-        else
-            return
-                (arDouble[OUTPUT_NODOUBLE] - arDouble[OUTPUT_DROP]) / (arDouble[OUTPUT_TAKE] - arDouble[OUTPUT_DROP]);
+#define EVAL_BATCH_SIZE (4 * NN_BATCH_BLOCK)
 
-    default:
+typedef struct _evalbatch {
+    unsigned int c;
+    TanBoard aanBoard[EVAL_BATCH_SIZE];
+    evalcache aec[EVAL_BATCH_SIZE];
+    uint32_t al[EVAL_BATCH_SIZE];
+    float *apr[EVAL_BATCH_SIZE];        /* where to copy the outputs, or NULL */
+} evalbatch;
 
-        g_assert_not_reached();
+static void
+FlushEvalBatch(evalbatch * peb, const positionclass pc, const int fPrune, const bgvariation bgv)
+{
+    float aarOutput[EVAL_BATCH_SIZE][NUM_OUTPUTS];
+    unsigned int i;
+
+    if (!peb->c)
+        return;
+
+    EvaluateNetBatch(pc, fPrune, peb->c, peb->aanBoard, aarOutput, bgv);
 
+    for (i = 0; i < peb->c; i++) {
+        memcpy(peb->aec[i].ar, aarOutput[i], sizeof(float) * NUM_OUTPUTS);
+        peb->aec[i].ar[5] = 0.f;
+        CacheAddCounted(fPrune ? EVAL_CACHE_PRUNE : EVAL_CACHE_EVAL, 0, pc, &peb->aec[i], peb->al[i]);
+        if (peb->apr[i])
+            memcpy(peb->apr[i], aarOutput[i], sizeof(float) * NUM_OUTPUTS);
     }
 
-    return -1.0f;
+    peb->c = 0;
 }
 
+/* Evaluate the moves in pml with the nets of cascade stage pcs, batching
+ * the cache misses, and move the best acKeep[] of them to the front of
+ * the list.  Returns FALSE, leaving the list as it was, if the moves lead
+ * to positions of different classes or of a class below CLASS_RACE. */
 
-/*
- * Resort movelist and recalculate best score.
- *
- * Input:
- *   pml: movelist
- *
- * Output:
- *   pml: update movelist
- *   ai : the new ordering. Caller must allocate ai.
- *
- * FIXME: the construction of the ai-array is *very* ugly.
- *        We should probably write a substitute for qsort that
- *        updates ai on the fly.
- *
- */
+static int
+CascadeStage(searchlist * pml, const cascadestage * pcs, const cubeinfo * pci, const evalcontext * pecPrune)
+{
+    evalcacheid const ic = pcs->fPrune ? EVAL_CACHE_PRUNE : EVAL_CACHE_EVAL;
+    unsigned int bmovesi[MAX_CASCADE_KEEP];
+    unsigned int i, cKeep, cMin;
+    positionclass evalClass;
+    uint64_t nEvalContext;
+    TanBoard anBoard;
+    evalbatch eb;
+
+    PositionFromKey(anBoard, &pml->amMoves[0].key);
+    SwapSides(anBoard);
+    evalClass = ClassifyPosition((ConstTanBoard) anBoard, VARIATION_STANDARD);
+    if (evalClass < CLASS_RACE)
+        return FALSE;
 
-extern void
-RefreshMoveList(movelist * pml, int *ai)
-{
+    cKeep = MIN(pcs->acKeep[evalClass - CLASS_RACE], MAX_CASCADE_KEEP);
+    cMin = cKeep;
 
-    unsigned int i, j;
-    movelist ml;
+    if (pecPrune->rPruneThreshold > 0.0f) {
+        if (pecPrune->nPruneMax)
+            cKeep = MIN(pecPrune->nPruneMax, MAX_CASCADE_KEEP);
+        cMin = MIN(MAX(pecPrune->nPruneMin, 1), cKeep);
+    }
 
-    if (!pml->cMoves)
-        return;
+    if (pml->cMoves <= cMin)
+        return TRUE;
 
-    if (ai)
-        CopyMoveList(&ml, pml);
+    ((cubeinfo *) pci)->fMove = !pci->fMove;
 
-    qsort(pml->amMoves, pml->cMoves, sizeof(move), (cfunc) CompareMovesGeneral);
+    /* The pruning nets have a cache of their own; the full nets share
+     * the 0-ply cubeless entries with EvaluatePositionCache(). */
+    nEvalContext = pcs->fPrune ? 0 : EvalKey(&ecBasic, 0, pci, FALSE);
 
-    pml->rBestScore = pml->amMoves[0].rScore;
+    /* The outputs are kept in arEvalMove until the moves are scored. */
 
-    if (ai) {
-        for (i = 0; i < pml->cMoves; i++) {
+    eb.c = 0;
 
-            for (j = 0; j < pml->cMoves; j++) {
+    for (i = 0; i < pml->cMoves; i++) {
+        evalcache *pec = &eb.aec[eb.c];
+        /* declared volatile to avoid wrong compiler optimization
+         * on some gcc systems. Remove with great care. */
+        searchmove *const volatile pm = &pml->amMoves[i];
 
-                if (!memcmp(ml.amMoves[j].anMove, pml->amMoves[i].anMove, 8 * sizeof(int)))
-                    ai[j] = i;
+        PositionFromKey(anBoard, &pm->key);
+        SwapSides(anBoard);
 
-            }
+        if (ClassifyPosition((ConstTanBoard) anBoard, VARIATION_STANDARD) != evalClass)
+            break;
+
+        CopyKey(pm->key, pec->key);
+        pec->nEvalContext = nEvalContext;
+        if ((eb.al[eb.c] = CacheLookupCounted(ic, 0, evalClass, pec, pm->arEvalMove, NULL)) != CACHEHIT) {
+            memcpy(eb.aanBoard[eb.c], anBoard, sizeof(TanBoard));
+            eb.apr[eb.c] = pm->arEvalMove;
+            if (++eb.c == EVAL_BATCH_SIZE)
+                FlushEvalBatch(&eb, evalClass, pcs->fPrune, VARIATION_STANDARD);
         }
+    }
 
-        free(ml.amMoves);
+    if (i == pml->cMoves) {
+        FlushEvalBatch(&eb, evalClass, pcs->fPrune, VARIATION_STANDARD);
 
+        for (i = 0; i < pml->cMoves; i++) {
+            searchmove *const pm = &pml->amMoves[i];
+
+            pm->rScore = UtilityME(pm->arEvalMove, pci);
+            if (i < cKeep) {
+                bmovesi[i] = i;
+                if (pm->rScore > pml->amMoves[bmovesi[0]].rScore) {
+                    bmovesi[i] = bmovesi[0];
+                    bmovesi[0] = i;
+                }
+            } else if (pm->rScore < pml->amMoves[bmovesi[0]].rScore) {
+                unsigned int m = 0, k;
+                bmovesi[0] = i;
+                for (k = 1; k < cKeep; ++k) {
+                    if (pml->amMoves[bmovesi[k]].rScore > pml->amMoves[bmovesi[m]].rScore) {
+                        m = k;
+                    }
+                }
+                bmovesi[0] = bmovesi[m];
+                bmovesi[m] = i;
+            }
+        }
     }
 
+    ((cubeinfo *) pci)->fMove = !pci->fMove;
 
-}
+    if (i < pml->cMoves)
+        return FALSE;
 
+    cKeep = MIN(cKeep, pml->cMoves);
 
-extern void
-CopyMoveList(movelist * pmlDest, const movelist * pmlSrc)
-{
+    if (cMin < cKeep) {
+        /* keep the candidates close to the best (which has the lowest
+         * score, from the opponent's side) */
+        unsigned int j, k;
 
-    if (pmlDest == pmlSrc)
-        return;
+        for (j = 1; j < cKeep; j++)
+            for (k = j; k > 0 && pml->amMoves[bmovesi[k]].rScore < pml->amMoves[bmovesi[k - 1]].rScore; k--) {
+                unsigned int t = bmovesi[k];
+                bmovesi[k] = bmovesi[k - 1];
+                bmovesi[k - 1] = t;
+            }
 
-    pmlDest->cMoves = pmlSrc->cMoves;
-    pmlDest->cMaxMoves = pmlSrc->cMaxMoves;
-    pmlDest->cMaxPips = pmlSrc->cMaxPips;
-    pmlDest->iMoveBest = pmlSrc->iMoveBest;
-    pmlDest->rBestScore = pmlSrc->rBestScore;
+        for (j = cMin; j < cKeep; j++)
+            if (pml->amMoves[bmovesi[j]].rScore > pml->amMoves[bmovesi[0]].rScore + pecPrune->rPruneThreshold)
+                break;
 
-    if (pmlSrc->cMoves) {
-        pmlDest->amMoves = (move *) malloc(pmlSrc->cMoves * sizeof(move));
-        memcpy(pmlDest->amMoves, pmlSrc->amMoves, pmlSrc->cMoves * sizeof(move));
-    } else
-        pmlDest->amMoves = NULL;
+        cKeep = j;
+    }
 
-}
+    {
+        searchmove amMoves[MAX_CASCADE_KEEP];
 
+        for (i = 0; i < cKeep; i++)
+            memcpy(&amMoves[i], &pml->amMoves[bmovesi[i]], sizeof(amMoves[0]));
+        memcpy(&pml->amMoves[0], amMoves, cKeep * sizeof(amMoves[0]));
+        pml->cMoves = cKeep;
+    }
 
+    return TRUE;
+}
 
-/*
- * is this a close cubedecision?
- *
- * Input:
- *   arDouble: equities for cube decisions
- *
- */
+/* Find the best move with the cascade of pec, the full net candidates
+ * being scored by ScoreMoves() (incrementally, with the NNStates of the
+ * thread) */
 
-extern int
-isCloseCubedecision(const float arDouble[])
+static void
+FindBestMoveInEval(int const nDice0, int const nDice1, const TanBoard anBoardIn,
+                   TanBoard anBoardOut, const cubeinfo * const pci, const evalcontext * pec)
 {
-    const float rThr = 0.16f;
-    float rDouble;
-    rDouble = MIN(arDouble[OUTPUT_TAKE], 1.0f);
+    const netcascade *pnc = NetCascade(pec);
+    unsigned int i;
+    searchlist ml;
 
-    /* Report if doubling is less than very bad (0.16) */
-    if (arDouble[OUTPUT_OPTIMAL] - rDouble < rThr)
-        return 1;
+    GenerateSearchMoves(&ml, anBoardIn, nDice0, nDice1, FALSE);
 
-    return 0;
+    if (ml.cMoves == 0) {
+        /* no legal moves */
+        return;
+    }
 
-}
+    if (ml.cMoves == 1) {
+        /* forced move */
+        ml.iMoveBest = 0;
+        PositionFromKey(anBoardOut, &ml.amMoves[ml.iMoveBest].key);
+        return;
+    }
 
+    /* Each stage narrows the candidates for the next one; if a stage
+     * can't be used the full net scores whatever is left.  The adaptive
+     * limits of pec apply to the last stage. */
+    for (i = 0; i < pnc->cStages; i++)
+        if (!CascadeStage(&ml, &pnc->acs[i], pci, i + 1 < pnc->cStages ? &ecBasic : pec))
+            break;
 
-/*
- * is this a missed double?
- *
- * Input:
- *   arDouble: equities for cube decisions
- *   fDouble: did the player double
- *   pci: cubeinfo
- *
- */
+    ScoreMoves(&ml, pci, pec, 0);
+    PositionFromKey(anBoardOut, &ml.amMoves[ml.iMoveBest].key);
+}
 
-extern int
-isMissedDouble(float arDouble[], float aarOutput[2][NUM_ROLLOUT_OUTPUTS], const int fDouble, const cubeinfo * pci)
-{
+#if !LOCKING_VERSION
+/* Compare the pruning of pecPrune (its cascade and adaptive limits) with
+ * the full net alone at choosing a move, for all 21 rolls in each of
+ * cPositions random positions that are the same on every call.  *prAgree receives the percentage of the moves on
+ * which the two agree, *prLoss the mean cubeless equity (by the full
+ * net) lost by the cascade's choices and *prSpeed the moves chosen per
+ * second by the cascade relative to the full net.  Both run with empty
+ * caches, so the evaluation caches are left empty: copying them aside
+ * would cost more memory than the report is worth, and they refill in
+ * a few moves. */
 
-    cubedecision cd = FindBestCubeDecision(arDouble, aarOutput, pci);
+extern void
+EvalCascadeReport(const evalcontext * pecPrune, const unsigned int cPositions, float *prAgree, float *prLoss,
+                  float *prSpeed)
+{
+    evalcontext ec = *pecPrune;
+    cubeinfo ci = ciCubeless;
+    TanBoard *aanBoard = g_new(TanBoard, cPositions);
+    positionkey *akey = g_new(positionkey, cPositions * 21);
+    unsigned int i, j, n0, n1, c = 0, cAgree = 0;
+    double rLoss = 0.0, t0, t1, t2;
+    TanBoard anBoard;
+    randctx rcTest;
+    searchlist ml;
+
+    /* only the cascade and its limits are taken from pecPrune */
+    ec.fCubeful = FALSE;
+    ec.nPlies = 0;
+    ec.fUsePrune = TRUE;
+    ec.fDeterministic = TRUE;
+    ec.rNoise = 0.0f;
+    ec.rTimeLimit = 0.0f;
+    if (ec.nCascade >= NUM_CASCADES)
+        ec.nCascade = 0;
+
+    memset(&rcTest, 0, sizeof(rcTest));
+    irandinit(&rcTest, TRUE);
+
+    for (i = 0; i < cPositions; i++)
+        RandomPosition(aanBoard[i], &rcTest);
+
+    CacheFlush(&cpEval);
+    EvalCacheFlush();
 
-    switch (cd) {
+    t0 = get_time();
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = 1; n1 <= n0; n1++) {
+                memcpy(anBoard, aanBoard[i], sizeof(TanBoard));
+                FindBestMoveInEval(n0, n1, (ConstTanBoard) aanBoard[i], anBoard, &ci, &ec);
+                PositionKey((ConstTanBoard) anBoard, &akey[c++]);
+            }
+    t1 = get_time();
 
-    case DOUBLE_TAKE:
-    case DOUBLE_PASS:
-    case DOUBLE_BEAVER:
-    case REDOUBLE_TAKE:
-    case REDOUBLE_PASS:
+    EvalCacheFlush();
 
-        return !fDouble;
+    c = 0;
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = 1; n1 <= n0; n1++, c++) {
+                if (GenerateSearchMoves(&ml, (ConstTanBoard) aanBoard[i], n0, n1, FALSE) == 0) {
+                    cAgree++;
+                    continue;
+                }
+                ScoreMoves(&ml, &ci, &ec, 0);
 
-    default:
+                for (j = 0; j < ml.cMoves; j++)
+                    if (EqualKeys(ml.amMoves[j].key, akey[c]))
+                        break;
 
-        return 0;
+                if (j == (unsigned int) ml.iMoveBest)
+                    cAgree++;
+                else if (j < ml.cMoves)
+                    rLoss += ml.rBestScore - ml.amMoves[j].rScore;
+            }
+    t2 = get_time();
 
-    }
+    *prAgree = c ? 100.0f * cAgree / c : 0.0f;
+    *prLoss = c ? (float) (rLoss / c) : 0.0f;
+    *prSpeed = t1 > t0 ? (float) ((t2 - t1) / (t1 - t0)) : 0.0f;
 
+    g_free(akey);
+    g_free(aanBoard);
 }
 
+#if USE_MULTITHREAD
+/* Evaluate cPositions random positions cubeful at nPlies, and pick a
+ * move in each for one roll, with the rolls evaluated on this thread
+ * alone and split over the threads (nEvalSplitPlies 0 and 1).
+ * arLatency receives the milliseconds each evaluation and each move
+ * took, serial then split; acDiffer the evaluations and the moves that
+ * differ between the two and *prMaxDiff the largest difference of an
+ * output.  Both run with empty caches, so the caches are empty after
+ * it too.  The evaluations are those of the threads, with locking. */
 
-
-extern unsigned int
-locateMove(const TanBoard anBoard, const int anMove[8], const movelist * pml)
+extern void
+EvalSplitReport(const unsigned int cPositions, const unsigned int nPlies, float arLatency[2][2],
+                unsigned int acDiffer[2], float *prMaxDiff)
 {
+    unsigned int const nSplitSaved = nEvalSplitPlies;
+    TanBoard *aanBoard = g_new(TanBoard, cPositions);
+    float *ar = g_new(float, 2 * cPositions * NUM_ROLLOUT_OUTPUTS);
+    int *anMove = g_new(int, 2 * cPositions * 8);
+    evalcontext ec;
+    cubeinfo ci;
+    randctx rcTest;
+    unsigned int i, j, fSplit;
 
-    unsigned int i;
-    positionkey key1, key2;
-
-    MoveKey(anBoard, anMove, &key1);
-
-    for (i = 0; i < pml->cMoves; ++i) {
+    memset(&ec, 0, sizeof(ec));
+    ec.fCubeful = TRUE;
+    ec.nPlies = nPlies;
+    ec.fUsePrune = TRUE;
+    ec.fDeterministic = TRUE;
+    SetCubeInfoMoney(&ci, 1, -1, 0, FALSE, FALSE, VARIATION_STANDARD);
 
-        MoveKey(anBoard, pml->amMoves[i].anMove, &key2);
+    memset(&rcTest, 0, sizeof(rcTest));
+    irandinit(&rcTest, TRUE);
 
-        if (EqualKeys(key2, key1))
-            return i;
+    for (i = 0; i < cPositions; i++)
+        RandomPosition(aanBoard[i], &rcTest);
 
+    for (fSplit = 0; fSplit < 2; fSplit++) {
+        float *arSplit = ar + fSplit * cPositions * NUM_ROLLOUT_OUTPUTS;
+        double t0, t1, t2;
 
-    }
+        nEvalSplitPlies = fSplit;
 
-    return 0;
+        EvalCacheFlush();
+        t0 = get_time();
+        for (i = 0; i < cPositions && !fInterrupt; i++)
+            EvaluatePositionWithLocking(NULL, (ConstTanBoard) aanBoard[i], arSplit + i * NUM_ROLLOUT_OUTPUTS, &ci,
+                                        &ec);
+        t1 = get_time();
 
-}
+        EvalCacheFlush();
+        for (i = 0; i < cPositions && !fInterrupt; i++) {
+            TanBoard anBoard;
 
+            memcpy(anBoard, aanBoard[i], sizeof(TanBoard));
+            FindBestMoveWithLocking(anMove + (fSplit * cPositions + i) * 8, 1 + i % 6, 1 + (i / 6) % 6, anBoard, &ci,
+                                    &ec, defaultFilters);
+        }
+        t2 = get_time();
 
-extern int
-MoveKey(const TanBoard anBoard, const int anMove[8], positionkey * pkey)
-{
+        arLatency[0][fSplit] = cPositions ? (float) ((t1 - t0) / cPositions) : 0.0f;
+        arLatency[1][fSplit] = cPositions ? (float) ((t2 - t1) / cPositions) : 0.0f;
+    }
 
-    TanBoard anBoardMove;
+    nEvalSplitPlies = nSplitSaved;
+    EvalCacheFlush();
 
-    memcpy(anBoardMove, anBoard, sizeof(anBoardMove));
-    ApplyMove(anBoardMove, anMove, FALSE);
-    PositionKey((ConstTanBoard) anBoardMove, pkey);
+    acDiffer[0] = acDiffer[1] = 0;
+    *prMaxDiff = 0.0f;
+    for (i = 0; i < cPositions; i++) {
+        int fDiffer = FALSE;
 
-    return 0;
+        for (j = 0; j < NUM_ROLLOUT_OUTPUTS; j++) {
+            float const r = fabsf(ar[i * NUM_ROLLOUT_OUTPUTS + j] - ar[(cPositions + i) * NUM_ROLLOUT_OUTPUTS + j]);
+
+            if (r > 0.0f)
+                fDiffer = TRUE;
+            if (r > *prMaxDiff)
+                *prMaxDiff = r;
+        }
+        acDiffer[0] += fDiffer;
+        acDiffer[1] += memcmp(anMove + i * 8, anMove + (cPositions + i) * 8, 8 * sizeof(int)) != 0;
+    }
 
+    g_free(anMove);
+    g_free(ar);
+    g_free(aanBoard);
 }
+#endif
+#endif
 
+/* The 21 rolls of an internal node of EvaluatePositionFull() or, with
+ * the cube positions aci, of EvaluatePositionCubeful4().  Each roll is
+ * evaluated into its own row of aar (and arCf) and the callers sum the
+ * rows in roll order, so the result is the same however the rolls were
+ * spread over the threads. */
+
+typedef struct {
+    ConstTanBoard anBoard;
+    const cubeinfo *pci;
+    const evalcontext *pec;
+    unsigned int nPlies;
+    int usePrune;
+    const cubeinfo *aci;
+    int cci;
+    float (*aar)[NUM_OUTPUTS];
+    float *arCf;
+    unsigned int nSplit;
+    int fError;
+} rollexpansion;
+
+/* Play the move chosen for roll iRoll into anBoardNew and swap sides;
+ * *pciOpp receives the cube of the opponent, who is on roll there */
 
-extern int
-equal_movefilter(const int i, movefilter amf1[MAX_FILTER_PLIES], movefilter amf2[MAX_FILTER_PLIES])
+static void
+PlayRoll(const rollexpansion * pre, unsigned int iRoll, TanBoard anBoardNew, cubeinfo * pciOpp)
 {
+    unsigned int n0, n1 = iRoll;
 
-    int j;
+    for (n0 = 1; n1 >= n0; n0++)
+        n1 -= n0;
+    n1++;
 
-    for (j = 0; j <= i; ++j) {
-        if (amf1[j].Accept != amf2[j].Accept)
-            return 0;
-        if (amf1[j].Accept < 0)
-            continue;
-        if (amf1[j].Extra != amf2[j].Extra)
-            return 0;
-        if (!amf1[j].Extra)
-            continue;
-        if (amf1[j].Threshold != amf2[j].Threshold)
-            return 0;
+    memcpy(anBoardNew, pre->anBoard, sizeof(TanBoard));
+
+    if (pre->usePrune) {
+        FindBestMoveInEval(n0, n1, pre->anBoard, anBoardNew, pre->pci, pre->pec);
+    } else {
 
+        FindBestMovePlied(NULL, n0, n1, anBoardNew, pre->pci, pre->pec, 0, defaultFilters);
     }
 
-    return 1;
+    SwapSides(anBoardNew);
 
+    SetCubeInfo(pciOpp, pre->pci->nCube, pre->pci->fCubeOwner, !pre->pci->fMove,
+                pre->pci->nMatchTo, pre->pci->anScore, pre->pci->fCrawford, pre->pci->fJacoby,
+                pre->pci->fBeavers, pre->pci->bgv);
 }
 
-
-extern int
-equal_movefilters(movefilter aamf1[MAX_FILTER_PLIES][MAX_FILTER_PLIES],
-                  movefilter aamf2[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
+static int
+ExpandRoll(NNState * nnStates, const rollexpansion * pre, unsigned int iRoll)
 {
+    TanBoard anBoardNew;
+    cubeinfo ciOpp;
 
-    int i;
+    if (fInterrupt) {
+        errno = EINTR;
+        return -1;
+    }
 
-    for (i = 0; i < MAX_FILTER_PLIES; ++i)
-        if (!equal_movefilter(i, aamf1[i], aamf2[i]))
-            return 0;
+    PlayRoll(pre, iRoll, anBoardNew, &ciOpp);
 
-    return 1;
+    if (pre->aci)
+        return EvaluatePositionCubeful3(nnStates, (ConstTanBoard) anBoardNew, pre->aar[iRoll],
+                                        pre->arCf + iRoll * pre->cci, pre->aci, pre->cci, &ciOpp, pre->pec,
+                                        pre->nPlies - 1, FALSE);
 
+    return EvaluatePositionCache(nnStates, (ConstTanBoard) anBoardNew, pre->aar[iRoll],
+                                 &ciOpp, pre->pec, pre->nPlies - 1,
+                                 ClassifyPosition((ConstTanBoard) anBoardNew, ciOpp.bgv));
 }
 
+/* Evaluate the c positions aanBoard at 0-ply as EvaluatePositionCache()
+ * does, into aar: the cache is probed for all of them first and the
+ * misses of each class go to the nets together.  With aar NULL only the
+ * cache entries of the net evaluations are filled in, for the cubeful
+ * evaluations that follow. */
 
-/*
- * Categorise double into normal, beaver, or raccoon.
- * 
- * The function is called before ApplyMoveRecord:
- *
- * fDoubled = FALSE:
- *
- *    the previous moverecord was not a MOVE_DOUBLE,
- *    hence this is a normal double.
- *
- * fDoubled = TRUE:
- *
- *    The previous moverecord was a MOVE_DOUBLE
- *    so it's either a beaver or a raccoon
- *
- *    Beaver: fTurn != fMove (the previous doubler was the player on roll
- *                            so the redouble must be a beaver)
- *    Raccoon: fTurn == fMove and/or fCubeOwner != fMove
- *
- *
- */
-
-extern doubletype
-DoubleType(const int fDoubled, const int fMove, const int fTurn)
+static int
+EvaluateLeaves(NNState * nnStates, TanBoard aanBoard[], const unsigned int c, float aar[][NUM_OUTPUTS],
+               const cubeinfo * pci, const evalcontext * pecx)
 {
+    evalbatch aeb[3];
+    evalcontext ecClean = *pecx;
+    float arOutput[NUM_OUTPUTS];
+    uint64_t nEvalContext;
+    unsigned int i;
 
-    if (fDoubled) {
-
-        /* beaver or raccoon */
+    if (!cCache) {
+        /* nothing to probe */
+        for (i = 0; aar && i < c; i++)
+            if (EvaluatePositionCache(nnStates, (ConstTanBoard) aanBoard[i], aar[i], pci, pecx, 0,
+                                      ClassifyPosition((ConstTanBoard) aanBoard[i], pci->bgv)))
+                return -1;
+        return 0;
+    }
 
-        if (fTurn != fMove)
-            /* beaver */
-            return DT_BEAVER;
-        else
-            /* raccoon */
-            return DT_RACCOON;
+    /* with noise the noiseless evaluations are cached and the noise is
+     * added once they are all in */
+    ecClean.rNoise = 0.0f;
+    nEvalContext = EvalKey(&ecClean, 0, pci, FALSE);
 
-    }
-    return DT_NORMAL;
-}
+    aeb[0].c = aeb[1].c = aeb[2].c = 0;
 
-#else
+    for (i = 0; i < c; i++) {
+        positionclass pc = ClassifyPosition((ConstTanBoard) aanBoard[i], pci->bgv);
+        float *ar = aar ? aar[i] : arOutput;
+        evalbatch *peb;
+        evalcache *pec;
 
-#define FindnSaveBestMoves FindnSaveBestMovesWithLocking
-#define FindBestMove FindBestMoveWithLocking
-#define EvaluatePosition EvaluatePositionWithLocking
-#define ScoreMove ScoreMoveWithLocking
-#define GeneralCubeDecisionE GeneralCubeDecisionEWithLocking
-#define GeneralEvaluationE GeneralEvaluationEWithLocking
-#define EvaluatePositionCache EvaluatePositionCacheWithLocking
-#define FindBestMovePlied FindBestMovePliedWithLocking
-#define GeneralEvaluationEPlied GeneralEvaluationEPliedWithLocking
-#define EvaluatePositionCubeful3 EvaluatePositionCubeful3WithLocking
-#define ScoreMoves ScoreMovesWithLocking
-#define FindBestMoveInEval FindBestMoveInEvalWithLocking
-#define GeneralEvaluationEPliedCubeful GeneralEvaluationEPliedCubefulWithLocking
-#define EvaluatePositionCubeful4 EvaluatePositionCubeful4WithLocking
-#define CacheAdd CacheAddWithLocking
-#define CacheLookup CacheLookupWithLocking
+        if (pc < CLASS_RACE) {
+            /* databases and won games */
+            if (aar && EvaluatePositionCache(nnStates, (ConstTanBoard) aanBoard[i], ar, pci, pecx, 0, pc))
+                return -1;
+            continue;
+        }
 
-static int EvaluatePositionCache(NNState * nnStates, const TanBoard anBoard, float arOutput[],
-                                 const cubeinfo * pci, const evalcontext * pecx, int nPlies, positionclass pc);
+        peb = &aeb[pc - CLASS_RACE];
+        pec = &peb->aec[peb->c];
+        PositionKey((ConstTanBoard) aanBoard[i], &pec->key);
+        pec->nEvalContext = nEvalContext;
 
-static int FindBestMovePlied(int anMove[8], int nDice0, int nDice1,
-                             TanBoard anBoard, const cubeinfo * pci,
-                             const evalcontext * pec, int nPlies, movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES]);
+        if ((peb->al[peb->c] = CacheLookupCounted(EVAL_CACHE_EVAL, 0, pc, pec, ar, NULL)) == CACHEHIT)
+            continue;
 
-extern neuralnet nnpContact, nnpRace, nnpCrashed;
-extern evalCache cEval;
-extern evalCache cpEval;
-extern classevalfunc acef[N_CLASSES];
-extern unsigned int cCache;
-extern evalcontext ecBasic;
-NNState nnStatesStorage[MAX_NUMTHREADS][3];
-#endif
+        memcpy(peb->aanBoard[peb->c], aanBoard[i], sizeof(TanBoard));
+        peb->apr[peb->c] = aar ? ar : NULL;
+        if (++peb->c == EVAL_BATCH_SIZE)
+            FlushEvalBatch(peb, pc, FALSE, pci->bgv);
+    }
 
-static int GeneralEvaluationEPlied(NNState * nnStates, float arOutput[NUM_ROLLOUT_OUTPUTS],
-                                   const TanBoard anBoard, const cubeinfo * pci, const evalcontext * pec, int nPlies);
-static int EvaluatePositionCubeful3(NNState * nnStates, const TanBoard anBoard, float arOutput[NUM_OUTPUTS],
-                                    float arCubeful[], const cubeinfo aciCubePos[], int cci, const cubeinfo * pciMove,
-                                    const evalcontext * pec, int nPlies, int fTop);
+    for (i = 0; i < 3; i++)
+        FlushEvalBatch(&aeb[i], CLASS_RACE + i, FALSE, pci->bgv);
 
-/* Functions that have both locking and non-locking versions below here */
+    if (aar && pecx->rNoise != 0.0f)
+        for (i = 0; i < c; i++)
+            if (ClassifyPosition((ConstTanBoard) aanBoard[i], pci->bgv) >= CLASS_RACE) {
+                AddNoise(pecx, (ConstTanBoard) aanBoard[i], aar[i]);
+                SanityCheck((ConstTanBoard) aanBoard[i], aar[i]);
+            }
 
-static int ScoreMoves(movelist * pml, const cubeinfo * pci, const evalcontext * pec, int nPlies);
+    return 0;
+}
 
-#define PRUNE_MOVES 10
+#if LOCKING_VERSION
+/* how many levels of split roll expansions each thread is inside */
+static unsigned int anSplitDepth[MAX_NUMTHREADS];
 
 static void
-FindBestMoveInEval(NNState * nnStates, int const nDice0, int const nDice1, const TanBoard anBoardIn,
-                   TanBoard anBoardOut, const cubeinfo * const pci, const evalcontext * pec)
+ExpandRollTask(void *p, unsigned int iRoll)
 {
-    unsigned int i;
-    movelist ml;
-    positionclass evalClass = 0;
-    unsigned int bmovesi[PRUNE_MOVES];
+    rollexpansion *pre = (rollexpansion *) p;
+    int const id = MT_GetThreadID();
+    unsigned int const nDepth = anSplitDepth[id];
 
-    GenerateMoves(&ml, anBoardIn, nDice0, nDice1, FALSE);
+    anSplitDepth[id] = pre->nSplit;
 
-    if (ml.cMoves == 0) {
-        /* no legal moves */
-        return;
-    }
+    if (!pre->fError && ExpandRoll(nnStatesStorage[id], pre, iRoll))
+        pre->fError = TRUE;
 
-    if (ml.cMoves == 1) {
-        /* forced move */
-        ml.iMoveBest = 0;
-        PositionFromKey(anBoardOut, &ml.amMoves[ml.iMoveBest].key);
-        return;
-    }
+    anSplitDepth[id] = nDepth;
+}
+#endif
 
-    if (ml.cMoves <= PRUNE_MOVES) {
-        ScoreMoves(&ml, pci, pec, 0);
-        PositionFromKey(anBoardOut, &ml.amMoves[ml.iMoveBest].key);
-        return;
-    }
+/* Evaluate the rolls, splitting them over the threads for the first
+ * nEvalSplitPlies levels below an evaluation of 2 or more plies.  The
+ * rows are summed in roll order either way, but a split changes which
+ * thread evaluates a position first and fills the cache with it, and a
+ * position scored incrementally or in a batch can differ from a plain
+ * evaluation in the last bits, so split results may differ by as much
+ * from run to run.  That is why splitting is off by default; see
+ * EvalSplitReport(). */
 
-    ((cubeinfo *) pci)->fMove = !pci->fMove;
+static int
+ExpandRolls(NNState * nnStates, rollexpansion * pre)
+{
+    unsigned int i;
 
-    for (i = 0; i < ml.cMoves; i++) {
-        positionclass pc;
-        SSE_ALIGN(float arInput[200]);
-        float arOutput[NUM_OUTPUTS];
-        evalcache ec;
-        uint32_t l;
-        /* declared volatile to avoid wrong compiler optimization
-         * on some gcc systems. Remove with great care. */
-        move *const volatile pm = &ml.amMoves[i];
+#if LOCKING_VERSION
+    unsigned int const nDepth = anSplitDepth[MT_GetThreadID()];
 
-        PositionFromKey(anBoardOut, &pm->key);
-        SwapSides(anBoardOut);
+    if (pre->nPlies >= 2 && nDepth < nEvalSplitPlies && MT_GetNumThreads() > 1) {
+        pre->nSplit = nDepth + 1;
+        pre->fError = FALSE;
 
-        pc = ClassifyPosition((ConstTanBoard) anBoardOut, VARIATION_STANDARD);
-        if (i == 0) {
-            if (pc < CLASS_RACE)
-                break;
-            evalClass = pc;
-        } else if (pc != evalClass)
-            break;
+        MT_ParallelFor(21, ExpandRollTask, pre);
 
-        CopyKey(pm->key, ec.key);
-        ec.nEvalContext = 0;
-        if ((l = CacheLookup(&cpEval, &ec, arOutput, NULL)) != CACHEHIT) {
-            baseInputs((ConstTanBoard) anBoardOut, arInput);
-            {
-                neuralnet *nets[] = { &nnpRace, &nnpCrashed, &nnpContact };
-                neuralnet *n = nets[pc - CLASS_RACE];
-                if (nnStates)
-                    nnStates[pc - CLASS_RACE].state = (i == 0) ? NNSTATE_INCREMENTAL : NNSTATE_DONE;
-#if USE_SIMD_INSTRUCTIONS
-                NeuralNetEvaluateSSE(n, arInput, arOutput, nnStates);
-#else
-                NeuralNetEvaluate(n, arInput, arOutput, nnStates);
+        if (pre->fError && fInterrupt)
+            errno = EINTR;
+
+        return pre->fError ? -1 : 0;
+    }
 #endif
-                if (pc == CLASS_RACE)
-                    /* special evaluation of backgammons
-                     * overrides net output */
-                    EvalRaceBG((ConstTanBoard) anBoardOut, arOutput, VARIATION_STANDARD);
 
-                SanityCheck((ConstTanBoard) anBoardOut, arOutput);
-            }
-            memcpy(ec.ar, arOutput, sizeof(float) * NUM_OUTPUTS);
-            ec.ar[5] = 0.f;
-            CacheAdd(&cpEval, &ec, l);
-        }
-        pm->rScore = UtilityME(arOutput, pci);
-        if (i < PRUNE_MOVES) {
-            bmovesi[i] = i;
-            if (pm->rScore > ml.amMoves[bmovesi[0]].rScore) {
-                bmovesi[i] = bmovesi[0];
-                bmovesi[0] = i;
-            }
-        } else if (pm->rScore < ml.amMoves[bmovesi[0]].rScore) {
-            int m = 0, k;
-            bmovesi[0] = i;
-            for (k = 1; k < PRUNE_MOVES; ++k) {
-                if (ml.amMoves[bmovesi[k]].rScore > ml.amMoves[bmovesi[m]].rScore) {
-                    m = k;
-                }
+    if (pre->nPlies == 1) {
+        /* the positions after the rolls are leaves: gather them first
+         * and evaluate them together */
+        TanBoard aanBoard[21];
+        cubeinfo ciOpp;
+
+        for (i = 0; i < 21; i++) {
+            if (fInterrupt) {
+                errno = EINTR;
+                return -1;
             }
-            bmovesi[0] = bmovesi[m];
-            bmovesi[m] = i;
+            PlayRoll(pre, i, aanBoard[i], &ciOpp);
         }
-    }
 
-    ((cubeinfo *) pci)->fMove = !pci->fMove;
+        if (!pre->aci)
+            return EvaluateLeaves(nnStates, aanBoard, 21, pre->aar, &ciOpp, pre->pec);
 
-    if (i == ml.cMoves) {
-        move amMoves[PRUNE_MOVES];
-        ml.cMoves = PRUNE_MOVES;
-        for (i = 0; i < PRUNE_MOVES; i++) {
-            unsigned int const j = bmovesi[i];
-            memcpy(&amMoves[i], &ml.amMoves[j], sizeof(amMoves[0]));
-            bmovesi[i] = i;
-        }
-        memcpy(&ml.amMoves[0], amMoves, ml.cMoves * sizeof(amMoves[0]));
+        /* the cubeful leaves start from the noiseless cubeless
+         * evaluations of EvaluatePosition() */
+        if (EvaluateLeaves(nnStates, aanBoard, 21, NULL, &ciOpp, &ecBasic))
+            return -1;
+
+        for (i = 0; i < 21; i++)
+            if (EvaluatePositionCubeful3(nnStates, (ConstTanBoard) aanBoard[i], pre->aar[i],
+                                         pre->arCf + i * pre->cci, pre->aci, pre->cci, &ciOpp, pre->pec, 0, FALSE))
+                return -1;
+
+        return 0;
     }
 
-    ScoreMoves(&ml, pci, pec, 0);
-    PositionFromKey(anBoardOut, &ml.amMoves[ml.iMoveBest].key);
+    for (i = 0; i < 21; i++)
+        if (ExpandRoll(nnStates, pre, i))
+            return -1;
+
+    return 0;
 }
 
 static int
 EvaluatePositionFull(NNState * nnStates, const TanBoard anBoard, float arOutput[],
                      const cubeinfo * pci, const evalcontext * pec, unsigned int nPlies, positionclass pc)
 {
-    int i, n0, n1;
-    float arVariationOutput[NUM_OUTPUTS];
+    int i, n0, n1, iRoll;
     float rTemp;
     int w;
 
     if (pc > CLASS_PERFECT && nPlies > 0) {
         /* internal node; recurse */
 
-        TanBoard anBoardNew;
-        /* int anMove[ 8 ]; */
-        cubeinfo ciOpp;
-        int const usePrune = pec->fUsePrune && !pec->rNoise && pci->bgv == VARIATION_STANDARD;
+        float aar[21][NUM_OUTPUTS];
+        rollexpansion re;
+
+        re.anBoard = anBoard;
+        re.pci = pci;
+        re.pec = pec;
+        re.nPlies = nPlies;
+        re.usePrune = pec->fUsePrune && !pec->rNoise && pci->bgv == VARIATION_STANDARD;
+        re.aci = NULL;
+        re.cci = 0;
+        re.aar = aar;
+        re.arCf = NULL;
+
+        if (ExpandRolls(nnStates, &re))
+            return -1;
 
         for (i = 0; i < NUM_OUTPUTS; i++)
             arOutput[i] = 0.0;
 
-        /* loop over rolls */
+        /* sum over rolls */
 
-        for (n0 = 1; n0 <= 6; n0++) {
-            for (n1 = 1; n1 <= n0; n1++) {
+        for (n0 = 1, iRoll = 0; n0 <= 6; n0++) {
+            for (n1 = 1; n1 <= n0; n1++, iRoll++) {
                 w = (n0 == n1) ? 1 : 2;
 
-                for (i = 0; i < 25; i++) {
-                    anBoardNew[0][i] = anBoard[0][i];
-                    anBoardNew[1][i] = anBoard[1][i];
-                }
-
-                if (fInterrupt) {
-                    errno = EINTR;
-                    return -1;
-                }
-
-                if (usePrune) {
-                    FindBestMoveInEval(nnStates, n0, n1, anBoard, anBoardNew, pci, pec);
-                } else {
-
-                    FindBestMovePlied(NULL, n0, n1, anBoardNew, pci, pec, 0, defaultFilters);
-                }
-
-                SwapSides(anBoardNew);
-
-                SetCubeInfo(&ciOpp, pci->nCube, pci->fCubeOwner, !pci->fMove,
-                            pci->nMatchTo, pci->anScore, pci->fCrawford, pci->fJacoby, pci->fBeavers, pci->bgv);
-
-                /* Evaluate at 0-ply */
-                if (EvaluatePositionCache(nnStates, (ConstTanBoard) anBoardNew, arVariationOutput,
-                                          &ciOpp, pec, nPlies - 1,
-                                          ClassifyPosition((ConstTanBoard) anBoardNew, ciOpp.bgv)))
-                    return -1;
-
                 for (i = 0; i < NUM_OUTPUTS; i++)
-                    arOutput[i] += w * arVariationOutput[i];
+                    arOutput[i] += w * aar[iRoll][i];
             }
 
         }
@@ -5481,8 +8127,7 @@ EvaluatePositionFull(NNState * nnStates, const TanBoard anBoard, float arOutput[
             return -1;
 
         if (pec->rNoise && pc != CLASS_OVER)
-            for (i = 0; i < NUM_OUTPUTS; i++)
-                arOutput[i] += Noise(pec, anBoard, i);
+            AddNoise(pec, anBoard, arOutput);
 
         if (pc > CLASS_PERFECT)
             /* no sanity check needed for exact evaluations */
@@ -5502,14 +8147,35 @@ EvaluatePositionCache(NNState * nnStates, const TanBoard anBoard, float arOutput
     /* This should be a part of the code that is called in all
      * time-consuming operations at a relatively steady rate, so is a
      * good choice for a callback function. */
-    if (!cCache || pecx->rNoise != 0.0f) {      /* non-deterministic noisy evaluations; cannot cache */
+    if (!cCache)
         return EvaluatePositionFull(nnStates, anBoard, arOutput, pci, pecx, nPlies, pc);
+
+    if (pecx->rNoise != 0.0f) {
+        if (nPlies == 0) {
+            /* cache the noiseless evaluation and add the noise to it */
+            evalcontext ecClean = *pecx;
+
+            ecClean.rNoise = 0.0f;
+            if (EvaluatePositionCache(nnStates, anBoard, arOutput, pci, &ecClean, 0, pc))
+                return -1;
+
+            if (pc != CLASS_OVER)
+                AddNoise(pecx, anBoard, arOutput);
+            if (pc > CLASS_PERFECT)
+                SanityCheck(anBoard, arOutput);
+
+            return 0;
+        }
+
+        if (!pecx->fDeterministic)
+            /* non-deterministic noisy evaluations; cannot cache */
+            return EvaluatePositionFull(nnStates, anBoard, arOutput, pci, pecx, nPlies, pc);
     }
 
     PositionKey(anBoard, &ec.key);
 
     ec.nEvalContext = EvalKey(pecx, nPlies, pci, FALSE);
-    if ((l = CacheLookup(&cEval, &ec, arOutput, NULL)) == CACHEHIT) {
+    if ((l = EvalCacheLookup(EVAL_CACHE_EVAL, nPlies, pc, &ec, arOutput, NULL)) == CACHEHIT) {
         return 0;
     }
 
@@ -5518,7 +8184,7 @@ EvaluatePositionCache(NNState * nnStates, const TanBoard anBoard, float arOutput
 
     memcpy(ec.ar, arOutput, sizeof(float) * NUM_OUTPUTS);
     ec.ar[5] = 0.f;
-    CacheAdd(&cEval, &ec, l);
+    EvalCacheAdd(EVAL_CACHE_EVAL, nPlies, pc, &ec, l);
     return 0;
 }
 
@@ -5533,8 +8199,8 @@ EvaluatePosition(NNState * nnStates, const TanBoard anBoard, float arOutput[],
 }
 
 
-extern int
-ScoreMove(NNState * nnStates, move * pm, const cubeinfo * pci, const evalcontext * pec, int nPlies)
+static int
+ScoreSearchMove(NNState * nnStates, searchmove * pm, const cubeinfo * pci, const evalcontext * pec, int nPlies)
 {
     TanBoard anBoardTemp;
     float arEval[NUM_ROLLOUT_OUTPUTS];
@@ -5544,54 +8210,163 @@ ScoreMove(NNState * nnStates, move * pm, const cubeinfo * pci, const evalcontext
 
     SwapSides(anBoardTemp);
 
-    /* swap fMove in cubeinfo */
+    /* swap fMove in cubeinfo */
+    memcpy(&ci, pci, sizeof(ci));
+    ci.fMove = !ci.fMove;
+
+    if (GeneralEvaluationEPlied(nnStates, arEval, (ConstTanBoard) anBoardTemp, &ci, pec, nPlies))
+        return -1;
+
+    InvertEvaluationR(arEval, &ci);
+
+    if (ci.nMatchTo)
+        arEval[OUTPUT_CUBEFUL_EQUITY] = mwc2eq(arEval[OUTPUT_CUBEFUL_EQUITY], pci);
+
+    /* Save evaluations */
+    memcpy(pm->arEvalMove, arEval, NUM_ROLLOUT_OUTPUTS * sizeof(float));
+    pm->nPlies = nPlies;
+
+    /* Score for move:
+     * rScore is the primary score (cubeful/cubeless)
+     * rScore2 is the secondary score (cubeless) */
+    pm->rScore = (pec->fCubeful) ? arEval[OUTPUT_CUBEFUL_EQUITY] : arEval[OUTPUT_EQUITY];
+    pm->rScore2 = arEval[OUTPUT_EQUITY];
+
+    return 0;
+}
+
+extern int
+ScoreMove(NNState * nnStates, move * pm, const cubeinfo * pci, const evalcontext * pec, int nPlies)
+{
+    searchmove sm;
+
+    CopyKey(pm->key, sm.key);
+
+    if (ScoreSearchMove(nnStates, &sm, pci, pec, nPlies) < 0)
+        return -1;
+
+    /* Save evaluations */
+    memcpy(pm->arEvalMove, sm.arEvalMove, sizeof(pm->arEvalMove));
+    memset(pm->arEvalStdDev, 0, sizeof(pm->arEvalStdDev));
+    pm->rScore = sm.rScore;
+    pm->rScore2 = sm.rScore2;
+
+    /* Save evaluation setup */
+    pm->esMove.et = EVAL_EVAL;
+    pm->esMove.ec = *pec;
+    pm->esMove.ec.nPlies = nPlies;
+
+    return 0;
+}
+
+/* How ScoreMovesWith() evaluates the positions after the moves at 0-ply
+ * that are not in the cache: each from scratch, from the inputs and
+ * hidden layer of the first one of its class (see
+ * CalculateInputsFromBase()), or in batches by ScoreMovesBatch().  Only
+ * one of them is used for a list, as the batches would leave no misses
+ * for the incremental evaluations.  ScoreMoves() does not batch: over
+ * eight runs of "show kernels" the two scored 1.17 (batched) and 1.12
+ * (incremental) times as fast as from scratch in the median, less than
+ * the spread of single runs (1.00 to 1.73), and the incremental scoring
+ * needs no copies of the boards, so SCORE_BATCH is only kept for that
+ * comparison.  The pruning nets are still batched. */
+
+typedef enum {
+    SCORE_SINGLE, SCORE_INCREMENTAL, SCORE_BATCH
+} scorestrategy;
+
+/* Evaluate the 0-ply positions after the moves in pml that are not in the
+ * cache yet in batches, one per position class, so that the ScoreSearchMove()
+ * calls that follow find them in the cache */
+
+static void
+ScoreMovesBatch(const searchlist * pml, const cubeinfo * pci)
+{
+    evalbatch aeb[3];
+    cubeinfo ci;
+    float arOutput[NUM_OUTPUTS];
+    uint64_t nEvalContext;
+    unsigned int i;
+
+    /* ScoreSearchMove() evaluates the position from the opponent's side */
     memcpy(&ci, pci, sizeof(ci));
     ci.fMove = !ci.fMove;
+    nEvalContext = EvalKey(&ecBasic, 0, &ci, FALSE);
 
-    if (GeneralEvaluationEPlied(nnStates, arEval, (ConstTanBoard) anBoardTemp, &ci, pec, nPlies))
-        return -1;
+    aeb[0].c = aeb[1].c = aeb[2].c = 0;
 
-    InvertEvaluationR(arEval, &ci);
+    for (i = 0; i < pml->cMoves; i++) {
+        TanBoard anBoard;
+        positionclass pc;
+        evalbatch *peb;
+        evalcache *pec;
 
-    if (ci.nMatchTo)
-        arEval[OUTPUT_CUBEFUL_EQUITY] = mwc2eq(arEval[OUTPUT_CUBEFUL_EQUITY], pci);
+        PositionFromKey(anBoard, &pml->amMoves[i].key);
+        SwapSides(anBoard);
 
-    /* Save evaluations */
-    memcpy(pm->arEvalMove, arEval, NUM_ROLLOUT_OUTPUTS * sizeof(float));
-    memset(pm->arEvalStdDev, 0, NUM_ROLLOUT_OUTPUTS * sizeof(float));
+        if ((pc = ClassifyPosition((ConstTanBoard) anBoard, ci.bgv)) < CLASS_RACE)
+            continue;
 
-    /* Save evaluation setup */
-    pm->esMove.et = EVAL_EVAL;
-    pm->esMove.ec = *pec;
-    pm->esMove.ec.nPlies = nPlies;
+        peb = &aeb[pc - CLASS_RACE];
+        pec = &peb->aec[peb->c];
+        PositionKey((ConstTanBoard) anBoard, &pec->key);
+        pec->nEvalContext = nEvalContext;
 
-    /* Score for move:
-     * rScore is the primary score (cubeful/cubeless)
-     * rScore2 is the secondary score (cubeless) */
-    pm->rScore = (pec->fCubeful) ? arEval[OUTPUT_CUBEFUL_EQUITY] : arEval[OUTPUT_EQUITY];
-    pm->rScore2 = arEval[OUTPUT_EQUITY];
+        if ((peb->al[peb->c] = CacheLookupCounted(EVAL_CACHE_EVAL, 0, pc, pec, arOutput, NULL)) == CACHEHIT)
+            continue;
 
-    return 0;
+        memcpy(peb->aanBoard[peb->c], anBoard, sizeof(TanBoard));
+        peb->apr[peb->c] = NULL;
+        if (++peb->c == EVAL_BATCH_SIZE)
+            FlushEvalBatch(peb, pc, FALSE, ci.bgv);
+    }
+
+    for (i = 0; i < 3; i++)
+        FlushEvalBatch(&aeb[i], CLASS_RACE + i, FALSE, ci.bgv);
+}
+
+/* Tell the evaluations that follow which points differ from the position
+ * the moves were generated from, so that the inputs of the other points
+ * can be taken from the saved base (see CalculateInputsFromBase()) */
+
+static void
+SetChangedPoints(NNState * nnStates, const unsigned int nPoints0, const unsigned int nPoints1)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        nnStates[i].anPoints[0] = nPoints0;
+        nnStates[i].anPoints[1] = nPoints1;
+    }
 }
 
 static int
-ScoreMoves(movelist * pml, const cubeinfo * pci, const evalcontext * pec, int nPlies)
+ScoreMovesWith(searchlist * pml, const cubeinfo * pci, const evalcontext * pec, int nPlies, const scorestrategy ss)
 {
     unsigned int i;
     int r = 0;                  /* return value */
+    int const fIncremental = nPlies == 0 && ss == SCORE_INCREMENTAL;
     NNState *nnStates;
     nnStates = nnStatesStorage[MT_GetThreadID()];
 
     pml->rBestScore = -99999.9f;
 
-    if (nPlies == 0) {
+    /* The cubeless evaluations at 0-ply are cached with the ecBasic key
+     * for both cubeful and cubeless scoring; noise is added to them
+     * afterwards */
+    if (nPlies == 0 && ss == SCORE_BATCH && cCache && pml->cMoves > 1)
+        ScoreMovesBatch(pml, pci);
+
+    if (fIncremental)
         /* start incremental evaluations */
         nnStates[0].state = nnStates[1].state = nnStates[2].state = NNSTATE_INCREMENTAL;
-    }
-
 
     for (i = 0; i < pml->cMoves; i++) {
-        if (ScoreMove(nnStates, pml->amMoves + i, pci, pec, nPlies) < 0) {
+        if (fIncremental)
+            /* the position is evaluated from the opponent's side */
+            SetChangedPoints(nnStates, pml->amMoves[i].anChanged[1], pml->amMoves[i].anChanged[0]);
+
+        if (ScoreSearchMove(nnStates, pml->amMoves + i, pci, pec, nPlies) < 0) {
             r = -1;
             break;
         }
@@ -5604,66 +8379,310 @@ ScoreMoves(movelist * pml, const cubeinfo * pci, const evalcontext * pec, int nP
         }
     }
 
-    if (nPlies == 0) {
+    if (fIncremental) {
         /* reset to none */
 
         nnStates[0].state = nnStates[1].state = nnStates[2].state = NNSTATE_NONE;
+        SetChangedPoints(nnStates, NN_ALL_POINTS, NN_ALL_POINTS);
     }
 
     return r;
 }
 
-static movefilter NullFilter = { 0, 0, 0.0 };
+/* The moves of a list are all generated from one position and differ
+ * from it in a few points, so their 0-ply evaluations are updated
+ * incrementally from the first one of each class */
 
 static int
-FindBestMovePlied(int anMove[8], int nDice0, int nDice1,
-                  TanBoard anBoard,
-                  const cubeinfo * pci, const evalcontext * pec, int nPlies,
-                  movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
+ScoreMoves(searchlist * pml, const cubeinfo * pci, const evalcontext * pec, int nPlies)
 {
+    return ScoreMovesWith(pml, pci, pec, nPlies, SCORE_INCREMENTAL);
+}
 
-    evalcontext ec;
-    movelist ml;
-    unsigned int i;
+#if !LOCKING_VERSION
+static unsigned int
+MovesFromBase(void)
+{
+    NNState *nnStates = nnStatesStorage[MT_GetThreadID()];
 
-    memcpy(&ec, pec, sizeof(evalcontext));
-    ec.nPlies = nPlies;
+    return nnStates[0].cFromBase + nnStates[1].cFromBase + nnStates[2].cFromBase;
+}
 
-    if (anMove)
-        for (i = 0; i < 8; ++i)
-            anMove[i] = -1;
+/* Time ScoreMoves() at 0-ply with each scorestrategy for all 21 rolls
+ * of cPositions random positions, starting each with an empty cache.
+ * arRate receives the moves scored per second (including generating
+ * them, the same for each), *prFromBase the percentage of the moves the
+ * incremental scoring took from the base and *prMaxDiff the largest
+ * difference in score between incremental and single evaluations, which
+ * are compared without the cache. */
 
-    if (FindnSaveBestMoves(&ml, nDice0, nDice1, (ConstTanBoard) anBoard, NULL, 0.0f, pci, &ec, aamf) < 0)
-        return -1;
+extern void
+EvalScoreMovesReport(const unsigned int cPositions, float arRate[3], float *prFromBase, float *prMaxDiff)
+{
+    evalcontext ec = { FALSE, 0, FALSE, TRUE, 0.0f };
+    cubeinfo ci = ciCubeless;
+    TanBoard *aanBoard = g_new(TanBoard, cPositions);
+    float *arScore = g_new(float, MAX_MOVES);
+    unsigned int const cCacheSave = cCache;
+    unsigned int i, j, n0, n1, cMoves = 0, cFromBase = 0;
+    scorestrategy ss;
+    randctx rcTest;
+    searchlist ml;
+
+    memset(&rcTest, 0, sizeof(rcTest));
+    irandinit(&rcTest, TRUE);
+
+    for (i = 0; i < cPositions; i++)
+        RandomPosition(aanBoard[i], &rcTest);
+
+    for (ss = SCORE_SINGLE; ss <= SCORE_BATCH; ss++) {
+        unsigned int const cFromBase0 = MovesFromBase();
+        double t0, t1;
+
+        EvalCacheFlush();
+        cMoves = 0;
+
+        t0 = get_time();
+        for (i = 0; i < cPositions; i++)
+            for (n0 = 1; n0 <= 6; n0++)
+                for (n1 = 1; n1 <= n0; n1++) {
+                    cMoves += GenerateSearchMoves(&ml, (ConstTanBoard) aanBoard[i], n0, n1, FALSE);
+                    ScoreMovesWith(&ml, &ci, &ec, 0, ss);
+                }
+        t1 = get_time();
 
-    if (anMove) {
-        for (i = 0; i < ml.cMaxMoves * 2; i++)
-            anMove[i] = ml.amMoves[ml.iMoveBest].anMove[i];
+        /* get_time() is in milliseconds */
+        arRate[ss] = t1 > t0 ? (float) (cMoves * 1000.0 / (t1 - t0)) : 0.0f;
+
+        if (ss == SCORE_INCREMENTAL)
+            cFromBase = MovesFromBase() - cFromBase0;
     }
 
-    if (ml.cMoves)
-        PositionFromKey(anBoard, &ml.amMoves[ml.iMoveBest].key);
+    *prFromBase = cMoves ? 100.0f * cFromBase / cMoves : 0.0f;
+    *prMaxDiff = 0.0f;
 
-    if (ml.amMoves)
-        free(ml.amMoves);
+    cCache = 0;
+    for (i = 0; i < cPositions; i++)
+        for (n0 = 1; n0 <= 6; n0++)
+            for (n1 = 1; n1 <= n0; n1++) {
+                GenerateSearchMoves(&ml, (ConstTanBoard) aanBoard[i], n0, n1, FALSE);
+                ScoreMovesWith(&ml, &ci, &ec, 0, SCORE_SINGLE);
+                for (j = 0; j < ml.cMoves; j++)
+                    arScore[j] = ml.amMoves[j].rScore;
+
+                ScoreMovesWith(&ml, &ci, &ec, 0, SCORE_INCREMENTAL);
+                for (j = 0; j < ml.cMoves; j++)
+                    if (fabsf(ml.amMoves[j].rScore - arScore[j]) > *prMaxDiff)
+                        *prMaxDiff = fabsf(ml.amMoves[j].rScore - arScore[j]);
+            }
+    cCache = cCacheSave;
 
-    return ml.cMaxMoves * 2;
+    EvalCacheFlush();
+
+    g_free(arScore);
+    g_free(aanBoard);
 }
+#endif
 
+static movefilter NullFilter = { 0, 0, 0.0 };
 
-extern
-    int
-FindBestMove(int anMove[8], int nDice0, int nDice1,
-             TanBoard anBoard, cubeinfo * pci, evalcontext * pec, movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
+/* SortMoves() sorts the scores and the indices of the moves, then moves
+ * each displaced move once along the cycles of the permutation, instead
+ * of letting qsort() shuffle whole moves around. */
+
+typedef struct {
+    float rScore, rScore2;
+    unsigned int iMove;
+} movesortkey;
+
+static int
+CompareMoveSortKeys(const movesortkey * pk0, const movesortkey * pk1)
 {
+    /* high score first, and keep the order of moves with equal scores */
+    if (pk0->rScore != pk1->rScore)
+        return pk1->rScore > pk0->rScore ? 1 : -1;
+    if (pk0->rScore2 != pk1->rScore2)
+        return pk1->rScore2 > pk0->rScore2 ? 1 : -1;
 
-    return FindBestMovePlied(anMove, nDice0, nDice1, anBoard, pci, pec ? pec : &ecBasic, pec ? pec->nPlies : 0, aamf);
+    return pk0->iMove < pk1->iMove ? -1 : 1;
 }
 
-extern int
-FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoard, positionkey * keyMove, const
-                   float rThr, const cubeinfo * pci, const evalcontext * pec,
-                   movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
+static void
+SortMoves(searchmove am[], const unsigned int cMoves)
+{
+    static movesortkey aak[MAX_NUMTHREADS][MAX_MOVES];
+    movesortkey *ak = aak[MT_GetThreadID()];
+    unsigned int i, j, k;
+    searchmove m;
+
+    if (cMoves < 2)
+        return;
+
+    g_assert(cMoves <= MAX_MOVES);
+
+    for (i = 0; i < cMoves; i++) {
+        ak[i].rScore = am[i].rScore;
+        ak[i].rScore2 = am[i].rScore2;
+        ak[i].iMove = i;
+    }
+
+    qsort(ak, cMoves, sizeof(movesortkey), (cfunc) CompareMoveSortKeys);
+
+    for (i = 0; i < cMoves; i++) {
+        if (ak[i].iMove == i)
+            continue;
+
+        /* am[j] becomes am[ak[j].iMove] around the cycle through i */
+        memcpy(&m, am + i, sizeof(searchmove));
+        for (j = i; ak[j].iMove != i; j = k) {
+            k = ak[j].iMove;
+            memcpy(am + j, am + k, sizeof(searchmove));
+            ak[j].iMove = j;
+        }
+        memcpy(am + j, &m, sizeof(searchmove));
+        ak[j].iMove = j;
+    }
+}
+
+/* FindnSaveBestMoves() with the moves left on the move stack of the
+ * thread, where they stay valid until MoveArenaPop(*pnMark), which the
+ * caller must do whatever this returns */
+
+/* Move searches with a time limit deepen against the clock: a ply is not
+ * started when the moves left by the filters would not fit in the time
+ * left, each taking the time of a move at the last ply times
+ * EVAL_TIME_GROWTH for every ply deeper.  The first ply above 0 grows by
+ * EVAL_TIME_FIRST_PLY instead, as 0-ply moves are scored incrementally
+ * and a 1-ply move searches all 21 rolls (a few hundred times as long,
+ * when timed; each ply above that took 9 to 21 times as long).  A ply
+ * that has been started is abandoned as soon as the moves it has left
+ * would not fit at the rate of the moves it has scored. */
+#define EVAL_TIME_FIRST_PLY 400.0
+#define EVAL_TIME_GROWTH 21.0
+
+/* Score the moves of pml at 0-ply, then the survivors of the move
+ * filters at the next ply and so on up to pec->nPlies, while the time
+ * limit of pec allows.  A ply that runs out of time is abandoned and its
+ * moves get back the scores of the last complete ply, so that the best
+ * move is always one evaluated as deep as all the moves it beat.  The
+ * scores are saved on the move stack, above pml, which must be the last
+ * list pushed there.  *pecDone receives the context of the last complete
+ * ply. */
+
+static int
+FindBestMovesTimed(searchlist * pml, const cubeinfo * pci, const evalcontext * pec,
+                   movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES], evalcontext * pecDone)
+{
+    double const tEnd = get_time() + 1000.0 * pec->rTimeLimit;
+    movefilter *mFilters = (pec->nPlies <= MAX_FILTER_PLIES) ?
+        aamf[pec->nPlies - 1] : aamf[MAX_FILTER_PLIES - 1];
+    double tStart, tMove;
+    unsigned int iPly, iNext, i;
+
+    *pecDone = *pec;
+    pecDone->rTimeLimit = 0.0f;
+    pecDone->nPlies = 0;
+
+    tStart = get_time();
+
+    if (ScoreMoves(pml, pci, pecDone, 0) < 0)
+        return -1;
+
+    tMove = (get_time() - tStart) / pml->cMoves;
+
+    SortMoves(pml->amMoves, pml->cMoves);
+    pml->iMoveBest = 0;
+    pml->rBestScore = pml->amMoves[0].rScore;
+
+    for (iPly = 0; iPly < pec->nPlies; iPly = iNext) {
+
+        movefilter *mFilter = (iPly < MAX_FILTER_PLIES) ? &mFilters[iPly] : &NullFilter;
+        evalcontext ec;
+        searchlist mlSaved;
+        unsigned int nMark;
+
+        if (mFilter->Accept >= 0) {
+            unsigned int k = pml->cMoves;
+            unsigned int limit;
+
+            pml->cMoves = MIN((unsigned int) mFilter->Accept, pml->cMoves);
+            limit = MIN(k, pml->cMoves + mFilter->Extra);
+
+            for ( /**/; pml->cMoves < limit; ++pml->cMoves)
+                if (pml->amMoves[pml->cMoves].rScore < pml->amMoves[0].rScore - mFilter->Threshold)
+                    break;
+        }
+
+        if (pml->cMoves == 1 && mFilter->Accept != 1)
+            /* nothing left to choose between, as in the untimed search */
+            break;
+
+        /* the next ply the filters score at; a move that is the only
+         * one the filter accepts goes straight to the top ply */
+        if (pml->cMoves == 1)
+            iNext = pec->nPlies;
+        else
+            for (iNext = iPly + 1; iNext < pec->nPlies && iNext < MAX_FILTER_PLIES; iNext++)
+                if (mFilters[iNext].Accept >= 0)
+                    break;
+
+        if (get_time() + pml->cMoves * tMove * (iPly ? 1.0 : EVAL_TIME_FIRST_PLY / EVAL_TIME_GROWTH)
+            * pow(EVAL_TIME_GROWTH, iNext - iPly) > tEnd)
+            break;
+
+        ec = *pecDone;
+        ec.nPlies = iNext;
+
+        /* the deeper searches of ScoreSearchMove() generate above the copy */
+        if (!(mlSaved.amMoves = MoveArenaTop())) {
+            errno = ENOMEM;
+            return -1;
+        }
+        mlSaved.cMoves = pml->cMoves;
+        memcpy(mlSaved.amMoves, pml->amMoves, pml->cMoves * sizeof(searchmove));
+        nMark = MoveArenaPush(&mlSaved);
+
+        tStart = get_time();
+
+        for (i = 0; i < pml->cMoves; i++) {
+            if (i && get_time() + (get_time() - tStart) / i * (pml->cMoves - i) > tEnd)
+                break;
+
+            if (ScoreSearchMove(NULL, pml->amMoves + i, pci, &ec, iNext) < 0) {
+                memcpy(pml->amMoves, mlSaved.amMoves, pml->cMoves * sizeof(searchmove));
+                MoveArenaPop(nMark);
+                return -1;
+            }
+        }
+
+        if (i < pml->cMoves) {
+            /* out of time */
+            memcpy(pml->amMoves, mlSaved.amMoves, pml->cMoves * sizeof(searchmove));
+            MoveArenaPop(nMark);
+            break;
+        }
+
+        MoveArenaPop(nMark);
+
+        tMove = (get_time() - tStart) / pml->cMoves;
+
+        SortMoves(pml->amMoves, pml->cMoves);
+        pml->iMoveBest = 0;
+        pml->rBestScore = pml->amMoves[0].rScore;
+        pecDone->nPlies = iNext;
+    }
+
+    return 0;
+}
+
+/* The moves are scored with *pecScored, which is pec or the context of
+ * the plies a timed search got through */
+
+static int
+FindBestMovesInArena(searchlist * pml, int nDice0, int nDice1, const TanBoard anBoard, positionkey * keyMove,
+                     const float rThr, const cubeinfo * pci, const evalcontext * pec,
+                     movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES], unsigned int *pnMark,
+                     evalcontext * pecScored)
 {
 
     /* Find best moves. 
@@ -5671,16 +8690,23 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
 
     unsigned int i;
     unsigned int nMoves, iPly;
-    move *pm;
     movefilter *mFilters;
     unsigned int nMaxPly = 0;
     int cOldMoves;
+    evalcontext ecTimed;
 
-    /* Find all moves -- note that pml contains internal pointers to static
-     * data, so we can't call GenerateMoves again (or anything that calls
-     * it, such as ScoreMoves at more than 0 plies) until we have saved
-     * the moves we want to keep in amCandidates. */
-    GenerateMoves(pml, anBoard, nDice0, nDice1, FALSE);
+    *pecScored = *pec;
+
+    /* Find all moves, and push them on the move stack so that
+     * ScoreMoves() at more than 0 plies generates its moves above
+     * them. */
+    if (GenerateSearchMoves(pml, anBoard, nDice0, nDice1, FALSE) < 0) {
+        /* nested deeper than the move stack allows */
+        *pnMark = MoveArenaPush(pml);
+        errno = ENOMEM;
+        return -1;
+    }
+    *pnMark = MoveArenaPush(pml);
 
     if (pml->cMoves == 0) {
         /* no legal moves */
@@ -5688,12 +8714,19 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
         return 0;
     }
 
-    /* Save moves */
-    pm = (move *) malloc(pml->cMoves * sizeof(move));
-    memcpy(pm, pml->amMoves, pml->cMoves * sizeof(move));
-    pml->amMoves = pm;
     nMoves = pml->cMoves;
 
+    if (pec->rTimeLimit > 0.0f && pec->nPlies > 0) {
+        if (FindBestMovesTimed(pml, pci, pec, aamf, &ecTimed) < 0)
+            return -1;
+
+        /* go on as a search as deep as the one that fitted in the time */
+        pec = &ecTimed;
+        *pecScored = ecTimed;
+        nMaxPly = pec->nPlies;
+        goto finished;
+    }
+
     mFilters = (pec->nPlies > 0 && pec->nPlies <= MAX_FILTER_PLIES) ?
         aamf[pec->nPlies - 1] : aamf[MAX_FILTER_PLIES - 1];
 
@@ -5711,7 +8744,7 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
             return -1;
         }
 
-        qsort(pml->amMoves, pml->cMoves, sizeof(move), (cfunc) CompareMoves);
+        SortMoves(pml->amMoves, pml->cMoves);
         pml->iMoveBest = 0;
 
         k = pml->cMoves;
@@ -5739,17 +8772,13 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
 
     /* evaluate moves on top ply */
 
-    if (ScoreMoves(pml, pci, pec, pec->nPlies) < 0) {
-        free(pm);
-        pml->cMoves = 0;
-        pml->amMoves = NULL;
+    if (ScoreMoves(pml, pci, pec, pec->nPlies) < 0)
         return -1;
-    }
 
     nMaxPly = pec->nPlies;
 
     /* Resort the moves, in case the new evaluation reordered them. */
-    qsort(pml->amMoves, pml->cMoves, sizeof(move), (cfunc) CompareMoves);
+    SortMoves(pml->amMoves, pml->cMoves);
     pml->iMoveBest = 0;
 
     /* set the proper size of the movelist */
@@ -5770,8 +8799,8 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
 
                 /* ensure top move is evaluted at deepest ply */
 
-                if (pml->amMoves[i].esMove.ec.nPlies < nMaxPly) {
-                    ScoreMove(NULL, pml->amMoves + i, pci, pec, nMaxPly);
+                if (pml->amMoves[i].nPlies < nMaxPly) {
+                    ScoreSearchMove(NULL, pml->amMoves + i, pci, pec, nMaxPly);
                     fResort = TRUE;
                 }
 
@@ -5779,8 +8808,8 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
 
                     /* this is en error/blunder: re-analyse at top-ply */
 
-                    ScoreMove(NULL, pml->amMoves, pci, pec, pec->nPlies);
-                    ScoreMove(NULL, pml->amMoves + i, pci, pec, pec->nPlies);
+                    ScoreSearchMove(NULL, pml->amMoves, pci, pec, pec->nPlies);
+                    ScoreSearchMove(NULL, pml->amMoves + i, pci, pec, pec->nPlies);
                     cOldMoves = 1;      /* only one move scored at deepest ply */
                     fResort = TRUE;
 
@@ -5789,19 +8818,19 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
                 /* move it up to the other moves evaluated on nMaxPly */
 
                 if (fResort && pec->nPlies) {
-                    move m;
+                    searchmove m;
                     int j;
 
                     memcpy(&m, pml->amMoves + i, sizeof m);
 
                     for (j = i - 1; j >= cOldMoves; --j)
-                        memcpy(pml->amMoves + j + 1, pml->amMoves + j, sizeof(move));
+                        memcpy(pml->amMoves + j + 1, pml->amMoves + j, sizeof(searchmove));
 
                     memcpy(pml->amMoves + cOldMoves, &m, sizeof(m));
 
                     /* reorder moves evaluated on nMaxPly */
 
-                    qsort(pml->amMoves, cOldMoves + 1, sizeof(move), (cfunc) CompareMoves);
+                    SortMoves(pml->amMoves, cOldMoves + 1);
 
                 }
                 break;
@@ -5812,6 +8841,93 @@ FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoar
 
 }
 
+static int
+FindBestMovePlied(int anMove[8], int nDice0, int nDice1,
+                  TanBoard anBoard,
+                  const cubeinfo * pci, const evalcontext * pec, int nPlies,
+                  movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
+{
+
+    evalcontext ec, ecScored;
+    searchlist ml;
+    unsigned int i, nMark;
+
+    memcpy(&ec, pec, sizeof(evalcontext));
+    ec.nPlies = nPlies;
+
+    if (anMove)
+        for (i = 0; i < 8; ++i)
+            anMove[i] = -1;
+
+    if (FindBestMovesInArena(&ml, nDice0, nDice1, (ConstTanBoard) anBoard, NULL, 0.0f, pci, &ec, aamf, &nMark,
+                             &ecScored) < 0) {
+        MoveArenaPop(nMark);
+        return -1;
+    }
+
+    if (anMove) {
+        for (i = 0; i < ml.cMaxMoves * 2; i++)
+            anMove[i] = ml.amMoves[ml.iMoveBest].anMove[i];
+    }
+
+    if (ml.cMoves)
+        PositionFromKey(anBoard, &ml.amMoves[ml.iMoveBest].key);
+
+    MoveArenaPop(nMark);
+
+    return ml.cMaxMoves * 2;
+}
+
+
+extern
+    int
+FindBestMove(int anMove[8], int nDice0, int nDice1,
+             TanBoard anBoard, cubeinfo * pci, evalcontext * pec, movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
+{
+
+    return FindBestMovePlied(anMove, nDice0, nDice1, anBoard, pci, pec ? pec : &ecBasic, pec ? pec->nPlies : 0, aamf);
+}
+
+/* The moves of pml are allocated with malloc() for the caller to free()
+ * if there are any.  The search runs on searchmoves; only the moves
+ * handed out here carry the analysis fields of move. */
+
+extern int
+FindnSaveBestMoves(movelist * pml, int nDice0, int nDice1, const TanBoard anBoard, positionkey * keyMove, const
+                   float rThr, const cubeinfo * pci, const evalcontext * pec,
+                   movefilter aamf[MAX_FILTER_PLIES][MAX_FILTER_PLIES])
+{
+
+    unsigned int nMark, i;
+    evalcontext ecScored;
+    searchlist sl;
+
+    if (FindBestMovesInArena(&sl, nDice0, nDice1, anBoard, keyMove, rThr, pci, pec, aamf, &nMark, &ecScored) < 0) {
+        MoveArenaPop(nMark);
+        pml->cMoves = 0;
+        pml->amMoves = NULL;
+        return -1;
+    }
+
+    pml->cMoves = sl.cMoves;
+    pml->cMaxMoves = sl.cMaxMoves;
+    pml->cMaxPips = sl.cMaxPips;
+    pml->iMoveBest = sl.iMoveBest;
+    pml->rBestScore = sl.rBestScore;
+    pml->amMoves = NULL;
+
+    if (sl.cMoves) {
+        pml->amMoves = (move *) malloc(sl.cMoves * sizeof(move));
+        for (i = 0; i < sl.cMoves; i++)
+            MoveFromSearch(pml->amMoves + i, sl.amMoves + i, &ecScored);
+    }
+
+    MoveArenaPop(nMark);
+
+    return 0;
+
+}
+
 extern int
 GeneralCubeDecisionE(float aarOutput[2][NUM_ROLLOUT_OUTPUTS],
                      const TanBoard anBoard,
@@ -5921,27 +9037,40 @@ EvaluatePositionCubeful4(NNState * nnStates, const TanBoard anBoard,
     int i, ici;
     positionclass pc;
     float r;
-    float ar[NUM_OUTPUTS];
     float arEquity[4];
     float rCubeX;
 
-    cubeinfo ciMoveOpp;
-
     float *arCf = (float *) g_alloca(2 * cci * sizeof(float));
-    float *arCfTemp = (float *) g_alloca(2 * cci * sizeof(float));
     cubeinfo *aci = (cubeinfo *) g_alloca(2 * cci * sizeof(cubeinfo));
 
     int w;
-    int n0, n1;
+    int n0, n1, iRoll;
 
     pc = ClassifyPosition(anBoard, pciMove->bgv);
 
     if (pc > CLASS_OVER && nPlies > 0 && !(pc <= CLASS_PERFECT && !pciMove->nMatchTo)) {
         /* internal node; recurse */
 
-        TanBoard anBoardNew;
+        float aar[21][NUM_OUTPUTS];
+        float *arCfRolls = (float *) g_alloca(21 * 2 * cci * sizeof(float));
+        rollexpansion re;
+
+        /* construct next level cube positions */
+
+        MakeCubePos(aciCubePos, cci, fTop, aci, TRUE);
 
-        int const usePrune = pec->fUsePrune && !pec->rNoise && pciMove->bgv == VARIATION_STANDARD;
+        re.anBoard = anBoard;
+        re.pci = pciMove;
+        re.pec = pec;
+        re.nPlies = nPlies;
+        re.usePrune = pec->fUsePrune && !pec->rNoise && pciMove->bgv == VARIATION_STANDARD;
+        re.aci = aci;
+        re.cci = 2 * cci;
+        re.aar = aar;
+        re.arCf = arCfRolls;
+
+        if (ExpandRolls(nnStates, &re))
+            return -1;
 
         for (i = 0; i < NUM_OUTPUTS; i++)
             arOutput[i] = 0.0;
@@ -5949,51 +9078,16 @@ EvaluatePositionCubeful4(NNState * nnStates, const TanBoard anBoard,
         for (i = 0; i < 2 * cci; i++)
             arCf[i] = 0.0;
 
-        /* construct next level cube positions */
-
-        MakeCubePos(aciCubePos, cci, fTop, aci, TRUE);
-
-        /* loop over rolls */
+        /* Sum up cubeless winning chances and cubeful equities */
 
-        for (n0 = 1; n0 <= 6; n0++) {
-            for (n1 = 1; n1 <= n0; n1++) {
+        for (n0 = 1, iRoll = 0; n0 <= 6; n0++) {
+            for (n1 = 1; n1 <= n0; n1++, iRoll++) {
                 w = (n0 == n1) ? 1 : 2;
 
-                for (i = 0; i < 25; i++) {
-                    anBoardNew[0][i] = anBoard[0][i];
-                    anBoardNew[1][i] = anBoard[1][i];
-                }
-
-                if (fInterrupt) {
-                    errno = EINTR;
-                    return -1;
-                }
-
-                if (usePrune) {
-                    FindBestMoveInEval(nnStates, n0, n1, anBoard, anBoardNew, pciMove, pec);
-                } else {
-
-                    FindBestMovePlied(NULL, n0, n1, anBoardNew, pciMove, pec, 0, defaultFilters);
-                }
-
-                SwapSides(anBoardNew);
-
-                SetCubeInfo(&ciMoveOpp,
-                            pciMove->nCube, pciMove->fCubeOwner,
-                            !pciMove->fMove, pciMove->nMatchTo,
-                            pciMove->anScore, pciMove->fCrawford, pciMove->fJacoby, pciMove->fBeavers, pciMove->bgv);
-
-                /* Evaluate at 0-ply */
-                if (EvaluatePositionCubeful3(nnStates, (ConstTanBoard) anBoardNew,
-                                             ar, arCfTemp, aci, 2 * cci, &ciMoveOpp, pec, nPlies - 1, FALSE))
-                    return -1;
-
-                /* Sum up cubeless winning chances and cubeful equities */
-
                 for (i = 0; i < NUM_OUTPUTS; i++)
-                    arOutput[i] += w * ar[i];
+                    arOutput[i] += w * aar[iRoll][i];
                 for (i = 0; i < 2 * cci; i++)
-                    arCf[i] += w * arCfTemp[i];
+                    arCf[i] += w * arCfRolls[iRoll * 2 * cci + i];
 
             }
 
@@ -6067,8 +9161,7 @@ EvaluatePositionCubeful4(NNState * nnStates, const TanBoard anBoard,
                 return -1;
 
             if (pec->rNoise && pc != CLASS_OVER)
-                for (i = 0; i < NUM_OUTPUTS; i++)
-                    arOutput[i] += Noise(pec, anBoard, i);
+                AddNoise(pec, anBoard, arOutput);
 
             if (pc > CLASS_PERFECT)
                 SanityCheck(anBoard, arOutput);
@@ -6212,7 +9305,8 @@ EvaluatePositionCubeful4(NNState * nnStates, const TanBoard anBoard,
 }
 
 /* EvaluatePositionCubeful3 is now just a wrapper for ....Cubeful4, which
- * first checks the cache, and then calls ...Cubeful3 */
+ * first checks the cache, and then calls ...Cubeful4 for the cube
+ * positions it does not have */
 
 extern int
 EvaluatePositionCubeful3(NNState * nnStates, const TanBoard anBoard,
@@ -6222,25 +9316,33 @@ EvaluatePositionCubeful3(NNState * nnStates, const TanBoard anBoard,
                          const cubeinfo * pciMove, const evalcontext * pec, int nPlies, int fTop)
 {
 
-    int ici;
-    int fAll = TRUE;
+    int ici, i, cMiss = 0;
     evalcache ec;
-    unsigned long l;
+    positionclass pc;
+    int *aiMiss;
+    uint32_t *alMiss;
+    cubeinfo *aciMiss;
+    float *arCfMiss;
 
-    if (!cCache || pec->rNoise != 0.0f)
+    if (!cCache || (pec->rNoise != 0.0f && !pec->fDeterministic) || fTop)
         /* non-deterministic evaluation; never cache */
+        /* FIXME: fTop should be a part of EvalKey */
     {
         return EvaluatePositionCubeful4(nnStates, anBoard, arOutput, arCubeful,
                                         aciCubePos, cci, pciMove, pec, nPlies, fTop);
     }
 
     PositionKey(anBoard, &ec.key);
+    pc = ClassifyPosition(anBoard, pciMove->bgv);
 
-    /* check cache for existence for earlier calculation */
+    aiMiss = (int *) g_alloca(cci * sizeof(int));
+    alMiss = (uint32_t *) g_alloca(cci * sizeof(uint32_t));
 
-    fAll = !fTop;               /* FIXME: fTop should be a part of EvalKey */
+    /* check cache for existence for earlier calculation; each cube
+     * position is evaluated on its own, so only the ones not found need
+     * to be */
 
-    for (ici = 0; ici < cci && fAll; ++ici) {
+    for (ici = 0; ici < cci; ++ici) {
 
         if (aciCubePos[ici].nCube < 0) {
             continue;
@@ -6248,36 +9350,35 @@ EvaluatePositionCubeful3(NNState * nnStates, const TanBoard anBoard,
 
         ec.nEvalContext = EvalKey(pec, nPlies, &aciCubePos[ici], TRUE);
 
-        if ((l = CacheLookup(&cEval, &ec, arOutput, arCubeful + ici)) != CACHEHIT) {
-            fAll = FALSE;
-        }
+        if ((alMiss[cMiss] = EvalCacheLookup(EVAL_CACHE_CUBEFUL, nPlies, pc, &ec, arOutput, arCubeful + ici)) !=
+            CACHEHIT)
+            aiMiss[cMiss++] = ici;
     }
 
-    /* get equities */
+    if (!cMiss)
+        return 0;
 
-    if (!fAll) {
+    /* cache miss */
 
-        /* cache miss */
-        if (EvaluatePositionCubeful4(nnStates, anBoard, arOutput, arCubeful,
-                                     aciCubePos, cci, pciMove, pec, nPlies, fTop))
-            return -1;
+    aciMiss = (cubeinfo *) g_alloca(cMiss * sizeof(cubeinfo));
+    arCfMiss = (float *) g_alloca(cMiss * sizeof(float));
+    for (i = 0; i < cMiss; i++)
+        aciMiss[i] = aciCubePos[aiMiss[i]];
 
-        /* add to cache */
+    if (EvaluatePositionCubeful4(nnStates, anBoard, arOutput, arCfMiss, aciMiss, cMiss, pciMove, pec, nPlies, FALSE))
+        return -1;
 
-        if (!fTop) {
+    /* add to cache */
 
-            for (ici = 0; ici < cci; ++ici) {
-                if (aciCubePos[ici].nCube < 0)
-                    continue;
+    memcpy(ec.ar, arOutput, sizeof(float) * NUM_OUTPUTS);
 
-                memcpy(ec.ar, arOutput, sizeof(float) * NUM_OUTPUTS);
-                ec.ar[5] = arCubeful[ici];      /* Cubeful equity stored in slot 5 */
-                ec.nEvalContext = EvalKey(pec, nPlies, &aciCubePos[ici], TRUE);
+    for (i = 0; i < cMiss; i++) {
+        arCubeful[aiMiss[i]] = arCfMiss[i];
 
-                CacheAdd(&cEval, &ec, GetHashKey(cEval.hashMask, &ec));
+        ec.ar[5] = arCfMiss[i]; /* Cubeful equity stored in slot 5 */
+        ec.nEvalContext = EvalKey(pec, nPlies, &aciMiss[i], TRUE);
 
-            }
-        }
+        EvalCacheAdd(EVAL_CACHE_CUBEFUL, nPlies, pc, &ec, alMiss[i]);
     }
 
     return 0;
@@ -97,8 +97,42 @@ typedef struct {
     unsigned int fUsePrune:1;
     unsigned int fDeterministic:1;
     float rNoise;               /* standard deviation */
+    unsigned int nCascade:3;    /* net cascade used with fUsePrune */
+    float rTimeLimit;           /* seconds for a move, 0 for no limit */
+    float rPruneThreshold;      /* keep pruning candidates this close to the
+                                 * best, 0 for a fixed number */
+    unsigned int nPruneMin:4;   /* ... but at least this many */
+    unsigned int nPruneMax:5;   /* ... and at most this many, 0 for the
+                                 * number the cascade keeps */
 } evalcontext;
 
+/* Net cascades: at the interior nodes of a search with pruning each
+ * stage scores the candidate moves left by the stage before and keeps
+ * the best acKeep[] of them (for race, crashed and contact positions);
+ * the full net then picks the move from the ones left.  With an
+ * evalcontext rPruneThreshold the last stage keeps only the candidates
+ * within it of the best, from nPruneMin up to nPruneMax or acKeep[]. */
+
+#define MAX_CASCADE_STAGES 3
+#define MAX_CASCADE_KEEP 16
+#define NUM_CASCADES 5
+
+typedef struct {
+    int fPrune;                 /* pruning nets, or else the full nets */
+    unsigned int acKeep[3];     /* indexed by pc - CLASS_RACE */
+} cascadestage;
+
+typedef struct {
+    const char *szName;
+    unsigned int cStages;
+    cascadestage acs[MAX_CASCADE_STAGES];
+} netcascade;
+
+extern const netcascade anNetCascades[NUM_CASCADES];
+
+/* the cascade of pec; "normal" if its nCascade is out of range */
+extern const netcascade *NetCascade(const evalcontext * pec);
+
 /* identifies the format of evaluation info in .sgf files
  * early (pre extending rollouts) had no version numbers
  * extendable rollouts have a version number of 1
@@ -107,9 +141,12 @@ typedef struct {
  * improvements, I assume we will drop reduction entirely. (ver = 3 or more)
  * When presented with an .sgf file, gnubg will attempt to work out what
  * data is present in the file based on the version number
+ * Version 4 adds the net cascade and the time limit after the other
+ * evaluation settings (after the outputs in a cube analysis), where
+ * earlier versions don't look.
  */
 
-#define SGF_FORMAT_VER 3
+#define SGF_FORMAT_VER 4
 
 typedef struct {
 
@@ -275,6 +312,10 @@ typedef enum {
     CMARK_ROLLOUT
 } CMark;
 
+/* The part of a move that the move generator and the ply search work
+ * on.  The search keeps its lists of these on the move stack of the
+ * thread; a move, with the analysis data as well, is only made from one
+ * for the lists handed out by GenerateMoves() and FindnSaveBestMoves(). */
 typedef struct {
     int anMove[8];
     positionkey key;
@@ -283,12 +324,32 @@ typedef struct {
     float rScore, rScore2;
     /* evaluation for this move */
     float arEvalMove[NUM_ROLLOUT_OUTPUTS];
+    /* bit masks of the points of each side that the move may have
+     * changed (bit 24 for the bar), set by GenerateMoves() */
+    unsigned int anChanged[2];
+    unsigned int nPlies;        /* of the evaluation */
+} searchmove;
+
+/* A move with its analysis: the standard deviations and the evalsetup,
+ * whose rollout context alone is most of a kilobyte */
+typedef struct {
+    int anMove[8];
+    positionkey key;
+    unsigned int cMoves, cPips;
+    /* scores for this move */
+    float rScore, rScore2;
+    /* evaluation for this move */
+    float arEvalMove[NUM_ROLLOUT_OUTPUTS];
+    CMark cmark;
+    /* bit masks of the points of each side that the move may have
+     * changed (bit 24 for the bar), set by GenerateMoves() */
+    unsigned int anChanged[2];
     float arEvalStdDev[NUM_ROLLOUT_OUTPUTS];
     evalsetup esMove;
-    CMark cmark;
 } move;
 
 extern int fInterrupt;
+extern unsigned int nEvalSplitPlies;
 extern cubeinfo ciCubeless;
 extern const char *aszEvalType[(int) EVAL_ROLLOUT + 1];
 
@@ -306,6 +367,14 @@ typedef struct {
     move *amMoves;
 } movelist;
 
+typedef struct {
+    unsigned int cMoves;        /* and current move when building list */
+    unsigned int cMaxMoves, cMaxPips;
+    int iMoveBest;
+    float rBestScore;
+    searchmove *amMoves;
+} searchlist;
+
 /* cube efficiencies */
 
 extern float rOSCubeX;
@@ -336,10 +405,39 @@ typedef enum {
 
 #define CLASS_PERFECT CLASS_BEAROFF_TS
 
+extern const char *aszPositionClass[N_CLASSES];
+
 /* Evaluation cache size is 2^SIZE entries */
 #define CACHE_SIZE_DEFAULT 19
 #define CACHE_SIZE_GUIMAX 23
 
+/* the evaluation caches */
+typedef enum {
+    EVAL_CACHE_EVAL,            /* cEval: all evaluations */
+    EVAL_CACHE_PRUNE,           /* cpEval: the pruning nets */
+    EVAL_CACHE_CUBEFUL,         /* cubeful equities, also in cEval */
+    EVAL_CACHE_FILE,            /* cfEval: the cache file */
+    N_EVAL_CACHES
+} evalcacheid;
+
+/* what EvalCacheStats() counts */
+typedef enum {
+    CACHE_LOOKUPS,
+    CACHE_HITS,
+    CACHE_ADDS,
+    CACHE_EVICTIONS,            /* adds that pushed out an entry */
+    N_CACHE_COUNTS
+} cachecount;
+
+/* the evaluations of this many plies or more are kept in the cache file */
+#define CACHE_FILE_MIN_PLIES 2
+
+#define CACHE_PLIES 8           /* evalcontext.nPlies has 3 bits */
+
+typedef struct {
+    unsigned long aaaac[N_EVAL_CACHES][CACHE_PLIES][N_CLASSES][N_CACHE_COUNTS];
+} cachecounts;
+
 #define CFMONEY(arEquity,pci) \
    ( ( (pci)->fCubeOwner == -1 ) ? arEquity[ 2 ] : \
    ( ( (pci)->fCubeOwner == (pci)->fMove ) ? arEquity[ 1 ] : arEquity[ 3 ] ) )
@@ -349,7 +447,8 @@ typedef enum {
      ( ( (pci)->fJacoby ) ? arEquity[ 2 ] : arEquity[ 1 ] ) : \
      ( ( (pci)->fCubeOwner == (pci)->fMove ) ? arEquity[ 0 ] : arEquity[ 3 ] ) )
 
-extern void EvalInitialise(char *szWeights, char *szWeightsBinary, int fNoBearoff, void (*pfProgress) (unsigned int));
+extern void EvalInitialise(char *szWeights, char *szWeightsBinary, char *szWeightsMapped, int fNoBearoff,
+                           void (*pfProgress) (unsigned int));
 
 extern int EvalShutdown(void);
 
@@ -409,8 +508,36 @@ extern void
 extern int
  EvalCacheResize(unsigned int cNew);
 
+extern void
+ EvalCacheStats(cachecounts * pcc, unsigned int acSize[N_EVAL_CACHES], unsigned int acUsed[N_EVAL_CACHES]);
+
+extern void
+ EvalCacheStatsReset(void);
+
 extern int
- EvalCacheStats(unsigned int *pcUsed, unsigned int *pcLookup, unsigned int *pcHit);
+ EvalCacheReallocate(void);
+
+extern unsigned int
+ EvalCacheAllocation(void);
+
+extern int
+ EvalCacheShare(const char *szName);
+
+extern int
+ EvalCacheUnshare(void);
+
+extern const char *EvalCacheSharedName(void);
+
+extern int
+ EvalCacheFileOpen(const char *szFile, unsigned int cEntries);
+
+extern void
+ EvalCacheFileClose(void);
+
+extern void
+ EvalCacheFileClear(void);
+
+extern const char *EvalCacheFileName(int *pfValid);
 
 extern double GetEvalCacheSize(void);
 void SetEvalCacheSize(unsigned int size);
@@ -419,6 +546,28 @@ extern int GetCacheMB(int size);
 
 extern int
  GenerateMoves(movelist * pml, const TanBoard anBoard, int n0, int n1, int fPartial);
+extern int GenerateSearchMoves(searchlist * pml, const TanBoard anBoard, int n0, int n1, int fPartial);
+
+extern searchmove *MoveArenaTop(void);
+extern unsigned int MoveArenaPush(const searchlist * pml);
+extern void MoveArenaPop(unsigned int nMark);
+
+/* kinds of positions timed by EvalMoveGeneration() */
+typedef enum {
+    MOVEGEN_ALL,                /* all rolls */
+    MOVEGEN_DOUBLES,            /* doubles only */
+    MOVEGEN_PARTIAL,            /* doubles, with incomplete moves */
+    MOVEGEN_BAR,                /* all rolls, with chequers on the bar */
+    N_MOVEGEN_TESTS
+} movegentest;
+
+extern void
+ EvalMoveGeneration(const movegentest mgt, const unsigned int cPositions, float *prMoves, float *prScan,
+                    float *prHash, unsigned int *pcDiffer);
+
+extern void
+ EvalPerft(const unsigned int cPositions, const int fPartial, unsigned long *pcMoves, unsigned int *pcDiffer,
+           float *prSub, float *prBits);
 
 extern int ApplySubMove(TanBoard anBoard, const int iSrc, const int nRoll, const int fCheckLegal);
 
@@ -465,6 +614,37 @@ extern void
 extern void
  SanityCheck(const TanBoard anBoard, float arOutput[]);
 
+extern void
+ EvaluateNetBatch(const positionclass pc, const int fPrune, const unsigned int cPositions,
+                  TanBoard aanBoard[], float aarOutput[][NUM_OUTPUTS], const bgvariation bgv);
+
+/* Number of nets checked by EvalCompareKernel() */
+#define N_KERNEL_TEST_NETS 6
+
+extern void
+ EvalCompareKernel(const nnkernel * pk, const unsigned int cPositions, float arMaxDiff[N_KERNEL_TEST_NETS]);
+
+extern void
+ EvalScoreMovesReport(const unsigned int cPositions, float arRate[3], float *prFromBase, float *prMaxDiff);
+
+extern void
+ EvalSplitReport(const unsigned int cPositions, const unsigned int nPlies, float arLatency[2][2],
+                 unsigned int acDiffer[2], float *prMaxDiff);
+
+extern void
+ EvalCascadeReport(const evalcontext * pecPrune, const unsigned int cPositions, float *prAgree, float *prLoss,
+                   float *prSpeed);
+
+extern void
+ EvalReducedPrecision(f_NeuralNetEvaluate pfReduced, const unsigned int cPositions, float arMax[3],
+                      float arMean[3], float arSpeed[3]);
+
+extern size_t EvalWeightsSize(int fHalf);
+extern int EvalSetHalf(int f);
+
+extern void
+ EvalHalfInputsCheck(const unsigned int cPositions, unsigned int *pcDiffer, float *prRate, float *prSpeed);
+
 extern int
  EvalBearoff1(const TanBoard anBoard, float arOutput[], const bgvariation bgv, NNState * nnStates);
 
@@ -578,19 +758,14 @@ extern int
  PerfectCubeful(bearoffcontext * pbc, const TanBoard anBoard, float arEquity[]);
 
 extern void
- baseInputs(const TanBoard anBoard, float arInput[]);
-
-extern void
- CalculateRaceInputs(const TanBoard anBoard, float inputs[]);
+ CalculateRaceInputs(const TanBoard anBoard, float inputs[], nnactive * pActive);
 
 
-extern float Noise(const evalcontext * pec, const TanBoard anBoard, int iOutput);
+extern void AddNoise(const evalcontext * pec, const TanBoard anBoard, float arOutput[NUM_OUTPUTS]);
 extern int CompareMoves(const move * pm0, const move * pm1);
 extern float EvalEfficiency(const TanBoard anBoard, positionclass pc);
 extern float Cl2CfMoney(float arOutput[NUM_OUTPUTS], cubeinfo * pci, float rCubeX);
 extern float Cl2CfMatch(float arOutput[NUM_OUTPUTS], cubeinfo * pci, float rCubeX);
-extern float Noise(const evalcontext * pec, const TanBoard anBoard, int iOutput);
-extern int EvalKey(const evalcontext * pec, const int nPlies, const cubeinfo * pci, int fCubefulEquity);
 extern void MakeCubePos(const cubeinfo aciCubePos[], const int cci, const int fTop, cubeinfo aci[], const int fInvert);
 extern void GetECF3(float arCubeful[], int cci, float arCf[], cubeinfo aci[]);
 extern int EvaluatePerfectCubeful(const TanBoard anBoard, float arEquity[], const bgvariation bgv);
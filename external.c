@@ -403,6 +403,7 @@ ExtEvaluation(extcmd * pec)
         ec.fCubeful = pec->fCubeful;
         ec.nPlies = pec->nPlies;
         ec.fUsePrune = pec->fUsePrune;
+        ec.nCascade = 0;
         ec.fDeterministic = pec->fDeterministic;
         ec.rNoise = pec->rNoise;
 
@@ -523,12 +524,29 @@ ExtFIBSBoard(extcmd * pec)
         } else if (anDice[0]) {
             /* move */
             char szMove[64];
-            if (FindBestMove(anMove, anDice[0], anDice[1],
-                             anBoard, &ci, &GetEvalChequer()->ec, *GetEvalMoveFilter()) < 0)
+            const evalcontext *pecMove = &GetEvalChequer()->ec;
+            movelist ml;
+            int i;
+
+            if (FindnSaveBestMoves(&ml, anDice[0], anDice[1], (ConstTanBoard) anBoard, NULL, 0.0f,
+                                   &ci, pecMove, *GetEvalMoveFilter()) < 0)
                 return NULL;
 
+            for (i = 0; i < 8; i++)
+                anMove[i] = (ml.cMoves && i < ml.cMaxMoves * 2) ? ml.amMoves[0].anMove[i] : -1;
+
             FormatMovePlain(szMove, anBoardOrig, anMove);
-            szResponse = g_strconcat(szMove, "\n", NULL);
+
+            /* a search against the clock tells the client how deep it
+             * got; without a time limit the response is the move alone,
+             * as before */
+            if (ml.cMoves > 1 && pecMove->rTimeLimit > 0.0f)
+                szResponse = g_strdup_printf("%s (ply %d)\n", szMove, ml.amMoves[0].esMove.ec.nPlies);
+            else
+                szResponse = g_strconcat(szMove, "\n", NULL);
+
+            if (ml.cMoves)
+                free(ml.amMoves);
         } else {
             /* double decision */
             if (GeneralCubeDecision(aarOutput, aarStdDev,
@@ -117,6 +117,10 @@ OutputEvalContext(const evalcontext * pec, const int fChequer)
 
     if (pec->fUsePrune) {
         sprintf(pc = strchr(sz, 0), " prune");
+        if (NetCascade(pec) != anNetCascades)
+            sprintf(pc = strchr(sz, 0), " (%s)", gettext(NetCascade(pec)->szName));
+        if (pec->rPruneThreshold > 0.0f)
+            sprintf(pc = strchr(sz, 0), " <%0.3g", pec->rPruneThreshold);
     }
 
     if (fChequer && pec->nPlies) {
@@ -126,6 +130,9 @@ OutputEvalContext(const evalcontext * pec, const int fChequer)
     if (pec->rNoise > 0.0f)
         sprintf(pc = strchr(sz, 0), ", noise %0.3g (%s)", pec->rNoise, pec->fDeterministic ? "d" : "nd");
 
+    if (fChequer && pec->rTimeLimit > 0.0f)
+        sprintf(pc = strchr(sz, 0), ", %0.3g s", pec->rTimeLimit);
+
     for (i = 0; i < NUM_SETTINGS; i++)
 
         if (!cmp_evalcontext(&aecSettings[i], pec)) {
@@ -1072,19 +1079,6 @@ DumpPosition(const TanBoard anBoard, char *szOutput,
     int i, nPlies;
     int j;
     evalcontext ec;
-    static const char *aszEvaluator[] = {
-        N_("Over"),
-        N_("Hypergammon-1"),
-        N_("Hypergammon-2"),
-        N_("Hypergammon-3"),
-        N_("Bearoff2"),
-        N_("Bearoff-TS"),
-        N_("Bearoff1"),
-        N_("Bearoff-OS"),
-        N_("Race"),
-        N_("Crashed"),
-        N_("Contact")
-    };
 
     strcpy(szOutput, "");
 
@@ -1099,7 +1093,7 @@ DumpPosition(const TanBoard anBoard, char *szOutput,
     strcat(szOutput, "\n");
 
     sprintf(strchr(szOutput, 0), "%s: \t", _("Evaluator"));
-    strcat(szOutput, gettext(aszEvaluator[pc]));
+    strcat(szOutput, gettext(aszPositionClass[pc]));
     strcat(szOutput, "\n\n");
     acdf[pc] (anBoard, strchr(szOutput, 0), pci->bgv);
     szOutput = strchr(szOutput, 0);
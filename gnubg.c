@@ -48,6 +48,7 @@ static char szCommandSeparators[] = " \t\n\r\v\f";
 
 #include "analysis.h"
 #include "backgammon.h"
+#include "cache.h"
 #include "dice.h"
 #include "drawboard.h"
 #include "eval.h"
@@ -517,6 +518,11 @@ char default_names[2][31] = { "gnubg", "user" };
 
 /* Usage strings */
 static char szDICE[] = N_("<die> <die>"),
+    szCACHEFILE[] = N_("<filename> [entries]|off"),
+    szCACHENUMA[] = N_("off|interleave|<node>"),
+    szCACHEPAGES[] = N_("off|transparent|explicit"),
+    szCANDIDATES[] = N_("<threshold> [<min> [<max>]]"),
+    szCACHESHARED[] = N_("<name>|off"),
     szCOMMAND[] = N_("<command>"),
     szCOMMENT[] = N_("<comment>"),
     szER[] = N_("evaluation|rollout"),
@@ -550,6 +556,7 @@ static char szDICE[] = N_("<die> <die>"),
     szPRIORITY[] = N_("<priority>"),
     szPROMPT[] = N_("<prompt>"),
     szSCORE[] = N_("<score>"),
+    szSECONDS[] = N_("<seconds>"),
     szSIZE[] = N_("<size>"),
     szSTEP[] = N_("[game|roll|rolled|marked] <count>"),
     szTRIALS[] = N_("<trials>"),
@@ -611,12 +618,12 @@ char const *aszBuildInfo[] = {
     N_("Multiple threads supported."),
 #endif
 #if USE_SIMD_INSTRUCTIONS
-#if USE_SSE2
-    N_("SSE/SSE2 supported."),
-#elif USE_AVX
-    N_("AVX supported."),
+#if HAVE_SIMD_AVX2
+    N_("SSE2/AVX/AVX2 supported (selected at run time)."),
+#elif HAVE_SIMD_AVX
+    N_("SSE2/AVX supported (selected at run time)."),
 #else
-    N_("SSE supported."),
+    N_("SSE2 supported."),
 #endif
 #endif
     NULL
@@ -2899,12 +2906,18 @@ SaveEvalSettings(FILE * pf, const char *sz, evalcontext * pec)
     gchar *szNoise = g_ascii_formatd(buf, G_ASCII_DTOSTR_BUF_SIZE, "%0.3f", pec->rNoise);
     fprintf(pf, "%s plies %d\n"
             "%s prune %s\n"
+            "%s cascade %s\n"
             "%s cubeful %s\n"
             "%s noise %s\n"
             "%s deterministic %s\n",
             sz, pec->nPlies,
             sz, pec->fUsePrune ? "on" : "off",
+            sz, NetCascade(pec)->szName,
             sz, pec->fCubeful ? "on" : "off", sz, szNoise, sz, pec->fDeterministic ? "on" : "off");
+    fprintf(pf, "%s timelimit %s\n", sz, g_ascii_formatd(buf, G_ASCII_DTOSTR_BUF_SIZE, "%0.3f", pec->rTimeLimit));
+    fprintf(pf, "%s candidates %s %u %u\n", sz,
+            g_ascii_formatd(buf, G_ASCII_DTOSTR_BUF_SIZE, "%0.4f", pec->rPruneThreshold), pec->nPruneMin,
+            pec->nPruneMax);
 }
 
 
@@ -3232,18 +3245,45 @@ SaveRuleSettings(FILE * pf)
     fprintf(pf, "set variation %s\n", aszVariationCommands[bgvDefault]);
 }
 
+static void
+SaveCacheAllocationSettings(FILE * pf)
+{
+    static const char *aszPages[] = { "off", "transparent", "explicit" };
+    cachepages cp;
+    int nNUMA;
+
+    CacheGetAllocation(&cp, &nNUMA);
+
+    fprintf(pf, "set cache hugepages %s\n", aszPages[cp]);
+    if (nNUMA == CACHE_NUMA_DEFAULT)
+        fprintf(pf, "set cache numa off\n");
+    else if (nNUMA == CACHE_NUMA_INTERLEAVE)
+        fprintf(pf, "set cache numa interleave\n");
+    else
+        fprintf(pf, "set cache numa %d\n", nNUMA);
+    fprintf(pf, "set cache sequencelock %s\n", CacheGetSequenceLock() ? "on" : "off");
+}
+
 static void
 SaveEvaluationSettings(FILE * pf)
 {
     fprintf(pf, "set eval sameasanalysis %s\n", fEvalSameAsAnalysis ? "on" : "off");
+    fprintf(pf, "set evaluation quantized %s\n", NeuralNetGetQuantised() ? "on" : "off");
+    fprintf(pf, "set evaluation halfprecision %s\n", NeuralNetGetHalf() ? "on" : "off");
     SaveEvalSetupSettings(pf, "set evaluation chequerplay", &esEvalChequer);
     SaveEvalSetupSettings(pf, "set evaluation cubedecision", &esEvalCube);
     SaveMoveFilterSettings(pf, "set evaluation movefilter", aamfEval);
+    SaveCacheAllocationSettings(pf);
     fprintf(pf, "set cache %d\n", GetEvalCacheEntries());
     fprintf(pf, "set matchequitytable \"%s\"\n", miCurrent.szFileName);
     fprintf(pf, "set invert matchequitytable %s\n", fInvertMET ? "on" : "off");
+    if (EvalCacheFileName(NULL))
+        fprintf(pf, "set cachefile \"%s\"\n", EvalCacheFileName(NULL));
+    if (EvalCacheSharedName())
+        fprintf(pf, "set cache shared \"%s\"\n", EvalCacheSharedName());
 #if USE_MULTITHREAD
     fprintf(pf, "set threads %d\n", MT_GetNumThreads());
+    fprintf(pf, "set threads split %u\n", nEvalSplitPlies);
 #endif
 }
 
@@ -4333,9 +4373,12 @@ init_nets(int fNoBearoff)
 {
     char *gnubg_weights = BuildFilename("gnubg.weights");
     char *gnubg_weights_binary = BuildFilename("gnubg.wd");
-    EvalInitialise(gnubg_weights, gnubg_weights_binary, fNoBearoff, fShowProgress ? BearoffProgress : NULL);
+    char *gnubg_weights_mapped = BuildFilename("gnubg.wm");
+    EvalInitialise(gnubg_weights, gnubg_weights_binary, gnubg_weights_mapped, fNoBearoff,
+                   fShowProgress ? BearoffProgress : NULL);
     g_free(gnubg_weights);
     g_free(gnubg_weights_binary);
+    g_free(gnubg_weights_mapped);
 }
 
 extern int
@@ -1408,6 +1408,60 @@ DictSetItemSteal(PyObject * dict, const char *key, PyObject * val)
     Py_DECREF(val);
 }
 
+static void
+CacheCountsToPy(PyObject * dict, const unsigned long ac[N_CACHE_COUNTS])
+{
+    DictSetItemSteal(dict, "lookups", PyLong_FromUnsignedLong(ac[CACHE_LOOKUPS]));
+    DictSetItemSteal(dict, "hits", PyLong_FromUnsignedLong(ac[CACHE_HITS]));
+    DictSetItemSteal(dict, "adds", PyLong_FromUnsignedLong(ac[CACHE_ADDS]));
+    DictSetItemSteal(dict, "evictions", PyLong_FromUnsignedLong(ac[CACHE_EVICTIONS]));
+}
+
+static PyObject *
+PythonCacheStats(PyObject * UNUSED(self), PyObject * UNUSED(args))
+{
+    static const char *aszCache[N_EVAL_CACHES] = { "eval", "prune", "cubeful", "file" };
+    cachecounts cc;
+    unsigned int acSize[N_EVAL_CACHES], acUsed[N_EVAL_CACHES];
+    unsigned int i, j, k, n;
+    PyObject *pyStats = PyDict_New();
+
+    EvalCacheStats(&cc, acSize, acUsed);
+
+    for (i = 0; i < N_EVAL_CACHES; i++) {
+        unsigned long ac[N_CACHE_COUNTS] = { 0, 0, 0, 0 };
+        PyObject *pyCache = PyDict_New();
+        PyObject *pyDetail = PyList_New(0);
+
+        for (j = 0; j < CACHE_PLIES; j++)
+            for (k = 0; k < N_CLASSES; k++) {
+                const unsigned long *pc = cc.aaaac[i][j][k];
+                PyObject *pyCounts;
+
+                for (n = 0; n < N_CACHE_COUNTS; n++)
+                    ac[n] += pc[n];
+
+                if (!pc[CACHE_LOOKUPS] && !pc[CACHE_ADDS])
+                    continue;
+
+                pyCounts = PyDict_New();
+                DictSetItemSteal(pyCounts, "plies", PyInt_FromLong(j));
+                DictSetItemSteal(pyCounts, "class", PyString_FromString(aszPositionClass[k]));
+                CacheCountsToPy(pyCounts, pc);
+                PyList_Append(pyDetail, pyCounts);
+                Py_DECREF(pyCounts);
+            }
+
+        DictSetItemSteal(pyCache, "size", PyLong_FromUnsignedLong(acSize[i]));
+        DictSetItemSteal(pyCache, "used", PyLong_FromUnsignedLong(acUsed[i]));
+        CacheCountsToPy(pyCache, ac);
+        DictSetItemSteal(pyCache, "detail", pyDetail);
+        DictSetItemSteal(pyStats, aszCache[i], pyCache);
+    }
+
+    return pyStats;
+}
+
 typedef struct {
     const evalcontext *ec;
     const rolloutcontext *rc;
@@ -2593,6 +2647,15 @@ PyMethodDef gnubgMethods[] = {
     {"command", PythonCommand, METH_VARARGS,
      "Execute a command\n" "    arguments: string containing command\n" "    returns: nothing"}
     ,
+    {"cachestats", PythonCacheStats, METH_VARARGS,
+     "Get the statistics of the evaluation caches since the last \"clear cache\"\n"
+     "    arguments: none\n"
+     "    returns: dictionary: 'eval'/'prune'/'cubeful'/'file' => dictionary:\n"
+     "        'size', 'used', 'lookups', 'hits', 'adds', 'evictions' => int\n"
+     "            ('cubeful' is kept in 'eval', its size and used are 0)\n"
+     "        'detail' => list of the counts by ply and position class,\n"
+     "            with 'plies' => int and 'class' => string"}
+    ,
     {"cfevaluate", PythonEvaluateCubeful, METH_VARARGS,
      "Cubeful evaluation\n"
      "    arguments: [board] [cube-info] [eval-context]\n"
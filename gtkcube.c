@@ -689,6 +689,7 @@ CubeAnalysisEvalPly(GtkWidget * pw, cubehintdata * pchd)
 
     ec.fCubeful = esAnalysisCube.ec.fCubeful;
     ec.fUsePrune = esAnalysisCube.ec.fUsePrune;
+    ec.nCascade = esAnalysisCube.ec.nCascade;
     ec.nPlies = atoi(szPly);
 
     EvalCube(pchd, &ec);
@@ -1887,8 +1887,10 @@ FinishMove(gpointer UNUSED(p), guint UNUSED(n), GtkWidget * UNUSED(pw))
 typedef struct _evalwidget {
     evalcontext *pec;
     movefilter *pmf;
-    GtkWidget *pwCubeful, *pwUsePrune, *pwDeterministic;
+    GtkWidget *pwCubeful, *pwUsePrune, *pwCascade, *pwDeterministic;
     GtkAdjustment *padjPlies, *padjSearchCandidates, *padjSearchTolerance, *padjNoise;
+    GtkAdjustment *padjTimeLimit;
+    GtkWidget *pwTimeLimit;
     int *pfOK;
     GtkWidget *pwOptionMenu;
     int fMoveFilter;
@@ -1900,9 +1902,11 @@ EvalGetValues(evalcontext * pec, evalwidget * pew)
 {
 
     pec->nPlies = (int) gtk_adjustment_get_value(pew->padjPlies);
+    pec->rTimeLimit = (float) gtk_adjustment_get_value(pew->padjTimeLimit);
     pec->fCubeful = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(pew->pwCubeful));
 
     pec->fUsePrune = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(pew->pwUsePrune));
+    pec->nCascade = (unsigned int) MAX(gtk_combo_box_get_active(GTK_COMBO_BOX(pew->pwCascade)), 0);
 
     pec->rNoise = (float) gtk_adjustment_get_value(pew->padjNoise);
     pec->fDeterministic = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(pew->pwDeterministic));
@@ -1918,6 +1922,8 @@ EvalChanged(GtkWidget * UNUSED(pw), evalwidget * pew)
     int fFound = FALSE;
     int fEval, fMoveFilter;
 
+    /* the settings without widgets stay as they are */
+    ecCurrent = *pew->pec;
     EvalGetValues(&ecCurrent, pew);
 
     /* update predefined settings menu */
@@ -1952,6 +1958,9 @@ EvalChanged(GtkWidget * UNUSED(pw), evalwidget * pew)
     if (pew->fMoveFilter)
         gtk_widget_set_sensitive(GTK_WIDGET(pew->pwMoveFilter), ecCurrent.nPlies);
 
+    gtk_widget_set_sensitive(pew->pwCascade, ecCurrent.nPlies > 0 && ecCurrent.fUsePrune);
+    gtk_widget_set_sensitive(pew->pwTimeLimit, ecCurrent.nPlies > 0);
+
 }
 
 
@@ -1990,9 +1999,11 @@ SettingsMenuActivate(GtkComboBox * box, evalwidget * pew)
     pec = &aecSettings[iSelected];
 
     gtk_adjustment_set_value(pew->padjPlies, pec->nPlies);
+    gtk_adjustment_set_value(pew->padjTimeLimit, pec->rTimeLimit);
     gtk_adjustment_set_value(pew->padjNoise, pec->rNoise);
 
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(pew->pwUsePrune), pec->fUsePrune);
+    gtk_combo_box_set_active(GTK_COMBO_BOX(pew->pwCascade), (int) (NetCascade(pec) - anNetCascades));
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(pew->pwCubeful), pec->fCubeful);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(pew->pwDeterministic), pec->fDeterministic);
 
@@ -2094,16 +2105,42 @@ EvalWidget(evalcontext * pec, movefilter * pmf, int *pfOK, const int fMoveFilter
     gtk_container_add(GTK_CONTAINER(pw), gtk_label_new(_("Plies:")));
     gtk_container_add(GTK_CONTAINER(pw), gtk_spin_button_new(pew->padjPlies, 1, 0));
 
+    pew->padjTimeLimit = GTK_ADJUSTMENT(gtk_adjustment_new(pec->rTimeLimit, 0, 3600, 1, 10, 0));
+    gtk_container_add(GTK_CONTAINER(pw), gtk_label_new(_("Time limit (s):")));
+    gtk_container_add(GTK_CONTAINER(pw), pew->pwTimeLimit = gtk_spin_button_new(pew->padjTimeLimit, 1, 1));
+    gtk_widget_set_tooltip_text(pew->pwTimeLimit,
+                                _("Deepen move searches one ply at a time, up "
+                                  "to the plies above, while they take less "
+                                  "than this long; 0 for no limit"));
+
     /* Use pruning neural nets */
 
     pwFrame2 = gtk_frame_new(_("Pruning neural nets"));
     gtk_container_add(GTK_CONTAINER(pw2), pwFrame2);
 
-    gtk_container_add(GTK_CONTAINER(pwFrame2),
+    pw3 = gtk_vbox_new(FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(pwFrame2), pw3);
+
+    gtk_container_add(GTK_CONTAINER(pw3),
                       pew->pwUsePrune = gtk_check_button_new_with_label(_("Use neural net pruning")));
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(pew->pwUsePrune), pec->fUsePrune);
     /* FIXME This needs a tool tip */
 
+    pw = gtk_hbox_new(FALSE, 0);
+    gtk_container_add(GTK_CONTAINER(pw3), pw);
+    gtk_container_add(GTK_CONTAINER(pw), gtk_label_new(_("Net cascade:")));
+
+    pew->pwCascade = gtk_combo_box_text_new();
+    for (i = 0; i < NUM_CASCADES; i++)
+        gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(pew->pwCascade), gettext(anNetCascades[i].szName));
+    gtk_combo_box_set_active(GTK_COMBO_BOX(pew->pwCascade), (int) (NetCascade(pec) - anNetCascades));
+    gtk_container_add(GTK_CONTAINER(pw), pew->pwCascade);
+
+    gtk_widget_set_tooltip_text(pew->pwCascade,
+                                _("The nets that select the candidate moves "
+                                  "when pruning; see \"show cascades\" for "
+                                  "how they compare"));
+
     /* cubeful */
 
     pwFrame2 = gtk_frame_new(_("Cubeful evaluations"));
@@ -2206,6 +2243,10 @@ EvalWidget(evalcontext * pec, movefilter * pmf, int *pfOK, const int fMoveFilter
 
     g_signal_connect(G_OBJECT(pew->pwUsePrune), "toggled", G_CALLBACK(EvalChanged), pew);
 
+    g_signal_connect(G_OBJECT(pew->pwCascade), "changed", G_CALLBACK(EvalChanged), pew);
+
+    g_signal_connect(G_OBJECT(pew->padjTimeLimit), "value-changed", G_CALLBACK(EvalChanged), pew);
+
     g_object_set_data_full(G_OBJECT(pwEval), "user_data", pew, free);
 
     return pwEval;
@@ -2240,11 +2281,22 @@ SetEvalCommands(const char *szPrefix, evalcontext * pec, evalcontext * pecOrig)
         UserCommand(sz);
     }
 
+    if (pec->rTimeLimit != pecOrig->rTimeLimit) {
+        gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+        sprintf(sz, "%s timelimit %s", szPrefix, g_ascii_formatd(buf, G_ASCII_DTOSTR_BUF_SIZE, "%.1f", pec->rTimeLimit));
+        UserCommand(sz);
+    }
+
     if (pec->fUsePrune != pecOrig->fUsePrune) {
         sprintf(sz, "%s prune %s", szPrefix, pec->fUsePrune ? "on" : "off");
         UserCommand(sz);
     }
 
+    if (pec->nCascade != pecOrig->nCascade) {
+        sprintf(sz, "%s cascade %s", szPrefix, NetCascade(pec)->szName);
+        UserCommand(sz);
+    }
+
     if (pec->fCubeful != pecOrig->fCubeful) {
         sprintf(sz, "%s cubeful %s", szPrefix, pec->fCubeful ? "on" : "off");
         UserCommand(sz);
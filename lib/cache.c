@@ -26,6 +26,27 @@
 #ifndef WIN32
 #include <stdio.h>
 #endif
+#include <glib.h>
+#include <glib/gstdio.h>
+#if HAVE_SYS_MMAN_H && HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define CACHE_MMAP 1
+#if HAVE_LINUX_MEMPOLICY_H && HAVE_SYS_SYSCALL_H
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
+/* the policies are an enum, so test one of the flags */
+#if defined(MPOL_MF_STRICT) && defined(__NR_mbind)
+#define CACHE_NUMA 1
+#endif
+#if HAVE_FLOCK
+#include <sys/file.h>
+#define CACHE_FLOCK 1
+#endif
+#include <errno.h>
+#endif
 
 #include "cache.h"
 #include "positionid.h"
@@ -36,6 +57,19 @@
 #if defined(__GNUC__) && ( __GNUC__ * 100 + __GNUC_MINOR__ >= 401 ) \
   && (defined (__i386) || defined (__x86_64))
 
+/* The lookups and adds of the evaluation threads can use the lock of
+ * each node as a sequence count, odd while the node is being written:
+ * readers check that it is even and unchanged around their copy of the
+ * node and never write to it, and writers make it odd with a single
+ * compare-and-swap, dropping their entry if another thread is writing
+ * the node.  The spin lock stays the default, see
+ * CacheSetSequenceLock(); CacheBenchmark() compares the two. */
+#define CACHE_SEQLOCK 1
+
+/* x86 keeps loads in order with other loads and stores with other
+ * stores, so the sequence count only needs the compiler kept in order */
+#define cache_barrier() __asm volatile ("" ::: "memory")
+
 #define cache_lock(pc, k) \
     while (__sync_lock_test_and_set(&(pc->entries[k].lock), 1)) \
          while (pc->entries[k].lock) \
@@ -64,30 +98,192 @@ WaitForLock(volatile int *lock)
 
 #endif                          /* USE_MULTITHREAD */
 
+/* Shared memory needs the sequence counts, as a process that dies
+ * holding a spin lock would leave the others waiting for it forever */
+#if CACHE_MMAP && HAVE_SHM_OPEN && CACHE_SEQLOCK
+#include <signal.h>
+#define CACHE_SHM 1
+#endif
+
+
+/* The allocation of the next caches created, see CacheSetAllocation() */
+static cachepages cpAlloc = CACHE_PAGES_DEFAULT;
+static int nNUMAAlloc = CACHE_NUMA_DEFAULT;
+static int fSeqLockAlloc = FALSE;
+
+/* Allocate the large caches of CacheCreate() on huge pages, which take
+ * most of the TLB misses out of their random lookups, and (nNUMA) on
+ * the memory of all NUMA nodes in turn or that of one node instead of
+ * that of the thread clearing them.  Each is a request the system may
+ * not grant; evalCache.fAlloc tells what a cache got. */
+
+extern void
+CacheSetAllocation(const cachepages cp, const int nNUMA)
+{
+    cpAlloc = cp;
+    nNUMAAlloc = nNUMA;
+}
+
+extern void
+CacheGetAllocation(cachepages * pcp, int *pnNUMA)
+{
+    *pcp = cpAlloc;
+    *pnNUMA = nNUMAAlloc;
+}
+
+/* Use sequence counts instead of spin locks in the caches created from
+ * now on; returns -1 if they are not available on this platform.  The
+ * shared caches of other processes always use them. */
+
+extern int
+CacheSetSequenceLock(const int f)
+{
+#if CACHE_SEQLOCK
+    fSeqLockAlloc = f;
+    return 0;
+#else
+    return f ? -1 : 0;
+#endif
+}
+
+extern int
+CacheGetSequenceLock(void)
+{
+    return fSeqLockAlloc;
+}
+
+#if CACHE_MMAP
+
+#define CACHE_HUGE_PAGE (2 * 1024 * 1024)
+
+#if CACHE_NUMA
+#define CACHE_NUMA_MASK_BITS (4 * sizeof(unsigned long) * 8)
+
+/* Set the bits of the online NUMA nodes (a list such as "0-3,6" in
+ * sysfs) in anMask; returns how many there are, 0 if the list can't be
+ * read.  Interleaving over nodes that are not there fails or leaves
+ * pages on whichever nodes the kernel picks. */
+
+static unsigned int
+CacheOnlineNodes(unsigned long anMask[CACHE_NUMA_MASK_BITS / (sizeof(unsigned long) * 8)])
+{
+    FILE *pf;
+    char sz[256], *pch;
+    unsigned int c = 0;
+
+    memset(anMask, 0, CACHE_NUMA_MASK_BITS / 8);
+
+    if ((pf = fopen("/sys/devices/system/node/online", "r")) == NULL)
+        return 0;
+    pch = fgets(sz, sizeof(sz), pf);
+    fclose(pf);
+
+    while (pch && *pch >= '0' && *pch <= '9') {
+        unsigned long n0 = strtoul(pch, &pch, 10), n1 = n0;
+
+        if (*pch == '-')
+            n1 = strtoul(pch + 1, &pch, 10);
+        for (; n0 <= n1 && n0 < CACHE_NUMA_MASK_BITS; n0++, c++)
+            anMask[n0 / (sizeof(unsigned long) * 8)] |= 1UL << (n0 % (sizeof(unsigned long) * 8));
+        if (*pch == ',')
+            pch++;
+    }
+
+    return c;
+}
+#endif
+
+/* Map cb bytes for pc as CacheSetAllocation() asked; returns NULL if
+ * they are to come from malloc() */
+
+static void *
+CacheMap(evalCache * pc, size_t cb)
+{
+    void *p = MAP_FAILED;
+
+    if (cpAlloc == CACHE_PAGES_DEFAULT && nNUMAAlloc == CACHE_NUMA_DEFAULT)
+        return NULL;
+
+    cb = (cb + CACHE_HUGE_PAGE - 1) & ~((size_t) CACHE_HUGE_PAGE - 1);
+
+#if defined(MAP_HUGETLB)
+    if (cpAlloc == CACHE_PAGES_EXPLICIT && (p = mmap(NULL, cb, PROT_READ | PROT_WRITE,
+                                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) != MAP_FAILED)
+        pc->fAlloc |= CACHE_ALLOC_HUGETLB;
+#endif
+
+    /* without reserved huge pages, ask for transparent ones */
+    if (p == MAP_FAILED && (p = mmap(NULL, cb, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+        return NULL;
+
+    pc->fAlloc |= CACHE_ALLOC_MAPPED;
+    pc->cbAlloc = cb;
+
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+    if (cpAlloc != CACHE_PAGES_DEFAULT && !(pc->fAlloc & CACHE_ALLOC_HUGETLB)
+        && !madvise(p, cb, MADV_HUGEPAGE))
+        pc->fAlloc |= CACHE_ALLOC_ADVISED;
+#endif
+
+#if CACHE_NUMA
+    /* before CacheFlush() first touches the pages */
+    if (nNUMAAlloc != CACHE_NUMA_DEFAULT) {
+        unsigned long anMask[CACHE_NUMA_MASK_BITS / (sizeof(unsigned long) * 8)];
+        unsigned int cOnline = CacheOnlineNodes(anMask);
+        int fBind;
+
+        if (nNUMAAlloc == CACHE_NUMA_INTERLEAVE)
+            /* nothing to interleave over a single node */
+            fBind = cOnline > 1;
+        else {
+            /* a node that is not online is left to the default policy */
+            fBind = nNUMAAlloc >= 0 && nNUMAAlloc < (int) CACHE_NUMA_MASK_BITS
+                && (anMask[nNUMAAlloc / (sizeof(unsigned long) * 8)] & (1UL << (nNUMAAlloc % (sizeof(unsigned long) * 8))));
+            memset(anMask, 0, sizeof(anMask));
+            if (fBind)
+                anMask[nNUMAAlloc / (sizeof(unsigned long) * 8)] = 1UL << (nNUMAAlloc % (sizeof(unsigned long) * 8));
+        }
+
+        if (fBind && !syscall(__NR_mbind, p, cb, nNUMAAlloc == CACHE_NUMA_INTERLEAVE ? MPOL_INTERLEAVE : MPOL_PREFERRED,
+                              anMask, (unsigned long) CACHE_NUMA_MASK_BITS, 0))
+            pc->fAlloc |= CACHE_ALLOC_NUMA;
+    }
+#endif
+
+    return p;
+}
+#endif
 
 int
 CacheCreate(evalCache * pc, unsigned int s)
 {
-#if CACHE_STATS
-    pc->cLookup = 0;
-    pc->cHit = 0;
-    pc->nAdds = 0;
-#endif
+    unsigned int cNodes;
 
     if (s > 1u << 31)
         return -1;
 
+    pc->pcf = NULL;
     pc->size = s;
     /* adjust size to smallest power of 2 GE to s */
     while ((s & (s - 1)) != 0)
         s &= (s - 1);
 
     pc->size = (s < pc->size) ? 2 * s : s;
-    pc->hashMask = (pc->size >> 1) - 1;
+    /* at least one node, so that a cache of size 0 can be looked up */
+    cNodes = pc->size > CACHE_WAYS ? pc->size / CACHE_WAYS : 1;
+    pc->hashMask = cNodes - 1;
+    pc->cWays = CACHE_WAYS;
+    pc->fSeqLock = fSeqLockAlloc;
 
-    pc->entries = (cacheNode *) malloc((pc->size / 2) * sizeof(*pc->entries));
-    if (pc->entries == 0)
+    /* each node on cache lines of its own */
+    pc->fAlloc = 0;
+#if CACHE_MMAP
+    if (!(pc->pAlloc = CacheMap(pc, cNodes * sizeof(cacheNode))))
+#endif
+        pc->pAlloc = malloc((cNodes + 1) * sizeof(cacheNode));
+    if (pc->pAlloc == 0)
         return -1;
+    pc->entries = (cacheNode *) (((size_t) pc->pAlloc + sizeof(cacheNode) - 1) & ~(sizeof(cacheNode) - 1));
 
     CacheFlush(pc);
     return 0;
@@ -210,12 +406,17 @@ CacheCreate(evalCache * pc, unsigned int s)
   c ^= b; c -= rot(b,24); \
 }
 
-extern uint32_t
-GetHashKey(uint32_t hashMask, const cacheNodeDetail * e)
+/* The hash of the key and evaluation context, which picks the node, and
+ * the tag kept in the entry, with the other 32 bits of a wide tag in
+ * anTag[1] */
+
+static uint32_t
+CacheHash(const cacheNodeDetail * e, uint32_t anTag[2])
 {
     uint32_t a, b, c;
 
     a = b = c = 0xdeadbeef + (uint32_t) e->nEvalContext;
+    c += (uint32_t) (e->nEvalContext >> 32);
 
     a = a + e->key.data[0];
     b = b + e->key.data[1];
@@ -225,7 +426,7 @@ GetHashKey(uint32_t hashMask, const cacheNodeDetail * e)
 
     a = a + e->key.data[3];
     b = b + e->key.data[4];
-    b = b + e->key.data[5];
+    c = c + e->key.data[5];
 
     mix(a, b, c);
 
@@ -233,41 +434,125 @@ GetHashKey(uint32_t hashMask, const cacheNodeDetail * e)
 
     final(a, b, c);
 
-    return (c & hashMask);
+    anTag[0] = b;
+    anTag[1] = a;
+    return c;
 }
 
-uint32_t
-CacheLookupWithLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful)
+extern uint32_t
+GetHashKey(uint32_t hashMask, const cacheNodeDetail * e)
 {
-    uint32_t const l = GetHashKey(pc->hashMask, e);
+    uint32_t anTag[2];
+
+    return (CacheHash(e, anTag) & hashMask);
+}
+
+/* The high words of the wide tags, in the last entry of a node of
+ * CACHE_WAYS_WIDE entries (copied, as they share it with floats) */
+
+static uint32_t
+CacheTagHigh(const cacheNode * pce, const int i)
+{
+    uint32_t n;
+
+    memcpy(&n, (const uint32_t *) (const void *) &pce->ae[CACHE_WAYS - 1] + i, sizeof(n));
+    return n;
+}
+
+static void
+CacheSetTagHigh(cacheNode * pce, const int i, const uint32_t n)
+{
+    memcpy((uint32_t *) (void *) &pce->ae[CACHE_WAYS - 1] + i, &n, sizeof(n));
+}
+
+/* The entry of the node pce of a cache of cWays ways with the tag
+ * anTag, or -1 */
+
+static int
+CacheFind(const cacheNode * pce, const unsigned int cWays, const uint32_t anTag[2])
+{
+    int i;
+
+    for (i = 0; i < (int) cWays; i++)
+        if (pce->anPlies[i] != CACHE_EMPTY && pce->ae[i].nTag == anTag[0]
+            && (cWays == CACHE_WAYS || CacheTagHigh(pce, i) == anTag[1]))
+            return i;
+
+    return -1;
+}
+
+/* Store the outputs of e, evaluated at nPlies, in the entry with the same
+ * tag if there is one, else in an unused entry or the one with the
+ * highest age less CACHE_AGE_PER_PLY for each of its plies.  Returns
+ * whether another entry was evicted. */
+
+static int
+CacheStore(cacheNode * pce, const unsigned int cWays, const uint32_t anTag[2], const cacheNodeDetail * e,
+           const int nPlies)
+{
+    int i, iWay = CacheFind(pce, cWays, anTag), nOldest = 0;
+    int fEvict = 0;
+
+    if (iWay < 0) {
+        for (i = 0; i < (int) cWays; i++) {
+            int n;
+
+            if (pce->anPlies[i] == CACHE_EMPTY) {
+                iWay = i;
+                break;
+            }
+
+            n = pce->anAge[i] - CACHE_AGE_PER_PLY * pce->anPlies[i];
+            if (iWay < 0 || n > nOldest) {
+                iWay = i;
+                nOldest = n;
+            }
+        }
+
+        fEvict = pce->anPlies[iWay] != CACHE_EMPTY;
+    }
+
+    for (i = 0; i < (int) cWays; i++)
+        if (pce->anAge[i] < 0xff)
+            pce->anAge[i]++;
+
+    pce->ae[iWay].nTag = anTag[0];
+    if (cWays != CACHE_WAYS)
+        CacheSetTagHigh(pce, iWay, anTag[1]);
+    memcpy(pce->ae[iWay].ar, e->ar, sizeof(pce->ae[iWay].ar));
+    pce->anPlies[iWay] = (unsigned char) nPlies;
+    pce->anAge[iWay] = 0;
+
+    return fEvict;
+}
+
+static void
+CacheCopy(const float ar[6], float *arOut, float *arCubeful)
+{
+    memcpy(arOut, ar, sizeof(float) * 5 /*NUM_OUTPUTS */ );
+    if (arCubeful)
+        *arCubeful = ar[5];     /* Cubeful equity stored in slot 5 */
+}
+
+static uint32_t
+CacheLookupSpinLock(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful)
+{
+    uint32_t anTag[2];
+    uint32_t const l = CacheHash(e, anTag) & pc->hashMask;
+    int i;
 
-#if CACHE_STATS
-    ++pc->cLookup;
-#endif
 #if USE_MULTITHREAD
     cache_lock(pc, l);
 #endif
-    if (!EqualKeys(pc->entries[l].nd_primary.key, e->key) || pc->entries[l].nd_primary.nEvalContext != e->nEvalContext) {       /* Not in primary slot */
-        if (!EqualKeys(pc->entries[l].nd_secondary.key, e->key) || pc->entries[l].nd_secondary.nEvalContext != e->nEvalContext) {       /* Cache miss */
+    if ((i = CacheFind(&pc->entries[l], pc->cWays, anTag)) < 0) {      /* Cache miss */
 #if USE_MULTITHREAD
-            cache_unlock(pc, l);
+        cache_unlock(pc, l);
 #endif
-            return l;
-        } else {                /* Found in second slot, promote "hot" entry */
-            cacheNodeDetail tmp = pc->entries[l].nd_primary;
-
-            pc->entries[l].nd_primary = pc->entries[l].nd_secondary;
-            pc->entries[l].nd_secondary = tmp;
-        }
+        return l;
     }
-    /* Cache hit */
-#if CACHE_STATS
-    ++pc->cHit;
-#endif
 
-    memcpy(arOut, pc->entries[l].nd_primary.ar, sizeof(float) * 5 /*NUM_OUTPUTS */ );
-    if (arCubeful)
-        *arCubeful = pc->entries[l].nd_primary.ar[5];   /* Cubeful equity stored in slot 5 */
+    /* Cache hit */
+    CacheCopy(pc->entries[l].ae[i].ar, arOut, arCubeful);
 
 #if USE_MULTITHREAD
     cache_unlock(pc, l);
@@ -276,71 +561,159 @@ CacheLookupWithLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut,
     return CACHEHIT;
 }
 
+#if CACHE_SEQLOCK
+
 uint32_t
-CacheLookupNoLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful)
+CacheLookupWithLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful)
 {
-    uint32_t const l = GetHashKey(pc->hashMask, e);
+    uint32_t anTag[2];
+    uint32_t const l = CacheHash(e, anTag) & pc->hashMask;
+    cacheNode *const pce = &pc->entries[l];
+    float ar[6];
+    int i, nSeq;
 
-#if CACHE_STATS
-    ++pc->cLookup;
-#endif
-    if (!EqualKeys(pc->entries[l].nd_primary.key, e->key) || pc->entries[l].nd_primary.nEvalContext != e->nEvalContext) {       /* Not in primary slot */
-        if (!EqualKeys(pc->entries[l].nd_secondary.key, e->key) || pc->entries[l].nd_secondary.nEvalContext != e->nEvalContext) {       /* Cache miss */
-            return l;
-        } else {                /* Found in second slot, promote "hot" entry */
-            cacheNodeDetail tmp = pc->entries[l].nd_primary;
+    if (!pc->fSeqLock)
+        return CacheLookupSpinLock(pc, e, arOut, arCubeful);
+
+    nSeq = pce->lock;
+    cache_barrier();
+
+    if (nSeq & 1)               /* being written, take it as a miss */
+        return l;
+
+    if ((i = CacheFind(pce, pc->cWays, anTag)) < 0)     /* Cache miss */
+        return l;
+
+    memcpy(ar, pce->ae[i].ar, sizeof(ar));
+
+    cache_barrier();
+    if (pce->lock != nSeq)      /* written while we copied it */
+        return l;
 
-            pc->entries[l].nd_primary = pc->entries[l].nd_secondary;
-            pc->entries[l].nd_secondary = tmp;
-        }
-    }
     /* Cache hit */
-#if CACHE_STATS
-    ++pc->cHit;
+    CacheCopy(ar, arOut, arCubeful);
+
+    return CACHEHIT;
+}
+
+#else
+
+uint32_t
+CacheLookupWithLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful)
+{
+    return CacheLookupSpinLock(pc, e, arOut, arCubeful);
+}
+
 #endif
 
-    memcpy(arOut, pc->entries[l].nd_primary.ar, sizeof(float) * 5 /*NUM_OUTPUTS */ );
-    if (arCubeful)
-        *arCubeful = pc->entries[l].nd_primary.ar[5];   /* Cubeful equity stored in slot 5 */
+uint32_t
+CacheLookupNoLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful)
+{
+    uint32_t anTag[2];
+    uint32_t const l = CacheHash(e, anTag) & pc->hashMask;
+    int i;
+
+    if ((i = CacheFind(&pc->entries[l], pc->cWays, anTag)) < 0) /* Cache miss */
+        return l;
+
+    /* Cache hit */
+    CacheCopy(pc->entries[l].ae[i].ar, arOut, arCubeful);
 
     return CACHEHIT;
 }
 
-void
-CacheAddWithLocking(evalCache * pc, const cacheNodeDetail * e, uint32_t l)
+static int
+CacheAddSpinLock(evalCache * pc, const cacheNodeDetail * e, uint32_t l, int nPlies)
 {
+    uint32_t anTag[2];
+    int fEvict;
+
+    (void) CacheHash(e, anTag);
+
 #if USE_MULTITHREAD
     cache_lock(pc, l);
 #endif
 
-    pc->entries[l].nd_secondary = pc->entries[l].nd_primary;
-    pc->entries[l].nd_primary = *e;
+    fEvict = CacheStore(&pc->entries[l], pc->cWays, anTag, e, nPlies);
 
 #if USE_MULTITHREAD
     cache_unlock(pc, l);
 #endif
 
-#if CACHE_STATS
-    ++pc->nAdds;
+    return fEvict;
+}
+
+#if CACHE_SEQLOCK
+
+/* With sequence counts the entry is dropped if another thread is
+ * writing the node */
+
+int
+CacheAddWithLocking(evalCache * pc, const cacheNodeDetail * e, uint32_t l, int nPlies)
+{
+    cacheNode *const pce = &pc->entries[l];
+    int nSeq;
+    uint32_t anTag[2];
+    int fEvict;
+
+    if (!pc->fSeqLock)
+        return CacheAddSpinLock(pc, e, l, nPlies);
+
+    nSeq = pce->lock;
+    (void) CacheHash(e, anTag);
+
+    if ((nSeq & 1) || !__sync_bool_compare_and_swap(&pce->lock, nSeq, (int) ((unsigned int) nSeq + 1)))
+        return -1;
+
+    fEvict = CacheStore(pce, pc->cWays, anTag, e, nPlies);
+
+    cache_barrier();
+    pce->lock = (int) ((unsigned int) nSeq + 2);
+
+    return fEvict;
+}
+
+#else
+
+int
+CacheAddWithLocking(evalCache * pc, const cacheNodeDetail * e, uint32_t l, int nPlies)
+{
+    return CacheAddSpinLock(pc, e, l, nPlies);
+}
+
 #endif
+
+int
+CacheAddNoLocking(evalCache * pc, const cacheNodeDetail * e, uint32_t l, int nPlies)
+{
+    uint32_t anTag[2];
+
+    (void) CacheHash(e, anTag);
+
+    return CacheStore(&pc->entries[l], pc->cWays, anTag, e, nPlies);
 }
 
 void
 CacheDestroy(const evalCache * pc)
 {
-    free(pc->entries);
+#if CACHE_MMAP
+    if (pc->fAlloc & CACHE_ALLOC_MAPPED) {
+        munmap(pc->pAlloc, pc->cbAlloc);
+        return;
+    }
+#endif
+    free(pc->pAlloc);
 }
 
 void
 CacheFlush(const evalCache * pc)
 {
     unsigned int k;
-    for (k = 0; k < pc->size / 2; ++k) {
-        pc->entries[k].nd_primary.nEvalContext = -1;
-        pc->entries[k].nd_secondary.nEvalContext = -1;
-#if USE_MULTITHREAD
+
+    for (k = 0; k <= pc->hashMask; ++k) {
         pc->entries[k].lock = 0;
-#endif
+        memset(pc->entries[k].anPlies, CACHE_EMPTY, sizeof(pc->entries[k].anPlies));
+        memset(pc->entries[k].anAge, 0, sizeof(pc->entries[k].anAge));
     }
 }
 
@@ -356,28 +729,725 @@ CacheResize(evalCache * pc, unsigned int cNew)
     return (int) pc->size;
 }
 
-void
-CacheStats(const evalCache * pc, unsigned int *pcLookup, unsigned int *pcHit, unsigned int *pcUsed)
+/* Add the entries of pceFrom to pceTo, nodes with wide tags, which
+ * keeps the CACHE_WAYS_WIDE that CacheStore() would evict last */
+
+static void
+CacheMergeNode(cacheNode * pceTo, const cacheNode * pceFrom)
 {
-#if CACHE_STATS
-    if (pcLookup)
-        *pcLookup = pc->cLookup;
+    int i, j;
+
+    for (i = 0; i < CACHE_WAYS_WIDE; i++) {
+        int iWay = -1, nOldest = 0;
+
+        if (pceFrom->anPlies[i] == CACHE_EMPTY)
+            continue;
+
+        for (j = 0; j < CACHE_WAYS_WIDE; j++) {
+            int n;
+
+            if (pceTo->anPlies[j] == CACHE_EMPTY) {
+                iWay = j;
+                break;
+            }
+
+            n = pceTo->anAge[j] - CACHE_AGE_PER_PLY * pceTo->anPlies[j];
+            if (iWay < 0 || n > nOldest) {
+                iWay = j;
+                nOldest = n;
+            }
+        }
+
+        if (pceTo->anPlies[iWay] != CACHE_EMPTY
+            && pceFrom->anAge[i] - CACHE_AGE_PER_PLY * pceFrom->anPlies[i] >= nOldest)
+            continue;
+
+        pceTo->ae[iWay] = pceFrom->ae[i];
+        CacheSetTagHigh(pceTo, iWay, CacheTagHigh(pceFrom, i));
+        pceTo->anPlies[iWay] = pceFrom->anPlies[i];
+        pceTo->anAge[iWay] = pceFrom->anAge[i];
+    }
+}
 
-    if (pcHit)
-        *pcHit = pc->cHit;
+/* The number of entries in use */
 
-    if (pcUsed)
-        *pcUsed = pc->nAdds;
+unsigned int
+CacheUsed(const evalCache * pc)
+{
+    unsigned int k, c = 0;
+    int i;
+
+    for (k = 0; k <= pc->hashMask; ++k)
+        for (i = 0; i < (int) pc->cWays; i++)
+            c += pc->entries[k].anPlies[i] != CACHE_EMPTY;
+
+    return c;
+}
+
+/* A cache kept in a file: a header of the size of a node, then the
+ * nodes as they are in memory, with wide tags.  The file is mapped
+ * where mmap() is available, so that the system writes the changed
+ * nodes back as they are made; elsewhere it is read into memory and
+ * written back by CacheFileClose().  Version 2 has the wide tags.
+ * fClosed is cleared while the file is open, so the nodes of a file
+ * whose process died, which may have been torn, are not trusted. */
+
+#define CACHE_FILE_MAGIC "GNUbg evalcache"
+#define CACHE_FILE_VERSION 2
+#define CACHE_FILE_BYTE_ORDER 0x01020304
+
+typedef struct {
+    char szMagic[16];
+    uint32_t nVersion;
+    uint32_t nByteOrder;        /* CACHE_FILE_BYTE_ORDER as written */
+    uint32_t cbNode;
+    uint32_t cNodes;
+    unsigned char auchFingerprint[16];
+    uint32_t nCreator;          /* the process creating a shared cache */
+    uint32_t fClosed;           /* the cache file was closed properly */
+    unsigned char anUnused[72];
+} cachefileheader;
+
+struct _cachefile {
+    char *szFile;
+    unsigned char *p;           /* the header, followed by the nodes */
+    size_t cb;
+#if CACHE_MMAP
+    int fd;
+#endif
+};
+
+/* The nodes of a cache of cEntries entries, as for CacheCreate() */
+
+static unsigned int
+CacheNodes(unsigned int cEntries)
+{
+    unsigned int c = 1;
+
+    while (c < cEntries && c < 1u << 31)
+        c <<= 1;
+
+    return c > CACHE_WAYS ? c / CACHE_WAYS : 1;
+}
+
+/* Read the header of szFile and, if ppce is not NULL, its nodes into
+ * *ppce; returns FALSE if it is not a cache file */
+
+static int
+CacheFileRead(const char *szFile, cachefileheader * phdr, cacheNode ** ppce)
+{
+    FILE *pf;
+    int fOK;
+
+    if (!(pf = g_fopen(szFile, "rb")))
+        return FALSE;
+
+    fOK = fread(phdr, sizeof(cachefileheader), 1, pf) == 1
+        && !memcmp(phdr->szMagic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC))
+        && phdr->nVersion == CACHE_FILE_VERSION && phdr->nByteOrder == CACHE_FILE_BYTE_ORDER
+        && phdr->cbNode == sizeof(cacheNode) && phdr->cNodes && !(phdr->cNodes & (phdr->cNodes - 1));
+
+    if (fOK && ppce) {
+        *ppce = (cacheNode *) malloc(phdr->cNodes * sizeof(cacheNode));
+        if (!*ppce || fread(*ppce, sizeof(cacheNode), phdr->cNodes, pf) != phdr->cNodes) {
+            free(*ppce);
+            *ppce = NULL;
+            fOK = FALSE;
+        }
+    }
+
+    fclose(pf);
+
+    return fOK;
+}
+
+/* Write a cache file of cNodes nodes with the entries of the cOldNodes
+ * nodes ace (which may be NULL) */
+
+static int
+CacheFileWrite(const char *szFile, const unsigned int cNodes, const unsigned char auchFingerprint[16],
+               const cacheNode * ace, const unsigned int cOldNodes)
+{
+    cachefileheader hdr;
+    cacheNode *acNew;
+    unsigned int i;
+    FILE *pf;
+    int fOK;
+
+    if (!(acNew = (cacheNode *) calloc(cNodes, sizeof(cacheNode))))
+        return FALSE;
+
+    for (i = 0; i < cNodes; i++)
+        memset(acNew[i].anPlies, CACHE_EMPTY, sizeof(acNew[i].anPlies));
+
+    /* A smaller cache takes the low bits of the node numbers, so the
+     * nodes fold together.  The entries keep only a tag, not the hash
+     * bits a larger cache adds to the node numbers, so they cannot be
+     * moved to their new nodes and a larger cache starts empty. */
+    for (i = 0; ace && cNodes <= cOldNodes && i < cOldNodes; i++)
+        CacheMergeNode(&acNew[i & (cNodes - 1)], &ace[i]);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.szMagic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+    hdr.nVersion = CACHE_FILE_VERSION;
+    hdr.nByteOrder = CACHE_FILE_BYTE_ORDER;
+    hdr.cbNode = sizeof(cacheNode);
+    hdr.cNodes = cNodes;
+    memcpy(hdr.auchFingerprint, auchFingerprint, sizeof(hdr.auchFingerprint));
+    hdr.fClosed = TRUE;
+
+    if (!(pf = g_fopen(szFile, "wb"))) {
+        free(acNew);
+        return FALSE;
+    }
+
+    fOK = fwrite(&hdr, sizeof(hdr), 1, pf) == 1 && fwrite(acNew, sizeof(cacheNode), cNodes, pf) == cNodes;
+    fOK = !fclose(pf) && fOK;
+    free(acNew);
+
+    return fOK;
+}
+
+/* Use the cache file szFile for pc, creating it with cEntries entries
+ * (or 1<<20 if 0) if it does not exist.  If cEntries is not 0 and the
+ * file has another size, it is rewritten with that size, keeping as
+ * many entries as a smaller size can (a larger one starts empty); if it
+ * was written for an evaluator with another fingerprint, its entries
+ * are removed, as are those of a file that was not closed by
+ * CacheFileClose().  Where flock() is available the file is locked for as
+ * long as it is open, as the nodes are written without the locks of
+ * the shared memory cache.  Returns the number of entries kept, -1 on
+ * error, or -2 if another process has the file open. */
+
+extern int
+CacheFileOpen(evalCache * pc, const char *szFile, unsigned int cEntries, const unsigned char auchFingerprint[16])
+{
+    cachefileheader hdr, *phdr;
+    cachefile *pcf;
+    unsigned int k, cNodes;
+    int fValid, fSame;
+#if CACHE_MMAP
+    int fd;
+
+    if ((fd = g_open(szFile, O_RDWR | O_CREAT, 0666)) < 0)
+        return -1;
+#if CACHE_FLOCK
+    /* before anything is read, as another process may be resizing it */
+    if (flock(fd, LOCK_EX | LOCK_NB)) {
+        k = errno == EWOULDBLOCK;
+        close(fd);
+        return k ? -2 : -1;
+    }
+#endif
+#endif
+
+    fValid = CacheFileRead(szFile, &hdr, NULL);
+    /* the entries of a file that was not closed may be torn */
+    fSame = fValid && hdr.fClosed && !memcmp(hdr.auchFingerprint, auchFingerprint, sizeof(hdr.auchFingerprint));
+    cNodes = cEntries ? CacheNodes(cEntries) : fValid ? hdr.cNodes : CacheNodes(1u << 20);
+
+    pcf = NULL;
+    if (!fSame || cNodes != hdr.cNodes) {
+        cacheNode *ace = NULL;
+
+        k = !fSame || CacheFileRead(szFile, &hdr, &ace);
+        k = k && CacheFileWrite(szFile, cNodes, auchFingerprint, ace, fSame ? hdr.cNodes : 0);
+        free(ace);
+        if (!k)
+            goto error;
+    }
+
+    if (!(pcf = (cachefile *) malloc(sizeof(cachefile))))
+        goto error;
+    pcf->szFile = g_strdup(szFile);
+    pcf->cb = sizeof(cachefileheader) + (size_t) cNodes *sizeof(cacheNode);
+
+#if CACHE_MMAP
+    {
+        /* the file was rewritten through another descriptor, but it is
+         * the same file, which fd keeps locked */
+        void *p = mmap(NULL, pcf->cb, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+        pcf->p = p != MAP_FAILED ? (unsigned char *) p : NULL;
+        pcf->fd = fd;
+    }
+#else
+    {
+        FILE *pf = g_fopen(szFile, "rb");
+
+        pcf->p = (unsigned char *) malloc(pcf->cb);
+        if (pcf->p && (!pf || fread(pcf->p, pcf->cb, 1, pf) != 1)) {
+            free(pcf->p);
+            pcf->p = NULL;
+        }
+        if (pf)
+            fclose(pf);
+    }
+#endif
+
+    if (!pcf->p)
+        goto error;
+
+    pc->pcf = pcf;
+    pc->pAlloc = NULL;
+    pc->fAlloc = 0;
+    pc->entries = (cacheNode *) (pcf->p + sizeof(cachefileheader));
+    pc->hashMask = cNodes - 1;
+    pc->cWays = CACHE_WAYS_WIDE;
+    pc->size = cNodes * CACHE_WAYS_WIDE;
+    pc->fSeqLock = fSeqLockAlloc;
+
+    for (k = 0; k < cNodes; k++) {
+        /* a node a writer was stopped in may be torn */
+        if (pc->entries[k].lock & 1) {
+            memset(pc->entries[k].anPlies, CACHE_EMPTY, sizeof(pc->entries[k].anPlies));
+            memset(pc->entries[k].anAge, 0, sizeof(pc->entries[k].anAge));
+        }
+        pc->entries[k].lock = 0;
+    }
+
+    phdr = (cachefileheader *) pcf->p;
+    phdr->fClosed = FALSE;
+#if CACHE_MMAP
+    /* on the disk before any node changes */
+    msync(pcf->p, sizeof(cachefileheader), MS_SYNC);
+#endif
+
+    return (int) CacheUsed(pc);
+
+  error:
+    if (pcf) {
+        g_free(pcf->szFile);
+        free(pcf);
+    }
+#if CACHE_MMAP
+    close(fd);
+#endif
+    return -1;
+}
+
+/* Write back and release the cache file or shared memory of pc */
+
+extern void
+CacheFileClose(evalCache * pc)
+{
+    cachefile *pcf = pc->pcf;
+
+    if (!pcf)
+        return;
+
+#if CACHE_MMAP
+    /* the nodes on the disk before the header says they are whole */
+    msync(pcf->p, pcf->cb, MS_SYNC);
+    ((cachefileheader *) pcf->p)->fClosed = TRUE;
+    munmap(pcf->p, pcf->cb);
+    close(pcf->fd);
+#else
+    {
+        FILE *pf = g_fopen(pcf->szFile, "r+b");
+
+        ((cachefileheader *) pcf->p)->fClosed = TRUE;
+        if (pf) {
+            if (fseek(pf, (long) sizeof(cachefileheader), SEEK_SET)
+                || fwrite(pcf->p + sizeof(cachefileheader), pcf->cb - sizeof(cachefileheader), 1, pf) != 1
+                || fflush(pf) || fseek(pf, 0, SEEK_SET)
+                || fwrite(pcf->p, sizeof(cachefileheader), 1, pf) != 1)
+                g_warning("cannot write cache file %s", pcf->szFile);
+            fclose(pf);
+        }
+        free(pcf->p);
+    }
+#endif
+
+    g_free(pcf->szFile);
+    free(pcf);
+    pc->pcf = NULL;
+    pc->entries = NULL;
+    pc->size = 0;
+    pc->hashMask = 0;
+}
+
+/* Remove all entries of the cache file, which is then for the evaluator
+ * with auchFingerprint */
+
+extern void
+CacheFileClear(evalCache * pc, const unsigned char auchFingerprint[16])
+{
+    CacheFlush(pc);
+    memcpy(((cachefileheader *) pc->pcf->p)->auchFingerprint, auchFingerprint, 16);
+}
+
+extern const unsigned char *
+CacheFileFingerprint(const evalCache * pc)
+{
+    return ((const cachefileheader *) pc->pcf->p)->auchFingerprint;
+}
+
+extern const char *
+CacheFileName(const evalCache * pc)
+{
+    return pc->pcf->szFile;
+}
+
+#if CACHE_SHM
+/* Clear the nodes of pc that a process which died while writing them
+ * left with an odd sequence count, where no other process would ever
+ * read or write again.  A node written by a live process is odd for
+ * well under a millisecond, so the nodes that are still odd with the
+ * same count after a pause are taken over and emptied. */
+
+static void
+CacheSharedRepair(const evalCache * pc)
+{
+    unsigned int k, i, c = 0;
+    unsigned int *ak = NULL;
+    int *anSeq = NULL;
+
+    for (k = 0; k <= pc->hashMask; ++k)
+        c += pc->entries[k].lock & 1;
+
+    if (!c || !(ak = (unsigned int *) malloc(c * sizeof(unsigned int)))
+        || !(anSeq = (int *) malloc(c * sizeof(int)))) {
+        free(ak);
+        return;
+    }
+
+    for (k = 0, i = 0; k <= pc->hashMask && i < c; ++k)
+        if ((anSeq[i] = pc->entries[k].lock) & 1)
+            ak[i++] = k;
+    c = i;
+
+    g_usleep(100000);
+
+    for (i = 0; i < c; i++) {
+        cacheNode *const pce = &pc->entries[ak[i]];
+
+        /* still odd, as the writer left it */
+        if (!__sync_bool_compare_and_swap(&pce->lock, anSeq[i], (int) ((unsigned int) anSeq[i] + 2)))
+            continue;
+
+        memset(pce->anPlies, CACHE_EMPTY, sizeof(pce->anPlies));
+        memset(pce->anAge, 0, sizeof(pce->anAge));
+        cache_barrier();
+        pce->lock = (int) ((unsigned int) anSeq[i] + 3);
+    }
+
+    free(ak);
+    free(anSeq);
+}
+
+/* Attach pc to the POSIX shared memory segment szName, which the other
+ * processes of the host evaluating with the same fingerprint share,
+ * creating it with cEntries entries (or 1<<20 if 0) if there is none.
+ * The segment stays after the last process detaches, for the next one;
+ * one whose creator died before it was ready is removed and created
+ * again.  Returns the number of entries in use, -1 on error, or -2 if
+ * the segment is for an evaluator with another fingerprint. */
+
+extern int
+CacheSharedOpen(evalCache * pc, const char *szName, unsigned int cEntries, const unsigned char auchFingerprint[16])
+{
+    cachefileheader hdr;
+    cachefile *pcf;
+    unsigned int cNodes = CacheNodes(cEntries ? cEntries : 1u << 20);
+    char *szShm = g_strconcat(*szName == '/' ? "" : "/", szName, NULL);
+    int fd, fCreated = FALSE, fStale = FALSE, i;
+    void *p;
+
+  retry:
+    if ((fd = shm_open(szShm, O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0) {
+        fCreated = TRUE;
+        if (ftruncate(fd, (off_t) (sizeof(cachefileheader) + (size_t) cNodes * sizeof(cacheNode)))) {
+            close(fd);
+            shm_unlink(szShm);
+            g_free(szShm);
+            return -1;
+        }
+    } else if (errno != EEXIST || (fd = shm_open(szShm, O_RDWR, 0)) < 0) {
+        g_free(szShm);
+        return -1;
+    } else {
+        /* Wait for the process creating it to write the header, which
+         * takes as long as it needs to empty the nodes.  It names
+         * itself in the header first, and if it dies before it is done
+         * the segment is removed: when it is gone, or when it has not
+         * named itself in a second. */
+        for (i = 0;; i++) {
+            int fHeader = pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr);
+
+            if (fHeader && hdr.nVersion)
+                break;
+            if (fHeader && hdr.nCreator ? kill((pid_t) hdr.nCreator, 0) && errno == ESRCH : i == 100) {
+                close(fd);
+                if (fStale) {
+                    g_free(szShm);
+                    return -1;
+                }
+                /* another process may have found it stale as well and
+                 * created a new one, which this removes; the two then
+                 * work with segments of their own */
+                shm_unlink(szShm);
+                fStale = TRUE;
+                goto retry;
+            }
+            g_usleep(10000);
+        }
+
+        if (memcmp(hdr.szMagic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC))
+            || hdr.nVersion != CACHE_FILE_VERSION || hdr.nByteOrder != CACHE_FILE_BYTE_ORDER
+            || hdr.cbNode != sizeof(cacheNode) || !hdr.cNodes || (hdr.cNodes & (hdr.cNodes - 1))) {
+            close(fd);
+            g_free(szShm);
+            return -1;
+        }
+        if (memcmp(hdr.auchFingerprint, auchFingerprint, sizeof(hdr.auchFingerprint))) {
+            close(fd);
+            g_free(szShm);
+            return -2;
+        }
+        cNodes = hdr.cNodes;
+    }
+
+    if (!(pcf = (cachefile *) malloc(sizeof(cachefile)))) {
+        close(fd);
+        if (fCreated)
+            shm_unlink(szShm);
+        g_free(szShm);
+        return -1;
+    }
+    pcf->szFile = g_strdup(szName);
+    pcf->cb = sizeof(cachefileheader) + (size_t) cNodes *sizeof(cacheNode);
+    pcf->fd = fd;
+
+    if ((p = mmap(NULL, pcf->cb, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        if (fCreated)
+            shm_unlink(szShm);
+        g_free(pcf->szFile);
+        free(pcf);
+        g_free(szShm);
+        return -1;
+    }
+    g_free(szShm);
+
+    pcf->p = (unsigned char *) p;
+    pc->pcf = pcf;
+    pc->pAlloc = NULL;
+    pc->fAlloc = 0;
+    pc->entries = (cacheNode *) (pcf->p + sizeof(cachefileheader));
+    pc->hashMask = cNodes - 1;
+    pc->cWays = CACHE_WAYS_WIDE;
+    pc->size = cNodes * CACHE_WAYS_WIDE;
+    pc->fSeqLock = TRUE;
+
+    if (fCreated) {
+        cachefileheader *phdr = (cachefileheader *) pcf->p;
+
+        phdr->nCreator = (uint32_t) getpid();
+
+        CacheFlush(pc);
+
+        memcpy(phdr->szMagic, CACHE_FILE_MAGIC, sizeof(CACHE_FILE_MAGIC));
+        phdr->nByteOrder = CACHE_FILE_BYTE_ORDER;
+        phdr->cbNode = sizeof(cacheNode);
+        phdr->cNodes = cNodes;
+        memcpy(phdr->auchFingerprint, auchFingerprint, sizeof(phdr->auchFingerprint));
+        /* the version last, as the others wait for it */
+        g_atomic_int_set((volatile gint *) &phdr->nVersion, CACHE_FILE_VERSION);
+    } else
+        CacheSharedRepair(pc);
+
+    return (int) CacheUsed(pc);
+}
 #else
-    (void) pc;                  /* suppress unused parameter compiler warning */
+extern int
+CacheSharedOpen(evalCache * pc, const char *szName, unsigned int cEntries, const unsigned char auchFingerprint[16])
+{
+    (void) pc;
+    (void) szName;
+    (void) cEntries;
+    (void) auchFingerprint;
+
+    return -1;
+}
+#endif
 
-    if (pcLookup)
-        *pcLookup = 0;
+/* The average time in nanoseconds of cLookups lookups, each of a random
+ * one of the cEntries entries of a full cache allocated as
+ * CacheSetAllocation() asks and depending on the one before, so that
+ * they measure the latency of the memory rather than its bandwidth.
+ * *pfAlloc receives what the cache got. */
 
-    if (pcHit)
-        *pcHit = 0;
+extern int
+CacheLatency(unsigned int cEntries, unsigned int cLookups, double *prNanoseconds, unsigned int *pfAlloc)
+{
+    evalCache c;
+    cacheNodeDetail nd;
+    GTimer *pt;
+    unsigned int i;
+    uint32_t r = 2463534242u;
+
+    if (CacheCreate(&c, cEntries))
+        return -1;
+    cEntries = c.size;
+
+    memset(&nd, 0, sizeof(nd));
+    for (i = 0; i < cEntries; i++) {
+        nd.key.data[0] = i;
+        nd.key.data[1] = i * 0x9e3779b9u;
+        nd.ar[0] = (float) (i & 0xffff);
+        CacheAddNoLocking(&c, &nd, GetHashKey(c.hashMask, &nd), 0);
+    }
+
+    pt = g_timer_new();
+
+    for (i = 0; i < cLookups; i++) {
+        float ar[5];
+        uint32_t l;
+
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+
+        nd.key.data[0] = r % cEntries;
+        nd.key.data[1] = nd.key.data[0] * 0x9e3779b9u;
+
+        if ((l = CacheLookupNoLocking(&c, &nd, ar, NULL)) == CACHEHIT)
+            l = (uint32_t) ar[0];
+        r ^= l << 7;
+        if (!r)
+            r = 2463534242u;
+    }
+
+    *prNanoseconds = g_timer_elapsed(pt, NULL) * 1e9 / cLookups;
+    *pfAlloc = c.fAlloc;
+
+    g_timer_destroy(pt);
+    CacheDestroy(&c);
+
+    return 0;
+}
+
+#if CACHE_SEQLOCK && defined(GLIB_THREADS)
+
+typedef struct {
+    evalCache *pc;
+    const cacheNodeDetail *and;
+    unsigned int cKeys;
+    unsigned int cLookups;
+    int fSpinLock;
+    uint32_t nSeed;
+    unsigned int cTorn;
+} cachebenchmark;
+
+static gpointer
+CacheBenchmarkThread(gpointer p)
+{
+    cachebenchmark *pcb = (cachebenchmark *) p;
+    uint32_t r = pcb->nSeed;
+    unsigned int i;
+
+    for (i = 0; i < pcb->cLookups; i++) {
+        const cacheNodeDetail *pnd;
+        float ar[5], rCubeful;
+        uint32_t l;
+
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+
+        /* half of the lookups are of a few positions every thread
+         * evaluates, like those near the root of a rollout */
+        pnd = pcb->and + ((r & 1) ? (r >> 1) % 64 : (r >> 1) % pcb->cKeys);
+
+        l = pcb->fSpinLock ? CacheLookupSpinLock(pcb->pc, pnd, ar, &rCubeful) :
+            CacheLookupWithLocking(pcb->pc, pnd, ar, &rCubeful);
 
-    if (pcUsed)
-        *pcUsed = 0;
+        if (l != CACHEHIT) {
+            if (pcb->fSpinLock)
+                CacheAddSpinLock(pcb->pc, pnd, l, 0);
+            else
+                CacheAddWithLocking(pcb->pc, pnd, l, 0);
+        } else if (memcmp(ar, pnd->ar, sizeof(ar)) || rCubeful != pnd->ar[5])
+            pcb->cTorn++;
+    }
+
+    return NULL;
+}
+
+/* Time cLookups lookups (and adds of the misses) in each of cThreads
+ * threads sharing one cache, with the spin lock or the sequence count.
+ * *pcTorn is the number of hits that returned another entry's values,
+ * which must be zero. */
+
+extern int
+CacheBenchmark(unsigned int cThreads, int fSpinLock, unsigned int cLookups, double *prRate, unsigned int *pcTorn)
+{
+    unsigned int const cKeys = 1 << 18;
+    evalCache c;
+    cacheNodeDetail *and;
+    cachebenchmark *acb;
+    GThread **apt;
+    GTimer *pt;
+    unsigned int i, j;
+    uint32_t r = 2463534242u;
+    int n = 0;
+
+    if (CacheCreate(&c, 1 << 17))
+        return -1;
+    c.fSeqLock = !fSpinLock;
+
+    and = g_new(cacheNodeDetail, cKeys);
+    for (i = 0; i < cKeys; i++) {
+        for (j = 0; j < 7; j++) {
+            r ^= r << 13;
+            r ^= r >> 17;
+            r ^= r << 5;
+            and[i].key.data[j] = r;
+        }
+        and[i].nEvalContext = i & 3;
+        for (j = 0; j < 6; j++)
+            and[i].ar[j] = (float) (i * 6 + j);
+    }
+
+    acb = g_new(cachebenchmark, cThreads);
+    apt = g_new(GThread *, cThreads);
+    pt = g_timer_new();
+
+    for (i = 0; i < cThreads; i++) {
+        acb[i].pc = &c;
+        acb[i].and = and;
+        acb[i].cKeys = cKeys;
+        acb[i].cLookups = cLookups;
+        acb[i].fSpinLock = fSpinLock;
+        acb[i].nSeed = 0x9e3779b9u * (i + 1);
+        acb[i].cTorn = 0;
+#if GLIB_CHECK_VERSION (2,32,0)
+        apt[i] = g_thread_try_new("Cache", CacheBenchmarkThread, acb + i, NULL);
+#else
+        apt[i] = g_thread_create(CacheBenchmarkThread, acb + i, TRUE, NULL);
 #endif
+        if (!apt[i]) {
+            n = -1;
+            break;
+        }
+    }
+
+    *pcTorn = 0;
+    for (j = 0; j < i; j++) {
+        g_thread_join(apt[j]);
+        *pcTorn += acb[j].cTorn;
+    }
+
+    *prRate = (double) cThreads *cLookups / g_timer_elapsed(pt, NULL);
+
+    g_timer_destroy(pt);
+    g_free(apt);
+    g_free(acb);
+    g_free(and);
+    CacheDestroy(&c);
+
+    return n;
 }
+
+#endif
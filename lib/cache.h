@@ -27,67 +27,118 @@
 #include <stdint.h>
 #else
 typedef unsigned int uint32_t;
+typedef unsigned long long uint64_t;
 #endif
 
 #include "gnubg-types.h"
 
-/* Set to calculate simple cache stats */
-#define CACHE_STATS 0
-
+/* What is looked up and added: the position, the evaluation context and
+ * the outputs, with the cubeful equity in ar[5].  The evaluation context
+ * has settings in its low 32 bits and hashes of others in the high ones. */
 typedef struct _cacheNodeDetail {
     positionkey key;
-    int nEvalContext;
+    uint64_t nEvalContext;
     float ar[6];
 } cacheNodeDetail;
 
+/* The cache is stored as 128 byte nodes, each a set of CACHE_WAYS
+ * entries which keep a 32 bit tag of the key and evaluation context
+ * instead of the whole key.  An entry added to a full node replaces the
+ * one added the longest time ago, counting each ply an entry was
+ * evaluated at as CACHE_AGE_PER_PLY more recent adds, so the few
+ * expensive deep evaluations are not pushed out by the many 0-ply ones.
+ *
+ * The caches in files and shared memory live for many sessions, too
+ * long for the odd wrong hit of a 32 bit tag.  Their nodes use only
+ * CACHE_WAYS_WIDE entries and keep the tags' other 32 bits in the
+ * space of the last one. */
+
+#define CACHE_WAYS 4
+#define CACHE_WAYS_WIDE 3
+#define CACHE_AGE_PER_PLY 8
+#define CACHE_EMPTY 0xff        /* anPlies[] of an unused entry */
+
+typedef struct _cacheEntry {
+    uint32_t nTag;
+    float ar[6];
+} cacheEntry;
+
 typedef struct _cacheNode {
-    cacheNodeDetail nd_primary;
-    cacheNodeDetail nd_secondary;
-#if USE_MULTITHREAD
+    /* a sequence count, odd while the node is written, or a spin lock */
     volatile int lock;
-#endif
+    unsigned char anPlies[CACHE_WAYS];
+    unsigned char anAge[CACHE_WAYS];    /* adds to the node since the entry's */
+    unsigned char anUnused[4];
+    cacheEntry ae[CACHE_WAYS];
 } cacheNode;
 
 /* name used in eval.c */
 typedef cacheNodeDetail evalcache;
 
+typedef struct _cachefile cachefile;
+
+/* The pages CacheCreate() allocates caches on, see CacheSetAllocation() */
+typedef enum {
+    CACHE_PAGES_DEFAULT,        /* malloc() */
+    CACHE_PAGES_TRANSPARENT,    /* transparent huge pages */
+    CACHE_PAGES_EXPLICIT        /* reserved huge pages, else transparent ones */
+} cachepages;
+
+/* the NUMA nodes of the memory, or the number of the one to prefer */
+#define CACHE_NUMA_DEFAULT (-1) /* that of the thread which touches it first */
+#define CACHE_NUMA_INTERLEAVE (-2)      /* all nodes in turn */
+
+/* what evalCache.fAlloc says a cache got */
+#define CACHE_ALLOC_MAPPED 1    /* mapped, not from malloc() */
+#define CACHE_ALLOC_HUGETLB 2   /* reserved huge pages */
+#define CACHE_ALLOC_ADVISED 4   /* transparent huge pages asked for */
+#define CACHE_ALLOC_NUMA 8      /* the NUMA policy was set */
+
 typedef struct _cache {
-    cacheNode *entries;
+    cacheNode *entries;         /* aligned to sizeof(cacheNode) in pAlloc */
+    void *pAlloc;
+    cachefile *pcf;             /* or in the file of CacheFileOpen() */
+    unsigned int fAlloc;        /* CACHE_ALLOC_* */
+    size_t cbAlloc;             /* of the mapping */
 
     unsigned int size;
     uint32_t hashMask;
-
-#if CACHE_STATS
-    unsigned int nAdds;
-    unsigned int cLookup;
-    unsigned int cHit;
-#endif
+    unsigned int cWays;         /* CACHE_WAYS, or CACHE_WAYS_WIDE for 64 bit tags */
+    int fSeqLock;               /* the locks are sequence counts, see CacheSetSequenceLock() */
 } evalCache;
 
 /* Cache size will be adjusted to a power of 2 */
 int CacheCreate(evalCache * pc, unsigned int size);
 int CacheResize(evalCache * pc, unsigned int cNew);
+void CacheSetAllocation(const cachepages cp, const int nNUMA);
+void CacheGetAllocation(cachepages * pcp, int *pnNUMA);
+int CacheSetSequenceLock(const int f);
+int CacheGetSequenceLock(void);
 
 #define CACHEHIT ((uint32_t)-1)
 /* returns a value which is passed to CacheAdd (if a miss) */
 unsigned int CacheLookupWithLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful);
 unsigned int CacheLookupNoLocking(evalCache * pc, const cacheNodeDetail * e, float *arOut, float *arCubeful);
 
-void CacheAddWithLocking(evalCache * pc, const cacheNodeDetail * e, uint32_t l);
-static inline void
-CacheAddNoLocking(evalCache * pc, const cacheNodeDetail * e, const uint32_t l)
-{
-    pc->entries[l].nd_secondary = pc->entries[l].nd_primary;
-    pc->entries[l].nd_primary = *e;
-#if CACHE_STATS
-    ++pc->nAdds;
-#endif
-}
+/* nPlies is the ply the entry was evaluated at; returns 1 if an entry
+ * was evicted to make room, 0 if not, and -1 if the entry was not added */
+int CacheAddWithLocking(evalCache * pc, const cacheNodeDetail * e, uint32_t l, int nPlies);
+int CacheAddNoLocking(evalCache * pc, const cacheNodeDetail * e, uint32_t l, int nPlies);
 
 void CacheFlush(const evalCache * pc);
 void CacheDestroy(const evalCache * pc);
-void CacheStats(const evalCache * pc, unsigned int *pcLookup, unsigned int *pcHit, unsigned int *pcUsed);
+unsigned int CacheUsed(const evalCache * pc);
 
 uint32_t GetHashKey(const uint32_t hashMask, const cacheNodeDetail * e);
 
+int CacheFileOpen(evalCache * pc, const char *szFile, unsigned int cEntries, const unsigned char auchFingerprint[16]);
+void CacheFileClose(evalCache * pc);
+void CacheFileClear(evalCache * pc, const unsigned char auchFingerprint[16]);
+const unsigned char *CacheFileFingerprint(const evalCache * pc);
+const char *CacheFileName(const evalCache * pc);
+int CacheSharedOpen(evalCache * pc, const char *szName, unsigned int cEntries, const unsigned char auchFingerprint[16]);
+
+int CacheLatency(unsigned int cEntries, unsigned int cLookups, double *prNanoseconds, unsigned int *pfAlloc);
+int CacheBenchmark(unsigned int cThreads, int fSpinLock, unsigned int cLookups, double *prRate, unsigned int *pcTorn);
+
 #endif
@@ -1,5 +1,5 @@
 /*
- * Subset of inputs computed with SSE
+ * Base inputs, shared by all evaluation kernels
  *
  *
  * This program is free software; you can redistribute it and/or modify
@@ -19,20 +19,11 @@
  */
 
 #include "config.h"
+#include <string.h>
 #include "gnubg-types.h"
 #include "simd.h"
 #include "eval.h"
 
-#if USE_SIMD_INSTRUCTIONS
-#if defined(USE_AVX)
-#include <immintrin.h>
-#elif defined(USE_SSE2)
-#include <emmintrin.h>
-#else
-#include <xmmintrin.h>
-#endif
-#endif
-
 SSE_ALIGN(float inpvec[16][4]) = {
     /*  0 */  {
     0.0, 0.0, 0.0, 0.0},
@@ -101,82 +92,10 @@ SSE_ALIGN(float inpvecb[16][4]) = {
         /* 15 */  {
 1.0, 1.0, 1.0, 6.0}};
 
-#if USE_SIMD_INSTRUCTIONS
-extern void
-baseInputs(const TanBoard anBoard, float arInput[])
-{
-    int i = 3;
-
-    const unsigned int *pB = &anBoard[0][0];
-    float *pInput = &arInput[0];
-    register __m128 vec0;
-    register __m128 vec1;
-    register __m128 vec2;
-    register __m128 vec3;
-    register __m128 vec4;
-    register __m128 vec5;
-    register __m128 vec6;
-    register __m128 vec7;
-
-    while (i--) {
-        vec0 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput, vec0);
-        vec1 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec1);
-        vec2 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec2);
-        vec3 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec3);
-        vec4 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec4);
-        vec5 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec5);
-        vec6 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec6);
-        vec7 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec7);
-        pInput += 4;
-    }
-
-    /* bar */
-    vec0 = _mm_load_ps(inpvecb[*pB++]);
-    _mm_store_ps(pInput, vec0);
-    pInput += 4;
-
-    i = 3;
-    while (i--) {
-        vec0 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput, vec0);
-        vec1 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec1);
-        vec2 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec2);
-        vec3 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec3);
-        vec4 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec4);
-        vec5 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec5);
-        vec6 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec6);
-        vec7 = _mm_load_ps(inpvec[*pB++]);
-        _mm_store_ps(pInput += 4, vec7);
-        pInput += 4;
-    }
-
-    /* bar */
-    vec0 = _mm_load_ps(inpvecb[*pB]);
-    _mm_store_ps(pInput, vec0);
-
-#if defined(USE_AVX)
-    _mm256_zeroupper();
-#endif
+/* The SIMD versions of baseInputs() are in neuralnetsse.c */
 
-    return;
-}
-#else
 extern void
-baseInputs(const TanBoard anBoard, float arInput[])
+baseInputsScalar(const TanBoard anBoard, float arInput[])
 {
     int j, i;
 
@@ -205,4 +124,52 @@ baseInputs(const TanBoard anBoard, float arInput[])
         }
     }
 }
-#endif
+
+/* List the inputs that baseInputs() sets to a non-zero value, in
+ * increasing order, and return how many there are */
+
+extern unsigned int
+baseInputsActive(const TanBoard anBoard, unsigned int aiActive[])
+{
+    unsigned int c = 0;
+    int j, i, k;
+
+    for (j = 0; j < 2; ++j) {
+        const unsigned int *board = anBoard[j];
+        unsigned int const iSide = j * 25 * 4;
+
+        for (i = 0; i < 24; i++)
+            if (board[i])
+                for (k = 0; k < 4; k++)
+                    if (inpvec[board[i]][k] != 0.0f)
+                        aiActive[c++] = iSide + i * 4 + k;
+
+        if (board[24])
+            for (k = 0; k < 4; k++)
+                if (inpvecb[board[24]][k] != 0.0f)
+                    aiActive[c++] = iSide + 24 * 4 + k;
+    }
+
+    return c;
+}
+
+/* Calculate the inputs of baseInputs() for the points in the bit masks
+ * anPoints[] only (bit i for point i of side j, the bar is point 24) */
+
+extern void
+baseInputsPoints(const TanBoard anBoard, const unsigned int anPoints[2], float arInput[])
+{
+    int j, i;
+
+    for (j = 0; j < 2; ++j) {
+        float *afInput = arInput + j * 25 * 4;
+        const unsigned int *board = anBoard[j];
+
+        for (i = 0; i < 24; i++)
+            if (anPoints[j] & (1u << i))
+                memcpy(afInput + i * 4, inpvec[board[i]], 4 * sizeof(float));
+
+        if (anPoints[j] & (1u << 24))
+            memcpy(afInput + 24 * 4, inpvecb[board[24]], 4 * sizeof(float));
+    }
+}
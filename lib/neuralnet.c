@@ -34,42 +34,6 @@
 #include "simd.h"
 #include "sigmoid.h"
 
-/* separate context for race, crashed, contact
- * -1: regular eval
- * 0: save base
- * 1: from base
- */
-
-static inline NNEvalType
-NNevalAction(NNState * pnState)
-{
-    if (!pnState)
-        return NNEVAL_NONE;
-
-    switch (pnState->state) {
-    case NNSTATE_NONE:
-        {
-            /* incremental evaluation not useful */
-            return NNEVAL_NONE;
-        }
-    case NNSTATE_INCREMENTAL:
-        {
-            /* next call should return FROMBASE */
-            pnState->state = NNSTATE_DONE;
-
-            /* starting a new context; save base in the hope it will be useful */
-            return NNEVAL_SAVE;
-        }
-    case NNSTATE_DONE:
-        {
-            /* context hit!  use the previously computed base */
-            return NNEVAL_FROMBASE;
-        }
-    }
-    /* never reached */
-    return NNEVAL_NONE;         /* for the picky compiler */
-}
-
 extern int
 NeuralNetCreate(neuralnet * pnn, unsigned int cInput, unsigned int cHidden,
                 unsigned int cOutput, float rBetaHidden, float rBetaOutput)
@@ -81,6 +45,9 @@ NeuralNetCreate(neuralnet * pnn, unsigned int cInput, unsigned int cHidden,
     pnn->rBetaOutput = rBetaOutput;
     pnn->nTrained = 0;
     pnn->fDirect = FALSE;
+    pnn->asHiddenWeight = NULL;
+    pnn->arHiddenScale = NULL;
+    pnn->ahHiddenWeight = pnn->ahOutputWeight = NULL;
 
     if ((pnn->arHiddenWeight = sse_malloc(cHidden * cInput * sizeof(float))) == NULL)
         return -1;
@@ -119,40 +86,241 @@ NeuralNetDestroy(neuralnet * pnn)
         sse_free(pnn->arOutputThreshold);
         pnn->arOutputThreshold = 0;
     }
+
+    if (pnn->asHiddenWeight && !pnn->fDirect) {
+        sse_free((float *) pnn->asHiddenWeight);
+        pnn->asHiddenWeight = NULL;
+        sse_free(pnn->arHiddenScale);
+        pnn->arHiddenScale = NULL;
+    }
+
+    /* made by NeuralNetHalve() even for mapped nets */
+    NeuralNetUnhalve(pnn);
 }
 
-static void
-Evaluate(const neuralnet * pnn, const float arInput[], float ar[], float arOutput[], float *saveAr)
+/* Make the int16 copy of the hidden weights used by
+ * NeuralNetEvaluateQuantised().  Each hidden node h gets its own scale q,
+ * with weight = asHiddenWeight * q.  The inputs are rounded to
+ * NN_Q_INPUT_BITS fraction bits and limited to NN_Q_INPUT_MAX, and the
+ * products summed in 32 bits, so q is chosen large enough that the sum
+ * of the absolute int16 weights of a node, after rounding, is at most
+ * NN_Q_WEIGHT_SUM.  Neither the sums of a full evaluation nor those of
+ * the input differences of an incremental one (at most 2 * NN_Q_INPUT_MAX
+ * each) can then overflow, whatever the inputs.  arHiddenScale holds
+ * q / 2^NN_Q_INPUT_BITS.
+ *
+ * There is no int8 version.  One scale per node leaves 1/127 of its
+ * largest weight as the step, which would round most of the small
+ * weights of a contact net node to 0 or 1.  The bytes would also have to
+ * be multiplied with saturating 16 bit sums (pmaddubsw), or with VNNI
+ * which few machines have.  The int16 kernel is hardly faster than the
+ * floating point one ("show kernels"), so halving the weights again is
+ * not worth that loss. */
+
+extern int
+NeuralNetQuantise(neuralnet * pnn)
 {
     const unsigned int cHidden = pnn->cHidden;
-    unsigned int i, j;
-    float *prWeight;
+    unsigned int i, h;
 
-    /* Calculate activity at hidden nodes */
-    for (i = 0; i < cHidden; i++)
-        ar[i] = pnn->arHiddenThreshold[i];
+    if (pnn->asHiddenWeight)
+        return 0;
 
-    prWeight = pnn->arHiddenWeight;
+    /* the int16 weights of a mapped net come from the file or not at all */
+    if (pnn->fDirect)
+        return -1;
 
-    for (i = 0; i < pnn->cInput; i++) {
-        float const ari = arInput[i];
+    if ((pnn->asHiddenWeight = (short *) sse_malloc(pnn->cInput * cHidden * sizeof(short))) == NULL)
+        return -1;
 
-        if (!ari)
-            prWeight += cHidden;
-        else {
-            float *pr = ar;
-
-            if (ari == 1.0f)
-                for (j = cHidden; j; j--)
-                    *pr++ += *prWeight++;
-            else
-                for (j = cHidden; j; j--)
-                    *pr++ += *prWeight++ * ari;
+    if ((pnn->arHiddenScale = sse_malloc(cHidden * sizeof(float))) == NULL) {
+        sse_free((float *) pnn->asHiddenWeight);
+        pnn->asHiddenWeight = NULL;
+        return -1;
+    }
+
+    for (h = 0; h < cHidden; h++) {
+        double rMax = 0.0, rSum = 0.0;
+        float rScale;
+        unsigned int nSum;
+
+        for (i = 0; i < pnn->cInput; i++) {
+            double const r = fabs(pnn->arHiddenWeight[i * cHidden + h]);
+
+            rSum += r;
+            if (r > rMax)
+                rMax = r;
         }
+
+        rScale = (float) MAX(rMax / 32767.0, rSum / NN_Q_WEIGHT_SUM);
+        if (rScale == 0.0f)
+            rScale = 1.0f;
+
+        /* rounding can take the sum over the limit; widen the scale
+         * until it doesn't */
+        for (;;) {
+            nSum = 0;
+            for (i = 0; i < pnn->cInput; i++) {
+                float const r = pnn->arHiddenWeight[i * cHidden + h] / rScale;
+                int n = (int) (r < 0.0f ? r - 0.5f : r + 0.5f);
+
+                n = MAX(MIN(n, 32767), -32767);
+                pnn->asHiddenWeight[i * cHidden + h] = (short) n;
+                nSum += (unsigned int) abs(n);
+            }
+
+            if (nSum <= NN_Q_WEIGHT_SUM)
+                break;
+
+            rScale *= 1.001f * (float) nSum / (float) NN_Q_WEIGHT_SUM;
+        }
+
+        pnn->arHiddenScale[h] = rScale / (float) (1 << NN_Q_INPUT_BITS);
+    }
+
+    return 0;
+}
+
+/* IEEE 754 half precision, as converted by the F16C instructions: the
+ * float is rounded to the nearest half, ties to even, with overflow to
+ * infinity and gradual underflow. */
+
+extern unsigned short
+NeuralNetFloatToHalf(float r)
+{
+    union {
+        float r;
+        unsigned int n;
+    } u;
+    unsigned int nSign, nMant, nHalf, nRest, nTie, nShift;
+    int nExp;
+
+    u.r = r;
+    nSign = (u.n >> 16) & 0x8000;
+    nExp = (int) ((u.n >> 23) & 0xff) - 127 + 15;
+    nMant = u.n & 0x7fffff;
+
+    if (((u.n >> 23) & 0xff) == 0xff)
+        /* infinity or NaN */
+        return (unsigned short) (nSign | 0x7c00 | (nMant ? 0x200 : 0));
+
+    if (nExp >= 31)
+        return (unsigned short) (nSign | 0x7c00);
+
+    if (nExp <= 0) {
+        /* subnormal half, or zero */
+        if (nExp < -10)
+            return (unsigned short) nSign;
+        nMant |= 0x800000;
+        nShift = (unsigned int) (14 - nExp);
+    } else {
+        nMant |= (unsigned int) nExp << 23;
+        nShift = 13;
     }
 
-    if (saveAr)
-        memcpy(saveAr, ar, cHidden * sizeof(*saveAr));
+    nHalf = nMant >> nShift;
+    nRest = nMant & ((1u << nShift) - 1);
+    nTie = 1u << (nShift - 1);
+
+    /* a carry out of the mantissa correctly increments the exponent */
+    if (nRest > nTie || (nRest == nTie && (nHalf & 1)))
+        nHalf++;
+
+    return (unsigned short) (nSign | nHalf);
+}
+
+extern float
+NeuralNetHalfToFloat(unsigned short h)
+{
+    union {
+        float r;
+        unsigned int n;
+    } u;
+    unsigned int const nExp = (h >> 10) & 0x1f, nMant = h & 0x3ff;
+
+    if (nExp == 0) {
+        float const r = (float) nMant * (1.0f / 16777216.0f);
+
+        return (h & 0x8000) ? -r : r;
+    }
+
+    u.n = ((unsigned int) (h & 0x8000) << 16) | (nMant << 13) | (nExp == 31 ? 0x7f800000 : (nExp + 112) << 23);
+
+    return u.r;
+}
+
+/* Make the half precision copies of the hidden and output weights used by
+ * NeuralNetEvaluateHalf().  The inputs, thresholds and sums stay in single
+ * precision; only the weights are rounded (to 11 significant bits), which
+ * halves the memory read for each evaluation.
+ *
+ * The copies are made only while half precision is in use.  The single
+ * precision weights are kept, although half precision evaluations don't
+ * read them: they are needed to go back to single precision (rounding to
+ * half precision loses bits that the weights file would have to be read
+ * again for), and the weights of a mapped net are pages of the shared
+ * file that can't be given back on their own. */
+
+extern int
+NeuralNetHalve(neuralnet * pnn)
+{
+    unsigned int const cHiddenWeights = pnn->cInput * pnn->cHidden;
+    unsigned int const cOutputWeights = pnn->cHidden * pnn->cOutput;
+    unsigned int i;
+
+    if (pnn->ahHiddenWeight)
+        return 0;
+
+    if ((pnn->ahHiddenWeight = (unsigned short *) sse_malloc(cHiddenWeights * sizeof(unsigned short))) == NULL)
+        return -1;
+
+    if ((pnn->ahOutputWeight = (unsigned short *) sse_malloc(cOutputWeights * sizeof(unsigned short))) == NULL) {
+        sse_free((float *) pnn->ahHiddenWeight);
+        pnn->ahHiddenWeight = NULL;
+        return -1;
+    }
+
+    for (i = 0; i < cHiddenWeights; i++)
+        pnn->ahHiddenWeight[i] = NeuralNetFloatToHalf(pnn->arHiddenWeight[i]);
+
+    for (i = 0; i < cOutputWeights; i++)
+        pnn->ahOutputWeight[i] = NeuralNetFloatToHalf(pnn->arOutputWeight[i]);
+
+    return 0;
+}
+
+/* Free the copies made by NeuralNetHalve() */
+
+extern void
+NeuralNetUnhalve(neuralnet * pnn)
+{
+    if (pnn->ahHiddenWeight) {
+        sse_free((float *) pnn->ahHiddenWeight);
+        pnn->ahHiddenWeight = NULL;
+        sse_free((float *) pnn->ahOutputWeight);
+        pnn->ahOutputWeight = NULL;
+    }
+}
+
+/* Bytes of weights and thresholds an evaluation of the net reads, with
+ * the weights in single or half precision */
+
+extern size_t
+NeuralNetWeightsSize(const neuralnet * pnn, int fHalf)
+{
+    size_t const cWeights = (size_t) pnn->cHidden * (pnn->cInput + pnn->cOutput);
+
+    return cWeights * (fHalf ? sizeof(unsigned short) : sizeof(float))
+        + (pnn->cHidden + pnn->cOutput) * sizeof(float);
+}
+
+/* Apply the sigmoid to the hidden activities and calculate the outputs */
+static void
+EvaluateOutputs(const neuralnet * pnn, float ar[], float arOutput[])
+{
+    const unsigned int cHidden = pnn->cHidden;
+    unsigned int i, j;
+    const float *prWeight;
 
     for (i = 0; i < cHidden; i++)
         ar[i] = sigmoid(-pnn->rBetaHidden * ar[i]);
@@ -170,92 +338,326 @@ Evaluate(const neuralnet * pnn, const float arInput[], float ar[], float arOutpu
     }
 }
 
-static void
-EvaluateFromBase(const neuralnet * pnn, const float arInputDif[], float ar[], float arOutput[])
+/* Record arInput (and its list of non-zero inputs, if known) as the base
+ * for later NNEVAL_FROMBASE evaluations */
+
+extern void
+NeuralNetSaveInputs(const neuralnet * pnn, const float arInput[], const nnactive * pActive, NNState * pnState)
 {
-    unsigned int i, j;
-    float *prWeight;
+    memcpy(pnState->savedIBase, arInput, pnn->cInput * sizeof(float));
+
+    if (pnState->savedActive) {
+        if (pActive && !pActive->fChanged) {
+            pnState->savedActive->c = pActive->c;
+            memcpy(pnState->savedActive->ai, pActive->ai, pActive->c * sizeof(pActive->ai[0]));
+        } else
+            pnState->savedActive->c = NN_NOT_ACTIVE;
+    }
+}
 
-    /* Calculate activity at hidden nodes */
-    /*    for( i = 0; i < pnn->cHidden; i++ )
-     * ar[ i ] = pnn->arHiddenThreshold[ i ]; */
+/* List in aiChanged the inputs whose weight rows have to be added: the
+ * non-zero inputs or, if pnStateBase is given, the inputs that differ
+ * from its saved ones.  With lists of the non-zero inputs for both
+ * (which must hold exactly the non-zero inputs) only the listed inputs
+ * are looked at; a list with fChanged set is taken as it is. */
 
-    prWeight = pnn->arHiddenWeight;
+extern unsigned int
+NeuralNetChangedInputs(const neuralnet * pnn, const float arInput[], const nnactive * pActive,
+                       const NNState * pnStateBase, unsigned int aiChanged[])
+{
+    unsigned int i, k, c = 0;
 
-    for (i = 0; i < pnn->cInput; ++i) {
-        float const ari = arInputDif[i];
+    if (pActive && pActive->fChanged) {
+        if (pnStateBase) {
+            memcpy(aiChanged, pActive->ai, pActive->c * sizeof(pActive->ai[0]));
+            return pActive->c;
+        }
+        /* not a list of the non-zero inputs */
+        pActive = NULL;
+    }
 
-        if (!ari)
-            prWeight += pnn->cHidden;
-        else {
-            float *pr = ar;
-
-            if (ari == 1.0f)
-                for (j = pnn->cHidden; j; j--)
-                    *pr++ += *prWeight++;
-            else if (ari == -1.0f)
-                for (j = pnn->cHidden; j; j--)
-                    *pr++ -= *prWeight++;
-            else
-                for (j = pnn->cHidden; j; j--)
-                    *pr++ += *prWeight++ * ari;
+    if (!pnStateBase) {
+        if (pActive) {
+            memcpy(aiChanged, pActive->ai, pActive->c * sizeof(pActive->ai[0]));
+            return pActive->c;
+        }
+
+        for (i = 0; i < pnn->cInput; i++)
+            if (arInput[i] != 0.0f)
+                aiChanged[c++] = i;
+    } else {
+        const float *arBase = pnStateBase->savedIBase;
+        const nnactive *pBase = pnStateBase->savedActive;
+
+        if (pActive && pBase && pBase->c != NN_NOT_ACTIVE) {
+            for (k = 0; k < pActive->c; k++)
+                if (arInput[pActive->ai[k]] != arBase[pActive->ai[k]])
+                    aiChanged[c++] = pActive->ai[k];
+
+            /* inputs that were non-zero in the base and now are zero */
+            for (k = 0; k < pBase->c; k++)
+                if (arInput[pBase->ai[k]] == 0.0f)
+                    aiChanged[c++] = pBase->ai[k];
+        } else {
+            for (i = 0; i < pnn->cInput; i++)
+                if (arInput[i] != arBase[i])
+                    aiChanged[c++] = i;
         }
     }
 
-    for (i = 0; i < pnn->cHidden; i++)
-        ar[i] = sigmoid(-pnn->rBetaHidden * ar[i]);
+    return c;
+}
 
-    /* Calculate activity at output nodes */
-    prWeight = pnn->arOutputWeight;
+extern int
+NeuralNetEvaluateScalar(const neuralnet * pnn, float arInput[], const nnactive * pActive, float arOutput[],
+                        NNState * pnState)
+{
+    const unsigned int cHidden = pnn->cHidden;
+    float *ar = (float *) g_alloca(cHidden * sizeof(float));
+    unsigned int *aiChanged = (unsigned int *) g_alloca(2 * pnn->cInput * sizeof(unsigned int));
+    const float *arInputBase = NULL;
+    float *arSave = NULL;
+    unsigned int j, k, c = 0;
 
-    for (i = 0; i < pnn->cOutput; i++) {
-        float r = pnn->arOutputThreshold[i];
+    switch (NNevalAction(pnState)) {
+    case NNEVAL_NONE:
+        memcpy(ar, pnn->arHiddenThreshold, cHidden * sizeof(float));
+        c = NeuralNetChangedInputs(pnn, arInput, pActive, NULL, aiChanged);
+        break;
+    case NNEVAL_SAVE:
+        NeuralNetSaveInputs(pnn, arInput, pActive, pnState);
+        arSave = pnState->savedBase;
+        memcpy(ar, pnn->arHiddenThreshold, cHidden * sizeof(float));
+        c = NeuralNetChangedInputs(pnn, arInput, pActive, NULL, aiChanged);
+        break;
+    case NNEVAL_FROMBASE:
+        arInputBase = pnState->savedIBase;
+        memcpy(ar, pnState->savedBase, cHidden * sizeof(float));
+        c = NeuralNetChangedInputs(pnn, arInput, pActive, pnState, aiChanged);
+        break;
+    }
 
-        for (j = 0; j < pnn->cHidden; j++)
-            r += ar[j] * *prWeight++;
+    /* Calculate activity at hidden nodes */
+    for (k = 0; k < c; k++) {
+        unsigned int const i = aiChanged[k];
+        float const ari = arInputBase ? arInput[i] - arInputBase[i] : arInput[i];
+        const float *prWeight = pnn->arHiddenWeight + i * cHidden;
+        float *pr = ar;
+
+        if (ari == 1.0f)
+            for (j = cHidden; j; j--)
+                *pr++ += *prWeight++;
+        else if (ari == -1.0f)
+            for (j = cHidden; j; j--)
+                *pr++ -= *prWeight++;
+        else
+            for (j = cHidden; j; j--)
+                *pr++ += *prWeight++ * ari;
+    }
 
-        arOutput[i] = sigmoid(-pnn->rBetaOutput * r);
+    if (arSave)
+        memcpy(arSave, ar, cHidden * sizeof(float));
+
+    EvaluateOutputs(pnn, ar, arOutput);
+
+    return 0;
+}
+
+/* NeuralNetEvaluate() with the hidden layer sums done in integers on
+ * the weights from NeuralNetQuantise().  Nets that have not been
+ * quantised are evaluated in floating point. */
+
+extern int
+NeuralNetEvaluateQuantisedScalar(const neuralnet * pnn, float arInput[], const nnactive * pActive, float arOutput[],
+                                 NNState * pnState)
+{
+    const unsigned int cHidden = pnn->cHidden;
+    float *ar = (float *) g_alloca(cHidden * sizeof(float));
+    int *anSum = (int *) g_alloca(cHidden * sizeof(int));
+    unsigned int *aiChanged = (unsigned int *) g_alloca(2 * pnn->cInput * sizeof(unsigned int));
+    const float *arBase = pnn->arHiddenThreshold;
+    const float *arInputBase = NULL;
+    float *arSave = NULL;
+    unsigned int j, k, c;
+
+    if (!pnn->asHiddenWeight)
+        return NeuralNetEvaluateScalar(pnn, arInput, pActive, arOutput, pnState);
+
+    switch (NNevalAction(pnState)) {
+    case NNEVAL_NONE:
+        break;
+    case NNEVAL_SAVE:
+        NeuralNetSaveInputs(pnn, arInput, pActive, pnState);
+        arSave = pnState->savedBase;
+        break;
+    case NNEVAL_FROMBASE:
+        arBase = pnState->savedBase;
+        arInputBase = pnState->savedIBase;
+        break;
     }
+
+    c = NeuralNetChangedInputs(pnn, arInput, pActive, arInputBase ? pnState : NULL, aiChanged);
+
+    memset(anSum, 0, cHidden * sizeof(int));
+
+    for (k = 0; k < c; k++) {
+        unsigned int const i = aiChanged[k];
+        const short *ps = pnn->asHiddenWeight + i * cHidden;
+        /* quantise before taking differences, so that evaluating from
+         * the base gives the same sums as evaluating from scratch */
+        int const n = arInputBase ? NNQuantiseInput(arInput[i]) - NNQuantiseInput(arInputBase[i])
+            : NNQuantiseInput(arInput[i]);
+
+        for (j = 0; j < cHidden; j++)
+            anSum[j] += n * ps[j];
+    }
+
+    for (j = 0; j < cHidden; j++)
+        ar[j] = arBase[j] + (float) anSum[j] * pnn->arHiddenScale[j];
+
+    if (arSave)
+        memcpy(arSave, ar, cHidden * sizeof(float));
+
+    EvaluateOutputs(pnn, ar, arOutput);
+
+    return 0;
 }
 
+/* NeuralNetEvaluate() with the weights from NeuralNetHalve(), converted
+ * one at a time.  This is far slower than the floating point kernels and
+ * is only the reference for the F16C ones. */
+
 extern int
-NeuralNetEvaluate(const neuralnet * pnn, float arInput[], float arOutput[], NNState * pnState)
+NeuralNetEvaluateHalfScalar(const neuralnet * pnn, float arInput[], const nnactive * pActive, float arOutput[],
+                            NNState * pnState)
 {
-    float *ar = (float *) g_alloca(pnn->cHidden * sizeof(float));
+    const unsigned int cHidden = pnn->cHidden;
+    float *ar = (float *) g_alloca(cHidden * sizeof(float));
+    unsigned int *aiChanged = (unsigned int *) g_alloca(2 * pnn->cInput * sizeof(unsigned int));
+    const float *arBase = pnn->arHiddenThreshold;
+    const float *arInputBase = NULL;
+    const unsigned short *ph;
+    float *arSave = NULL;
+    unsigned int i, j, k, c;
+
+    if (!pnn->ahHiddenWeight)
+        return NeuralNetEvaluateScalar(pnn, arInput, pActive, arOutput, pnState);
+
     switch (NNevalAction(pnState)) {
     case NNEVAL_NONE:
-        {
-            Evaluate(pnn, arInput, ar, arOutput, 0);
-            break;
-        }
+        break;
     case NNEVAL_SAVE:
-        {
-            memcpy(pnState->savedIBase, arInput, pnn->cInput * sizeof(*ar));
-            Evaluate(pnn, arInput, ar, arOutput, pnState->savedBase);
-            break;
-        }
+        NeuralNetSaveInputs(pnn, arInput, pActive, pnState);
+        arSave = pnState->savedBase;
+        break;
     case NNEVAL_FROMBASE:
-        {
-            unsigned int i;
-
-            memcpy(ar, pnState->savedBase, pnn->cHidden * sizeof(*ar));
-
-            {
-                float *r = arInput;
-                float *s = pnState->savedIBase;
-
-                for (i = 0; i < pnn->cInput; ++i, ++r, ++s) {
-                    if (*r != *s /*lint --e(777) */ ) {
-                        *r -= *s;
-                    } else {
-                        *r = 0.0;
-                    }
-                }
-            }
-            EvaluateFromBase(pnn, arInput, ar, arOutput);
-            break;
+        arBase = pnState->savedBase;
+        arInputBase = pnState->savedIBase;
+        break;
+    }
+
+    c = NeuralNetChangedInputs(pnn, arInput, pActive, arInputBase ? pnState : NULL, aiChanged);
+
+    memcpy(ar, arBase, cHidden * sizeof(float));
+
+    for (k = 0; k < c; k++) {
+        unsigned int const n = aiChanged[k];
+        float const ari = arInputBase ? arInput[n] - arInputBase[n] : arInput[n];
+
+        ph = pnn->ahHiddenWeight + n * cHidden;
+        for (j = 0; j < cHidden; j++)
+            ar[j] += NeuralNetHalfToFloat(ph[j]) * ari;
+    }
+
+    if (arSave)
+        memcpy(arSave, ar, cHidden * sizeof(float));
+
+    for (j = 0; j < cHidden; j++)
+        ar[j] = sigmoid(-pnn->rBetaHidden * ar[j]);
+
+    ph = pnn->ahOutputWeight;
+
+    for (i = 0; i < pnn->cOutput; i++) {
+        float r = pnn->arOutputThreshold[i];
+
+        for (j = 0; j < cHidden; j++)
+            r += ar[j] * NeuralNetHalfToFloat(*ph++);
+
+        arOutput[i] = sigmoid(-pnn->rBetaOutput * r);
+    }
+
+    return 0;
+}
+
+/* Add the weight row of input i times arInput[i] to the hidden
+ * activities for each input in aiInput[] */
+static void
+AddRows(const neuralnet * pnn, float ar[], const float arInput[], const unsigned int aiInput[], unsigned int cInputs)
+{
+    const unsigned int cHidden = pnn->cHidden;
+    unsigned int j, k;
+
+    for (k = 0; k < cInputs; k++) {
+        float const ari = arInput[aiInput[k]];
+        const float *prWeight = pnn->arHiddenWeight + aiInput[k] * cHidden;
+
+        if (!ari)
+            continue;
+
+        if (ari == 1.0f)
+            for (j = 0; j < cHidden; j++)
+                ar[j] += prWeight[j];
+        else
+            for (j = 0; j < cHidden; j++)
+                ar[j] += prWeight[j] * ari;
+    }
+}
+
+/* Evaluate nPositions input vectors, stored one after the other in
+ * arInput, storing the outputs one after the other in arOutput.
+ *
+ * The positions are taken NN_BATCH_BLOCK at a time.  The candidate moves
+ * of a position share most of their inputs, so the weight rows of the
+ * inputs that are the same for the whole block are added only once and
+ * each position only adds the rows of the inputs where they differ. */
+
+extern int
+NeuralNetEvaluateBatchScalar(const neuralnet * pnn, unsigned int nPositions, const float arInput[], float arOutput[])
+{
+    const unsigned int cInput = pnn->cInput;
+    const unsigned int cHidden = pnn->cHidden;
+    float *arBase = (float *) g_alloca(2 * cHidden * sizeof(float));
+    float *ar = arBase + cHidden;
+    unsigned int *aiCommon = (unsigned int *) g_alloca(2 * cInput * sizeof(unsigned int));
+    unsigned int *aiDiff = aiCommon + cInput;
+    unsigned int n, b, i;
+
+    for (n = 0; n < nPositions; n += NN_BATCH_BLOCK) {
+        unsigned int const cBlock = MIN(NN_BATCH_BLOCK, nPositions - n);
+        const float *arIn = arInput + n * cInput;
+        unsigned int cCommon = 0, cDiff = 0;
+
+        for (i = 0; i < cInput; i++) {
+            for (b = 1; b < cBlock; b++)
+                if (arIn[b * cInput + i] != arIn[i])
+                    break;
+
+            if (b < cBlock)
+                aiDiff[cDiff++] = i;
+            else if (arIn[i] != 0.0f)
+                aiCommon[cCommon++] = i;
+        }
+
+        memcpy(arBase, pnn->arHiddenThreshold, cHidden * sizeof(float));
+        AddRows(pnn, arBase, arIn, aiCommon, cCommon);
+
+        for (b = 0; b < cBlock; b++) {
+            memcpy(ar, arBase, cHidden * sizeof(float));
+            AddRows(pnn, ar, arIn + b * cInput, aiDiff, cDiff);
+            EvaluateOutputs(pnn, ar, arOutput + (n + b) * pnn->cOutput);
         }
     }
+
     return 0;
 }
 
@@ -358,203 +760,510 @@ NeuralNetSaveBinary(const neuralnet * pnn, FILE * pf)
 }
 
 
-#if USE_SIMD_INSTRUCTIONS
+/* Mapped weights files ("gnubg.wm", written by makeweights -m) hold the
+ * arrays of each net exactly as they are used in memory, so that they
+ * can be mapped read-only and shared between processes instead of being
+ * read and copied:
+ *
+ *   nnmapheader
+ *   nnmapnet for each net
+ *   the arrays of the nets, each at an offset from the start of the file
+ *   that is a multiple of NN_MAP_ALIGN (as the mapping starts on a page
+ *   boundary they keep that alignment in memory)
+ *
+ * The numbers are in the byte order and formats of the machine that
+ * wrote the file; nByteOrder and the sizes in the header catch a file
+ * from a different one. */
+
+#define NN_MAP_MAGIC "GNUBGWM"
+/* 2: int16 weight scales sized for inputs up to NN_Q_INPUT_MAX
+ * 3: the absolute int16 weights of a node sum to at most NN_Q_WEIGHT_SUM */
+#define NN_MAP_VERSION 3
+#define NN_MAP_ALIGN 64
+#define NN_MAP_BYTE_ORDER 0x01020304u
+
+typedef struct _nnmapheader {
+    char szMagic[8];
+    unsigned int nVersion;
+    unsigned int nByteOrder;
+    unsigned int cbFloat, cbShort;
+    unsigned int nAlign;
+    unsigned int cNets;
+    char szVersion[16];         /* WEIGHTS_VERSION of the weights */
+} nnmapheader;
+
+typedef struct _nnmapnet {
+    unsigned int cInput;
+    unsigned int cHidden;
+    unsigned int cOutput;
+    int nTrained;
+    float rBetaHidden;
+    float rBetaOutput;
+    /* offsets of the arrays; 0 for no int16 weights */
+    unsigned int oHiddenWeight;
+    unsigned int oOutputWeight;
+    unsigned int oHiddenThreshold;
+    unsigned int oOutputThreshold;
+    unsigned int oQuantisedWeight;
+    unsigned int oHiddenScale;
+} nnmapnet;
+
+static unsigned int
+MapAlign(unsigned int o)
+{
+    return (o + NN_MAP_ALIGN - 1) & ~(NN_MAP_ALIGN - 1);
+}
 
-#if defined(DISABLE_SIMD_TEST)
+/* Lay out the arrays of pnn from offset o on; returns the offset after
+ * them */
 
-int
-SIMD_Supported(void)
+static unsigned int
+MapLayout(const neuralnet * pnn, nnmapnet * pnm, unsigned int o)
 {
-    return 1;
+    pnm->cInput = pnn->cInput;
+    pnm->cHidden = pnn->cHidden;
+    pnm->cOutput = pnn->cOutput;
+    pnm->nTrained = pnn->nTrained;
+    pnm->rBetaHidden = pnn->rBetaHidden;
+    pnm->rBetaOutput = pnn->rBetaOutput;
+
+    pnm->oHiddenWeight = o = MapAlign(o);
+    o += pnn->cInput * pnn->cHidden * sizeof(float);
+    pnm->oOutputWeight = o = MapAlign(o);
+    o += pnn->cHidden * pnn->cOutput * sizeof(float);
+    pnm->oHiddenThreshold = o = MapAlign(o);
+    o += pnn->cHidden * sizeof(float);
+    pnm->oOutputThreshold = o = MapAlign(o);
+    o += pnn->cOutput * sizeof(float);
+
+    if (pnn->asHiddenWeight) {
+        pnm->oQuantisedWeight = o = MapAlign(o);
+        o += pnn->cInput * pnn->cHidden * sizeof(short);
+        pnm->oHiddenScale = o = MapAlign(o);
+        o += pnn->cHidden * sizeof(float);
+    } else
+        pnm->oQuantisedWeight = pnm->oHiddenScale = 0;
+
+    return o;
 }
 
-#else
+static int
+MapWrite(const void *p, size_t cb, unsigned int o, unsigned int *po, FILE * pf)
+{
+    static const char achZero[NN_MAP_ALIGN] = { 0 };
 
-#if defined(__APPLE__) || defined(__FreeBSD__)
-#include <sys/sysctl.h>
-#endif
+    if (fwrite(achZero, 1, o - *po, pf) < o - *po || fwrite(p, 1, cb, pf) < cb)
+        return -1;
+
+    *po = o + cb;
+
+    return 0;
+}
+
+/* Write the cNets nets in apnn[] (with their int16 weights, if they have
+ * been made by NeuralNetQuantise()) as a mapped weights file */
+
+extern int
+NeuralNetSaveMapped(neuralnet * const apnn[], unsigned int cNets, const char *szVersion, FILE * pf)
+{
+    nnmapheader nmh;
+    nnmapnet *anm = (nnmapnet *) g_alloca(cNets * sizeof(nnmapnet));
+    unsigned int i, o;
+
+    memset(&nmh, 0, sizeof(nmh));
+    strcpy(nmh.szMagic, NN_MAP_MAGIC);
+    nmh.nVersion = NN_MAP_VERSION;
+    nmh.nByteOrder = NN_MAP_BYTE_ORDER;
+    nmh.cbFloat = sizeof(float);
+    nmh.cbShort = sizeof(short);
+    nmh.nAlign = NN_MAP_ALIGN;
+    nmh.cNets = cNets;
+    strncpy(nmh.szVersion, szVersion, sizeof(nmh.szVersion) - 1);
+
+    o = sizeof(nmh) + cNets * sizeof(nnmapnet);
+    for (i = 0; i < cNets; i++)
+        o = MapLayout(apnn[i], &anm[i], o);
+
+    if (fwrite(&nmh, sizeof(nmh), 1, pf) < 1 || fwrite(anm, sizeof(nnmapnet), cNets, pf) < cNets)
+        return -1;
+
+    o = sizeof(nmh) + cNets * sizeof(nnmapnet);
+    for (i = 0; i < cNets; i++) {
+        const neuralnet *pnn = apnn[i];
+
+        if (MapWrite(pnn->arHiddenWeight, pnn->cInput * pnn->cHidden * sizeof(float), anm[i].oHiddenWeight, &o, pf)
+            || MapWrite(pnn->arOutputWeight, pnn->cHidden * pnn->cOutput * sizeof(float), anm[i].oOutputWeight, &o,
+                        pf)
+            || MapWrite(pnn->arHiddenThreshold, pnn->cHidden * sizeof(float), anm[i].oHiddenThreshold, &o, pf)
+            || MapWrite(pnn->arOutputThreshold, pnn->cOutput * sizeof(float), anm[i].oOutputThreshold, &o, pf))
+            return -1;
+
+        if (anm[i].oQuantisedWeight
+            && (MapWrite(pnn->asHiddenWeight, pnn->cInput * pnn->cHidden * sizeof(short), anm[i].oQuantisedWeight,
+                         &o, pf)
+                || MapWrite(pnn->arHiddenScale, pnn->cHidden * sizeof(float), anm[i].oHiddenScale, &o, pf)))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Check that an array of cb bytes at offset o lies within the file and
+ * is aligned in memory */
 
 static int
-check_for_cpuid()
+MapArrayOK(const char *pch, size_t cbFile, unsigned int o, size_t cb)
+{
+    return o && o % NN_MAP_ALIGN == 0 && o <= cbFile && cb <= cbFile - o
+        && ((size_t) (pch + o)) % NN_MAP_ALIGN == 0;
+}
+
+/* Map the weights file szFilename, which must hold cNets nets with
+ * weights version szVersion, and point the nets in apnn[] at its arrays.
+ * Returns the mapping, to be released with NeuralNetUnmap() once the nets
+ * are destroyed, or NULL if the file cannot be used. */
+
+extern void *
+NeuralNetMap(const char *szFilename, const char *szVersion, neuralnet * const apnn[], unsigned int cNets)
 {
-    int result;
+#if GLIB_CHECK_VERSION(2,8,0)
+    GMappedFile *pmf;
+    const char *pch;
+    const nnmapheader *pnmh;
+    const nnmapnet *anm;
+    size_t cb;
+    unsigned int i;
 
-    asm volatile(
-#if defined(ENVIRONMENT32) && defined(__PIC__)
-        /* We have to be careful to not destroy ebx if using PIC on 32bit builds */
-        "pushl %%ebx\n\t"
+    if (!(pmf = g_mapped_file_new(szFilename, FALSE, NULL)))
+        return NULL;
+
+    pch = g_mapped_file_get_contents(pmf);
+    cb = g_mapped_file_get_length(pmf);
+    pnmh = (const nnmapheader *) pch;
+    anm = (const nnmapnet *) (pch + sizeof(nnmapheader));
+
+    if (cb < sizeof(nnmapheader) || memcmp(pnmh->szMagic, NN_MAP_MAGIC, sizeof(NN_MAP_MAGIC))
+        || pnmh->nVersion != NN_MAP_VERSION || pnmh->nByteOrder != NN_MAP_BYTE_ORDER
+        || pnmh->cbFloat != sizeof(float) || pnmh->cbShort != sizeof(short) || pnmh->nAlign != NN_MAP_ALIGN
+        || pnmh->cNets != cNets || strncmp(pnmh->szVersion, szVersion, sizeof(pnmh->szVersion))
+        || cb < sizeof(nnmapheader) + cNets * sizeof(nnmapnet))
+        goto invalid;
+
+    for (i = 0; i < cNets; i++) {
+        const nnmapnet *pnm = &anm[i];
+        size_t const cWeights = (size_t) pnm->cInput * pnm->cHidden;
+
+        if (pnm->cInput < 1 || pnm->cHidden < 1 || pnm->cOutput < 1 || pnm->rBetaHidden <= 0.0
+            || pnm->rBetaOutput <= 0.0
+            || !MapArrayOK(pch, cb, pnm->oHiddenWeight, cWeights * sizeof(float))
+            || !MapArrayOK(pch, cb, pnm->oOutputWeight, (size_t) pnm->cHidden * pnm->cOutput * sizeof(float))
+            || !MapArrayOK(pch, cb, pnm->oHiddenThreshold, pnm->cHidden * sizeof(float))
+            || !MapArrayOK(pch, cb, pnm->oOutputThreshold, pnm->cOutput * sizeof(float))
+            || (pnm->oQuantisedWeight && (!MapArrayOK(pch, cb, pnm->oQuantisedWeight, cWeights * sizeof(short))
+                                          || !MapArrayOK(pch, cb, pnm->oHiddenScale,
+                                                         pnm->cHidden * sizeof(float)))))
+            goto invalid;
+    }
+
+    for (i = 0; i < cNets; i++) {
+        const nnmapnet *pnm = &anm[i];
+        neuralnet *pnn = apnn[i];
+
+        pnn->cInput = pnm->cInput;
+        pnn->cHidden = pnm->cHidden;
+        pnn->cOutput = pnm->cOutput;
+        pnn->nTrained = pnm->nTrained;
+        pnn->rBetaHidden = pnm->rBetaHidden;
+        pnn->rBetaOutput = pnm->rBetaOutput;
+        pnn->fDirect = TRUE;
+        /* the kernels only read the arrays */
+        pnn->arHiddenWeight = (float *) (pch + pnm->oHiddenWeight);
+        pnn->arOutputWeight = (float *) (pch + pnm->oOutputWeight);
+        pnn->arHiddenThreshold = (float *) (pch + pnm->oHiddenThreshold);
+        pnn->arOutputThreshold = (float *) (pch + pnm->oOutputThreshold);
+        pnn->asHiddenWeight = pnm->oQuantisedWeight ? (short *) (pch + pnm->oQuantisedWeight) : NULL;
+        pnn->arHiddenScale = pnm->oQuantisedWeight ? (float *) (pch + pnm->oHiddenScale) : NULL;
+        pnn->ahHiddenWeight = pnn->ahOutputWeight = NULL;
+    }
+
+    return pmf;
+
+  invalid:
+#if GLIB_CHECK_VERSION(2,22,0)
+    g_mapped_file_unref(pmf);
+#else
+    g_mapped_file_free(pmf);
 #endif
-        "mov $1, %%eax\n\t"
-        "shl $21, %%eax\n\t"
-        "mov %%eax, %%edx\n\t"
-#if defined(ENVIRONMENT64)
-        "pushf\n\t"
-        "pop %%rax\n\t"
+    errno = EINVAL;
+    return NULL;
 #else
-        "pushfl\n\t"
-        "popl %%eax\n\t"
+    (void) szFilename;
+    (void) szVersion;
+    (void) apnn;
+    (void) cNets;
+    return NULL;
 #endif
-        "mov %%eax, %%ecx\n\t"
-        "xor %%edx, %%eax\n\t"
-#if defined(ENVIRONMENT64)
-        "push %%rax\n\t"
-        "popf\n\t"
-        "pushf\n\t"
-        "pop %%rax\n\t"
+}
+
+extern void
+NeuralNetUnmap(void *pMap)
+{
+#if GLIB_CHECK_VERSION(2,8,0)
+    if (pMap)
+#if GLIB_CHECK_VERSION(2,22,0)
+        g_mapped_file_unref((GMappedFile *) pMap);
 #else
-        "pushl %%eax\n\t"
-        "popfl\n\t"
-        "pushfl\n\t"
-        "popl %%eax\n\t"
+        g_mapped_file_free((GMappedFile *) pMap);
 #endif
-        "xor %%ecx, %%eax\n\t"
-        "test %%edx, %%eax\n\t"
-        "jnz cpuid_success\n\t"
-        /* Failed (non-pentium compatible machine) */
-        "mov $-1, %%eax\n\t"
-        "jmp cpuid_finished\n\t"
-
-"cpuid_success:"
-        "xor %%eax, %%eax\n\t"
-        "cpuid\n\t"
-        "cmp $1, %%eax\n\t" 
-        /* If 0 returned processor doesn't hav feature test */
-        "jge feature_success\n\t"
-
-        /* Unlucky - somehow cpuid 1 isn't supported */
-        "mov $-2, %%eax\n\t" 
-        "jmp cpuid_finished\n\t"
-
-"feature_success:"
-        "xor %%eax, %%eax\n\t"
-
-"cpuid_finished:"
-#if defined(ENVIRONMENT32) && defined(__PIC__)
-        "popl %%ebx\n\t"
 #endif
-        : "=a"(result)
-        :
-        : "%ecx",
-#if !defined(ENVIRONMENT32) || !defined(__PIC__)
-          "%ebx", 
-#endif 
-          "%edx");
-    return result;
 }
 
-static int
-CheckSSE(void)
+#if USE_SIMD_INSTRUCTIONS
+
+#include "mm_malloc.h"
+
+float *
+sse_malloc(size_t size)
 {
-    int result;
-    int cpuidchk;
+    return (float *) _mm_malloc(size, ALIGN_SIZE);
+}
 
-    if ((cpuidchk = check_for_cpuid()) < 0)
-        return cpuidchk;
+void
+sse_free(float *ptr)
+{
+    _mm_free(ptr);
+}
 
-#if USE_AVX
+#if defined(DISABLE_SIMD_TEST)
 
-    asm volatile(
-#if defined(ENVIRONMENT32) && defined(__PIC__)
-        /* We have to be careful to not destroy ebx if using PIC on 32bit builds */
-        "pushl %%ebx\n\t"
-#endif
-        "mov $1, %%eax\n\t" 
-        "cpuid\n\t" 
-        "and $0x018000000, %%ecx\n\t" /* Check bit 27 (OS uses XSAVE/XRSTOR)*/
-        "cmp $0x018000000, %%ecx\n\t" /* and bit 28 (AVX supported by CPU) */
-        "jne avx_unsupported\n\t"
-        "xor %%ecx, %%ecx\n\t" /* XFEATURE_ENABLED_MASK/XCR0 register number = 0 */
-        "xgetbv\n\t" /* XFEATURE_ENABLED_MASK register is in edx:eax" */
-        "and $0b110, %%eax\n\t"
-        "cmp $0b110, %%eax\n\t" /* check the AVX registers restore at context switch */
-        "jne avx_unsupported\n\t"
-        "mov $1, %%eax\n\t"
-        "jmp avx_end\n\t"
-
-"avx_unsupported:"
-        "xor %%eax, %%eax\n\t"
-
-"avx_end:"
-#if defined(ENVIRONMENT32) && defined(__PIC__)
-        "popl %%ebx\n\t"
-#endif
-        : "=a"(result) /* Result returned in result variable */
-        :
-        : "%ecx", 
-#if !defined(ENVIRONMENT32) || !defined(__PIC__)
-          "%ebx", 
-#endif
-          "%edx"); /* These are all destroyed by cpuid */
+/* Without the test only the baseline of x86-64 is assumed */
+extern unsigned int
+SIMD_Supported(void)
+{
+    return SIMD_SSE2;
+}
 
 #else
-#if defined(__APPLE__) || defined(__FreeBSD__)
-    size_t length = sizeof(result);
-#if defined(__APPLE__)
-    int error = sysctlbyname("hw.optional.sse", &result, &length, NULL, 0);
-#endif
-#if defined(__FreeBSD__)
-    int error = sysctlbyname("hw.instruction_sse", &result, &length, NULL, 0);
-#endif
-    if (0 != error)
-        result = 0;
-    return result;
+
+#include <cpuid.h>
+
+static unsigned int
+GetXCR0(void)
+{
+    unsigned int eax, edx;
+
+    /* xgetbv, spelt out for assemblers that don't know it */
+    asm volatile (".byte 0x0f, 0x01, 0xd0":"=a" (eax), "=d"(edx):"c"(0));
+
+    return eax;
+}
+
+static unsigned int
+CheckSIMD(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int fFeatures = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+
+    if (edx & bit_SSE2)
+        fFeatures |= SIMD_SSE2;
+
+    /* AVX needs the OS to save the ymm registers on context switches */
+    if ((ecx & (bit_OSXSAVE | bit_AVX)) == (bit_OSXSAVE | bit_AVX) && (GetXCR0() & 0x6) == 0x6) {
+        fFeatures |= SIMD_AVX;
+        if (ecx & bit_FMA)
+            fFeatures |= SIMD_FMA;
+        if (ecx & bit_F16C)
+            fFeatures |= SIMD_F16C;
+        if (__get_cpuid_max(0, NULL) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            if (ebx & bit_AVX2)
+                fFeatures |= SIMD_AVX2;
+        }
+    }
+
+    return fFeatures;
+}
+
+extern unsigned int
+SIMD_Supported(void)
+{
+    static int fChecked = FALSE;
+    static unsigned int fFeatures;
+
+    if (!fChecked) {
+        fFeatures = CheckSIMD();
+        fChecked = TRUE;
+    }
+
+    return fFeatures;
+}
+
+#endif                          /* DISABLE_SIMD_TEST */
 
 #else
 
-    asm volatile (
-#if defined(ENVIRONMENT32) && defined(__PIC__)
-        /* We have to be careful to not destroy ebx if using PIC on I386 */
-        "pushl %%ebx\n\t"
-#endif
-        /* Check if sse is supported (bit 25/26 in edx from cpuid 1) */
-        "mov $1, %%eax\n\t"
-        "cpuid\n\t" 
-        "mov $1, %%eax\n\t"
-#if USE_SSE2
-        "shl $26, %%eax\n\t"
+extern unsigned int
+SIMD_Supported(void)
+{
+    return 0;
+}
+
+#endif                          /* USE_SIMD_INSTRUCTIONS */
+
+/* The AVX kernels are built with F16C for half precision if the
+ * compiler has it (HAVE_SIMD_F16C); SSE2 has no half conversions. */
+#if HAVE_SIMD_F16C
+#define HALF_KERNEL(name) name, SIMD_F16C
 #else
-        "shl $25, %%eax\n\t"
-#endif
-        "test %%eax, %%edx\n\t"
-        "jnz sse_success\n\t"
-        /* Not supported */
-        "mov $0, %%eax\n\t"
-        "jmp sse_end\n\t"
-
-"sse_success:"
-        /* Supported */
-        "mov $1, %%eax\n\t"
-
-"sse_end:"
-#if defined(ENVIRONMENT32) && defined(__PIC__)
-        "pop %%ebx\n\t"
+#define HALF_KERNEL(name) NULL, 0
 #endif
 
-        : "=a"(result)
-        :
-        : "%ecx", 
-#if !defined(ENVIRONMENT32) || !defined(__PIC__)
-          "%ebx", 
+/* Fastest first; the scalar kernel is always last */
+const nnkernel anNeuralNetKernels[] = {
+#if USE_SIMD_INSTRUCTIONS
+#if HAVE_SIMD_AVX2
+    {"AVX2/FMA", SIMD_AVX | SIMD_AVX2 | SIMD_FMA, NeuralNetEvaluateAVX2, NeuralNetEvaluateBatchAVX2, baseInputsAVX2,
+     NeuralNetEvaluateQuantisedAVX2, HALF_KERNEL(NeuralNetEvaluateHalfAVX2)},
+#endif
+#if HAVE_SIMD_AVX
+    {"AVX", SIMD_AVX, NeuralNetEvaluateAVX, NeuralNetEvaluateBatchAVX, baseInputsAVX,
+     NeuralNetEvaluateQuantisedAVX, HALF_KERNEL(NeuralNetEvaluateHalfAVX)},
+#endif
+    {"SSE2", SIMD_SSE2, NeuralNetEvaluateSSE2, NeuralNetEvaluateBatchSSE2, baseInputsSSE2,
+     NeuralNetEvaluateQuantisedSSE2, NULL, 0},
 #endif
-	  "%edx");
-#endif /* APPLE/BSD */
+    {"scalar", 0, NeuralNetEvaluateScalar, NeuralNetEvaluateBatchScalar, baseInputsScalar,
+     NeuralNetEvaluateQuantisedScalar, NeuralNetEvaluateHalfScalar, 0}
+};
+
+const unsigned int cNeuralNetKernels = sizeof(anNeuralNetKernels) / sizeof(anNeuralNetKernels[0]);
+
+static const nnkernel *pnkActive = &anNeuralNetKernels[sizeof(anNeuralNetKernels) / sizeof(anNeuralNetKernels[0]) - 1];
+
+static int fQuantised = FALSE;
+static int fHalf = FALSE;
+
+f_NeuralNetEvaluate NeuralNetEvaluate = NeuralNetEvaluateScalar;
+f_NeuralNetEvaluateBatch NeuralNetEvaluateBatch = NeuralNetEvaluateBatchScalar;
+f_baseInputs baseInputs = baseInputsScalar;
+f_NeuralNetEvaluateQuantised NeuralNetEvaluateQuantised = NeuralNetEvaluateQuantisedScalar;
+f_NeuralNetEvaluateHalf NeuralNetEvaluateHalf = NeuralNetEvaluateHalfScalar;
+
+/* The quantised and half precision kernels have no batch version;
+ * evaluate one position at a time */
+static int
+NeuralNetEvaluateBatchSingly(const neuralnet * pnn, unsigned int nPositions, const float arInput[],
+                             float arOutput[])
+{
+    SSE_ALIGN(float ar[pnn->cInput]);
+    unsigned int n;
 
-#endif /* USE_AVX */
+    for (n = 0; n < nPositions; n++) {
+        memcpy(ar, arInput + n * pnn->cInput, pnn->cInput * sizeof(float));
+        NeuralNetEvaluate(pnn, ar, NULL, arOutput + n * pnn->cOutput, NULL);
+    }
 
-    return result;
+    return 0;
 }
 
-int
-SIMD_Supported(void)
+/* The half precision evaluation of kernel pnk, or NULL if it has none or
+ * the CPU can't run it */
+
+extern f_NeuralNetEvaluateHalf
+NeuralNetHalfKernel(const nnkernel * pnk)
 {
-    static int state = -3;
+    if (!pnk->pfNeuralNetEvaluateHalf || (pnk->fHalfFeatures & SIMD_Supported()) != pnk->fHalfFeatures)
+        return NULL;
 
-    if (state == -3)
-        state = CheckSSE();
+    return pnk->pfNeuralNetEvaluateHalf;
+}
 
-    return state;
+static void
+SetKernelFunctions(void)
+{
+    f_NeuralNetEvaluateHalf pfHalf = NeuralNetHalfKernel(pnkActive);
+
+    NeuralNetEvaluateQuantised = pnkActive->pfNeuralNetEvaluateQuantised;
+    NeuralNetEvaluateHalf = pfHalf ? pfHalf : pnkActive->pfNeuralNetEvaluate;
+    baseInputs = pnkActive->pfBaseInputs;
+
+    /* quantised evaluation takes precedence; the hidden layer is then
+     * in int16 anyway */
+    if (fQuantised) {
+        NeuralNetEvaluate = pnkActive->pfNeuralNetEvaluateQuantised;
+        NeuralNetEvaluateBatch = NeuralNetEvaluateBatchSingly;
+    } else if (fHalf && pfHalf) {
+        NeuralNetEvaluate = pfHalf;
+        NeuralNetEvaluateBatch = NeuralNetEvaluateBatchSingly;
+    } else {
+        NeuralNetEvaluate = pnkActive->pfNeuralNetEvaluate;
+        NeuralNetEvaluateBatch = pnkActive->pfNeuralNetEvaluateBatch;
+    }
 }
 
-#endif
-#endif
+/* Select the named kernel, or the fastest one the CPU supports if szName
+ * is NULL.  Returns -1 if the kernel is unknown or not supported here. */
+
+extern int
+NeuralNetSetKernel(const char *szName)
+{
+    unsigned int fFeatures = SIMD_Supported();
+    unsigned int i;
+
+    for (i = 0; i < cNeuralNetKernels; i++) {
+        const nnkernel *pnk = &anNeuralNetKernels[i];
+
+        if ((pnk->fFeatures & fFeatures) != pnk->fFeatures)
+            continue;
+
+        if (szName && g_ascii_strcasecmp(szName, pnk->szName))
+            continue;
+
+        pnkActive = pnk;
+        SetKernelFunctions();
+        return 0;
+    }
+
+    return -1;
+}
 
+extern const nnkernel *
+NeuralNetGetKernel(void)
+{
+    return pnkActive;
+}
+
+/* Evaluate the nets that have been quantised (see NeuralNetQuantise())
+ * with NeuralNetEvaluateQuantised() */
+
+extern void
+NeuralNetSetQuantised(int f)
+{
+    fQuantised = f;
+    SetKernelFunctions();
+}
+
+extern int
+NeuralNetGetQuantised(void)
+{
+    return fQuantised;
+}
+
+/* Evaluate the nets that have been halved (see NeuralNetHalve()) with
+ * NeuralNetEvaluateHalf(), if the kernel in use has an F16C version */
+
+extern void
+NeuralNetSetHalf(int f)
+{
+    fHalf = f;
+    SetKernelFunctions();
+}
+
+extern int
+NeuralNetGetHalf(void)
+{
+    return fHalf;
+}
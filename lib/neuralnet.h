@@ -23,12 +23,13 @@
 
 #include <stdio.h>
 #include "common.h"
+#include "gnubg-types.h"
 
 typedef struct _neuralnet {
     unsigned int cInput;
     unsigned int cHidden;
     unsigned int cOutput;
-    unsigned int fDirect;
+    unsigned int fDirect;       /* the arrays belong to a mapped file */
     int nTrained;
     float rBetaHidden;
     float rBetaOutput;
@@ -36,6 +37,10 @@ typedef struct _neuralnet {
     float *arOutputWeight;
     float *arHiddenThreshold;
     float *arOutputThreshold;
+    short *asHiddenWeight;      /* quantised arHiddenWeight, see NeuralNetQuantise() */
+    float *arHiddenScale;
+    unsigned short *ahHiddenWeight;     /* IEEE half precision copies of the */
+    unsigned short *ahOutputWeight;     /* weights, see NeuralNetHalve() */
 } neuralnet;
 
 typedef enum {
@@ -50,21 +55,170 @@ typedef enum {
     NNSTATE_DONE
 } NNStateType;
 
+/* The inputs of a net that are not zero, listed by the functions that
+ * calculate the inputs.  A kernel given such a list adds up the weight
+ * rows of these inputs only instead of scanning the whole input vector. */
+#define NN_MAX_INPUTS 256
+
+typedef struct _nnactive {
+    unsigned int c;             /* NN_NOT_ACTIVE if not known */
+    int fChanged;               /* ai[] lists the inputs that differ from
+                                 * the saved base instead (NNEVAL_FROMBASE) */
+    unsigned int ai[NN_MAX_INPUTS];
+} nnactive;
+
+#define NN_NOT_ACTIVE ((unsigned int) -1)
+
 typedef struct _NNState {
     NNStateType state;
     float *savedBase;
     float *savedIBase;
+    nnactive *savedActive;      /* non-zero inputs in savedIBase, or NULL */
+    /* For eval.c: bit masks of the board points (bit i for point i of
+     * side j) that may differ from the position the moves were generated
+     * from, for the position evaluated next and for the saved base;
+     * NN_ALL_POINTS if not known */
+    unsigned int anPoints[2];
+    unsigned int anBasePoints[2];
+    unsigned int cFromBase;     /* evaluations whose inputs came from the base */
 } NNState;
 
+#define NN_ALL_POINTS (~0u)
+
+/* Evaluation kernels.  The scalar versions live in neuralnet.c and
+ * inputs.c; the SIMD ones are built from neuralnetsse.c once per
+ * instruction set.  The function pointers are set by NeuralNetSetKernel() */
+#define NN_KERNEL_FUN(ret, name, ...) \
+	typedef ret (*f_##name)( __VA_ARGS__); \
+	extern f_##name name; \
+	extern ret name##Scalar( __VA_ARGS__); \
+	extern ret name##SSE2( __VA_ARGS__); \
+	extern ret name##AVX( __VA_ARGS__); \
+	extern ret name##AVX2( __VA_ARGS__)
+
+NN_KERNEL_FUN(int, NeuralNetEvaluate, const neuralnet * pnn, float arInput[], const nnactive * pActive,
+              float arOutput[], NNState * pnState);
+NN_KERNEL_FUN(int, NeuralNetEvaluateBatch, const neuralnet * pnn, unsigned int nPositions, const float arInput[],
+              float arOutput[]);
+NN_KERNEL_FUN(void, baseInputs, const TanBoard anBoard, float arInput[]);
+NN_KERNEL_FUN(int, NeuralNetEvaluateQuantised, const neuralnet * pnn, float arInput[], const nnactive * pActive,
+              float arOutput[], NNState * pnState);
+NN_KERNEL_FUN(int, NeuralNetEvaluateHalf, const neuralnet * pnn, float arInput[], const nnactive * pActive,
+              float arOutput[], NNState * pnState);
+
+/* Positions evaluated together by NeuralNetEvaluateBatch() */
+#define NN_BATCH_BLOCK 8
+
+/* The quantised evaluation multiplies the int16 hidden weights by the
+ * inputs in fixed point with this many fraction bits.  Inputs are
+ * limited to +-8 so that the difference of two still fits in a short.
+ * NeuralNetQuantise() keeps the sum of the absolute int16 weights of a
+ * hidden node to NN_Q_WEIGHT_SUM, so a 32 bit sum of products is at most
+ * NN_Q_WEIGHT_SUM * 2 * NN_Q_INPUT_MAX = 2147287044 < 2^31. */
+#define NN_Q_INPUT_BITS 11
+#define NN_Q_INPUT_MAX ((8 << NN_Q_INPUT_BITS) - 1)
+#define NN_Q_WEIGHT_SUM 65534
+
+static inline int
+NNQuantiseInput(float r)
+{
+    r *= (float) (1 << NN_Q_INPUT_BITS);
+
+    if (r >= (float) NN_Q_INPUT_MAX)
+        return NN_Q_INPUT_MAX;
+    else if (r <= (float) -NN_Q_INPUT_MAX)
+        return -NN_Q_INPUT_MAX;
+    else
+        return (int) (r < 0.0f ? r - 0.5f : r + 0.5f);
+}
+
+/* CPU features reported by SIMD_Supported() */
+#define SIMD_SSE2 0x01
+#define SIMD_AVX  0x02
+#define SIMD_AVX2 0x04
+#define SIMD_FMA  0x08
+#define SIMD_F16C 0x10
+
+typedef struct _nnkernel {
+    const char *szName;
+    unsigned int fFeatures;     /* SIMD_* flags the kernel needs */
+    f_NeuralNetEvaluate pfNeuralNetEvaluate;
+    f_NeuralNetEvaluateBatch pfNeuralNetEvaluateBatch;
+    f_baseInputs pfBaseInputs;
+    f_NeuralNetEvaluateQuantised pfNeuralNetEvaluateQuantised;
+    f_NeuralNetEvaluateHalf pfNeuralNetEvaluateHalf;    /* NULL if none */
+    unsigned int fHalfFeatures; /* SIMD_* flags the half precision one needs */
+} nnkernel;
+
+extern const nnkernel anNeuralNetKernels[];
+extern const unsigned int cNeuralNetKernels;
+
 extern int NeuralNetCreate(neuralnet * pnn, unsigned int cInput, unsigned int cHidden, unsigned int cOutput,
                            float rBetaHidden, float rBetaOutput);
 extern void NeuralNetDestroy(neuralnet * pnn);
-extern int NeuralNetEvaluate(const neuralnet * pnn, float arInput[], float arOutput[], NNState * pnState);
-extern int NeuralNetEvaluateSSE(const neuralnet * pnn, float arInput[], float arOutput[], NNState * pnState);
 extern int NeuralNetLoad(neuralnet * pnn, FILE * pf);
 extern int NeuralNetLoadBinary(neuralnet * pnn, FILE * pf);
 extern int NeuralNetSaveBinary(const neuralnet * pnn, FILE * pf);
-extern int SIMD_Supported(void);
+extern int NeuralNetSaveMapped(neuralnet * const apnn[], unsigned int cNets, const char *szVersion, FILE * pf);
+extern void *NeuralNetMap(const char *szFilename, const char *szVersion, neuralnet * const apnn[],
+                          unsigned int cNets);
+extern void NeuralNetUnmap(void *pMap);
+extern unsigned int SIMD_Supported(void);
+extern int NeuralNetSetKernel(const char *szName);
+extern const nnkernel *NeuralNetGetKernel(void);
+extern int NeuralNetQuantise(neuralnet * pnn);
+extern int NeuralNetHalve(neuralnet * pnn);
+extern void NeuralNetUnhalve(neuralnet * pnn);
+extern size_t NeuralNetWeightsSize(const neuralnet * pnn, int fHalf);
+extern unsigned short NeuralNetFloatToHalf(float r);
+extern float NeuralNetHalfToFloat(unsigned short h);
+extern void NeuralNetSaveInputs(const neuralnet * pnn, const float arInput[], const nnactive * pActive,
+                                NNState * pnState);
+extern unsigned int NeuralNetChangedInputs(const neuralnet * pnn, const float arInput[], const nnactive * pActive,
+                                           const NNState * pnStateBase, unsigned int aiChanged[]);
+extern unsigned int baseInputsActive(const TanBoard anBoard, unsigned int aiActive[]);
+extern void baseInputsPoints(const TanBoard anBoard, const unsigned int anPoints[2], float arInput[]);
+extern void NeuralNetSetQuantised(int f);
+extern int NeuralNetGetQuantised(void);
+extern void NeuralNetSetHalf(int f);
+extern int NeuralNetGetHalf(void);
+extern f_NeuralNetEvaluateHalf NeuralNetHalfKernel(const nnkernel * pnk);
+
+/* separate context for race, crashed, contact
+ * -1: regular eval
+ * 0: save base
+ * 1: from base
+ */
+
+static inline NNEvalType
+NNevalAction(NNState * pnState)
+{
+    if (!pnState)
+        return NNEVAL_NONE;
+
+    switch (pnState->state) {
+    case NNSTATE_NONE:
+        {
+            /* incremental evaluation not useful */
+            return NNEVAL_NONE;
+        }
+    case NNSTATE_INCREMENTAL:
+        {
+            /* next call should return FROMBASE */
+            pnState->state = NNSTATE_DONE;
+
+            /* starting a new context; save base in the hope it will be useful */
+            return NNEVAL_SAVE;
+        }
+    case NNSTATE_DONE:
+        {
+            /* context hit!  use the previously computed base */
+            return NNEVAL_FROMBASE;
+        }
+    }
+    /* never reached */
+    return NNEVAL_NONE;         /* for the picky compiler */
+}
 
 /* Try to determine whetehr we are 64-bit or 32-bit */
 #if _WIN32 || _WIN64
@@ -4,6 +4,9 @@
  *
  * SSE (Intel) specific code
  *
+ * This file is compiled once for each instruction set (see simd.h); the
+ * kernel actually used is chosen at run time in neuralnet.c
+ *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of version 3 or later of the GNU General Public License as
  * published by the Free Software Foundation.
@@ -30,32 +33,20 @@
 #include "simd.h"
 #include "neuralnet.h"
 #include <string.h>
+#include <stdint.h>
 
 #if defined(USE_AVX)
 #include <immintrin.h>
-#elif defined(USE_SSE2)
-#include <emmintrin.h>
 #else
-#include <xmmintrin.h>
+#include <emmintrin.h>
 #endif
 
 #include <glib.h>
 #include "sigmoid.h"
 
-float *
-sse_malloc(size_t size)
-{
-    return (float *) _mm_malloc(size, ALIGN_SIZE);
-}
-
-void
-sse_free(float *ptr)
-{
-    _mm_free(ptr);
-}
-
-#if defined(USE_AVX) || defined(USE_SSE2)
-#include <stdint.h>
+/* In inputs.c */
+extern float inpvec[16][4];
+extern float inpvecb[16][4];
 
 static const union {
     float f[VEC_SIZE];
@@ -90,6 +81,61 @@ static const union {
 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF}};
 #endif
 
+#if defined(USE_AVX2)
+
+/* exp(x) for |x| < 88: x = n ln 2 + r with |r| <= ln 2 / 2, exp(r) from
+ * the Cephes expf() polynomial and the power of two added to the
+ * exponent bits.  The relative error is below 2e-7. */
+static inline float_vector
+exp_ps(float_vector x)
+{
+    float_vector n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    float_vector r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    float_vector p;
+
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+    p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, ones.ps));
+
+    return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(p),
+                                                _mm256_slli_epi32(_mm256_cvtps_epi32(n), 23)));
+}
+
+/* The same function as sigmoid() in sigmoid.h, with the table entries
+ * e[i] = exp(i/10) / 10 computed by exp_ps() instead of looked up, so
+ * that no lane leaves the vector registers.  Over the whole range the
+ * result differs from the table version by less than 1.2e-7 absolute
+ * and 8e-7 relative (measured in steps of 1e-5); the table
+ * interpolation itself is only within 1.2e-3 of the true sigmoid. */
+static inline float_vector
+sigmoid_positive_ps(float_vector xin)
+{
+    float_vector const tenth = _mm256_set1_ps(0.1f);
+    float_vector x1 = _mm256_mul_ps(_mm256_min_ps(xin, tens.ps), tens.ps);
+    float_vector i = _mm256_floor_ps(x1);
+    /* e[100] repeats e[99] */
+    float_vector ex = _mm256_min_ps(i, _mm256_set1_ps(99.0f));
+
+    ex = _mm256_mul_ps(exp_ps(_mm256_mul_ps(ex, tenth)), tenth);
+
+    x1 = _mm256_add_ps(_mm256_sub_ps(x1, i), tens.ps);
+    x1 = _mm256_fmadd_ps(x1, ex, ones.ps);
+#ifdef __FAST_MATH__
+    return _mm256_rcp_ps(x1);
+#else
+    return _mm256_div_ps(ones.ps, x1);
+#endif
+}
+
+#else
+
 static inline float_vector
 sigmoid_positive_ps(float_vector xin)
 {
@@ -146,6 +192,8 @@ sigmoid_positive_ps(float_vector xin)
 #endif
 }
 
+#endif
+
 static inline float_vector
 sigmoid_ps(float_vector xin)
 {
@@ -164,72 +212,16 @@ sigmoid_ps(float_vector xin)
 #endif
 }
 
-#endif                          // USE_SSE2 or USE_AVX
-
+/* Apply the hidden layer sigmoid and calculate the outputs */
 static void
-EvaluateSSE(const neuralnet * pnn, const float arInput[], float ar[], float arOutput[])
+EvaluateOutputs(const neuralnet * pnn, float ar[], float arOutput[])
 {
-
     const unsigned int cHidden = pnn->cHidden;
     unsigned int i, j;
-    float *prWeight;
-#if defined(USE_SSE2) || defined(USE_AVX)
+    const float *prWeight;
     float *par;
-#endif
     float_vector vec0, vec1, vec3, scalevec, sum;
 
-    /* Calculate activity at hidden nodes */
-    memcpy(ar, pnn->arHiddenThreshold, cHidden * sizeof(float));
-
-    prWeight = pnn->arHiddenWeight;
-
-    for (i = 0; i < pnn->cInput; i++) {
-        float const ari = arInput[i];
-
-        if (!ari)
-            prWeight += cHidden;
-        else {
-            float *pr = ar;
-            if (ari == 1.0f) {
-                for (j = (cHidden >> LOG2VEC_SIZE); j; j--, pr += VEC_SIZE, prWeight += VEC_SIZE) {
-#if defined(USE_AVX)
-                    vec0 = _mm256_load_ps(pr);
-                    vec1 = _mm256_load_ps(prWeight);
-                    sum = _mm256_add_ps(vec0, vec1);
-                    _mm256_store_ps(pr, sum);
-#else
-                    vec0 = _mm_load_ps(pr);
-                    vec1 = _mm_load_ps(prWeight);
-                    sum = _mm_add_ps(vec0, vec1);
-                    _mm_store_ps(pr, sum);
-#endif
-                }
-            } else {
-#if defined(USE_AVX)
-                scalevec = _mm256_set1_ps(ari);
-#else
-                scalevec = _mm_set1_ps(ari);
-#endif
-                for (j = (cHidden >> LOG2VEC_SIZE); j; j--, pr += VEC_SIZE, prWeight += VEC_SIZE) {
-#if defined(USE_AVX)
-                    vec0 = _mm256_load_ps(pr);
-                    vec1 = _mm256_load_ps(prWeight);
-                    vec3 = _mm256_mul_ps(vec1, scalevec);
-                    sum = _mm256_add_ps(vec0, vec3);
-                    _mm256_store_ps(pr, sum);
-#else
-                    vec0 = _mm_load_ps(pr);
-                    vec1 = _mm_load_ps(prWeight);
-                    vec3 = _mm_mul_ps(vec1, scalevec);
-                    sum = _mm_add_ps(vec0, vec3);
-                    _mm_store_ps(pr, sum);
-#endif
-                }
-            }
-        }
-    }
-
-#if defined(USE_SSE2) || defined(USE_AVX)
 #if defined(USE_AVX)
     scalevec = _mm256_set1_ps(pnn->rBetaHidden);
 #else
@@ -248,10 +240,6 @@ EvaluateSSE(const neuralnet * pnn, const float arInput[], float ar[], float arOu
         _mm_store_ps(par, vec);
 #endif
     }
-#else
-    for (i = 0; i < cHidden; i++)
-        ar[i] = sigmoid(-pnn->rBetaHidden * ar[i]);
-#endif
 
     /* Calculate activity at output nodes */
     prWeight = pnn->arOutputWeight;
@@ -259,7 +247,7 @@ EvaluateSSE(const neuralnet * pnn, const float arInput[], float ar[], float arOu
     for (i = 0; i < pnn->cOutput; i++) {
 
 #if defined(USE_AVX)
-        float r[8];
+        SSE_ALIGN(float r[8]);
 #else
         float r;
 #endif
@@ -304,21 +292,627 @@ EvaluateSSE(const neuralnet * pnn, const float arInput[], float ar[], float arOu
     }
 }
 
+#if defined(USE_AVX2)
+#define MADD(acc, x, w) _mm256_fmadd_ps(w, x, acc)
+#elif defined(USE_AVX)
+#define MADD(acc, x, w) _mm256_add_ps(acc, _mm256_mul_ps(w, x))
+#else
+#define MADD(acc, x, w) _mm_add_ps(acc, _mm_mul_ps(w, x))
+#endif
+
+#if defined(USE_AVX)
+#define VLOAD _mm256_load_ps
+#define VLOADU _mm256_loadu_ps
+#define VSTORE _mm256_store_ps
+#define VSTOREU _mm256_storeu_ps
+#define VSET1 _mm256_set1_ps
+#define VZERO _mm256_setzero_ps
+#define VMUL _mm256_mul_ps
+#else
+#define VLOAD _mm_load_ps
+#define VLOADU _mm_loadu_ps
+#define VSTORE _mm_store_ps
+#define VSTOREU _mm_storeu_ps
+#define VSET1 _mm_set1_ps
+#define VZERO _mm_setzero_ps
+#define VMUL _mm_mul_ps
+#endif
+
+/* Add arValue[k] times the weight row of input aiRow[k] to the hidden
+ * activities, keeping four vectors of them in registers at a time */
+static void
+AddRows(const neuralnet * pnn, float ar[], const unsigned int aiRow[], const float arValue[], unsigned int cRows)
+{
+    const unsigned int cHidden = pnn->cHidden;
+    unsigned int h, k;
+
+    for (h = 0; h + 4 * VEC_SIZE <= cHidden; h += 4 * VEC_SIZE) {
+        float_vector acc0 = VLOAD(ar + h);
+        float_vector acc1 = VLOAD(ar + h + VEC_SIZE);
+        float_vector acc2 = VLOAD(ar + h + 2 * VEC_SIZE);
+        float_vector acc3 = VLOAD(ar + h + 3 * VEC_SIZE);
+
+        for (k = 0; k < cRows; k++) {
+            const float *prWeight = pnn->arHiddenWeight + aiRow[k] * cHidden + h;
+            float_vector const x = VSET1(arValue[k]);
+
+            acc0 = MADD(acc0, x, VLOAD(prWeight));
+            acc1 = MADD(acc1, x, VLOAD(prWeight + VEC_SIZE));
+            acc2 = MADD(acc2, x, VLOAD(prWeight + 2 * VEC_SIZE));
+            acc3 = MADD(acc3, x, VLOAD(prWeight + 3 * VEC_SIZE));
+        }
+
+        VSTORE(ar + h, acc0);
+        VSTORE(ar + h + VEC_SIZE, acc1);
+        VSTORE(ar + h + 2 * VEC_SIZE, acc2);
+        VSTORE(ar + h + 3 * VEC_SIZE, acc3);
+    }
+
+    for (; h < cHidden; h += VEC_SIZE) {
+        float_vector acc = VLOAD(ar + h);
+
+        for (k = 0; k < cRows; k++)
+            acc = MADD(acc, VSET1(arValue[k]), VLOAD(pnn->arHiddenWeight + aiRow[k] * cHidden + h));
+
+        VSTORE(ar + h, acc);
+    }
+}
+
+/* The nets of gnubg all have five outputs; EvaluateRows() keeps their
+ * sums in registers */
+#define REG_OUTPUTS 5
+
+#define HIDDEN_TO_OUTPUTS_LOAD(v, h, LOAD) \
+    do { \
+        v = sigmoid_ps(VMUL(v, beta)); \
+        o0 = MADD(o0, v, LOAD(prWeight + (h))); \
+        o1 = MADD(o1, v, LOAD(prWeight + cHidden + (h))); \
+        o2 = MADD(o2, v, LOAD(prWeight + 2 * cHidden + (h))); \
+        o3 = MADD(o3, v, LOAD(prWeight + 3 * cHidden + (h))); \
+        o4 = MADD(o4, v, LOAD(prWeight + 4 * cHidden + (h))); \
+    } while (0)
+
+#define HIDDEN_TO_OUTPUTS(v, h) HIDDEN_TO_OUTPUTS_LOAD(v, h, VLOAD)
+
+/* Add up the lanes of the output sums o0-o4 and apply the output
+ * thresholds and sigmoid */
+static inline void
+StoreOutputs(const neuralnet * pnn, float_vector o0, float_vector o1, float_vector o2, float_vector o3,
+             float_vector o4, float arOutput[])
+{
+    float_vector sum;
+    SSE_ALIGN(float r[VEC_SIZE]);
+
+    /* sums of outputs 0-3 in the first four lanes of sum */
+#if defined(USE_AVX)
+    o0 = _mm256_hadd_ps(o0, o1);
+    o2 = _mm256_hadd_ps(o2, o3);
+    o0 = _mm256_hadd_ps(o0, o2);
+    o4 = _mm256_hadd_ps(o4, o4);
+    o4 = _mm256_hadd_ps(o4, o4);
+    sum = _mm256_add_ps(_mm256_permute2f128_ps(o0, o4, 0x20), _mm256_permute2f128_ps(o0, o4, 0x31));
+    /* output 4 is in lanes 4-7 */
+    sum = _mm256_add_ps(sum, _mm256_setr_ps(pnn->arOutputThreshold[0], pnn->arOutputThreshold[1],
+                                            pnn->arOutputThreshold[2], pnn->arOutputThreshold[3],
+                                            pnn->arOutputThreshold[4], 0.0f, 0.0f, 0.0f));
+    sum = sigmoid_ps(_mm256_mul_ps(sum, VSET1(pnn->rBetaOutput)));
+    VSTORE(r, sum);
+    memcpy(arOutput, r, REG_OUTPUTS * sizeof(float));
+#else
+    _MM_TRANSPOSE4_PS(o0, o1, o2, o3);
+    sum = _mm_add_ps(_mm_add_ps(o0, o1), _mm_add_ps(o2, o3));
+    sum = _mm_add_ps(sum, _mm_loadu_ps(pnn->arOutputThreshold));
+    sum = sigmoid_ps(_mm_mul_ps(sum, VSET1(pnn->rBetaOutput)));
+    VSTORE(r, sum);
+    memcpy(arOutput, r, 4 * sizeof(float));
+
+    o4 = _mm_add_ps(o4, _mm_movehl_ps(o4, o4));
+    o4 = _mm_add_ss(o4, _mm_shuffle_ps(o4, o4, _MM_SHUFFLE(1, 1, 1, 1)));
+    _mm_store_ss(r, o4);
+    arOutput[4] = sigmoid(-pnn->rBetaOutput * (r[0] + pnn->arOutputThreshold[4]));
+#endif
+}
+
+/* Evaluate the net for the hidden activities arBase plus arValue[k] times
+ * the weight rows aiRow[k].  Each group of hidden nodes goes from the
+ * input sums through the sigmoid into the output sums without leaving
+ * the registers; only the activities before the sigmoid are stored, in
+ * arSave, if it is not NULL.  arBase and arSave need not be aligned (the
+ * NNState buffers come from malloc()).  The net must have REG_OUTPUTS
+ * outputs. */
+static void
+EvaluateRows(const neuralnet * pnn, const float arBase[], const unsigned int aiRow[], const float arValue[],
+             unsigned int cRows, float arSave[], float arOutput[])
+{
+    const unsigned int cHidden = pnn->cHidden;
+    const float *prWeight = pnn->arOutputWeight;
+    float_vector const beta = VSET1(pnn->rBetaHidden);
+    float_vector o0 = VZERO(), o1 = VZERO(), o2 = VZERO(), o3 = VZERO(), o4 = VZERO();
+    unsigned int h, k;
+
+    for (h = 0; h + 4 * VEC_SIZE <= cHidden; h += 4 * VEC_SIZE) {
+        float_vector acc0 = VLOADU(arBase + h);
+        float_vector acc1 = VLOADU(arBase + h + VEC_SIZE);
+        float_vector acc2 = VLOADU(arBase + h + 2 * VEC_SIZE);
+        float_vector acc3 = VLOADU(arBase + h + 3 * VEC_SIZE);
+
+        for (k = 0; k < cRows; k++) {
+            const float *prRow = pnn->arHiddenWeight + aiRow[k] * cHidden + h;
+            float_vector const x = VSET1(arValue[k]);
+
+            acc0 = MADD(acc0, x, VLOAD(prRow));
+            acc1 = MADD(acc1, x, VLOAD(prRow + VEC_SIZE));
+            acc2 = MADD(acc2, x, VLOAD(prRow + 2 * VEC_SIZE));
+            acc3 = MADD(acc3, x, VLOAD(prRow + 3 * VEC_SIZE));
+        }
+
+        if (arSave) {
+            VSTOREU(arSave + h, acc0);
+            VSTOREU(arSave + h + VEC_SIZE, acc1);
+            VSTOREU(arSave + h + 2 * VEC_SIZE, acc2);
+            VSTOREU(arSave + h + 3 * VEC_SIZE, acc3);
+        }
+
+        HIDDEN_TO_OUTPUTS(acc0, h);
+        HIDDEN_TO_OUTPUTS(acc1, h + VEC_SIZE);
+        HIDDEN_TO_OUTPUTS(acc2, h + 2 * VEC_SIZE);
+        HIDDEN_TO_OUTPUTS(acc3, h + 3 * VEC_SIZE);
+    }
+
+    for (; h < cHidden; h += VEC_SIZE) {
+        float_vector acc = VLOADU(arBase + h);
+
+        for (k = 0; k < cRows; k++)
+            acc = MADD(acc, VSET1(arValue[k]), VLOAD(pnn->arHiddenWeight + aiRow[k] * cHidden + h));
+
+        if (arSave)
+            VSTOREU(arSave + h, acc);
+
+        HIDDEN_TO_OUTPUTS(acc, h);
+    }
+
+    StoreOutputs(pnn, o0, o1, o2, o3, o4, arOutput);
+}
 
 extern int
-NeuralNetEvaluateSSE(const neuralnet * pnn, /*lint -e{818} */ float arInput[],
-                     float arOutput[], NNState * UNUSED(pnState))
+SIMD_NAME(NeuralNetEvaluate) (const neuralnet * pnn, /*lint -e{818} */ float arInput[], const nnactive * pActive,
+                              float arOutput[], NNState * pnState)
 {
-    SSE_ALIGN(float ar[pnn->cHidden]);
+    const unsigned int cHidden = pnn->cHidden;
+    const float *arBase = pnn->arHiddenThreshold;
+    const float *arInputBase = NULL;
+    float *arSave = NULL;
+    unsigned int *aiRow = (unsigned int *) g_alloca(2 * pnn->cInput * sizeof(unsigned int));
+    float *arValue = (float *) g_alloca(2 * pnn->cInput * sizeof(float));
+    unsigned int k, cRows;
 
 #if DEBUG_SSE
     /* Not 64bit robust (pointer truncation) - causes strange crash */
-    g_assert(sse_aligned(ar));
     g_assert(sse_aligned(arInput));
 #endif
 
-    EvaluateSSE(pnn, arInput, ar, arOutput);
+    /* The vector loops need whole vectors of hidden nodes */
+    if (cHidden & (VEC_SIZE - 1))
+        return NeuralNetEvaluateScalar(pnn, arInput, pActive, arOutput, pnState);
+
+    switch (NNevalAction(pnState)) {
+    case NNEVAL_NONE:
+        break;
+    case NNEVAL_SAVE:
+        NeuralNetSaveInputs(pnn, arInput, pActive, pnState);
+        arSave = pnState->savedBase;
+        break;
+    case NNEVAL_FROMBASE:
+        arBase = pnState->savedBase;
+        arInputBase = pnState->savedIBase;
+        break;
+    }
+
+    cRows = NeuralNetChangedInputs(pnn, arInput, pActive, arInputBase ? pnState : NULL, aiRow);
+    for (k = 0; k < cRows; k++)
+        arValue[k] = arInputBase ? arInput[aiRow[k]] - arInputBase[aiRow[k]] : arInput[aiRow[k]];
+
+    if (pnn->cOutput == REG_OUTPUTS)
+        EvaluateRows(pnn, arBase, aiRow, arValue, cRows, arSave, arOutput);
+    else {
+        SSE_ALIGN(float ar[cHidden]);
+
+        memcpy(ar, arBase, cHidden * sizeof(float));
+        AddRows(pnn, ar, aiRow, arValue, cRows);
+        if (arSave)
+            memcpy(arSave, ar, cHidden * sizeof(float));
+        EvaluateOutputs(pnn, ar, arOutput);
+    }
+
+    return 0;
+}
+
+extern int
+SIMD_NAME(NeuralNetEvaluateBatch) (const neuralnet * pnn, unsigned int nPositions, const float arInput[],
+                                   float arOutput[])
+{
+    const unsigned int cInput = pnn->cInput;
+    const unsigned int cHidden = pnn->cHidden;
+    SSE_ALIGN(float arBase[cHidden]);
+    SSE_ALIGN(float ar[cHidden]);
+    unsigned int *aiRow = (unsigned int *) g_alloca(2 * cInput * sizeof(unsigned int));
+    float *arValue = (float *) g_alloca(cInput * sizeof(float));
+    unsigned int *aiDiff = aiRow + cInput;
+    unsigned int n, b, i, k;
+
+    if (cHidden & (VEC_SIZE - 1))
+        return NeuralNetEvaluateBatchScalar(pnn, nPositions, arInput, arOutput);
+
+    for (n = 0; n < nPositions; n += NN_BATCH_BLOCK) {
+        unsigned int const cBlock = MIN(NN_BATCH_BLOCK, nPositions - n);
+        const float *arIn = arInput + n * cInput;
+        unsigned int cRows = 0, cDiff = 0;
+
+        /* Moves from the same position share most of their inputs; add
+         * those once for the whole block */
+        for (i = 0; i < cInput; i++) {
+            float const ari = arIn[i];
+
+            for (b = 1; b < cBlock; b++)
+                if (arIn[b * cInput + i] != ari)
+                    break;
+
+            if (b < cBlock)
+                aiDiff[cDiff++] = i;
+            else if (ari != 0.0f) {
+                aiRow[cRows] = i;
+                arValue[cRows++] = ari;
+            }
+        }
+
+        memcpy(arBase, pnn->arHiddenThreshold, cHidden * sizeof(float));
+        AddRows(pnn, arBase, aiRow, arValue, cRows);
+
+        for (b = 0; b < cBlock; b++) {
+            const float *arPos = arIn + b * cInput;
+
+            for (cRows = 0, k = 0; k < cDiff; k++)
+                if (arPos[aiDiff[k]] != 0.0f) {
+                    aiRow[cRows] = aiDiff[k];
+                    arValue[cRows++] = arPos[aiDiff[k]];
+                }
+
+            if (pnn->cOutput == REG_OUTPUTS)
+                EvaluateRows(pnn, arBase, aiRow, arValue, cRows, NULL, arOutput + (n + b) * REG_OUTPUTS);
+            else {
+                memcpy(ar, arBase, cHidden * sizeof(float));
+                AddRows(pnn, ar, aiRow, arValue, cRows);
+                EvaluateOutputs(pnn, ar, arOutput + (n + b) * pnn->cOutput);
+            }
+        }
+    }
+
+    return 0;
+}
+
+#if defined(USE_AVX) && HAVE_SIMD_F16C
+
+/* Eight half precision weights as floats.  With cHidden a multiple of
+ * eight every group of them is 16 byte aligned. */
+#define VLOADH(p) _mm256_cvtph_ps(_mm_load_si128((const __m128i *) (p)))
+
+/* EvaluateRows() with the weights from NeuralNetHalve(), converted as
+ * they are loaded; half the bytes of the float weights are read. */
+static void
+EvaluateRowsHalf(const neuralnet * pnn, const float arBase[], const unsigned int aiRow[], const float arValue[],
+                 unsigned int cRows, float arSave[], float arOutput[])
+{
+    const unsigned int cHidden = pnn->cHidden;
+    const unsigned short *prWeight = pnn->ahOutputWeight;
+    float_vector const beta = VSET1(pnn->rBetaHidden);
+    float_vector o0 = VZERO(), o1 = VZERO(), o2 = VZERO(), o3 = VZERO(), o4 = VZERO();
+    unsigned int h, k;
+
+    for (h = 0; h + 4 * VEC_SIZE <= cHidden; h += 4 * VEC_SIZE) {
+        float_vector acc0 = VLOADU(arBase + h);
+        float_vector acc1 = VLOADU(arBase + h + VEC_SIZE);
+        float_vector acc2 = VLOADU(arBase + h + 2 * VEC_SIZE);
+        float_vector acc3 = VLOADU(arBase + h + 3 * VEC_SIZE);
+
+        for (k = 0; k < cRows; k++) {
+            const unsigned short *phRow = pnn->ahHiddenWeight + aiRow[k] * cHidden + h;
+            float_vector const x = VSET1(arValue[k]);
+
+            acc0 = MADD(acc0, x, VLOADH(phRow));
+            acc1 = MADD(acc1, x, VLOADH(phRow + VEC_SIZE));
+            acc2 = MADD(acc2, x, VLOADH(phRow + 2 * VEC_SIZE));
+            acc3 = MADD(acc3, x, VLOADH(phRow + 3 * VEC_SIZE));
+        }
+
+        if (arSave) {
+            VSTOREU(arSave + h, acc0);
+            VSTOREU(arSave + h + VEC_SIZE, acc1);
+            VSTOREU(arSave + h + 2 * VEC_SIZE, acc2);
+            VSTOREU(arSave + h + 3 * VEC_SIZE, acc3);
+        }
+
+        HIDDEN_TO_OUTPUTS_LOAD(acc0, h, VLOADH);
+        HIDDEN_TO_OUTPUTS_LOAD(acc1, h + VEC_SIZE, VLOADH);
+        HIDDEN_TO_OUTPUTS_LOAD(acc2, h + 2 * VEC_SIZE, VLOADH);
+        HIDDEN_TO_OUTPUTS_LOAD(acc3, h + 3 * VEC_SIZE, VLOADH);
+    }
+
+    for (; h < cHidden; h += VEC_SIZE) {
+        float_vector acc = VLOADU(arBase + h);
+
+        for (k = 0; k < cRows; k++)
+            acc = MADD(acc, VSET1(arValue[k]), VLOADH(pnn->ahHiddenWeight + aiRow[k] * cHidden + h));
+
+        if (arSave)
+            VSTOREU(arSave + h, acc);
+
+        HIDDEN_TO_OUTPUTS_LOAD(acc, h, VLOADH);
+    }
+
+    StoreOutputs(pnn, o0, o1, o2, o3, o4, arOutput);
+}
+
+extern int
+SIMD_NAME(NeuralNetEvaluateHalf) (const neuralnet * pnn, float arInput[], const nnactive * pActive,
+                                  float arOutput[], NNState * pnState)
+{
+    const float *arBase = pnn->arHiddenThreshold;
+    const float *arInputBase = NULL;
+    float *arSave = NULL;
+    unsigned int *aiRow = (unsigned int *) g_alloca(2 * pnn->cInput * sizeof(unsigned int));
+    float *arValue = (float *) g_alloca(2 * pnn->cInput * sizeof(float));
+    unsigned int k, cRows;
+
+    if (!pnn->ahHiddenWeight || pnn->cOutput != REG_OUTPUTS || (pnn->cHidden & (VEC_SIZE - 1)))
+        return SIMD_NAME(NeuralNetEvaluate) (pnn, arInput, pActive, arOutput, pnState);
+
+    switch (NNevalAction(pnState)) {
+    case NNEVAL_NONE:
+        break;
+    case NNEVAL_SAVE:
+        NeuralNetSaveInputs(pnn, arInput, pActive, pnState);
+        arSave = pnState->savedBase;
+        break;
+    case NNEVAL_FROMBASE:
+        arBase = pnState->savedBase;
+        arInputBase = pnState->savedIBase;
+        break;
+    }
+
+    cRows = NeuralNetChangedInputs(pnn, arInput, pActive, arInputBase ? pnState : NULL, aiRow);
+    for (k = 0; k < cRows; k++)
+        arValue[k] = arInputBase ? arInput[aiRow[k]] - arInputBase[aiRow[k]] : arInput[aiRow[k]];
+
+    EvaluateRowsHalf(pnn, arBase, aiRow, arValue, cRows, arSave, arOutput);
+
+    return 0;
+}
+
+#endif
+
+/* Integer vectors for the quantised hidden layer; AVX without AVX2 has
+ * only the 128 bit integer instructions */
+#if defined(USE_AVX2)
+typedef __m256i q_vector;
+#define Q_SIZE 16               /* shorts per q_vector */
+#define QLOAD(p) _mm256_load_si256((const __m256i *) (p))
+#define QSET1 _mm256_set1_epi32
+#define QZERO _mm256_setzero_si256
+#define QADD _mm256_add_epi32
+#define QMADD _mm256_madd_epi16
+#define QUNPACKLO _mm256_unpacklo_epi16
+#define QUNPACKHI _mm256_unpackhi_epi16
+/* The unpacks work within 128 bit lanes, so lo holds the sums of hidden
+ * nodes 0-3 and 8-11 and hi those of 4-7 and 12-15 */
+#define QSTORE(p, lo, hi) \
+    do { \
+        _mm256_store_si256((__m256i *) (p), _mm256_permute2x128_si256(lo, hi, 0x20)); \
+        _mm256_store_si256((__m256i *) ((p) + 8), _mm256_permute2x128_si256(lo, hi, 0x31)); \
+    } while (0)
+#else
+typedef __m128i q_vector;
+#define Q_SIZE 8
+#define QLOAD(p) _mm_load_si128((const __m128i *) (p))
+#define QSET1 _mm_set1_epi32
+#define QZERO _mm_setzero_si128
+#define QADD _mm_add_epi32
+#define QMADD _mm_madd_epi16
+#define QUNPACKLO _mm_unpacklo_epi16
+#define QUNPACKHI _mm_unpackhi_epi16
+#define QSTORE(p, lo, hi) \
+    do { \
+        _mm_store_si128((__m128i *) (p), lo); \
+        _mm_store_si128((__m128i *) ((p) + 4), hi); \
+    } while (0)
+#endif
+
+#if defined(USE_AVX)
+#define VCVTI(p) _mm256_cvtepi32_ps(_mm256_load_si256((const __m256i *) (p)))
+#else
+#define VCVTI(p) _mm_cvtepi32_ps(_mm_load_si128((const __m128i *) (p)))
+#endif
+
+/* Add up the int16 weight rows aiRow[k] times asValue[k] into anSum, two
+ * rows at a time: the two rows are interleaved and multiplied by the pair
+ * of values with one madd, giving 32 bit sums that NN_Q_WEIGHT_SUM keeps
+ * from overflowing.  cRows must be even. */
+static void
+AddRowsQuantised(const neuralnet * pnn, int anSum[], const unsigned int aiRow[], const short asValue[],
+                 unsigned int cRows)
+{
+    const unsigned int cHidden = pnn->cHidden;
+    unsigned int h, k;
+
+#define Q_PAIR(acc0, acc1, off) \
+    do { \
+        q_vector const wa = QLOAD(psA + (off)); \
+        q_vector const wb = QLOAD(psB + (off)); \
+        acc0 = QADD(acc0, QMADD(QUNPACKLO(wa, wb), x)); \
+        acc1 = QADD(acc1, QMADD(QUNPACKHI(wa, wb), x)); \
+    } while (0)
+
+    for (h = 0; h + 2 * Q_SIZE <= cHidden; h += 2 * Q_SIZE) {
+        q_vector acc0 = QZERO(), acc1 = QZERO(), acc2 = QZERO(), acc3 = QZERO();
+
+        for (k = 0; k < cRows; k += 2) {
+            const short *psA = pnn->asHiddenWeight + aiRow[k] * cHidden + h;
+            const short *psB = pnn->asHiddenWeight + aiRow[k + 1] * cHidden + h;
+            q_vector const x = QSET1((int) (unsigned short) asValue[k] | ((int) asValue[k + 1] << 16));
+
+            Q_PAIR(acc0, acc1, 0);
+            Q_PAIR(acc2, acc3, Q_SIZE);
+        }
+
+        QSTORE(anSum + h, acc0, acc1);
+        QSTORE(anSum + h + Q_SIZE, acc2, acc3);
+    }
+
+    for (; h < cHidden; h += Q_SIZE) {
+        q_vector acc0 = QZERO(), acc1 = QZERO();
+
+        for (k = 0; k < cRows; k += 2) {
+            const short *psA = pnn->asHiddenWeight + aiRow[k] * cHidden + h;
+            const short *psB = pnn->asHiddenWeight + aiRow[k + 1] * cHidden + h;
+            q_vector const x = QSET1((int) (unsigned short) asValue[k] | ((int) asValue[k + 1] << 16));
+
+            Q_PAIR(acc0, acc1, 0);
+        }
+
+        QSTORE(anSum + h, acc0, acc1);
+    }
+#undef Q_PAIR
+}
+
+extern int
+SIMD_NAME(NeuralNetEvaluateQuantised) (const neuralnet * pnn, float arInput[], const nnactive * pActive,
+                                       float arOutput[], NNState * pnState)
+{
+    const unsigned int cHidden = pnn->cHidden;
+    SSE_ALIGN(float ar[cHidden]);
+    SSE_ALIGN(int anSum[cHidden]);
+    unsigned int *aiRow = (unsigned int *) g_alloca((2 * pnn->cInput + 1) * sizeof(unsigned int));
+    short *asValue = (short *) g_alloca((2 * pnn->cInput + 1) * sizeof(short));
+    const float *arBase = pnn->arHiddenThreshold;
+    const float *arInputBase = NULL;
+    float *arSave = NULL;
+    float_vector vec;
+    unsigned int i, k, cRows;
+
+    if (!pnn->asHiddenWeight || (cHidden & (Q_SIZE - 1)))
+        return SIMD_NAME(NeuralNetEvaluate) (pnn, arInput, pActive, arOutput, pnState);
+
+    switch (NNevalAction(pnState)) {
+    case NNEVAL_NONE:
+        break;
+    case NNEVAL_SAVE:
+        NeuralNetSaveInputs(pnn, arInput, pActive, pnState);
+        arSave = pnState->savedBase;
+        break;
+    case NNEVAL_FROMBASE:
+        arBase = pnState->savedBase;
+        arInputBase = pnState->savedIBase;
+        break;
+    }
+
+    cRows = NeuralNetChangedInputs(pnn, arInput, pActive, arInputBase ? pnState : NULL, aiRow);
+    for (k = 0; k < cRows; k++)
+        asValue[k] = arInputBase ? (short) (NNQuantiseInput(arInput[aiRow[k]]) - NNQuantiseInput(arInputBase[aiRow[k]]))
+            : (short) NNQuantiseInput(arInput[aiRow[k]]);
+
+    /* pad to an even number of rows with a zero value */
+    if (cRows & 1) {
+        aiRow[cRows] = 0;
+        asValue[cRows++] = 0;
+    }
+
+    AddRowsQuantised(pnn, anSum, aiRow, asValue, cRows);
+
+    for (i = 0; i < cHidden; i += VEC_SIZE) {
+        vec = MADD(VLOADU(arBase + i), VCVTI(anSum + i), VLOAD(pnn->arHiddenScale + i));
+        VSTORE(ar + i, vec);
+        if (arSave)
+            VSTOREU(arSave + i, vec);
+    }
+
+    if (pnn->cOutput == REG_OUTPUTS)
+        EvaluateRows(pnn, ar, NULL, NULL, 0, NULL, arOutput);
+    else
+        EvaluateOutputs(pnn, ar, arOutput);
+
     return 0;
 }
 
+extern void
+SIMD_NAME(baseInputs) (const TanBoard anBoard, float arInput[])
+{
+    int i = 3;
+
+    const unsigned int *pB = &anBoard[0][0];
+    float *pInput = &arInput[0];
+    register __m128 vec0;
+    register __m128 vec1;
+    register __m128 vec2;
+    register __m128 vec3;
+    register __m128 vec4;
+    register __m128 vec5;
+    register __m128 vec6;
+    register __m128 vec7;
+
+    while (i--) {
+        vec0 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput, vec0);
+        vec1 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec1);
+        vec2 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec2);
+        vec3 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec3);
+        vec4 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec4);
+        vec5 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec5);
+        vec6 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec6);
+        vec7 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec7);
+        pInput += 4;
+    }
+
+    /* bar */
+    vec0 = _mm_load_ps(inpvecb[*pB++]);
+    _mm_store_ps(pInput, vec0);
+    pInput += 4;
+
+    i = 3;
+    while (i--) {
+        vec0 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput, vec0);
+        vec1 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec1);
+        vec2 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec2);
+        vec3 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec3);
+        vec4 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec4);
+        vec5 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec5);
+        vec6 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec6);
+        vec7 = _mm_load_ps(inpvec[*pB++]);
+        _mm_store_ps(pInput += 4, vec7);
+        pInput += 4;
+    }
+
+    /* bar */
+    vec0 = _mm_load_ps(inpvecb[*pB]);
+    _mm_store_ps(pInput, vec0);
+
+#if defined(USE_AVX)
+    _mm256_zeroupper();
+#endif
+
+    return;
+}
+
 #endif
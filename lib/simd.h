@@ -17,20 +17,36 @@
 
 #include <stdlib.h>
 
-#ifdef USE_AVX
+/* Buffers are aligned for the widest kernel that may be selected at run
+ * time, whichever variant is being compiled */
 #define ALIGN_SIZE 32
+
+/* neuralnetsse.c is compiled once per instruction set with one of
+ * USE_SSE2, USE_AVX or USE_AVX2 (which implies USE_AVX) defined */
+#if defined(USE_AVX2) && !defined(USE_AVX)
+#define USE_AVX 1
+#endif
+
+#ifdef USE_AVX
 #define VEC_SIZE 8
 #define LOG2VEC_SIZE 3
 #define float_vector __m256
 #define int_vector __m256i
 #else
-#define ALIGN_SIZE 16
 #define VEC_SIZE 4
 #define LOG2VEC_SIZE 2
 #define float_vector __m128
 #define int_vector __m128i
 #endif
 
+#if defined(USE_AVX2)
+#define SIMD_NAME(name) name##AVX2
+#elif defined(USE_AVX)
+#define SIMD_NAME(name) name##AVX
+#else
+#define SIMD_NAME(name) name##SSE2
+#endif
+
 #ifdef _MSC_VER
 #define SSE_ALIGN(D) __declspec(align(ALIGN_SIZE)) D
 #else
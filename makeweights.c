@@ -23,15 +23,21 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
 #include <locale.h>
 #include "eval.h"               /* for WEIGHTS_VERSION */
 
+/* the contact, race and crashed nets, which EvalInitialise() quantises */
+#define QUANTISED_NETS 3
+#define MAX_NETS 16
+
 static void
 usage(char *prog)
 {
-    fprintf(stderr, "Usage: %s [[-f] outputfile [inputfile]]\n"
+    fprintf(stderr, "Usage: %s [-m] [[-f] outputfile [inputfile]]\n"
+            "  -m: Write a weights file to be mapped (gnubg.wm)\n"
             "  outputfile: Output to file instead of stdout\n" "  inputfile: Input from file instead of stdin\n", prog);
 
     exit(1);
@@ -41,11 +47,20 @@ extern int
 main(int argc, /*lint -e{818} */ char *argv[])
 {
     neuralnet nn;
+    static neuralnet ann[MAX_NETS];
+    neuralnet *apnn[MAX_NETS];
     char szFileVersion[16];
     static float ar[2] = { WEIGHTS_MAGIC_BINARY, WEIGHTS_VERSION_BINARY };
-    int c;
+    int c, fMapped = FALSE;
     FILE *input = stdin, *output = stdout;
 
+    if (argc > 1 && !strcmp(argv[1], "-m")) {
+        fMapped = TRUE;
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+
     if (argc > 1) {
         int arg = 1;
         if (!StrCaseCmp(argv[1], "-f"))
@@ -84,6 +99,28 @@ main(int argc, /*lint -e{818} */ char *argv[])
         return EXIT_FAILURE;
     }
 
+    if (fMapped) {
+        for (c = 0; !feof(input); c++) {
+            if (c == MAX_NETS || NeuralNetLoad(&ann[c], input) == -1) {
+                fprintf(stderr, "Failed to load neural net!");
+                return EXIT_FAILURE;
+            }
+            if (c < QUANTISED_NETS && NeuralNetQuantise(&ann[c]) == -1) {
+                fprintf(stderr, "Failed to quantise neural net!");
+                return EXIT_FAILURE;
+            }
+            apnn[c] = &ann[c];
+        }
+        if (NeuralNetSaveMapped(apnn, c, WEIGHTS_VERSION, output) == -1) {
+            fprintf(stderr, "Failed to save neural net!");
+            return EXIT_FAILURE;
+        }
+
+        fprintf(stderr, _("%d nets converted\n"), c);
+
+        return EXIT_SUCCESS;
+    }
+
     if (fwrite(ar, sizeof(ar[0]), 2, output) != 2) {
         fprintf(stderr, "Failed to write neural net!");
         return EXIT_FAILURE;
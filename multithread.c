@@ -231,9 +231,9 @@ InitMutex(Mutex * pMutex)
 }
 
 static void
-FreeMutex(Mutex mutex)
+FreeMutex(Mutex * pMutex)
 {
-    g_mutex_clear(&mutex);
+    g_mutex_clear(pMutex);
 }
 #else
 static void
@@ -243,14 +243,16 @@ InitMutex(Mutex * pMutex)
 }
 
 static void
-FreeMutex(Mutex mutex)
+FreeMutex(Mutex * pMutex)
 {
-    g_mutex_free(mutex);
+    g_mutex_free(*pMutex);
 }
 #endif
 
+/* The mutexes are passed by address: since GLib 2.32 a Mutex is the
+ * GMutex itself, and locking a copy of it locks nothing */
 static void
-Mutex_Lock(Mutex mutex, const char *reason)
+Mutex_Lock(Mutex * pMutex, const char *reason)
 {
 #ifdef DEBUG_MULTITHREADED
     multi_debug(reason);
@@ -258,22 +260,22 @@ Mutex_Lock(Mutex mutex, const char *reason)
     (void) reason;
 #endif
 #if GLIB_CHECK_VERSION (2,32,0)
-    g_mutex_lock(&mutex);
+    g_mutex_lock(pMutex);
 #else
-    g_mutex_lock(mutex);
+    g_mutex_lock(*pMutex);
 #endif
 }
 
 static void
-Mutex_Release(Mutex mutex)
+Mutex_Release(Mutex * pMutex)
 {
 #ifdef DEBUG_MULTITHREADED
     multi_debug("Releasing lock");
 #endif
 #if GLIB_CHECK_VERSION (2,32,0)
-    g_mutex_unlock(&mutex);
+    g_mutex_unlock(pMutex);
 #else
-    g_mutex_unlock(mutex);
+    g_mutex_unlock(*pMutex);
 #endif
 }
 
@@ -332,33 +334,33 @@ InitMutex(Mutex * pMutex)
 }
 
 static void
-FreeMutex(Mutex mutex)
+FreeMutex(Mutex * pMutex)
 {
-    CloseHandle(mutex);
+    CloseHandle(*pMutex);
 }
 
 #ifdef DEBUG_MULTITHREADED
 void
-Mutex_Lock(Mutex mutex, const char *reason)
+Mutex_Lock(Mutex * pMutex, const char *reason)
 {
-    if (WaitForSingleObject(mutex, 0) == WAIT_OBJECT_0) {       /* Got mutex */
+    if (WaitForSingleObject(*pMutex, 0) == WAIT_OBJECT_0) {     /* Got mutex */
         multi_debug("%s: lock acquired", reason);
     } else {
         multi_debug("%s: waiting on lock", reason);
-        WaitForSingleObject(mutex, INFINITE);
+        WaitForSingleObject(*pMutex, INFINITE);
         multi_debug("lock relinquished");
     }
 }
 
 void
-Mutex_Release(Mutex mutex)
+Mutex_Release(Mutex * pMutex)
 {
     multi_debug("Releasing lock");
-    ReleaseMutex(mutex);
+    ReleaseMutex(*pMutex);
 }
 #else
-#define Mutex_Lock(mutex, reason) WaitForSingleObject(mutex, INFINITE)
-#define Mutex_Release(mutex) ReleaseMutex(mutex)
+#define Mutex_Lock(pMutex, reason) WaitForSingleObject(*(pMutex), INFINITE)
+#define Mutex_Release(pMutex) ReleaseMutex(*(pMutex))
 #endif
 
 #endif
@@ -401,7 +403,7 @@ MT_GetTask(void)
 {
     Task *task = NULL;
 
-    Mutex_Lock(td.queueLock, "get task");
+    Mutex_Lock(&td.queueLock, "get task");
 
     if (g_list_length(td.tasks) > 0) {
         task = (Task *) g_list_first(td.tasks)->data;
@@ -412,18 +414,129 @@ MT_GetTask(void)
     }
 
     multi_debug("get task: release");
-    Mutex_Release(td.queueLock);
+    Mutex_Release(&td.queueLock);
 
     return task;
 }
 
+/* The items of one MT_ParallelFor() call; the caller and each of its
+ * helper tasks hold a reference */
+typedef struct _TaskGroup {
+    void (*fun) (void *, unsigned int);
+    void *data;
+    unsigned int c;
+    int iNext;
+    int cDone;
+    int cRefs;
+    ManualEvent done;           /* set when the last item is done */
+} TaskGroup;
+
+static void
+MT_GroupRun(TaskGroup * ptg)
+{
+    unsigned int i;
+
+    while ((i = (unsigned int) (MT_SafeIncValue(&ptg->iNext) - 1)) < ptg->c) {
+        ptg->fun(ptg->data, i);
+        if ((unsigned int) MT_SafeIncValue(&ptg->cDone) == ptg->c)
+            SetManualEvent(ptg->done);
+    }
+}
+
+static void
+MT_GroupRelease(TaskGroup * ptg)
+{
+    if (MT_SafeDecCheck(&ptg->cRefs)) {
+        FreeManualEvent(ptg->done);
+        free(ptg);
+    }
+}
+
+static void
+MT_GroupHelper(void *data)
+{
+    MT_GroupRun((TaskGroup *) data);
+}
+
+/* Helper tasks are not counted by MT_WaitForTasks(), which may be
+ * waiting for the task that added them */
+
+static void
+MT_TaskFree(Task * pt)
+{
+    if (pt->fun == MT_GroupHelper) {
+        MT_GroupRelease((TaskGroup *) pt->data);
+        free(pt);
+    } else
+        MT_TaskDone(pt);
+}
+
+/* Call fun(data, i) for i from 0 to c - 1 on this thread and on any idle
+ * ones, returning when all the calls are done.  It can be called from a
+ * task; this thread takes items itself rather than waiting for the
+ * helpers, which find nothing left to do if they only start late.  While
+ * tasks are queued no thread is idle and the items run here in turn. */
+
+extern void
+MT_ParallelFor(unsigned int c, void (*fun) (void *, unsigned int), void *data)
+{
+    TaskGroup *ptg;
+    unsigned int i, cHelpers;
+
+    if (c < 2 || td.numThreads < 2 || td.closingThreads)
+        cHelpers = 0;
+    else
+        cHelpers = MIN(td.numThreads, c) - 1;
+
+    if (cHelpers) {
+        Mutex_Lock(&td.queueLock, "add helper tasks");
+        if (td.tasks) {
+            Mutex_Release(&td.queueLock);
+            cHelpers = 0;
+        }
+    }
+
+    if (cHelpers == 0) {
+        for (i = 0; i < c; i++)
+            fun(data, i);
+        return;
+    }
+
+    ptg = (TaskGroup *) malloc(sizeof(TaskGroup));
+    ptg->fun = fun;
+    ptg->data = data;
+    ptg->c = c;
+    ptg->iNext = ptg->cDone = 0;
+    ptg->cRefs = cHelpers + 1;
+    InitManualEvent(&ptg->done);
+
+    for (i = 0; i < cHelpers; i++) {
+        Task *pt = (Task *) malloc(sizeof(Task));
+        pt->fun = MT_GroupHelper;
+        pt->data = ptg;
+        pt->pLinkedTask = NULL;
+        td.tasks = g_list_append(td.tasks, pt);
+    }
+    SetManualEvent(td.activity);
+    Mutex_Release(&td.queueLock);
+
+    MT_GroupRun(ptg);
+
+    /* wait for the items other threads took (the wait gives up after a
+     * while, hence the loop) */
+    while ((unsigned int) g_atomic_int_get(&ptg->cDone) < c)
+        WaitForManualEvent(ptg->done);
+
+    MT_GroupRelease(ptg);
+}
+
 extern void
 MT_AbortTasks(void)
 {
     Task *task;
     /* Remove tasks from list */
     while ((task = MT_GetTask()) != NULL)
-        MT_TaskDone(task);
+        MT_TaskFree(task);
 
     td.result = -1;
 }
@@ -455,7 +568,7 @@ MT_WorkerThreadFunction(void *id)
             task = MT_GetTask();
             if (task) {
                 task->fun(task->data);
-                MT_TaskDone(task);
+                MT_TaskFree(task);
             }
         } while (!td.closingThreads);
 
@@ -503,6 +616,31 @@ MT_CreateThreads(void)
         g_print("Error creating threads!\n");
 }
 
+/* the evaluation cache is shared with other processes */
+static int fSharedCache = FALSE;
+
+static void
+MT_SetLocking(void)
+{
+    if (td.numThreads == 1 && !fSharedCache) {  /* No locking in evals */
+        EvaluatePosition = EvaluatePositionNoLocking;
+        GeneralCubeDecisionE = GeneralCubeDecisionENoLocking;
+        GeneralEvaluationE = GeneralEvaluationENoLocking;
+        ScoreMove = ScoreMoveNoLocking;
+        FindBestMove = FindBestMoveNoLocking;
+        FindnSaveBestMoves = FindnSaveBestMovesNoLocking;
+        BasicCubefulRollout = BasicCubefulRolloutNoLocking;
+    } else {                    /* Locking version of evals */
+        EvaluatePosition = EvaluatePositionWithLocking;
+        GeneralCubeDecisionE = GeneralCubeDecisionEWithLocking;
+        GeneralEvaluationE = GeneralEvaluationEWithLocking;
+        ScoreMove = ScoreMoveWithLocking;
+        FindBestMove = FindBestMoveWithLocking;
+        FindnSaveBestMoves = FindnSaveBestMovesWithLocking;
+        BasicCubefulRollout = BasicCubefulRolloutWithLocking;
+    }
+}
+
 void
 MT_SetNumThreads(unsigned int num)
 {
@@ -511,26 +649,20 @@ MT_SetNumThreads(unsigned int num)
             MT_CloseThreads();
         td.numThreads = num;
         MT_CreateThreads();
-        if (num == 1) {         /* No locking in evals */
-            EvaluatePosition = EvaluatePositionNoLocking;
-            GeneralCubeDecisionE = GeneralCubeDecisionENoLocking;
-            GeneralEvaluationE = GeneralEvaluationENoLocking;
-            ScoreMove = ScoreMoveNoLocking;
-            FindBestMove = FindBestMoveNoLocking;
-            FindnSaveBestMoves = FindnSaveBestMovesNoLocking;
-            BasicCubefulRollout = BasicCubefulRolloutNoLocking;
-        } else {                /* Locking version of evals */
-            EvaluatePosition = EvaluatePositionWithLocking;
-            GeneralCubeDecisionE = GeneralCubeDecisionEWithLocking;
-            GeneralEvaluationE = GeneralEvaluationEWithLocking;
-            ScoreMove = ScoreMoveWithLocking;
-            FindBestMove = FindBestMoveWithLocking;
-            FindnSaveBestMoves = FindnSaveBestMovesWithLocking;
-            BasicCubefulRollout = BasicCubefulRolloutWithLocking;
-        }
+        MT_SetLocking();
     }
 }
 
+/* Lock the evaluation cache even with one thread while other processes
+ * share it */
+
+void
+MT_SetSharedCache(int f)
+{
+    fSharedCache = f;
+    MT_SetLocking();
+}
+
 extern void
 MT_InitThreads(void)
 {
@@ -578,7 +710,7 @@ void
 MT_AddTask(Task * pt, gboolean lock)
 {
     if (lock) {
-        Mutex_Lock(td.queueLock, "add task");
+        Mutex_Lock(&td.queueLock, "add task");
     }
     if (td.addedTasks == 0)
         td.result = 0;          /* Reset result for new tasks */
@@ -589,7 +721,7 @@ MT_AddTask(Task * pt, gboolean lock)
     }
     if (lock) {
         multi_debug("add task: release");
-        Mutex_Release(td.queueLock);
+        Mutex_Release(&td.queueLock);
     }
 }
 
@@ -601,9 +733,9 @@ mt_add_tasks(unsigned int num_tasks, AsyncFun pFun, void *taskData, gpointer lin
 #ifdef DEBUG_MULTITHREADED
         char buf[20];
         sprintf(buf, "add %u tasks", num_tasks);
-        Mutex_Lock(td.queueLock, buf);
+        Mutex_Lock(&td.queueLock, buf);
 #else
-        Mutex_Lock(td.queueLock, NULL);
+        Mutex_Lock(&td.queueLock, NULL);
 #endif
     }
     for (i = 0; i < num_tasks; i++) {
@@ -614,7 +746,7 @@ mt_add_tasks(unsigned int num_tasks, AsyncFun pFun, void *taskData, gpointer lin
         MT_AddTask(pt, FALSE);
     }
     multi_debug("add many release: lock");
-    Mutex_Release(td.queueLock);
+    Mutex_Release(&td.queueLock);
 }
 
 static gboolean
@@ -683,8 +815,8 @@ MT_Close(void)
     MT_CloseThreads();
 
     FreeManualEvent(td.activity);
-    FreeMutex(td.multiLock);
-    FreeMutex(td.queueLock);
+    FreeMutex(&td.multiLock);
+    FreeMutex(&td.queueLock);
 
     FreeManualEvent(td.syncStart);
     FreeManualEvent(td.syncEnd);
@@ -700,13 +832,13 @@ MT_GetThreadID(void)
 extern void
 MT_Exclusive(void)
 {
-    Mutex_Lock(td.multiLock, "Exclusive lock");
+    Mutex_Lock(&td.multiLock, "Exclusive lock");
 }
 
 extern void
 MT_Release(void)
 {
-    Mutex_Release(td.multiLock);
+    Mutex_Release(&td.multiLock);
 }
 
 extern int
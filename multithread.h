@@ -69,11 +69,13 @@ extern void MT_InitThreads(void);
 extern void MT_StartThreads(void);
 extern void MT_Close(void);
 extern void MT_SetNumThreads(unsigned int num);
+extern void MT_SetSharedCache(int f);
 extern int MT_GetThreadID(void);
 extern void MT_SyncInit(void);
 extern void MT_SyncStart(void);
 extern double MT_SyncEnd(void);
 extern void MT_SetResultFailed(void);
+extern void MT_ParallelFor(unsigned int c, void (*fun) (void *, unsigned int), void *data);
 
 #ifdef GLIB_THREADS
 #if GLIB_CHECK_VERSION (2,30,0)
@@ -114,6 +116,7 @@ extern int asyncRet;
 #define MT_SafeDec(x) (--(*x))
 #define MT_SafeDecCheck(x) ((--(*x)) == 0)
 #define MT_GetThreadID() 0
+#define MT_SetSharedCache(f) {}
 #endif
 
 #endif
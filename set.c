@@ -57,6 +57,7 @@
 #endif                          /* HAVE_UNISTD_H */
 
 #include "backgammon.h"
+#include "cache.h"
 #include "dice.h"
 #include "eval.h"
 #include "external.h"
@@ -603,6 +604,12 @@ extern void
 CommandSetCache(char *sz)
 {
     int n;
+
+    if (sz && isalpha(*sz)) {
+        HandleCommand(sz, acSetCache);
+        return;
+    }
+
     if ((n = ParseNumber(&sz)) < 0) {
         outputl(_("You must specify the number of cache entries to use."));
         return;
@@ -617,12 +624,175 @@ CommandSetCache(char *sz)
         outputerr("EvalCacheResize");
 }
 
+static void
+SetCacheAllocation(const cachepages cp, const int nNUMA)
+{
+    int f;
+    cachepages cpOld;
+    int nNUMAOld;
+
+    CacheGetAllocation(&cpOld, &nNUMAOld);
+    if (cp == cpOld && nNUMA == nNUMAOld)
+        return;
+
+    CacheSetAllocation(cp, nNUMA);
+
+    if ((f = EvalCacheReallocate()) < 0) {
+        outputerr("EvalCacheReallocate");
+        return;
+    }
+
+    if (cp == CACHE_PAGES_EXPLICIT && !(f & CACHE_ALLOC_HUGETLB))
+        outputl(_("No reserved huge pages were available for the evaluation cache."));
+    if (cp != CACHE_PAGES_DEFAULT && !(f & (CACHE_ALLOC_HUGETLB | CACHE_ALLOC_ADVISED)))
+        outputl(_("The evaluation cache could not be put on huge pages."));
+    if (nNUMA != CACHE_NUMA_DEFAULT && !(f & CACHE_ALLOC_NUMA))
+        outputl(_("The NUMA policy of the evaluation cache could not be set."));
+}
+
+extern void
+CommandSetCacheHugePages(char *sz)
+{
+    char *pch = NextToken(&sz);
+    cachepages cp;
+    int nNUMA;
+
+    CacheGetAllocation(&cp, &nNUMA);
+
+    if (!pch || !StrCaseCmp(pch, "off"))
+        cp = CACHE_PAGES_DEFAULT;
+    else if (!StrCaseCmp(pch, "transparent"))
+        cp = CACHE_PAGES_TRANSPARENT;
+    else if (!StrCaseCmp(pch, "explicit"))
+        cp = CACHE_PAGES_EXPLICIT;
+    else {
+        outputl(_("You must specify `off', `transparent' or `explicit'. See `help set cache hugepages'."));
+        return;
+    }
+
+    SetCacheAllocation(cp, nNUMA);
+}
+
+extern void
+CommandSetCacheNUMA(char *sz)
+{
+    char *pch = NextToken(&sz);
+    cachepages cp;
+    int nNUMA;
+
+    CacheGetAllocation(&cp, &nNUMA);
+
+    if (!pch || !StrCaseCmp(pch, "off"))
+        nNUMA = CACHE_NUMA_DEFAULT;
+    else if (!StrCaseCmp(pch, "interleave"))
+        nNUMA = CACHE_NUMA_INTERLEAVE;
+    else if ((nNUMA = ParseNumber(&pch)) < 0) {
+        outputl(_("You must specify `off', `interleave' or a node. See `help set cache numa'."));
+        return;
+    }
+
+    SetCacheAllocation(cp, nNUMA);
+}
+
+extern void
+CommandSetCacheSequenceLock(char *sz)
+{
+    int f = CacheGetSequenceLock();
+
+    SetToggle("cache sequencelock", &f, sz,
+              _("The evaluation threads will lock the cache nodes with sequence counts."),
+              _("The evaluation threads will lock the cache nodes with spin locks."));
+
+    if (f == CacheGetSequenceLock())
+        return;
+
+    if (CacheSetSequenceLock(f)) {
+        outputl(_("Sequence counts are not available in this build; the spin locks stay."));
+        return;
+    }
+
+    if (EvalCacheReallocate() < 0)
+        outputerr("EvalCacheReallocate");
+}
+
+extern void
+CommandSetCacheShared(char *sz)
+{
+    char *pchName = NextToken(&sz);
+    int n;
+
+    if (!pchName || !*pchName) {
+        outputl(_("You must specify a name, or `off'. See `help set cache shared'."));
+        return;
+    }
+
+    if (!StrCaseCmp(pchName, "off")) {
+        if (EvalCacheUnshare())
+            outputerr("EvalCacheUnshare");
+        else
+            outputl(_("The evaluation cache is no longer shared."));
+        return;
+    }
+
+    switch (n = EvalCacheShare(pchName)) {
+    case -2:
+        outputf(_("The shared evaluation cache %s is used by processes with other weights, precision,\n"
+                  "bearoff databases or match equity table; choose another name.\n"), pchName);
+        break;
+    case -1:
+        outputerrf(_("The shared evaluation cache %s could not be opened."), pchName);
+        break;
+    default:
+        outputf(ngettext("The evaluation cache is now shared as %s, with %d entry in use.\n",
+                         "The evaluation cache is now shared as %s, with %d entries in use.\n", n), pchName, n);
+    }
+}
+
+extern void
+CommandSetCacheFile(char *sz)
+{
+    char *pchFile = NextToken(&sz);
+    int n = 0;
+
+    if (!pchFile || !*pchFile) {
+        outputl(_("You must specify a file, or `off'. See `help set cachefile'."));
+        return;
+    }
+
+    if (!StrCaseCmp(pchFile, "off")) {
+        EvalCacheFileClose();
+        outputl(_("No cache file will be used."));
+        return;
+    }
+
+    if (sz && *sz && (n = ParseNumber(&sz)) <= 0) {
+        outputl(_("You must specify a positive number of cache file entries."));
+        return;
+    }
+
+    if ((n = EvalCacheFileOpen(pchFile, (unsigned int) n)) == -2) {
+        outputf(_("The cache file %s is in use by another process.\n"), pchFile);
+        return;
+    } else if (n < 0) {
+        outputerrf(_("The cache file %s could not be opened."), pchFile);
+        return;
+    }
+
+    outputf(ngettext("The cache file %s has been opened with %d entry.\n",
+                     "The cache file %s has been opened with %d entries.\n", n), pchFile, n);
+}
+
 #if USE_MULTITHREAD
 extern void
 CommandSetThreads(char *sz)
 {
     int n;
 
+    if (sz && isalpha(*sz)) {
+        HandleCommand(sz, acSetThreads);
+        return;
+    }
+
     if ((n = ParseNumber(&sz)) <= 0) {
         outputl(_("You must specify the number of threads to use."));
 
@@ -638,6 +808,26 @@ CommandSetThreads(char *sz)
     MT_SetNumThreads(n);
     outputf(_("The number of threads has been set to %d.\n"), n);
 }
+
+extern void
+CommandSetThreadsSplit(char *sz)
+{
+    int n;
+
+    if ((n = ParseNumber(&sz)) < 0) {
+        outputl(_("You must specify how many levels of deep evaluations to split over the threads."));
+        return;
+    }
+
+    nEvalSplitPlies = (unsigned int) n;
+
+    if (n)
+        outputf(ngettext("The rolls of the first %d level of deep evaluations will be split over the threads.\n",
+                         "The rolls of the first %d levels of deep evaluations will be split over the threads.\n",
+                         n), n);
+    else
+        outputl(_("Deep evaluations will not be split over the threads."));
+}
 #endif
 
 extern void
@@ -1015,6 +1205,70 @@ CommandSetEvalPrune(char *sz)
     pecSet->fUsePrune = f;
 }
 
+extern void
+CommandSetEvalCandidates(char *sz)
+{
+    double r = ParseReal(&sz);
+    int nMin, nMax = 0;
+
+    if ((nMin = ParseNumber(&sz)) == INT_MIN)
+        nMin = 1;
+    else if ((nMax = ParseNumber(&sz)) == INT_MIN)
+        nMax = 0;
+
+    if (r < 0.0 || nMin < 1 || nMax < 0) {
+        outputf(_("You must specify an equity threshold, and optionally the least and the most "
+                  "candidates to keep (see `help set %s candidates').\n"), szSetCommand);
+        return;
+    }
+
+    if (nMin > 15 || nMax > MAX_CASCADE_KEEP || (nMax && nMin > nMax)) {
+        outputf(_("Keep at least 1 to 15 candidates and at most that many to %d.\n"), MAX_CASCADE_KEEP);
+        return;
+    }
+
+    pecSet->rPruneThreshold = (float) r;
+    pecSet->nPruneMin = nMin;
+    pecSet->nPruneMax = nMax;
+
+    if (pecSet->rPruneThreshold > 0.0f) {
+        if (nMax)
+            outputf(_("%s will keep the candidate moves within %0.3f of the best when pruning, "
+                      "%d to %d of them.\n"), szSet, pecSet->rPruneThreshold, nMin, nMax);
+        else
+            outputf(_("%s will keep the candidate moves within %0.3f of the best when pruning, "
+                      "at least %d and at most as many as the cascade keeps.\n"), szSet, pecSet->rPruneThreshold,
+                    nMin);
+    } else
+        outputf(_("%s will keep as many candidate moves as the cascade does when pruning.\n"), szSet);
+
+    if (!pecSet->fUsePrune)
+        outputf(_("(Pruning is off; see `help set %s prune'.)\n"), szSetCommand);
+}
+
+extern void
+CommandSetEvalCascade(char *sz)
+{
+    char *pch = NextToken(&sz);
+    unsigned int i;
+
+    for (i = 0; pch && i < NUM_CASCADES; i++)
+        if (!StrNCaseCmp(pch, anNetCascades[i].szName, strlen(pch)))
+            break;
+
+    if (!pch || i == NUM_CASCADES) {
+        outputf(_("You must specify one of the net cascades listed by `show cascades' "
+                  "(see `help set %s cascade').\n"), szSetCommand);
+        return;
+    }
+
+    pecSet->nCascade = i;
+
+    outputf(_("%s will use the %s net cascade when pruning.\n"), szSet, gettext(anNetCascades[i].szName));
+    if (!pecSet->fUsePrune)
+        outputf(_("(Pruning is off; see `help set %s prune'.)\n"), szSetCommand);
+}
+
 extern void
 CommandSetEvalDeterministic(char *sz)
 {
@@ -1052,6 +1306,26 @@ CommandSetEvalNoise(char *sz)
         outputf(_("%s will use noiseless evaluations.\n"), szSet);
 }
 
+extern void
+CommandSetEvalTimeLimit(char *sz)
+{
+
+    double r = ParseReal(&sz);
+
+    if (r < 0.0) {
+        outputf(_("You must specify a valid number of seconds (see `help set %s timelimit').\n"), szSetCommand);
+        return;
+    }
+
+    pecSet->rTimeLimit = (float) r;
+
+    if (pecSet->rTimeLimit)
+        outputf(_("%s will deepen move searches up to %d ply while they take less than %0.3g seconds.\n"),
+                szSet, pecSet->nPlies, pecSet->rTimeLimit);
+    else
+        outputf(_("%s will search moves at %d ply however long it takes.\n"), szSet, pecSet->nPlies);
+}
+
 extern void
 CommandSetEvalPlies(char *sz)
 {
@@ -3012,6 +3286,49 @@ CommandSetEvalSameAsAnalysis(char *sz)
               _("Evaluation settings separate from analysis settings."));
 }
 
+extern void
+CommandSetEvalQuantized(char *sz)
+{
+    int f = NeuralNetGetQuantised();
+
+    SetToggle("evaluation quantized", &f, sz,
+              _("The contact, crashed and race nets will be evaluated with quantised (int16) weights."),
+              _("The neural nets will be evaluated in floating point."));
+
+    if (f != NeuralNetGetQuantised()) {
+        NeuralNetSetQuantised(f);
+        /* The cache holds evaluations of the other kind */
+        EvalCacheFlush();
+    }
+}
+
+extern void
+CommandSetEvalHalfPrecision(char *sz)
+{
+    int f = NeuralNetGetHalf();
+
+    SetToggle("evaluation halfprecision", &f, sz,
+              _("The neural nets will be evaluated with half precision weights."),
+              _("The neural nets will be evaluated with single precision weights."));
+
+    if (f && !NeuralNetHalfKernel(NeuralNetGetKernel())) {
+        outputf(_("The %s kernel has no half precision evaluation on this CPU; "
+                  "half precision weights stay off.\n"), NeuralNetGetKernel()->szName);
+        f = FALSE;
+    }
+
+    if (f != NeuralNetGetHalf()) {
+        if (EvalSetHalf(f)) {
+            outputl(_("There is not enough memory for the half precision weights; " "they stay off."));
+            return;
+        }
+        EvalCacheFlush();
+    }
+
+    if (f && NeuralNetGetQuantised())
+        outputl(_("(Quantised evaluation is on and takes precedence.)"));
+}
+
 extern void
 CommandSetAnalysisPlayer(char *sz)
 {
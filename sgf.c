@@ -573,9 +573,65 @@ InitEvalContext(evalcontext * pec)
     pec->fUsePrune = FALSE;
     pec->fDeterministic = FALSE;
     pec->rNoise = 0.0;
+    pec->nCascade = 0;
+    pec->rTimeLimit = 0.0f;
+    pec->rPruneThreshold = 0.0f;
+    pec->nPruneMin = 0;
+    pec->nPruneMax = 0;
 
 }
 
+/* Read the evaluation settings that version 4 writes after the others */
+
+static char *
+RestoreEvalContextExtra(evalcontext * pec, char *pc, int ver)
+{
+    char *pch;
+    long n, m;
+
+    double r;
+
+    pec->nCascade = 0;
+    pec->rTimeLimit = 0.0f;
+    pec->rPruneThreshold = 0.0f;
+    pec->nPruneMin = 0;
+    pec->nPruneMax = 0;
+
+    if (ver < 4)
+        return pc;
+
+    n = strtol(pc, &pch, 10);
+    if (pch != pc && n >= 0 && n < NUM_CASCADES)
+        pec->nCascade = (unsigned int) n;
+    pc = pch;
+
+    r = g_ascii_strtod(pc, &pch);
+    if (pch != pc && r > 0.0)
+        pec->rTimeLimit = (float) r;
+    pc = pch;
+
+    /* the pruning limits, missing in the first files of version 4 */
+    r = g_ascii_strtod(pc, &pch);
+    if (pch == pc || r <= 0.0)
+        return pch;
+    pc = pch;
+
+    n = strtol(pc, &pch, 10);
+    if (pch == pc || n < 1 || n > 15)
+        return pch;
+    pc = pch;
+
+    m = strtol(pc, &pch, 10);
+    if (pch == pc || m < 0 || m > MAX_CASCADE_KEEP || (m && n > m))
+        return pch;
+
+    pec->rPruneThreshold = (float) r;
+    pec->nPruneMin = (unsigned int) n;
+    pec->nPruneMax = (unsigned int) m;
+
+    return pch;
+}
+
 
 static void
 RestoreEvalContext(evalcontext * pec, char *pc)
@@ -601,6 +657,7 @@ RestoreEvalContext(evalcontext * pec, char *pc)
         fUsePrune = strtol(pc, &pc, 10);
         pec->fUsePrune = fUsePrune;
     }
+    RestoreEvalContextExtra(pec, pc, ver);
 }
 
 static void
@@ -923,6 +980,7 @@ RestoreDoubleAnalysis(property * pp,
         for (i = 0; i < 2; i++)
             for (j = 0; j < 7; j++)
                 aarOutput[i][j] = g_ascii_strtod(pch, &pch);
+        RestoreEvalContextExtra(&pes->ec, pch, ver);
         break;
 
     case 'R':
@@ -1051,6 +1109,7 @@ RestoreMoveAnalysis(property * pp, int fPlayer,
                 fUsePrune = strtol(pch, &pch, 10);
             }
             pm->esMove.ec.fUsePrune = fUsePrune;
+            RestoreEvalContextExtra(&pm->esMove.ec, pch, ver);
             break;
 
         case 'R':
@@ -1601,6 +1660,19 @@ WriteEscapedString(FILE * pf, char *pch, int fEscapeColons)
     free(sz);
 }
 
+/* The evaluation settings version 4 writes after the others */
+
+static void
+WriteEvalContextExtra(FILE * pf, const evalcontext * pec)
+{
+    gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+
+    g_ascii_formatd(buffer, sizeof(buffer), "%.3f", pec->rTimeLimit);
+    fprintf(pf, " %u %s", pec->nCascade, buffer);
+    g_ascii_formatd(buffer, sizeof(buffer), "%.4f", pec->rPruneThreshold);
+    fprintf(pf, " %s %u %u", buffer, pec->nPruneMin, pec->nPruneMax);
+}
+
 static void
 WriteEvalContext(FILE * pf, const evalcontext * pec)
 {
@@ -1608,6 +1680,7 @@ WriteEvalContext(FILE * pf, const evalcontext * pec)
     g_ascii_formatd(buffer, sizeof(buffer), "%.6f", pec->rNoise);
     fprintf(pf, "ver %d %d%s %d %s %d",
             SGF_FORMAT_VER, pec->nPlies, pec->fCubeful ? "C" : "", pec->fDeterministic, buffer, pec->fUsePrune);
+    WriteEvalContextExtra(pf, pec);
 }
 
 static void
@@ -1752,6 +1825,7 @@ WriteDoubleAnalysis(FILE * pf,
                 fprintf(pf, " %s", buffer);
             }
         }
+        WriteEvalContextExtra(pf, &pes->ec);
 
         break;
 
@@ -1828,6 +1902,7 @@ WriteMoveAnalysis(FILE * pf, int fPlayer, movelist * pml, unsigned int iMove)
                     pml->amMoves[i].esMove.ec.nPlies,
                     pml->amMoves[i].esMove.ec.fCubeful ? "C" : "",
                     0, pml->amMoves[i].esMove.ec.fDeterministic, buffer, pml->amMoves[i].esMove.ec.fUsePrune);
+            WriteEvalContextExtra(pf, &pml->amMoves[i].esMove.ec);
             break;
 
         case EVAL_ROLLOUT:
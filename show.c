@@ -32,6 +32,7 @@
 #include <math.h>
 
 #include "backgammon.h"
+#include "cache.h"
 #include "drawboard.h"
 #include "eval.h"
 #include "export.h"
@@ -113,12 +114,27 @@ static void
 ShowEvaluation(const evalcontext * pec)
 {
 
+    char szPrune[256];
+
+    if (pec->fUsePrune)
+        sprintf(szPrune, _("Using pruning neural nets (%s cascade).\n"),
+                gettext(NetCascade(pec)->szName));
+    else
+        strcpy(szPrune, _("Not using pruning neural nets.\n"));
+
+    if (pec->fUsePrune && pec->rPruneThreshold > 0.0f) {
+        if (pec->nPruneMax)
+            sprintf(strchr(szPrune, 0), _("        Keeping the candidates within %0.3f of the best, %u to %u.\n"),
+                    pec->rPruneThreshold, MAX(pec->nPruneMin, 1), pec->nPruneMax);
+        else
+            sprintf(strchr(szPrune, 0), _("        Keeping the candidates within %0.3f of the best, at least %u.\n"),
+                    pec->rPruneThreshold, MAX(pec->nPruneMin, 1));
+    }
+
     outputf(_("        %d-ply evaluation.\n"
               "        %s"
               "        %s evaluations.\n"),
-            pec->nPlies,
-            (pec->fUsePrune) ? _("Using pruning neural nets.") :
-            _("Not using pruning neural nets."), pec->fCubeful ? _("Cubeful") : _("Cubeless"));
+            pec->nPlies, szPrune, pec->fCubeful ? _("Cubeful") : _("Cubeless"));
 
     if (pec->rNoise)
         outputf("%s%s %5.3f", ("        "), _("Noise standard deviation"), pec->rNoise);
@@ -127,6 +143,9 @@ ShowEvaluation(const evalcontext * pec)
 
     outputl(pec->fDeterministic ? _(" (deterministic noise).\n") : _(" (pseudo-random noise).\n"));
 
+    if (pec->rTimeLimit)
+        outputf(_("        Move searches deepened while they take less than %0.3g seconds.\n"), pec->rTimeLimit);
+
 }
 
 extern int
@@ -515,25 +534,108 @@ CommandShowDelay(char *UNUSED(sz))
 #endif
 }
 
+/* Hits as a percentage of the lookups, as a string */
+
+static char *
+CachePercent(unsigned long cHit, unsigned long cLookup)
+{
+    static char sz[16];
+
+    if (cLookup)
+        sprintf(sz, "%.1f%%", 100.0 * cHit / cLookup);
+    else
+        strcpy(sz, "-");
+
+    return sz;
+}
+
 extern void
 CommandShowCache(char *UNUSED(sz))
 {
+    static const char *aszCache[N_EVAL_CACHES] = {
+        N_("Evaluation cache"), N_("Pruning cache"), N_("Cubeful equities"), N_("Cache file")
+    };
+    cachecounts cc;
+    unsigned int acSize[N_EVAL_CACHES], acUsed[N_EVAL_CACHES];
+    unsigned int i, j, k, n;
+    unsigned int const fAlloc = EvalCacheAllocation();
+    cachepages cp;
+    int nNUMA;
+
+    EvalCacheStats(&cc, acSize, acUsed);
+
+    CacheGetAllocation(&cp, &nNUMA);
+    outputf(_("Evaluation cache pages: %s"), (fAlloc & CACHE_ALLOC_HUGETLB) ? _("reserved huge pages") :
+            (fAlloc & CACHE_ALLOC_ADVISED) ? _("transparent huge pages") : _("default"));
+    if (!(fAlloc & CACHE_ALLOC_NUMA))
+        outputf(_(", default NUMA policy.\n\n"));
+    else if (nNUMA == CACHE_NUMA_INTERLEAVE)
+        outputf(_(", interleaved over the NUMA nodes.\n\n"));
+    else
+        outputf(_(", on NUMA node %d.\n\n"), nNUMA);
+    outputl(CacheGetSequenceLock() ? _("The cache nodes are locked with sequence counts.\n") :
+            _("The cache nodes are locked with spin locks.\n"));
+    if (EvalCacheSharedName())
+        outputf(_("The evaluation cache is shared with other processes as %s.\n\n"), EvalCacheSharedName());
+
+    for (i = 0; i < N_EVAL_CACHES; i++) {
+        unsigned long ac[N_CACHE_COUNTS] = { 0, 0, 0, 0 };
+
+        for (j = 0; j < CACHE_PLIES; j++)
+            for (k = 0; k < N_CLASSES; k++)
+                for (n = 0; n < N_CACHE_COUNTS; n++)
+                    ac[n] += cc.aaaac[i][j][k][n];
+
+        if (i == EVAL_CACHE_CUBEFUL)
+            outputf(_("%s, in the evaluation cache: %lu lookups, %lu hits (%s), %lu adds, %lu evictions.\n"),
+                    gettext(aszCache[i]), ac[CACHE_LOOKUPS], ac[CACHE_HITS],
+                    CachePercent(ac[CACHE_HITS], ac[CACHE_LOOKUPS]), ac[CACHE_ADDS], ac[CACHE_EVICTIONS]);
+        else
+            outputf(_("%s: %u of %u entries used.  %lu lookups, %lu hits (%s), %lu adds, %lu evictions.\n"),
+                    gettext(aszCache[i]), acUsed[i], acSize[i], ac[CACHE_LOOKUPS], ac[CACHE_HITS],
+                    CachePercent(ac[CACHE_HITS], ac[CACHE_LOOKUPS]), ac[CACHE_ADDS], ac[CACHE_EVICTIONS]);
 
-    unsigned int c, cHit;
-    unsigned int cLookup;
+        if (!ac[CACHE_LOOKUPS])
+            continue;
 
-    EvalCacheStats(&c, &cLookup, &cHit);
+        outputf("\n    %-4s %-14s %12s %12s %7s %12s %12s\n", _("Ply"), _("Class"), _("Lookups"), _("Hits"), "",
+                _("Adds"), _("Evictions"));
+        for (j = 0; j < CACHE_PLIES; j++)
+            for (k = 0; k < N_CLASSES; k++) {
+                unsigned long *pc = cc.aaaac[i][j][k];
 
-    outputf(_("%d cache entries have been used.  %d lookups, %d hits"), c, cLookup, cHit);
+                if (pc[CACHE_LOOKUPS] || pc[CACHE_ADDS])
+                    outputf("    %-4u %-14s %12lu %12lu %7s %12lu %12lu\n", j, gettext(aszPositionClass[k]),
+                            pc[CACHE_LOOKUPS], pc[CACHE_HITS], CachePercent(pc[CACHE_HITS], pc[CACHE_LOOKUPS]),
+                            pc[CACHE_ADDS], pc[CACHE_EVICTIONS]);
+            }
+        outputc('\n');
+    }
+}
 
-    if (cLookup > 0x01000000)   /* calculate carefully to avoid overflow */
-        outputf(" (%d%%).", (cHit + (cLookup / 200)) / (cLookup / 100));
-    else if (cLookup)
-        outputf(" (%d%%).", (cHit * 100 + cLookup / 2) / cLookup);
-    else
-        outputc('.');
+extern void
+CommandShowCacheFile(char *UNUSED(sz))
+{
+    cachecounts cc;
+    unsigned int acSize[N_EVAL_CACHES], acUsed[N_EVAL_CACHES];
+    int fValid;
+    const char *szFile = EvalCacheFileName(&fValid);
 
-    outputc('\n');
+    if (!szFile) {
+        outputl(_("No cache file is used (see `set cachefile')."));
+        return;
+    }
+
+    EvalCacheStats(&cc, acSize, acUsed);
+
+    outputf(_("Cache file: %s\n"), szFile);
+    outputf(_("%u of %u entries used, for evaluations of %d plies or more.\n"), acUsed[EVAL_CACHE_FILE],
+            acSize[EVAL_CACHE_FILE], CACHE_FILE_MIN_PLIES);
+    if (fValid)
+        outputl(_("The entries are for the current evaluator and are used."));
+    else
+        outputl(_("The entries are for another evaluator (nets, precision, bearoff databases or\n"
+                  "match equity table) and are not used; `clear cachefile' removes them."));
 }
 
 extern void
@@ -715,6 +817,196 @@ CommandShowEvaluation(char *UNUSED(sz))
     outputl(_("    Cube decisions:"));
     ShowEvalSetup(GetEvalCube());
 
+    outputf(_("Neural net evaluation kernel: %s\n"), NeuralNetGetKernel()->szName);
+    outputf(_("Quantised evaluation: %s\n"), NeuralNetGetQuantised() ? _("on") : _("off"));
+    outputf(_("Half precision weights: %s\n"), NeuralNetGetHalf() ? _("on") : _("off"));
+
+}
+
+/* adaptive pruning limits compared by `show cascades' (threshold,
+ * minimum and maximum candidates; 0 for the cascade's number) */
+static const struct {
+    float rThreshold;
+    unsigned int nMin, nMax;
+} aAdaptivePrune[] = {
+    {0.02f, 1, 0}, {0.05f, 1, 0}, {0.1f, 1, 0}, {0.1f, 2, 16}, {0.2f, 2, 16}
+};
+
+extern void
+CommandShowCascades(char *sz)
+{
+    int n = 100;
+    unsigned int i, j;
+    float rAgree, rLoss, rSpeed;
+    evalcontext ec;
+    const evalcontext *pecCurrent = &GetEvalChequer()->ec;
+
+    memset(&ec, 0, sizeof(ec));
+    ec.fUsePrune = TRUE;
+    ec.fDeterministic = TRUE;
+
+    if (sz && *sz && (n = ParseNumber(&sz)) < 1) {
+        outputl(_("If you specify a parameter to `show cascades', " "it must be a number of positions to test."));
+        return;
+    }
+
+    outputf(_("Net cascades compared with the full net at 0-ply over %d random positions "
+              "and all 21 rolls:\n\n"), n);
+    outputf("%-10s %-26s %9s %11s %9s\n", _("Cascade"), _("Stages (race/crashed/contact)"), _("Agree %"),
+            _("Mean loss"), _("Speed"));
+
+    for (i = 0; i < NUM_CASCADES; i++) {
+        const netcascade *pnc = &anNetCascades[i];
+        char szStages[64] = "";
+
+        for (j = 0; j < pnc->cStages; j++)
+            sprintf(strchr(szStages, 0), "%s%s %u/%u/%u", j ? ", " : "", pnc->acs[j].fPrune ? "prune" : "full",
+                    pnc->acs[j].acKeep[0], pnc->acs[j].acKeep[1], pnc->acs[j].acKeep[2]);
+
+        ec.nCascade = i;
+        EvalCascadeReport(&ec, (unsigned int) n, &rAgree, &rLoss, &rSpeed);
+        outputf("%-10s %-26s %9.2f %11.5f %9.2f\n", gettext(pnc->szName), szStages, rAgree, rLoss, rSpeed);
+    }
+
+    outputf(_("\nAdaptive candidates: kept within a threshold of the best, from a minimum "
+              "up to a maximum:\n\n"));
+    outputf("%-10s %-24s %9s %11s %9s\n", _("Cascade"), _("Threshold, min-max"), _("Agree %"),
+            _("Mean loss"), _("Speed"));
+
+    for (i = 0; i <= G_N_ELEMENTS(aAdaptivePrune); i++) {
+        char szLimits[64];
+
+        if (i < G_N_ELEMENTS(aAdaptivePrune)) {
+            ec.nCascade = 0;
+            ec.rPruneThreshold = aAdaptivePrune[i].rThreshold;
+            ec.nPruneMin = aAdaptivePrune[i].nMin;
+            ec.nPruneMax = aAdaptivePrune[i].nMax;
+        } else if (pecCurrent->rPruneThreshold > 0.0f)
+            /* the chequer play setting */
+            ec = *pecCurrent;
+        else
+            break;
+
+        sprintf(szLimits, "%0.3f, %u-%u", ec.rPruneThreshold, MAX(ec.nPruneMin, 1),
+                ec.nPruneMax ? ec.nPruneMax : NetCascade(&ec)->acs[NetCascade(&ec)->cStages - 1].acKeep[2]);
+
+        EvalCascadeReport(&ec, (unsigned int) n, &rAgree, &rLoss, &rSpeed);
+        outputf("%-10s %-24s %9.2f %11.5f %9.2f%s\n", gettext(NetCascade(&ec)->szName), szLimits,
+                rAgree, rLoss, rSpeed, i < G_N_ELEMENTS(aAdaptivePrune) ? "" : _(" (chequer play setting)"));
+    }
+
+    outputl(_("\nSpeed is relative to scoring every move with the full net.  The comparison\n"
+              "empties the evaluation caches."));
+}
+
+extern void
+CommandShowKernels(char *sz)
+{
+    int n = 1000;
+    unsigned int i, j;
+    float arMaxDiff[N_KERNEL_TEST_NETS];
+    float arMax[3], arMean[3], arSpeed[3];
+    float rRate, rSpeed;
+    unsigned int cDiffer;
+    unsigned int fFeatures = SIMD_Supported();
+
+    if (sz && *sz && (n = ParseNumber(&sz)) < 1) {
+        outputl(_("If you specify a parameter to `show kernels', " "it must be a number of positions to test."));
+        return;
+    }
+
+    outputf(_("Largest output difference from the scalar code over %d random positions:\n\n"), n);
+    outputf("%-12s %9s %9s %9s %9s %9s %9s\n", "", _("Contact"), _("Race"), _("Crashed"),
+            _("Contact"), _("Race"), _("Crashed"));
+    outputf("%-12s %9s %9s %9s %9s %9s %9s\n", _("Kernel"), "", "", "", _("(prune)"), _("(prune)"), _("(prune)"));
+
+    for (i = 0; i < cNeuralNetKernels; i++) {
+        const nnkernel *pk = &anNeuralNetKernels[i];
+
+        outputf("%-10s %c", pk->szName, pk == NeuralNetGetKernel() ? '*' : ' ');
+
+        if ((pk->fFeatures & fFeatures) != pk->fFeatures) {
+            outputl(_("  not supported by this CPU"));
+            continue;
+        }
+
+        EvalCompareKernel(pk, (unsigned int) n, arMaxDiff);
+        for (j = 0; j < N_KERNEL_TEST_NETS; j++)
+            outputf(" %9.2g", arMaxDiff[j]);
+        outputc('\n');
+    }
+
+    outputl(_("\n* kernel in use"));
+
+    EvalReducedPrecision(NeuralNetGetKernel()->pfNeuralNetEvaluateQuantised, (unsigned int) n, arMax, arMean,
+                         arSpeed);
+
+    outputf(_("\nQuantised evaluation (%s) compared with floating point:\n\n"), NeuralNetGetKernel()->szName);
+    outputf("%-24s %9s %9s %9s\n", "", _("Contact"), _("Race"), _("Crashed"));
+    outputf("%-24s %9.2g %9.2g %9.2g\n", _("Largest difference"), arMax[0], arMax[1], arMax[2]);
+    outputf("%-24s %9.2g %9.2g %9.2g\n", _("Mean difference"), arMean[0], arMean[1], arMean[2]);
+    outputf("%-24s %9.2f %9.2f %9.2f\n", _("Relative speed"), arSpeed[0], arSpeed[1], arSpeed[2]);
+
+    if (NeuralNetHalfKernel(NeuralNetGetKernel())) {
+        EvalReducedPrecision(NeuralNetHalfKernel(NeuralNetGetKernel()), (unsigned int) n, arMax, arMean, arSpeed);
+
+        outputf(_("\nHalf precision weights (%s) compared with single precision:\n\n"),
+                NeuralNetGetKernel()->szName);
+        outputf("%-24s %9s %9s %9s\n", "", _("Contact"), _("Race"), _("Crashed"));
+        outputf("%-24s %9.2g %9.2g %9.2g\n", _("Largest difference"), arMax[0], arMax[1], arMax[2]);
+        outputf("%-24s %9.2g %9.2g %9.2g\n", _("Mean difference"), arMean[0], arMean[1], arMean[2]);
+        outputf("%-24s %9.2f %9.2f %9.2f\n", _("Relative speed"), arSpeed[0], arSpeed[1], arSpeed[2]);
+    }
+
+    /* the inputs are cheap enough to need more positions to time them */
+    EvalHalfInputsCheck((unsigned int) n * 100, &cDiffer, &rRate, &rSpeed);
+
+    outputf(_("\nContact inputs compared with the reference code over %d random positions:\n\n"), n * 100);
+    outputf("%-24s %9u\n", _("Positions differing"), cDiffer);
+    outputf("%-24s %9.0f\n", _("Positions per second"), rRate);
+    outputf("%-24s %9.2f\n", _("Relative speed"), rSpeed);
+
+    {
+        float arRate[3], rFromBase, rMaxDiff;
+
+        EvalScoreMovesReport((unsigned int) n / 10 + 1, arRate, &rFromBase, &rMaxDiff);
+
+        outputf(_("\nMoves scored at 0-ply for all rolls of %d random positions:\n\n"), n / 10 + 1);
+        outputf("%-24s %9s %9s\n", "", _("Moves/s"), _("Relative"));
+        outputf("%-24s %9.0f %9.2f\n", _("From scratch"), arRate[0], 1.0f);
+        outputf("%-24s %9.0f %9.2f\n", _("Incremental"), arRate[1], arRate[0] > 0.0f ? arRate[1] / arRate[0] : 0.0f);
+        outputf("%-24s %9.0f %9.2f\n", _("Batched"), arRate[2], arRate[0] > 0.0f ? arRate[2] / arRate[0] : 0.0f);
+        outputf(_("\nIncremental scoring took %.1f%% of the moves from the base;\n"
+                  "their largest difference from scoring from scratch was %.2g.\n"), rFromBase, rMaxDiff);
+    }
+}
+
+extern void
+CommandShowMoveGeneration(char *sz)
+{
+    int n = 100;
+    unsigned int i, cDiffer;
+    float rMoves, rScan, rHash;
+    static const char *aszTests[N_MOVEGEN_TESTS] = {
+        N_("All rolls"), N_("Doubles"), N_("Doubles, partial"), N_("On the bar")
+    };
+
+    if (sz && *sz && (n = ParseNumber(&sz)) < 1) {
+        outputl(_("If you specify a parameter to `show movegeneration', "
+                  "it must be a number of positions to test."));
+        return;
+    }
+
+    outputf(_("Move generation over %d random positions, in rolls per second:\n\n"), n);
+    outputf("%-18s %9s %11s %11s %9s %9s\n", "", _("Moves"), _("Scan"), _("Hash"), _("Speed"), _("Differ"));
+
+    for (i = 0; i < N_MOVEGEN_TESTS; i++) {
+        EvalMoveGeneration((movegentest) i, (unsigned int) n, &rMoves, &rScan, &rHash, &cDiffer);
+        outputf("%-18s %9.1f %11.0f %11.0f %9.2f %9u\n", gettext(aszTests[i]), rMoves, rScan, rHash,
+                rScan > 0.0f ? rHash / rScan : 0.0f, cDiffer);
+    }
+
+    outputl(_("\nScan finds duplicate moves by scanning the list, Hash with a hash set."));
 }
 
 extern void
@@ -1128,6 +1420,12 @@ CommandShowThreads(char *UNUSED(sz))
 {
     int c = MT_GetNumThreads();
     outputf(ngettext("%d calculation thread.\n", "%d calculation threads.\n", c), c);
+    if (nEvalSplitPlies)
+        outputf(ngettext("The rolls of the first %u level of deep evaluations are split over them.\n",
+                         "The rolls of the first %u levels of deep evaluations are split over them.\n",
+                         nEvalSplitPlies), nEvalSplitPlies);
+    else
+        outputl(_("Deep evaluations are not split over them."));
 }
 #endif
 
@@ -34,6 +34,7 @@
 #endif
 
 #include <isaac.h>
+#include "cache.h"
 #include "speed.h"
 
 #define EVALS_PER_ITERATION 1024
@@ -91,6 +92,29 @@ RunEvals(void *UNUSED(notused))
 #endif
 }
 
+/* How the half precision weights change the memory read by evaluations
+ * and their speed, next to the calibration result (which is for the
+ * precision in use) */
+static void
+ShowWeightPrecision(void)
+{
+    f_NeuralNetEvaluateHalf pfHalf = NeuralNetHalfKernel(NeuralNetGetKernel());
+    float arMax[3], arMean[3], arSpeed[3];
+
+    outputf(_("Neural net weights: %.0f KB in single precision, %.0f KB in half precision (%s in use).\n"),
+            EvalWeightsSize(FALSE) / 1024.0, EvalWeightsSize(TRUE) / 1024.0,
+            NeuralNetGetHalf() && pfHalf && !NeuralNetGetQuantised() ? _("half") : _("single"));
+
+    if (!pfHalf) {
+        outputf(_("The %s kernel has no half precision evaluation on this CPU.\n"), NeuralNetGetKernel()->szName);
+        return;
+    }
+
+    EvalReducedPrecision(pfHalf, 1000, arMax, arMean, arSpeed);
+    outputf(_("Half precision speed relative to single precision (one thread): "
+              "contact %.2f, race %.2f, crashed %.2f.\n"), arSpeed[0], arSpeed[1], arSpeed[2]);
+}
+
 extern void
 CommandCalibrate(char *sz)
 {
@@ -166,6 +190,170 @@ CommandCalibrate(char *sz)
     if (timeTaken) {
         rEvalsPerSec = iIter * (float) (EVALS_PER_ITERATION * 1000 / timeTaken);
         outputf("\rCalibration result: %.0f static evaluations/second.\n", rEvalsPerSec);
+        ShowWeightPrecision();
     } else
         outputl(_("Calibration incomplete."));
 }
+
+/* The latency of lookups in a cache of the size of the evaluation cache
+ * (up to 2^23 entries) on the pages `set cache hugepages' can ask for,
+ * and on the current pages with the policies `set cache numa' can ask
+ * for */
+
+static void
+CacheSpeedLatency(void)
+{
+    static const char *aszPages[] = { N_("Default pages"), N_("Transparent huge pages"), N_("Reserved huge pages") };
+    static const int anNUMA[] = { CACHE_NUMA_INTERLEAVE, 0 };
+    static const char *aszNUMA[] = { N_("Interleaved NUMA nodes"), N_("NUMA node 0") };
+    unsigned int const cEntries = MIN(MAX(GetEvalCacheEntries(), 1u << 16), 1u << 23);
+    cachepages cp, cpSaved;
+    int nNUMA;
+    unsigned int i;
+    double rDefault = 0.0;
+
+    CacheGetAllocation(&cpSaved, &nNUMA);
+
+    outputf(_("\nLatency of lookups in a cache of %u entries:\n\n"), cEntries);
+    outputf("%-24s %14s %9s\n", "", _("Nanoseconds"), _("Speed"));
+
+    for (cp = CACHE_PAGES_DEFAULT; cp <= CACHE_PAGES_EXPLICIT; cp++) {
+        double r;
+        unsigned int fAlloc;
+
+        if (fInterrupt)
+            break;
+
+        CacheSetAllocation(cp, nNUMA);
+        if (CacheLatency(cEntries, 4000000, &r, &fAlloc) < 0) {
+            outputerr("CacheLatency");
+            break;
+        }
+        if (cp == CACHE_PAGES_DEFAULT)
+            rDefault = r;
+
+        outputf("%-24s %14.1f %9.2f%s\n", gettext(aszPages[cp]), r, rDefault / r,
+                (cp == CACHE_PAGES_EXPLICIT && !(fAlloc & CACHE_ALLOC_HUGETLB))
+                || (cp == CACHE_PAGES_TRANSPARENT && !(fAlloc & CACHE_ALLOC_ADVISED)) ? _(" (not available)") : "");
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(anNUMA); i++) {
+        double r;
+        unsigned int fAlloc;
+
+        if (fInterrupt)
+            break;
+
+        CacheSetAllocation(cpSaved, anNUMA[i]);
+        if (CacheLatency(cEntries, 4000000, &r, &fAlloc) < 0) {
+            outputerr("CacheLatency");
+            break;
+        }
+
+        outputf("%-24s %14.1f %9.2f%s\n", gettext(aszNUMA[i]), r, rDefault > 0.0 ? rDefault / r : 0.0,
+                fAlloc & CACHE_ALLOC_NUMA ? "" : _(" (not available)"));
+    }
+
+    CacheSetAllocation(cpSaved, nNUMA);
+}
+
+extern void
+CommandCacheSpeed(char *sz)
+{
+#if USE_MULTITHREAD && defined(GLIB_THREADS) && defined(__GNUC__) && (defined (__i386) || defined (__x86_64))
+    int n = 1000000;
+    unsigned int cThreads;
+
+    if (sz && *sz && (n = ParseNumber(&sz)) < 1) {
+        outputl(_("If you specify a parameter to `cachespeed', " "it must be a number of lookups per thread."));
+        return;
+    }
+
+    outputf(_("Evaluation cache lookups per second, %d per thread:\n\n"), n);
+    outputf("%-8s %14s %14s %9s %9s\n", _("Threads"), _("Spin lock"), _("Sequence"), _("Speed"), _("Torn"));
+
+    for (cThreads = 1; cThreads <= 64; cThreads *= 2) {
+        double rSpin, rSeq;
+        unsigned int cTornSpin, cTornSeq;
+
+        if (fInterrupt)
+            break;
+
+        if (CacheBenchmark(cThreads, TRUE, (unsigned int) n, &rSpin, &cTornSpin) < 0
+            || CacheBenchmark(cThreads, FALSE, (unsigned int) n, &rSeq, &cTornSeq) < 0) {
+            outputl(_("Could not start the threads."));
+            return;
+        }
+
+        outputf("%-8u %14.0f %14.0f %9.2f %9u\n", cThreads, rSpin, rSeq, rSeq / rSpin, cTornSpin + cTornSeq);
+    }
+#else
+    (void) sz;
+    outputl(_("The evaluation cache has no lock free lookups in this build."));
+#endif
+
+    CacheSpeedLatency();
+}
+
+extern void
+CommandSplitSpeed(char *sz)
+{
+#if USE_MULTITHREAD
+    static const char *aszRow[] = { N_("Evaluation"), N_("Best move") };
+    int n = 20;
+    float arLatency[2][2], rMaxDiff;
+    unsigned int acDiffer[2], i;
+
+    if (sz && *sz && (n = ParseNumber(&sz)) < 1) {
+        outputl(_("If you specify a parameter to `splitspeed', " "it must be a number of positions to evaluate."));
+        return;
+    }
+
+    if (MT_GetNumThreads() < 2)
+        outputl(_("There is only one calculation thread, so nothing is split (see `set threads')."));
+
+    EvalSplitReport((unsigned int) n, 2, arLatency, acDiffer, &rMaxDiff);
+    if (fInterrupt)
+        return;
+
+    outputf(_("%d random positions cubeful at 2 plies, on %u threads, in milliseconds each:\n\n"), n,
+            MT_GetNumThreads());
+    outputf("%-16s %11s %11s %9s %9s\n", "", _("Serial"), _("Split"), _("Speed"), _("Differ"));
+    for (i = 0; i < 2; i++)
+        outputf("%-16s %11.1f %11.1f %9.2f %9u\n", gettext(aszRow[i]), arLatency[i][0], arLatency[i][1],
+                arLatency[i][1] > 0.0f ? arLatency[i][0] / arLatency[i][1] : 0.0f, acDiffer[i]);
+    outputf(_("\nLargest difference of an output: %.7f\n"), rMaxDiff);
+#else
+    (void) sz;
+    outputl(_("This build has no calculation threads to split evaluations over."));
+#endif
+}
+
+extern void
+CommandPerft(char *sz)
+{
+    int n = 1000;
+    int fPartial;
+    unsigned long cMoves;
+    unsigned int cDiffer, cDifferAll = 0;
+    float rSub, rBits;
+
+    if (sz && *sz && (n = ParseNumber(&sz)) < 1) {
+        outputl(_("If you specify a parameter to `perft', " "it must be a number of positions to test."));
+        return;
+    }
+
+    outputf(_("Legal moves for all 21 rolls of %d random positions, in moves per second:\n\n"), n);
+    outputf("%-16s %12s %11s %11s %9s %9s\n", "", _("Moves"), _("Original"), _("Bitboard"), _("Speed"),
+            _("Differ"));
+
+    for (fPartial = FALSE; fPartial <= TRUE; fPartial++) {
+        EvalPerft((unsigned int) n, fPartial, &cMoves, &cDiffer, &rSub, &rBits);
+        outputf("%-16s %12lu %11.0f %11.0f %9.2f %9u\n", fPartial ? _("Partial moves") : _("Complete moves"),
+                cMoves, rSub, rBits, rSub > 0.0f ? rBits / rSub : 0.0f, cDiffer);
+        cDifferAll += cDiffer;
+    }
+
+    if (cDifferAll)
+        outputl(_("\nThe bitboard move generator does not agree with the original one!"));
+}